@@ -30,6 +30,9 @@
 #define ALLOCATOR_H_
 
 #include <cstddef>
+#include <stdint.h>
+
+#include <libfreenect2/frame_listener.hpp>
 
 namespace libfreenect2
 {
@@ -57,16 +60,93 @@ public:
   virtual ~Allocator() {}
 };
 
+/** Allocator using new[]. */
+class NewAllocator: public Allocator
+{
+public:
+  virtual Buffer *allocate(size_t size);
+  virtual void free(Buffer *b);
+};
+
+/** Allocator for large streaming buffers backed by huge pages.
+ *
+ * On Linux it first tries an explicit MAP_HUGETLB mapping and falls back to
+ * an anonymous mapping advised for transparent huge pages. On macOS it asks
+ * for superpages and falls back to a regular anonymous mapping. Elsewhere,
+ * or if mapping fails, memory comes from new[], so allocate() only fails
+ * the way NewAllocator does.
+ *
+ * If a NUMA node is given, the mapping prefers pages from that node (Linux
+ * only). Binding happens before the first touch, so the buffer should be
+ * written first by the thread that produces data into it.
+ */
+class HugePageAllocator: public Allocator
+{
+public:
+  /* numa_node < 0 means no NUMA binding. */
+  explicit HugePageAllocator(int numa_node = -1);
+
+  virtual Buffer *allocate(size_t size);
+  virtual void free(Buffer *b);
+private:
+  int numa_node_;
+};
+
+/* Allocator for large streaming buffers: packets, frames and USB transfers.
+ *
+ * Returns a HugePageAllocator if environment variable LIBFREENECT2_HUGEPAGES
+ * is set to a value other than 0, bound to LIBFREENECT2_NUMA_NODE if set.
+ * Returns a NewAllocator otherwise. The caller owns the returned allocator.
+ */
+Allocator *createLargeBufferAllocator();
+
+/** Frame whose memory is a Buffer. The buffer is freed with the frame. */
+class BufferFrame: public Frame
+{
+public:
+  /* The allocator must outlive the frame. */
+  BufferFrame(size_t width, size_t height, size_t bytes_per_pixel, Allocator *allocator);
+  virtual ~BufferFrame();
+private:
+  Buffer *buffer_;
+};
+
+/* Allocate an output frame for the processors.
+ * Returns a huge-page backed BufferFrame if enabled via environment (see
+ * createLargeBufferAllocator()), a plain Frame otherwise.
+ */
+Frame *newLargeFrame(size_t width, size_t height, size_t bytes_per_pixel);
+
+/** Counters collected by PoolAllocator. */
+struct PoolAllocatorStatistics
+{
+  size_t depth;             ///< Number of buffers in the pool.
+  size_t in_use;            ///< Buffers currently handed out.
+  size_t high_water_mark;   ///< Maximum number of buffers handed out at the same time.
+  uint64_t allocations;     ///< Total calls to allocate().
+  uint64_t waits;           ///< Calls to allocate() that found the pool exhausted and blocked.
+  uint64_t wait_time_ns;    ///< Total time spent blocked in allocate().
+  uint64_t max_wait_time_ns; ///< Longest single block in allocate().
+  uint64_t failures;        ///< Allocations whose inner buffer has no memory (data is NULL).
+};
+
 class PoolAllocatorImpl;
 
 class PoolAllocator: public Allocator
 {
 public:
-  /* Use new as the inner allocator. */
-  PoolAllocator();
+  /** Depth of a pool unless specified otherwise (double buffering). */
+  static const size_t DefaultDepth = 2;
+  /** Largest supported pool depth. */
+  static const size_t MaxDepth = 64;
+
+  /* Use new as the inner allocator.
+   * depth is the number of buffers in the pool, clamped to [1, MaxDepth].
+   */
+  explicit PoolAllocator(size_t depth = DefaultDepth);
 
   /* This inner allocator will be freed by PoolAllocator. */
-  PoolAllocator(Allocator *inner);
+  PoolAllocator(Allocator *inner, size_t depth = DefaultDepth);
 
   virtual ~PoolAllocator();
 
@@ -74,6 +154,9 @@ public:
    * It should be called as late as possible before the memory is required
    * for write access.
    *
+   * Taking a free buffer is lock-free; the mutex is only used to sleep while
+   * all buffers are in use.
+   *
    * This allocate() never returns NULL as required by Allocator.
    *
    * All calls to allocate() MUST have the same size.
@@ -91,6 +174,27 @@ public:
    * free() can be called from different threads than allocate().
    */
   virtual void free(Buffer *b);
+
+  /* Keep b handed out until free() has been called once more for it, so
+   * several owners can read it. Each retained buffer occupies a slot, grow
+   * the pool with reserve() to account for it.
+   * The caller must still own b: once its last reference is freed the slot
+   * may be handed out again.
+   * Returns false if b is not handed out by this pool.
+   */
+  bool retain(Buffer *b);
+
+  /* Grow the pool to at least depth buffers (clamped to MaxDepth).
+   * The pool never shrinks. Safe to call while buffers are in use; blocked
+   * allocate() calls are woken up.
+   * Returns false if depth exceeds MaxDepth.
+   */
+  bool reserve(size_t depth);
+
+  /* Snapshot of the pool counters. Safe to call from any thread. */
+  PoolAllocatorStatistics getStatistics() const;
+
+  size_t depth() const;
 private:
   PoolAllocatorImpl *impl_;
 };
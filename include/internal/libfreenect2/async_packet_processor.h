@@ -31,51 +31,126 @@
 
 #include <libfreenect2/threading.h>
 #include <libfreenect2/packet_processor.h>
+#include <libfreenect2/logging.h>
+#include <libfreenect2/telemetry.h>
+#include <libfreenect2/trace_span.h>
+#include <libfreenect2/worker_pool.h>
+
+#include <vector>
 
 namespace libfreenect2
 {
 
+/** Counters collected by AsyncPacketProcessor. */
+struct AsyncPacketProcessorStatistics
+{
+  size_t queue_depth;     ///< Maximum number of queued packets.
+  size_t occupancy;       ///< Packets currently queued, excluding the one being processed.
+  size_t high_water_mark; ///< Maximum occupancy seen.
+  uint64_t queued;        ///< Packets accepted by process().
+  uint64_t processed;     ///< Packets handed to the wrapped processor.
+  uint64_t dropped;       ///< Packets refused because the queue was full.
+  uint64_t skipped;       ///< Queued packets discarded because they exceeded the maximum age.
+};
+
 /**
  * Packet processor that runs asynchronously.
+ *
+ * Packets are kept in a bounded FIFO queue, so a short processing spike is
+ * absorbed instead of dropping packets. The wrapped processor's buffer pool is
+ * grown to hold a full queue, the packet being processed and the packet being
+ * filled by the stream parser.
+ *
+ * With a maximum packet age set, a worker that finds the oldest queued packet
+ * older than that skips straight to the newest one, so late processing yields
+ * fresh frames rather than complete sequences.
+ *
+ * Packets are processed by a dedicated thread, or by a WorkerPool shared with
+ * other processors after setWorkerPool(). On the pool a processor handles one
+ * packet per task and requeues itself, so a busy stream cannot starve the
+ * others, and it never runs on two workers at once.
  * @tparam PacketT Type of the packet being processed.
  */
 template<typename PacketT>
-class AsyncPacketProcessor : public PacketProcessor<PacketT>
+class AsyncPacketProcessor : public PacketProcessor<PacketT>, private WorkerPool::Task
 {
 public:
   typedef PacketProcessor<PacketT>* PacketProcessorPtr;
 
+  /** Queue depth unless specified otherwise. */
+  static const size_t DefaultQueueDepth = 2;
+
   /**
    * Constructor.
    * @param processor Object performing the processing.
+   * @param role Thread policy applied to the processing thread.
+   * @param queue_depth Maximum number of packets waiting for processing, at least 1.
    */
-  AsyncPacketProcessor(PacketProcessorPtr processor) :
+  AsyncPacketProcessor(PacketProcessorPtr processor, ThreadPolicy::Role role, size_t queue_depth = DefaultQueueDepth) :
     processor_(processor),
-    current_packet_available_(false),
+    role_(role),
+    queue_(queue_depth < 1 ? 1 : queue_depth),
+    head_(0),
+    occupancy_(0),
+    high_water_mark_(0),
+    queued_(0),
+    processed_(0),
+    dropped_(0),
+    skipped_(0),
+    max_age_(0),
+    telemetry_(0),
+    stream_(Telemetry::Depth),
     shutdown_(false),
-    thread_(&AsyncPacketProcessor<PacketT>::static_execute, this)
+    busy_(false),
+    pool_(0),
+    scheduled_(false),
+    retaining_(false),
+    thread_(new libfreenect2::thread(&AsyncPacketProcessor<PacketT>::static_execute, this))
   {
+    // parser's packet + queued packets + packet being processed
+    if (!processor_->reserveBuffers(queue_.size() + 2))
+      LOG_WARNING << processor_->name() << ": buffer pool is smaller than queue depth " << queue_.size();
   }
 
   virtual ~AsyncPacketProcessor()
   {
-    shutdown_ = true;
-    packet_condition_.notify_one();
+    {
+      libfreenect2::lock_guard l(packet_mutex_);
+      shutdown_ = true;
+    }
+    packet_condition_.notify_all();
 
-    thread_.join();
-  }
+    if (thread_)
+    {
+      thread_->join();
+      delete thread_;
+    }
 
-  virtual bool ready()
-  {
-    // try to aquire lock, if we succeed the background thread is waiting on packet_condition_
-    bool locked = packet_mutex_.try_lock();
+    {
+      // Wait for a pool task that is queued or running.
+      libfreenect2::unique_lock l(packet_mutex_);
+      while (scheduled_)
+        WAIT_CONDITION(packet_condition_, packet_mutex_, l);
+    }
 
-    if(locked)
+    while (occupancy_ > 0)
     {
-      packet_mutex_.unlock();
+      releaseBuffer(queue_[head_]);
+      head_ = (head_ + 1) % queue_.size();
+      occupancy_--;
     }
+  }
 
-    return locked;
+  /**
+   * True if the queue has room for another packet.
+   * Callers drop their packet if this is false; such a drop is counted.
+   */
+  virtual bool ready()
+  {
+    if (occupancy_.load() < queue_.size())
+      return true;
+    dropped_++;
+    return false;
   }
 
   virtual bool good()
@@ -85,12 +160,30 @@ public:
 
   virtual void process(const PacketT &packet)
   {
+    bool post = false;
     {
       libfreenect2::lock_guard l(packet_mutex_);
-      current_packet_ = packet;
-      current_packet_available_ = true;
+      const size_t n = occupancy_.load();
+      if (n == queue_.size())
+      {
+        // Caller did not check ready(); drop the newest packet.
+        dropped_++;
+        PacketT dropped = packet;
+        releaseBuffer(dropped);
+        return;
+      }
+      queue_[(head_ + n) % queue_.size()] = packet;
+      occupancy_ = n + 1;
+      if (n + 1 > high_water_mark_)
+        high_water_mark_ = n + 1;
+      queued_++;
+      if (pool_ && !scheduled_)
+        scheduled_ = post = true;
     }
-    packet_condition_.notify_one();
+    if (post)
+      pool_->post(this);
+    else
+      packet_condition_.notify_all();
   }
 
   virtual void allocateBuffer(PacketT &p, size_t size)
@@ -103,15 +196,113 @@ public:
     processor_->releaseBuffer(p);
   }
 
+  virtual bool reserveBuffers(size_t count)
+  {
+    return processor_->reserveBuffers(count);
+  }
+
+  virtual bool retainBuffer(PacketT &p)
+  {
+    // The retained buffer may be held after processing, next to a full queue.
+    if (!retaining_)
+    {
+      retaining_ = true;
+      if (!processor_->reserveBuffers(queue_.size() + 3))
+        LOG_WARNING << processor_->name() << ": buffer pool is too small to retain a packet";
+    }
+    return processor_->retainBuffer(p);
+  }
+
+  /**
+   * Set the age after which queued packets are skipped in favor of the newest one.
+   * @param max_age_ns Maximum age in nanoseconds since arrival, 0 disables skipping.
+   */
+  void setMaxPacketAge(uint64_t max_age_ns)
+  {
+    max_age_ = max_age_ns;
+  }
+
+  /**
+   * Count stale packets, processed packets and latencies in telemetry.
+   * Set before packets arrive; telemetry may be NULL.
+   */
+  void setTelemetry(Telemetry *telemetry, Telemetry::Stream stream)
+  {
+    telemetry_ = telemetry;
+    stream_ = stream;
+  }
+
+  /**
+   * Process packets on @p pool instead of the dedicated thread, which is stopped.
+   * Call before packets arrive; the pool must outlive this object.
+   * @return False if the wrapped processor requires its own thread and keeps it.
+   */
+  bool setWorkerPool(WorkerPool *pool)
+  {
+    if (processor_->requiresDedicatedThread())
+      return false;
+
+    if (thread_)
+    {
+      {
+        libfreenect2::lock_guard l(packet_mutex_);
+        shutdown_ = true;
+      }
+      packet_condition_.notify_all();
+      thread_->join();
+      delete thread_;
+      thread_ = 0;
+      shutdown_ = false;
+    }
+    pool_ = pool;
+    return true;
+  }
+
+  /** Block until every queued packet has been processed. */
+  void waitForIdle()
+  {
+    libfreenect2::unique_lock l(packet_mutex_);
+    while (!shutdown_ && (occupancy_.load() > 0 || busy_))
+      WAIT_CONDITION(packet_condition_, packet_mutex_, l);
+  }
+
+  /** Snapshot of the queue counters. Safe to call from any thread. */
+  AsyncPacketProcessorStatistics getStatistics() const
+  {
+    AsyncPacketProcessorStatistics s;
+    s.queue_depth = queue_.size();
+    s.occupancy = occupancy_.load();
+    s.high_water_mark = high_water_mark_.load();
+    s.queued = queued_.load();
+    s.processed = processed_.load();
+    s.dropped = dropped_.load();
+    s.skipped = skipped_.load();
+    return s;
+  }
+
 private:
   PacketProcessorPtr processor_;  ///< The processing routine, executed in the asynchronous thread.
-  bool current_packet_available_; ///< Whether #current_packet_ still needs processing.
-  PacketT current_packet_;        ///< Packet being processed.
+  ThreadPolicy::Role role_;       ///< Thread policy role of #thread_.
+  std::vector<PacketT> queue_;    ///< Ring buffer of packets waiting for processing.
+  size_t head_;                   ///< Index of the oldest packet in #queue_.
+  atomic<size_t> occupancy_;      ///< Number of packets in #queue_, written under #packet_mutex_.
+  atomic<size_t> high_water_mark_;
+  atomic<uint64_t> queued_;
+  atomic<uint64_t> processed_;
+  atomic<uint64_t> dropped_;
+  atomic<uint64_t> skipped_;
+  atomic<uint64_t> max_age_;      ///< Maximum packet age in ns, 0 for no limit.
+  Telemetry *telemetry_;
+  Telemetry::Stream stream_;
 
   bool shutdown_;
-  libfreenect2::mutex packet_mutex_; ///< Mutex indicating a new packet can be stored in #current_packet_.
-  libfreenect2::condition_variable packet_condition_; ///< Mutex indicating processing is blocked on lack of packets.
-  libfreenect2::thread thread_; ///< Asynchronous thread.
+  bool busy_;         ///< A packet is being processed.
+  WorkerPool *pool_;  ///< Pool running the packets, NULL for #thread_.
+  bool scheduled_;    ///< This processor is queued or running on #pool_.
+  bool retaining_;    ///< The pool has been grown for a retained buffer.
+  libfreenect2::mutex packet_mutex_; ///< Mutex protecting #queue_, #head_ and #scheduled_.
+  libfreenect2::condition_variable packet_condition_; ///< Condition signaled when a packet is queued or processed, or #scheduled_ is cleared.
+  libfreenect2::thread *thread_; ///< Asynchronous thread, NULL on a worker pool.
 
   /**
    * Wrapper function to start the thread.
@@ -122,35 +313,125 @@ private:
     static_cast<AsyncPacketProcessor<PacketT> *>(data)->execute();
   }
 
-  /** Asynchronously process a provided packet. */
+  /** Drop all but the newest queued packet if the oldest one is too old. Called with #packet_mutex_ held. */
+  void skipStalePackets()
+  {
+    const uint64_t max_age = max_age_.load();
+    if (max_age == 0 || occupancy_.load() < 2)
+      return;
+    if (packetArrivalTime() - queue_[head_].arrival_time <= max_age)
+      return;
+
+    while (occupancy_.load() > 1)
+    {
+      releaseBuffer(queue_[head_]);
+      head_ = (head_ + 1) % queue_.size();
+      occupancy_--;
+      skipped_++;
+      if (telemetry_)
+        telemetry_->add(stream_, Telemetry::DroppedStale);
+    }
+  }
+
+  /** Remove the oldest queued packet and mark #busy_. Called with #packet_mutex_ held and a packet queued. */
+  PacketT pop()
+  {
+    skipStalePackets();
+
+    PacketT packet = queue_[head_];
+    head_ = (head_ + 1) % queue_.size();
+    occupancy_--;
+    busy_ = true;
+    return packet;
+  }
+
+  /** Process and release one packet. Called without #packet_mutex_, so the queue stays open for the parser. */
+  void processPacket(PacketT &packet)
+  {
+    // invoke process impl
+    const uint64_t start = packetArrivalTime();
+    packet.process_start_time = start;
+    // A processor that is not good() decodes nothing, so no frame is counted.
+    const bool decoded = processor_->good();
+    if (decoded)
+    {
+      processor_->process(packet);
+      processed_++;
+    }
+    if (trace::active())
+    {
+      const uint64_t end = packetArrivalTime();
+      trace::record(stream_ == Telemetry::Color ? "color_queue" : "depth_queue", packet.sequence, packet.arrival_time, start);
+      trace::record(stream_ == Telemetry::Color ? "color_process" : "depth_process", packet.sequence, start, end);
+    }
+    if (telemetry_ && decoded)
+    {
+      const uint64_t end = packetArrivalTime();
+      telemetry_->add(stream_, Telemetry::FramesProcessed);
+      telemetry_->record(stream_, Telemetry::QueueLatency, start > packet.arrival_time ? start - packet.arrival_time : 0);
+      telemetry_->record(stream_, Telemetry::ProcessLatency, end - start);
+    }
+    /*
+     * The stream parser passes the buffer asynchronously to processors so
+     * it can not wait after process() finishes and free the buffer. The
+     * buffer pool holds enough buffers for a full queue (see the
+     * constructor), so releasing here never stalls the parser.
+     */
+    releaseBuffer(packet);
+  }
+
+  /** Asynchronously process queued packets in arrival order. */
   void execute()
   {
     this_thread::set_name(processor_->name());
+    this_thread::apply_policy(role_);
     libfreenect2::unique_lock l(packet_mutex_);
 
     while(!shutdown_)
     {
-      WAIT_CONDITION(packet_condition_, packet_mutex_, l);
-
-      if(current_packet_available_)
+      if(occupancy_.load() == 0)
       {
-        // invoke process impl
-        if (processor_->good())
-          processor_->process(current_packet_);
-        /*
-         * The stream parser passes the buffer asynchronously to processors so
-         * it can not wait after process() finishes and free the buffer.  In
-         * theory releaseBuffer() should be called as soon as the access to it
-         * is finished, but right now no new allocateBuffer() will be called
-         * before ready() becomes true, so releaseBuffer() in the main loop of
-         * the async processor is OK.
-         */
-        releaseBuffer(current_packet_);
-
-        current_packet_available_ = false;
+        WAIT_CONDITION(packet_condition_, packet_mutex_, l);
+        continue;
       }
+
+      PacketT packet = pop();
+
+      l.unlock();
+      processPacket(packet);
+      l.lock();
+      busy_ = false;
+      packet_condition_.notify_all();
     }
   }
+
+  /** Process one packet on the worker pool, then requeue if more are waiting. */
+  virtual void run()
+  {
+    libfreenect2::unique_lock l(packet_mutex_);
+
+    if (!shutdown_ && occupancy_.load() > 0)
+    {
+      PacketT packet = pop();
+
+      l.unlock();
+      processPacket(packet);
+      l.lock();
+      busy_ = false;
+      packet_condition_.notify_all();
+    }
+
+    if (!shutdown_ && occupancy_.load() > 0)
+    {
+      l.unlock();
+      pool_->post(this);
+      return;
+    }
+
+    // Notify with the lock held: the destructor may run as soon as it is released.
+    scheduled_ = false;
+    packet_condition_.notify_all();
+  }
 };
 
 } /* namespace libfreenect2 */
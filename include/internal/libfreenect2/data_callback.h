@@ -38,12 +38,43 @@ namespace libfreenect2
 class DataCallback
 {
 public:
+  /** One successfully received packet of an isochronous transfer. */
+  struct IsoPacket
+  {
+    unsigned char *data; ///< Start of the packet's slot in the transfer buffer.
+    size_t length;       ///< Number of bytes received into the slot.
+  };
+
   /**
    * Callback that new data has arrived.
    * @param buffer Buffer with new data.
    * @param n Size of the new data.
    */
   virtual void onDataReceived(unsigned char *buffer, size_t n) = 0;
+
+  /**
+   * Callback that an isochronous transfer has completed.
+   * Failed packets are left out, so consecutive entries are not necessarily
+   * adjacent in memory. The default forwards each packet to onDataReceived().
+   * @param packets Received packets, in transfer order.
+   * @param count Number of packets.
+   */
+  virtual void onIsoPacketsReceived(const IsoPacket *packets, size_t count)
+  {
+    for(size_t i = 0; i < count; ++i)
+      onDataReceived(packets[i].data, packets[i].length);
+  }
+
+  /**
+   * Ask for the memory the next bulk transfer should be received into.
+   * Called on the USB thread before a completed transfer is resubmitted.
+   * The returned memory must stay valid until the transfer is reported by
+   * onDataReceived(); failed transfers are reported with n = 0.
+   * @param n Size of the transfer.
+   * @param queued_bytes Size of the transfers that are in flight and will complete before this one.
+   * @return Destination for the transfer, or NULL to use the transfer pool's own memory.
+   */
+  virtual unsigned char *getTransferBuffer(size_t n, size_t queued_bytes) { return NULL; }
 };
 
 } // namespace libfreenect2
@@ -32,10 +32,13 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <vector>
+
 #include <libfreenect2/config.h>
 #include <libfreenect2/libfreenect2.hpp>
 #include <libfreenect2/frame_listener.hpp>
 #include <libfreenect2/packet_processor.h>
+#include <libfreenect2/frame_timing.h>
 
 namespace libfreenect2
 {
@@ -47,6 +50,11 @@ struct DepthPacket
   uint32_t timestamp;
   unsigned char *buffer; ///< Depth data.
   size_t buffer_length;  ///< Size of depth data.
+  uint64_t arrival_time; ///< Host time the packet was completed, see packetArrivalTime().
+  uint64_t first_byte_time;    ///< Host time the first USB transfer of the packet arrived.
+  uint64_t process_start_time; ///< Host time processing started, set by AsyncPacketProcessor.
+  uint32_t missing;      ///< One bit per sub-image filled in from the previous packet, 0 if complete.
+  uint32_t salvage;      ///< Sub-images the parser may fill in, 0 if it drops incomplete packets.
 
   Buffer *memory;
 };
@@ -54,6 +62,27 @@ struct DepthPacket
 /** Class for processing depth information. */
 typedef PacketProcessor<DepthPacket> BaseDepthPacketProcessor;
 
+/**
+ * Post-processing of frames decoded from salvaged packets (DepthPacket::missing).
+ *
+ * Sub-images taken from the previous packet only agree with the rest of the
+ * packet where the scene did not move, so depth pixels that changed by more
+ * than MaxRelativeChange since the last complete frame are set to 0. The
+ * status of both frames is set to Frame::Degraded.
+ *
+ * The last complete frame is only kept while the parser salvages packets
+ * (DepthPacket::salvage), otherwise there is no per-frame copy.
+ */
+class DepthSalvageFilter
+{
+public:
+  static const float MaxRelativeChange;
+
+  void apply(const DepthPacket &packet, Frame *ir, Frame *depth);
+private:
+  std::vector<float> reference_; ///< Last complete depth frame.
+};
+
 class DepthPacketProcessor : public BaseDepthPacketProcessor
 {
 public:
@@ -119,6 +148,8 @@ public:
 protected:
   libfreenect2::DepthPacketProcessor::Config config_;
   libfreenect2::FrameListener *listener_;
+  DepthSalvageFilter salvage_filter_;
+  FrameTimer timer_;
 };
 
 #ifdef LIBFREENECT2_WITH_OPENGL_SUPPORT
@@ -138,6 +169,7 @@ public:
   virtual void loadLookupTable(const short *lut);
 
   virtual const char *name() { return "OpenGL"; }
+  virtual bool requiresDedicatedThread() { return true; }
   virtual void process(const DepthPacket &packet);
 private:
   OpenGLDepthPacketProcessorImpl *impl_;
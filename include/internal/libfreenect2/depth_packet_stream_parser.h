@@ -32,11 +32,14 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <vector>
+
 #include <libfreenect2/config.h>
 
 #include <libfreenect2/depth_packet_processor.h>
 
 #include <libfreenect2/data_callback.h>
+#include <libfreenect2/telemetry.h>
 
 namespace libfreenect2
 {
@@ -56,6 +59,24 @@ LIBFREENECT2_PACK(struct DepthSubPacketFooter
 /**
  * Parser of th depth stream, recognizes valid depth packets in the stream, and
  * passes them on for further processing.
+ *
+ * In zero-copy mode (the default) iso payloads are written straight into the
+ * slot of the expected subsequence in the packet buffer, and a packet is
+ * passed on as soon as all its subsequences arrived. Only when the footer
+ * names a different subsequence than expected is the sub-image moved to the
+ * right slot. The copy mode assembles each sub-image in a work buffer first.
+ * Set `LIBFREENECT2_DEPTH_ZERO_COPY=0` to use the copy mode.
+ *
+ * Packets with missing sub-images are dropped unless salvaging is enabled
+ * with setSalvage() or `LIBFREENECT2_DEPTH_SALVAGE=<n>`: then a packet that
+ * lacks at most n of the nine measurement sub-images (sub-image 9 is not
+ * decoded) is completed with the sub-images of the previous packet and
+ * passed on with DepthPacket::missing set. The parser retains the buffer
+ * of the last packet it passed on as reference (PacketProcessor::retainBuffer()),
+ * which takes one more buffer of the processor's pool but no copy.
+ *
+ * In every mode a packet carries the timestamp of the last sub-image
+ * footer of that packet.
  */
 class DepthPacketStreamParser : public DataCallback
 {
@@ -66,7 +87,38 @@ public:
   void setPacketProcessor(libfreenect2::BaseDepthPacketProcessor *processor);
 
   virtual void onDataReceived(unsigned char* buffer, size_t length);
+
+  /** Append runs of adjacent mid-sub-image packets with one copy, everything else goes through onDataReceived(). */
+  virtual void onIsoPacketsReceived(const IsoPacket *packets, size_t count);
+
+  void setZeroCopy(bool enable);
+  bool zeroCopy() const;
+
+  /** Number of sub-images that arrived in a different slot than expected and had to be copied. */
+  uint64_t misalignedCopies() const;
+
+  /** Salvage packets missing up to max_missing measurement sub-images, 0 to drop them. */
+  void setSalvage(unsigned max_missing);
+  unsigned salvage() const;
+
+  /** Number of incomplete packets passed on. */
+  uint64_t salvagedPackets() const;
+
+  /** Count resyncs, completed and dropped packets in telemetry, which may be NULL. */
+  void setTelemetry(Telemetry *telemetry);
 private:
+  void count(Telemetry::Counter counter, uint64_t n = 1)
+  {
+    if(telemetry_)
+      telemetry_->add(Telemetry::Depth, counter, n);
+  }
+
+  void dispatchPacket(uint32_t missing = 0);
+  bool salvagePacket(const unsigned char *incoming, size_t incoming_length);
+  unsigned char *slotData(uint32_t subsequence);
+  unsigned char *subImageData();
+  void releasePrevious();
+
   libfreenect2::BaseDepthPacketProcessor *processor_;
 
   size_t buffer_size_;
@@ -76,6 +128,20 @@ private:
   uint32_t processed_packets_;
   uint32_t current_sequence_;
   uint32_t current_subsequence_;
+
+  bool zero_copy_;
+  uint32_t expected_subsequence_; ///< Slot the incoming sub-image is written to in zero-copy mode.
+  uint64_t misaligned_copies_;
+
+  unsigned max_missing_;
+  uint32_t current_timestamp_;
+  DepthPacket previous_; ///< Last packet passed on, its buffer is retained while salvaging.
+  uint32_t previous_sequence_;
+  uint64_t salvaged_packets_;
+
+  Telemetry *telemetry_;
+  uint64_t sub_image_start_; ///< Arrival of the first payload of the current sub-image.
+  uint64_t packet_start_;    ///< Arrival of the first payload of the current packet.
 };
 
 } /* namespace libfreenect2 */
@@ -0,0 +1,60 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+
+/** @file depth_tables.h X/Z and lookup tables of depth processing. */
+
+#ifndef DEPTH_TABLES_H_
+#define DEPTH_TABLES_H_
+
+#include <vector>
+
+#include <libfreenect2/libfreenect2.hpp>
+#include <libfreenect2/depth_packet_processor.h>
+
+namespace libfreenect2
+{
+
+/** Tables computed from the IR camera parameters for DepthPacketProcessor::loadXZTables() and loadLookupTable(). */
+struct IrCameraTables: Freenect2Device::IrCameraParams
+{
+  std::vector<float> xtable;
+  std::vector<float> ztable;
+  std::vector<short> lut;
+
+  IrCameraTables(const Freenect2Device::IrCameraParams &parent);
+
+  //x,y: undistorted, normalized coordinates
+  //xd,yd: distorted, normalized coordinates
+  void distort(double x, double y, double &xd, double &yd) const;
+
+  //The inverse of distort() using Newton's method
+  //Return true if converged correctly
+  bool undistort(double x, double y, double &xu, double &yu) const;
+};
+
+} /* namespace libfreenect2 */
+#endif /* DEPTH_TABLES_H_ */
@@ -0,0 +1,120 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+
+/** @file frame_timing.h Host timestamps and device clock mapping of frames. */
+
+#ifndef FRAME_TIMING_H_
+#define FRAME_TIMING_H_
+
+#include <stdint.h>
+
+#include <libfreenect2/frame_listener.hpp>
+#include <libfreenect2/packet_processor.h>
+
+namespace libfreenect2
+{
+
+/**
+ * Maps the device timestamp (Frame::timestamp) to the host clock.
+ *
+ * Fits host time = offset + slope * device time by exponentially weighted
+ * least squares over the observed pairs, so the estimate follows slow drift
+ * between the two clocks while transfer jitter is averaged out. The 32 bit
+ * device timestamp is unwrapped. The fixed part of the transfer latency ends
+ * up in the offset.
+ */
+class DeviceClock
+{
+public:
+  static const double Forgetting; ///< Weight decay per observation.
+  static const double MinWeight;  ///< Total weight before toHost() returns estimates.
+  static const double MaxResidual; ///< Host nanoseconds off the fit that restart the estimate, e.g. after a device reset.
+
+  DeviceClock();
+
+  /** Add an observation: device @p timestamp was seen at host time @p host_ns. */
+  void update(uint32_t timestamp, uint64_t host_ns);
+
+  /** Host time of device @p timestamp in nanoseconds, 0 until enough observations. */
+  uint64_t toHost(uint32_t timestamp) const;
+
+  /** Estimated host nanoseconds per device tick, 0 until enough observations. */
+  double nsPerTick() const;
+
+  void reset();
+private:
+  double ticks(uint32_t timestamp) const;
+  double estimate(double x) const;
+
+  bool started_;
+  uint32_t last_timestamp_;
+  double last_x_;        ///< Unwrapped device ticks of the last observation since the origin.
+  uint64_t host_origin_; ///< Host time of the first observation.
+  double weight_;
+  double mean_x_, mean_y_; ///< Device ticks and host ns since the origin.
+  double var_x_, cov_xy_;  ///< Weighted sums of squares and products around the means.
+};
+
+/**
+ * Fills the FrameTiming of frames decoded by a processor.
+ */
+class FrameTimer
+{
+public:
+  /** Stamp frames decoded from @p packet; call when decoding has finished. */
+  template<typename PacketT>
+  void stamp(const PacketT &packet, Frame *frame, Frame *other = NULL)
+  {
+    clock_.update(packet.timestamp, packet.arrival_time);
+
+    FrameTiming timing;
+    timing.usb_first = packet.first_byte_time;
+    timing.usb_last = packet.arrival_time;
+    timing.process_start = packet.process_start_time;
+    timing.process_end = packetArrivalTime();
+    timing.delivered = 0;
+    timing.device_time = clock_.toHost(packet.timestamp);
+
+    frame->timing = timing;
+    if (other)
+      other->timing = timing;
+  }
+
+  const DeviceClock &clock() const { return clock_; }
+private:
+  DeviceClock clock_;
+};
+
+/** Hand @p frame to @p listener, recording the delivery time. */
+inline bool deliverFrame(FrameListener *listener, Frame::Type type, Frame *frame)
+{
+  frame->timing.delivered = packetArrivalTime();
+  return listener->onNewFrame(type, frame);
+}
+
+} /* namespace libfreenect2 */
+#endif /* FRAME_TIMING_H_ */
@@ -49,12 +49,30 @@ private:
   WithPerfLoggingImpl *impl_;
 };
 
+/** Stream buffer appending to a string, so a reused string keeps its capacity across messages. */
+class LogBuffer : public std::streambuf
+{
+public:
+  explicit LogBuffer(std::string *text): text_(text) {}
+
+  /** The message formatted so far. */
+  const std::string &text() const { return *text_; }
+protected:
+  virtual int_type overflow(int_type c);
+  virtual std::streamsize xsputn(const char *s, std::streamsize n);
+private:
+  std::string *text_;
+};
+
 class LogMessage
 {
 private:
   Logger *logger_;
   Logger::Level level_;
-  std::ostringstream stream_;
+  std::string *text_;  ///< The thread's reused buffer, or #own_text_ if a message is formatted inside another.
+  std::string own_text_;
+  LogBuffer buffer_;
+  std::ostream stream_;
 public:
   LogMessage(Logger *logger, Logger::Level level);
   LogMessage(Logger *logger, Logger::Level level, const char *source);
@@ -63,6 +81,16 @@ public:
   std::ostream &stream();
 };
 
+/** True if the global logger takes messages of @p level. */
+inline bool logEnabled(Logger::Level level)
+{
+  Logger *logger = getGlobalLogger();
+  return logger != 0 && level <= logger->level();
+}
+
+/** Stream that discards its input without formatting it, for disabled log levels. */
+std::ostream &nullLogStream();
+
 } /* namespace libfreenect2 */
 
 #if defined(__GNUC__) || defined(__clang__)
@@ -73,7 +101,10 @@ public:
 #define LOG_SOURCE ""
 #endif
 
-#define LOG(LEVEL) (::libfreenect2::LogMessage(::libfreenect2::getGlobalLogger(), ::libfreenect2::Logger::LEVEL, LOG_SOURCE).stream())
+/* The LogMessage is only constructed if the level is enabled; otherwise << does no formatting. */
+#define LOG(LEVEL) (::libfreenect2::logEnabled(::libfreenect2::Logger::LEVEL) ? \
+  ::libfreenect2::LogMessage(::libfreenect2::getGlobalLogger(), ::libfreenect2::Logger::LEVEL, LOG_SOURCE).stream() : \
+  ::libfreenect2::nullLogStream())
 #define LOG_DEBUG LOG(Debug)
 #define LOG_INFO LOG(Info)
 #define LOG_WARNING LOG(Warning)
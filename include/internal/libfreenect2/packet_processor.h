@@ -30,10 +30,17 @@
 #define PACKET_PROCESSOR_H_
 
 #include "libfreenect2/allocator.h"
+#include "libfreenect2/threading.h"
 
 namespace libfreenect2
 {
 
+/** Host clock used to stamp packet arrival, in nanoseconds of steady_clock. */
+inline uint64_t packetArrivalTime()
+{
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 /**
  * Processor node in the pipeline.
  * @tparam PacketT Type of the packet being processed.
@@ -42,6 +49,7 @@ template<typename PacketT>
 class PacketProcessor
 {
 public:
+  PacketProcessor(): default_allocator_(createLargeBufferAllocator()) {}
   virtual ~PacketProcessor() {}
 
   /**
@@ -54,6 +62,9 @@ public:
 
   virtual const char *name() { return "a packet processor"; }
 
+  /** True if process() must always run on the same thread, e.g. because it uses a thread-bound graphics context. */
+  virtual bool requiresDedicatedThread() { return false; }
+
   /**
    * A new packet has arrived, process it.
    * @param packet Packet to process.
@@ -75,6 +86,30 @@ public:
     p.memory = NULL;
   }
 
+  /**
+   * Let callers hold up to @p count buffers at once without allocateBuffer() blocking.
+   * Only has an effect if the packet buffers come from a PoolAllocator.
+   * @param count Number of buffers that may be in flight.
+   * @return True if the allocator can provide that many buffers.
+   */
+  virtual bool reserveBuffers(size_t count)
+  {
+    PoolAllocator *pool = dynamic_cast<PoolAllocator *>(getAllocator());
+    return pool ? pool->reserve(count) : true;
+  }
+
+  /**
+   * Keep the buffer of @p p for the caller after the processor released it.
+   * The caller calls releaseBuffer() for it once more.
+   * Only possible if the packet buffers come from a PoolAllocator.
+   * @return True if the buffer is retained.
+   */
+  virtual bool retainBuffer(PacketT &p)
+  {
+    PoolAllocator *pool = dynamic_cast<PoolAllocator *>(getAllocator());
+    return pool ? pool->retain(p.memory) : false;
+  }
+
 protected:
   virtual Allocator *getAllocator() { return &default_allocator_; }
 
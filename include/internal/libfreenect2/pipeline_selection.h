@@ -0,0 +1,96 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+
+/** @file pipeline_selection.h Choice of the fastest depth pipeline on the host. */
+
+#ifndef PIPELINE_SELECTION_H_
+#define PIPELINE_SELECTION_H_
+
+#include <string>
+#include <vector>
+
+#include <libfreenect2/packet_pipeline.h>
+
+namespace libfreenect2
+{
+
+/** Depth processing time of one pipeline. */
+struct PipelineTiming
+{
+  std::string name;
+  size_t frames;    ///< Frames timed, 0 if the pipeline could not process depth here.
+  double median_ms; ///< Median processing time of a frame.
+  double mean_ms;
+};
+
+/**
+ * Picks the pipeline whose depth processor decodes a generated depth packet
+ * fastest, for the "auto" pipeline.
+ *
+ * Each candidate processes a few warm-up frames, then frames are timed until
+ * a time budget is spent. The winner is kept in a file per host name in the
+ * cache directory, together with the library version and the candidates; a
+ * file that does not match them is measured again.
+ */
+class PipelineSelector
+{
+public:
+  /** Creates a pipeline by name, NULL if unavailable. */
+  typedef PacketPipeline *(*Factory)(std::string name);
+
+  /**
+   * @param factory Creates the pipelines to measure.
+   * @param cache_directory Where to keep the choice, empty to not cache it.
+   * @param budget_ms Time spent timing each candidate.
+   */
+  PipelineSelector(Factory factory, const std::string &cache_directory, double budget_ms = 250);
+
+  /** Names of the pipelines compiled in that may run on this host. */
+  static std::vector<std::string> candidates();
+
+  /** Time the depth processor of each named pipeline. */
+  std::vector<PipelineTiming> measure(const std::vector<std::string> &names) const;
+
+  /**
+   * The cached choice, else the fastest of candidates(), which is then cached.
+   * @return The pipeline name, empty if none could process depth.
+   */
+  std::string select();
+
+  /** File the choice is cached in, empty if there is no cache directory. */
+  std::string cachePath() const;
+
+private:
+  std::string signature(const std::vector<std::string> &names) const;
+
+  Factory factory_;
+  std::string cache_directory_;
+  double budget_ms_;
+};
+
+} /* namespace libfreenect2 */
+#endif /* PIPELINE_SELECTION_H_ */
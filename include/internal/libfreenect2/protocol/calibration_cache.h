@@ -0,0 +1,87 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+
+/** @file calibration_cache.h Cache of the fixed data read from a device on start. */
+
+#ifndef CALIBRATION_CACHE_H_
+#define CALIBRATION_CACHE_H_
+
+#include <string>
+#include <libfreenect2/protocol/command_transaction.h>
+
+namespace libfreenect2
+{
+namespace protocol
+{
+
+/** Raw responses of the commands that read data which does not change while a device is in use. */
+struct DeviceCalibration
+{
+  CommandTransaction::Result firmware;
+  CommandTransaction::Result serial;
+  CommandTransaction::Result depth_params;
+  CommandTransaction::Result p0_tables;
+  CommandTransaction::Result rgb_params;
+
+  /** True if every response is present. */
+  bool complete() const;
+};
+
+/**
+ * Keeps DeviceCalibration per serial number in memory and, if a directory is
+ * given, in one file per device so that later processes find it too.
+ *
+ * Files are written to a temporary name first and renamed, so concurrent
+ * processes never read a partial file. A file that does not parse is ignored.
+ */
+class CalibrationCache
+{
+public:
+  /** @param directory Where to keep files, empty to cache in memory only. */
+  explicit CalibrationCache(const std::string &directory);
+
+  /** LIBFREENECT2_CACHE_DIR, else the user's cache directory, e.g. ~/.cache/libfreenect2. */
+  static std::string defaultDirectory();
+
+  /** Create @p path and its missing parents, true if it exists afterwards. */
+  static bool makeDirectories(const std::string &path);
+
+  bool load(const std::string &serial, DeviceCalibration &calibration) const;
+  bool store(const std::string &serial, const DeviceCalibration &calibration);
+
+  /** Forget the calibrations kept in memory, so that load() reads the files again. */
+  static void clearMemory();
+
+private:
+  std::string path(const std::string &serial) const;
+
+  std::string directory_;
+};
+
+} /* namespace protocol */
+} /* namespace libfreenect2 */
+#endif /* CALIBRATION_CACHE_H_ */
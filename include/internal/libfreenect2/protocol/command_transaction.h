@@ -28,7 +28,7 @@
 #define COMMAND_TRANSACTION_H_
 
 #include <vector>
-#include <libusb.h>
+#include <libfreenect2/usb/transport.h>
 #include <libfreenect2/protocol/command.h>
 
 namespace libfreenect2
@@ -44,12 +44,12 @@ public:
 
   typedef std::vector<unsigned char> Result;
 
-  CommandTransaction(libusb_device_handle *handle, int inbound_endpoint, int outbound_endpoint);
+  CommandTransaction(usb::Transport *transport, int inbound_endpoint, int outbound_endpoint);
   ~CommandTransaction();
 
   bool execute(const CommandBase& command, Result& result);
 private:
-  libusb_device_handle *handle_;
+  usb::Transport *transport_;
   int inbound_endpoint_, outbound_endpoint_, timeout_;
   Result response_complete_result_;
 
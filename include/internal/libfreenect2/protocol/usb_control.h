@@ -27,7 +27,7 @@
 #ifndef USB_CONTROL_H_
 #define USB_CONTROL_H_
 
-#include <libusb.h>
+#include <libfreenect2/usb/transport.h>
 
 namespace libfreenect2
 {
@@ -64,7 +64,7 @@ namespace protocol
 class UsbControl
 {
 public:
-  UsbControl(libusb_device_handle *handle);
+  UsbControl(usb::Transport *transport);
   virtual ~UsbControl();
 
   enum State
@@ -99,7 +99,7 @@ private:
   static const int ControlAndRgbInterfaceId = 0;
   static const int IrInterfaceId = 1;
 
-  libusb_device_handle* handle_;
+  usb::Transport *transport_;
   int timeout_;
 };
 
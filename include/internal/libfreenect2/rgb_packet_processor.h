@@ -35,6 +35,7 @@
 #include <libfreenect2/config.h>
 #include <libfreenect2/frame_listener.hpp>
 #include <libfreenect2/packet_processor.h>
+#include <libfreenect2/frame_timing.h>
 
 namespace libfreenect2
 {
@@ -50,6 +51,9 @@ struct RgbPacket
   float exposure;
   float gain;
   float gamma;
+  uint64_t arrival_time; ///< Host time the packet was completed, see packetArrivalTime().
+  uint64_t first_byte_time;    ///< Host time the first USB transfer of the packet arrived.
+  uint64_t process_start_time; ///< Host time processing started, set by AsyncPacketProcessor.
 
   Buffer *memory;
 };
@@ -66,6 +70,7 @@ public:
   virtual void setFrameListener(libfreenect2::FrameListener *listener);
 protected:
   libfreenect2::FrameListener *listener_;
+  FrameTimer timer_;
 };
 
 /** Class for dumping the JPEG information, eg to file. */
@@ -30,16 +30,57 @@
 #define RGB_PACKET_STREAM_PARSER_H_
 
 #include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
 
 #include <libfreenect2/config.h>
 #include <libfreenect2/rgb_packet_processor.h>
 
 #include <libfreenect2/data_callback.h>
+#include <libfreenect2/telemetry.h>
 
 namespace libfreenect2
 {
 
-/** Parser for getting an RGB packet from the stream. */
+/** Header of a color frame in the bulk stream. */
+LIBFREENECT2_PACK(struct RawRgbPacket
+{
+  uint32_t sequence;
+  uint32_t magic_header; // is 'BBBB' equal 0x42424242
+
+  unsigned char jpeg_buffer[0];
+});
+
+// starting from JPEG EOI: 0xff 0xd9
+// char pad_0xa5[]; //0-3 bytes alignment of 0xa5
+// char filler[filler_length] = "ZZZZ...";
+LIBFREENECT2_PACK(struct RgbPacketFooter {
+  uint32_t magic_header; // is '9999' equal 0x39393939
+  uint32_t sequence;
+  uint32_t filler_length;
+  uint32_t unknown1; // seems 0 always
+  uint32_t unknown2; // seems 0 always
+  uint32_t timestamp;
+  float exposure; // ? ranges from 0.5 to about 60.0 with powerfull light at camera or totally covered
+  float gain; // ? ranges from 1.0 when camera is clear to 1.5 when camera is covered.
+  uint32_t magic_footer; // is 'BBBB' equal 0x42424242
+  uint32_t packet_size;
+  float gamma; // ranges from 1.0f to about 6.4 when camera is fully covered
+  uint32_t unknown4[3]; // seems to be 0 all the time.
+});
+
+/**
+ * Parser for getting an RGB packet from the stream.
+ *
+ * In zero-copy mode (the default) the bulk transfer pool receives transfers
+ * directly into the packet buffer at the offset where their data belongs,
+ * see getTransferBuffer(). Data that does not arrive in place is copied: the
+ * first transfers after start, the tail of the previous frame's transfers
+ * after a packet is passed on, transfers following a short one, and
+ * transfers that would not fit before the end of the buffer. Set
+ * `LIBFREENECT2_RGB_ZERO_COPY=0` to always copy.
+ */
 class RgbPacketStreamParser : public DataCallback
 {
 public:
@@ -49,10 +90,46 @@ public:
   void setPacketProcessor(BaseRgbPacketProcessor *processor);
 
   virtual void onDataReceived(unsigned char* buffer, size_t length);
+  virtual unsigned char *getTransferBuffer(size_t length, size_t queued_bytes);
+
+  void setZeroCopy(bool enable);
+
+  /** Bytes received in place and bytes copied into the packet buffer. */
+  uint64_t inPlaceBytes() const;
+  uint64_t copiedBytes() const;
+
+  /** Count resyncs, completed and dropped packets in telemetry, which may be NULL. */
+  void setTelemetry(Telemetry *telemetry);
 private:
+  void count(Telemetry::Counter counter, uint64_t n = 1)
+  {
+    if(telemetry_)
+      telemetry_->add(Telemetry::Color, counter, n);
+  }
+
+  /** Region of a packet buffer handed out to a transfer that is in flight. */
+  struct Slice
+  {
+    unsigned char *data;
+    size_t length;
+  };
+
+  bool overlapsInFlight(const unsigned char *data, size_t length) const;
+  void releaseSlice(const unsigned char *data);
+
   size_t buffer_size_;
   RgbPacket packet_;
   BaseRgbPacketProcessor *processor_; ///< Parser implementation.
+
+  bool zero_copy_;
+  std::deque<Slice> in_flight_; ///< Slices handed out, in submission order.
+  uint64_t in_place_bytes_;
+  uint64_t copied_bytes_;
+
+  Telemetry *telemetry_;
+  uint32_t last_sequence_; ///< Sequence of the last packet passed on, for FramesLost.
+  bool has_sequence_;
+  uint64_t packet_start_; ///< Arrival of the first transfer of the current packet.
 };
 
 } /* namespace libfreenect2 */
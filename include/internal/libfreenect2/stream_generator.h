@@ -0,0 +1,142 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file stream_generator.h Synthetic USB streams of a Kinect v2. */
+
+#ifndef STREAM_GENERATOR_H_
+#define STREAM_GENERATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <libfreenect2/config.h>
+#include <libfreenect2/data_callback.h>
+
+namespace libfreenect2
+{
+
+/** Parameters of StreamGenerator. */
+struct LIBFREENECT2_API StreamGeneratorConfig
+{
+  size_t iso_packet_size;    ///< Payload size of an iso packet of the depth stream.
+  size_t bulk_transfer_size; ///< Size of a bulk transfer of the color stream.
+  double loss;               ///< Probability of losing an iso packet or a bulk transfer.
+  double reorder;            ///< Probability of swapping an iso packet or bulk transfer with the next one.
+  double jitter_us;          ///< Maximum random delay before a frame, only when paced.
+  double frame_rate;         ///< Frames per second of run(), 0 to run as fast as possible.
+  uint32_t seed;             ///< Seed of the random loss, reordering and jitter.
+
+  StreamGeneratorConfig();
+};
+
+/** Counters of StreamGenerator. */
+struct StreamGeneratorStatistics
+{
+  uint64_t depth_frames;
+  uint64_t rgb_frames;
+  uint64_t payloads;  ///< Iso packets and bulk transfers delivered.
+  uint64_t bytes;     ///< Bytes delivered.
+  uint64_t lost;      ///< Iso packets and bulk transfers dropped.
+  uint64_t reordered; ///< Swapped pairs.
+};
+
+/**
+ * Synthesizes the depth iso stream and the color bulk stream of a device
+ * and feeds them to DataCallback objects, usually the stream parsers of a
+ * PacketPipeline.
+ *
+ * The depth source is one raw depth packet (10 sub-images, as stored in the
+ * .depth files of Freenect2Replay) or a generated pattern. The color source
+ * is one JPEG image or a generated JPEG-shaped payload that passes the parser
+ * but cannot be decoded.
+ */
+class LIBFREENECT2_API StreamGenerator
+{
+public:
+  static const size_t DepthSubImageSize = 512 * 424 * 11 / 8;
+  static const size_t DepthSubImages = 10;
+
+  explicit StreamGenerator(const StreamGeneratorConfig &config = StreamGeneratorConfig());
+
+  /** Use a raw depth packet of DepthSubImages * DepthSubImageSize bytes. */
+  bool setDepthSource(const unsigned char *data, size_t length);
+  bool loadDepthSource(const std::string &filename);
+
+  /** Use a JPEG image, it must end with an EOI marker. */
+  bool setRgbSource(const unsigned char *jpeg, size_t length);
+  bool loadRgbSource(const std::string &filename);
+
+  /** Content of the depth packet and the JPEG image that are streamed. */
+  const std::vector<unsigned char> &depthSource() const;
+  const std::vector<unsigned char> &rgbSource() const;
+
+  /** Serialize the next color frame: RawRgbPacket, JPEG, padding, filler, RgbPacketFooter. */
+  void serializeRgbFrame(std::vector<unsigned char> &frame);
+
+  /** Send the next depth frame as iso packets, with an empty packet after each sub-image. */
+  void feedDepthFrame(DataCallback &callback);
+
+  /** Send the next color frame as bulk transfers. */
+  void feedRgbFrame(DataCallback &callback);
+
+  /** Advance the device timestamp of the next frames, by one frame at 30 Hz by default. */
+  void advanceTimestamp(uint32_t ticks = 267);
+
+  /**
+   * Send frames of both streams, paced by StreamGeneratorConfig::frame_rate.
+   * @param rgb Color stream receiver, or NULL.
+   * @param depth Depth stream receiver, or NULL.
+   * @param frames Number of frames per stream.
+   * @return Elapsed wall time in seconds.
+   */
+  double run(DataCallback *rgb, DataCallback *depth, size_t frames);
+
+  StreamGeneratorStatistics getStatistics() const;
+
+private:
+  void deliver(DataCallback &callback, std::vector<std::pair<const unsigned char *, size_t> > &payloads);
+  bool chance(double probability);
+
+  StreamGeneratorConfig config_;
+  StreamGeneratorStatistics stats_;
+  std::mt19937 random_;
+
+  std::vector<unsigned char> depth_source_;
+  std::vector<unsigned char> rgb_source_;
+  std::vector<unsigned char> depth_scratch_;
+  std::vector<unsigned char> rgb_scratch_;
+
+  uint32_t depth_sequence_;
+  uint32_t rgb_sequence_;
+  uint32_t timestamp_;
+};
+
+} /* namespace libfreenect2 */
+#endif /* STREAM_GENERATOR_H_ */
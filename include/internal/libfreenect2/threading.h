@@ -30,11 +30,13 @@
 #define THREADING_H_
 
 #include <libfreenect2/config.h>
+#include <libfreenect2/thread_policy.h>
 
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <chrono>
+#include <atomic>
 
 #define WAIT_CONDITION(var, mutex, lock) var.wait(lock);
 
@@ -46,6 +48,7 @@ typedef std::mutex mutex;
 typedef std::lock_guard<std::mutex> lock_guard;
 typedef std::unique_lock<std::mutex> unique_lock;
 typedef std::condition_variable condition_variable;
+using std::atomic;
 
 namespace chrono
 {
@@ -77,6 +80,9 @@ namespace this_thread
     pthread_setname_np(name);
 #endif
   }
+
+  /** Apply the CPU affinity and scheduling configured for @p role to the calling thread. */
+  void apply_policy(ThreadPolicy::Role role);
 }
 }
 
@@ -0,0 +1,91 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file trace_span.h Recording spans for the tracing API. */
+
+#ifndef TRACE_SPAN_H_
+#define TRACE_SPAN_H_
+
+#include <stdint.h>
+
+#include <libfreenect2/tracing.h>
+#include <libfreenect2/threading.h>
+
+namespace libfreenect2
+{
+namespace trace
+{
+
+/** Sequence of spans that do not belong to a frame. */
+static const uint32_t NoSequence = 0xffffffffu;
+
+extern atomic<bool> enabled;
+
+/** Steady clock in nanoseconds, the clock of packetArrivalTime(). */
+inline uint64_t now()
+{
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline bool active()
+{
+  return enabled.load(std::memory_order_relaxed);
+}
+
+/** Append a span to the calling thread's ring. */
+void record(const char *name, uint32_t sequence, uint64_t start_ns, uint64_t end_ns);
+
+/**
+ * Records the time between construction and destruction as a span.
+ * @p name must be a string literal; costs one atomic load when tracing is off.
+ */
+class Span
+{
+public:
+  Span(const char *name, uint32_t sequence = NoSequence) :
+    name_(name), sequence_(sequence), start_(active() ? now() : 0)
+  {
+  }
+
+  ~Span()
+  {
+    if (start_ != 0)
+      record(name_, sequence_, start_, now());
+  }
+
+  void setSequence(uint32_t sequence) { sequence_ = sequence; }
+private:
+  const char *name_;
+  uint32_t sequence_;
+  uint64_t start_;
+
+  Span(const Span &);
+  Span &operator=(const Span &);
+};
+
+} /* namespace trace */
+} /* namespace libfreenect2 */
+#endif /* TRACE_SPAN_H_ */
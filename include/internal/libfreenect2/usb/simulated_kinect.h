@@ -0,0 +1,167 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+
+/** @file simulated_kinect.h In-process Kinect v2 behind the USB transport. */
+
+#ifndef SIMULATED_KINECT_H_
+#define SIMULATED_KINECT_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <libfreenect2/usb/transport.h>
+#include <libfreenect2/stream_generator.h>
+#include <libfreenect2/threading.h>
+
+namespace libfreenect2
+{
+namespace usb
+{
+
+/** Parameters of SimulatedKinect. */
+struct SimulatedKinectConfig
+{
+  std::string serial;             ///< Serial number reported by the protocol.
+  double frame_rate;              ///< Frames per second of both streams.
+  unsigned int status_delay_ms;   ///< Time from enabling the video function until status 0x090000 reports ready.
+  unsigned int command_latency_us; ///< Added to every command round trip.
+  std::string depth_source;       ///< Raw depth packet file to stream, generated if empty.
+  std::string rgb_source;         ///< JPEG file to stream, generated if empty.
+  bool external_events;           ///< Complete transfers only in handleEvents(), like libusb without an event thread.
+
+  SimulatedKinectConfig();
+};
+
+/** Counters of SimulatedKinect. */
+struct SimulatedKinectStatistics
+{
+  uint64_t commands;      ///< Commands executed.
+  uint64_t depth_frames;  ///< Frames sent on the depth endpoint.
+  uint64_t rgb_frames;    ///< Frames sent on the color endpoint.
+  uint64_t transfers;     ///< Transfers completed, including cancelled ones.
+  uint64_t dropped;       ///< Iso packets and bulk payloads without a submitted transfer.
+};
+
+/**
+ * A Kinect v2 simulated in process, for testing and benchmarking the full
+ * open, start, stream, stop path without hardware.
+ *
+ * It accepts the standard requests of UsbControl, answers the commands of
+ * protocol/command.h with canned responses and, while streaming is enabled,
+ * fills the submitted transfers with the streams of a StreamGenerator at
+ * the configured frame rate. Transfers complete on an internal thread that
+ * stands in for the USB event loop, or with SimulatedKinectConfig::external_events
+ * in the thread calling handleEvents(). Iso packets without a submitted transfer
+ * are dropped like on the bus, color data waits for transfers.
+ */
+class SimulatedKinect : public Transport
+{
+public:
+  static const unsigned char CommandInEndpoint = 0x81;
+  static const unsigned char CommandOutEndpoint = 0x02;
+  static const unsigned char RgbEndpoint = 0x83;
+  static const unsigned char IrEndpoint = 0x84;
+  static const int MaxIsoPacketSize = 0x8400;
+
+  explicit SimulatedKinect(const SimulatedKinectConfig &config = SimulatedKinectConfig());
+  virtual ~SimulatedKinect();
+
+  virtual int getConfiguration(int *configuration);
+  virtual int setConfiguration(int configuration);
+  virtual int claimInterface(int interface_number);
+  virtual int releaseInterface(int interface_number);
+  virtual int setInterfaceAltSetting(int interface_number, int alternate_setting);
+  virtual int controlTransfer(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+                              unsigned char *data, uint16_t length, unsigned int timeout);
+  virtual int getMaxIsoPacketSize(int configuration, int alternate_setting, unsigned char endpoint);
+  virtual int bulkTransfer(unsigned char endpoint, unsigned char *data, int length, int *transferred, unsigned int timeout);
+  virtual int submitTransfer(libusb_transfer *transfer);
+  virtual int cancelTransfer(libusb_transfer *transfer);
+  virtual int handleEvents(int timeout_ms);
+  virtual libusb_device_handle *handle();
+  virtual void close();
+
+  SimulatedKinectStatistics getStatistics();
+
+  /** Canned command responses, also used as inputs of the benchmark tools. */
+  static std::vector<unsigned char> depthCameraParamsResponse();
+  static std::vector<unsigned char> rgbCameraParamsResponse();
+  static std::vector<unsigned char> p0TablesResponse();
+
+  /** A 1920x1080 test image encoded with TurboJPEG, empty without TurboJPEG support. */
+  static std::vector<unsigned char> syntheticJpeg();
+
+private:
+  class Sink;
+  typedef std::deque<libusb_transfer *> TransferQueue;
+
+  SimulatedKinectConfig config_;
+  SimulatedKinectStatistics stats_;
+  StreamGenerator *generator_;
+
+  libfreenect2::mutex mutex_;
+  libfreenect2::condition_variable condition_;
+  libfreenect2::thread *thread_;
+  bool shutdown_;
+  bool closed_;
+
+  int configuration_;
+  unsigned int claimed_interfaces_; ///< Bit mask.
+  int ir_alternate_setting_;
+  bool video_suspended_;
+  bool streaming_;
+  libfreenect2::chrono::steady_clock::time_point video_enabled_time_;
+
+  std::deque<std::vector<unsigned char> > responses_;
+  TransferQueue rgb_transfers_;
+  TransferQueue ir_transfers_;
+  TransferQueue completed_;
+  unsigned int delivering_; ///< Threads running callbacks of completed transfers outside the lock.
+  libusb_transfer *ir_current_; ///< Iso transfer being filled.
+  int ir_current_packet_;
+  libusb_transfer *rgb_current_; ///< Bulk transfer being filled.
+  libfreenect2::unique_lock *frame_lock_;
+
+  bool execute(const unsigned char *command, size_t length);
+  std::vector<unsigned char> respond(uint32_t command, const uint32_t *parameters, size_t num_parameters, uint32_t max_length);
+
+  void createGenerator();
+  void sendFrame(libfreenect2::unique_lock &lock);
+  void sendIsoPacket(const unsigned char *data, size_t length);
+  void finishIsoTransfer();
+  void sendBulkPayload(const unsigned char *data, size_t length);
+  void finishBulkTransfer();
+  void deliverCompleted(libfreenect2::unique_lock &lock);
+
+  static void static_execute(void *cookie);
+  void run();
+};
+
+} /* namespace usb */
+} /* namespace libfreenect2 */
+#endif /* SIMULATED_KINECT_H_ */
@@ -30,8 +30,11 @@
 #include <vector>
 #include <libusb.h>
 
+#include <libfreenect2/allocator.h>
 #include <libfreenect2/data_callback.h>
 #include <libfreenect2/threading.h>
+#include <libfreenect2/telemetry.h>
+#include <libfreenect2/usb/transport.h>
 
 namespace libfreenect2
 {
@@ -39,10 +42,63 @@ namespace libfreenect2
 namespace usb
 {
 
+/**
+ * Picks the number of transfers a pool keeps in flight while streaming.
+ *
+ * Completions are judged in windows of WindowNs. A window is stressed if a
+ * transfer or iso packet failed, the parser lost data, or a transfer
+ * completed while no other one was in flight, i.e. the host fell so far
+ * behind that the device had nowhere to put its data. A stressed window
+ * grows the target by a quarter. CalmWindows windows in a row that kept at
+ * least half of the transfers in flight shrink it by one.
+ */
+class AdaptiveTransferCount
+{
+public:
+  static const uint64_t WindowNs = 500000000;
+  static const unsigned CalmWindows = 10;
+
+  AdaptiveTransferCount();
+
+  /** Adapt between min_transfers and max_transfers, starting at initial. Equal bounds disable adaptation. */
+  void setBounds(size_t min_transfers, size_t max_transfers, size_t initial);
+  bool enabled() const { return min_ < max_; }
+  size_t maximum() const { return max_; }
+  size_t target() const { return target_; }
+
+  /** Start over with a baseline window, the parsers resynchronize when the streams start. */
+  void restart();
+
+  /** Count failed iso packets of the current transfer. */
+  void addErrors(uint64_t n) { errors_ += n; }
+
+  /**
+   * Account for a completed transfer.
+   * @param now_ns Completion time in nanoseconds.
+   * @param in_flight Transfers still submitted besides the completed one.
+   * @param failed True if the transfer completed with an error status.
+   * @param parser_loss Running total of data the parser lost.
+   * @return The target, possibly changed.
+   */
+  size_t onCompletion(uint64_t now_ns, size_t in_flight, bool failed, uint64_t parser_loss);
+
+private:
+  size_t min_;
+  size_t max_;
+  size_t target_;
+
+  bool baseline_;
+  uint64_t window_start_;
+  uint64_t errors_;
+  uint64_t parser_loss_;
+  size_t low_water_; ///< Fewest other transfers in flight at a completion in this window.
+  unsigned calm_;
+};
+
 class TransferPool
 {
 public:
-  TransferPool(libusb_device_handle *device_handle, unsigned char device_endpoint);
+  TransferPool(Transport *transport, unsigned char device_endpoint);
   virtual ~TransferPool();
 
   void deallocate();
@@ -53,24 +109,61 @@ public:
 
   bool enabled();
 
+  /** True if transfers have been allocated. */
+  bool allocated() const { return !transfers_.empty(); }
+
   bool submit();
 
+  /** Cancel all transfers and wait until libusb returned each of them. */
   void cancel();
 
+  /**
+   * No event thread completes transfers, the application calls Transport::handleEvents().
+   * cancel() then handles events itself while it waits, so it must not be called from a transfer callback.
+   */
+  void setExternalEvents(bool external);
+
   void setCallback(DataCallback *callback);
+
+  /** Count transfers and bytes in telemetry, which may be NULL. */
+  void setTelemetry(Telemetry *telemetry, Telemetry::Stream stream);
+
+  /**
+   * Let the number of submitted transfers follow AdaptiveTransferCount
+   * between min_transfers and max_transfers. Must be called before allocation;
+   * transfers beyond the allocated ones are allocated when first needed.
+   */
+  void setAdaptive(size_t min_transfers, size_t max_transfers);
+
+  /** Number of transfers the pool keeps submitted while streaming. */
+  size_t targetTransfers() const;
 protected:
   libfreenect2::mutex stopped_mutex;
+  libfreenect2::condition_variable stopped_condition; ///< Signaled when the last active transfer stops.
+  size_t active_transfers; ///< Transfers not stopped, guarded by #stopped_mutex.
+
   struct Transfer
   {
     libusb_transfer *transfer;
     TransferPool *pool;
+    unsigned char *buffer; ///< Slice of the pool's own memory.
     bool stopped;
-    Transfer(libusb_transfer *transfer, TransferPool *pool):
-      transfer(transfer), pool(pool), stopped(true) {}
+    Transfer(libusb_transfer *transfer, TransferPool *pool, unsigned char *buffer):
+      transfer(transfer), pool(pool), buffer(buffer), stopped(true) {}
     void setStopped(bool value)
     {
       libfreenect2::lock_guard guard(pool->stopped_mutex);
+      if (stopped == value)
+        return;
       stopped = value;
+      if (value)
+      {
+        // Notify under the lock: cancel() may destroy the pool as soon as it is released.
+        if (--pool->active_transfers == 0)
+          pool->stopped_condition.notify_all();
+      }
+      else
+        pool->active_transfers++;
     }
     bool getStopped()
     {
@@ -81,33 +174,69 @@ protected:
 
   void allocateTransfers(size_t num_transfers, size_t transfer_size);
 
+  /** Count failed iso packets of the transfer being processed. */
+  void countErrors(uint64_t n) { adaptive_.addErrors(n); }
+
   virtual libusb_transfer *allocateTransfer() = 0;
   virtual void fillTransfer(libusb_transfer *transfer) = 0;
 
   virtual void processTransfer(libusb_transfer *transfer) = 0;
 
+  /** Memory a completed transfer is resubmitted with, the pool's own slice by default. */
+  virtual unsigned char *nextTransferBuffer(Transfer *t) { return t->buffer; }
+
+  /** Number of submitted transfers that have not completed yet. */
+  size_t inFlight() const { return in_flight_; }
+
+  /** Add to a counter of the pool's stream, if telemetry is set. */
+  void count(Telemetry::Counter counter, uint64_t n = 1)
+  {
+    if(telemetry_)
+      telemetry_->add(stream_, counter, n);
+  }
+
   DataCallback *callback_;
 private:
   typedef std::vector<Transfer> TransferQueue;
 
-  libusb_device_handle *device_handle_;
+  Transport *transport_;
   unsigned char device_endpoint_;
 
-  TransferQueue transfers_;
-  unsigned char *buffer_;
-  size_t buffer_size_;
+  TransferQueue transfers_; ///< Capacity is reserved up front, Transfer addresses stay valid.
+  libfreenect2::mutex transfers_mutex_; ///< Guards growing #transfers_ while streaming.
+  Allocator *allocator_; ///< Backing store allocator, see createLargeBufferAllocator().
+  std::vector<Buffer *> buffers_; ///< One per allocation of transfers.
+  size_t transfer_size_;
+
+  size_t adaptive_min_;
+  size_t adaptive_max_;
+  AdaptiveTransferCount adaptive_;
 
   bool enable_submit_;
+  bool external_events_;
+  atomic<size_t> in_flight_;
+
+  Telemetry *telemetry_;
+  Telemetry::Stream stream_;
 
   static void onTransferCompleteStatic(libusb_transfer *transfer);
 
   void onTransferComplete(Transfer *transfer);
+
+  /** Allocate @p num_transfers more transfers, with a new slice of memory. */
+  void addTransfers(size_t num_transfers);
+
+  /** Submit stopped transfers, allocating new ones if needed, until @p target are active. */
+  void growTo(size_t target);
+
+  /** Parser-level loss of the pool's stream, from telemetry. */
+  uint64_t parserLoss() const;
 };
 
 class BulkTransferPool : public TransferPool
 {
 public:
-  BulkTransferPool(libusb_device_handle *device_handle, unsigned char device_endpoint);
+  BulkTransferPool(Transport *transport, unsigned char device_endpoint);
   virtual ~BulkTransferPool();
 
   void allocate(size_t num_transfers, size_t transfer_size);
@@ -116,12 +245,13 @@ protected:
   virtual libusb_transfer *allocateTransfer();
   virtual void fillTransfer(libusb_transfer *transfer);
   virtual void processTransfer(libusb_transfer *transfer);
+  virtual unsigned char *nextTransferBuffer(Transfer *t);
 };
 
 class IsoTransferPool : public TransferPool
 {
 public:
-  IsoTransferPool(libusb_device_handle *device_handle, unsigned char device_endpoint);
+  IsoTransferPool(Transport *transport, unsigned char device_endpoint);
   virtual ~IsoTransferPool();
 
   void allocate(size_t num_transfers, size_t num_packets, size_t packet_size);
@@ -134,6 +264,7 @@ protected:
 private:
   size_t num_packets_;
   size_t packet_size_;
+  std::vector<DataCallback::IsoPacket> received_;
 };
 
 } /* namespace usb */
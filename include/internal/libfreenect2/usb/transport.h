@@ -0,0 +1,117 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+
+/** @file transport.h USB operations of a device, over libusb or simulated. */
+
+#ifndef TRANSPORT_H_
+#define TRANSPORT_H_
+
+#include <stdint.h>
+#include <libusb.h>
+
+namespace libfreenect2
+{
+namespace usb
+{
+
+/**
+ * The USB operations a device uses: standard requests, synchronous bulk
+ * transfers for the command protocol and asynchronous transfers for the
+ * streams.
+ *
+ * The methods mirror the libusb calls of the same name and return libusb
+ * error codes, so UsbControl, CommandTransaction and TransferPool report
+ * failures the same way for every transport. Asynchronous transfers are
+ * allocated with libusb_alloc_transfer() and complete through their
+ * callback, like libusb transfers.
+ */
+class Transport
+{
+public:
+  virtual ~Transport() {}
+
+  virtual int getConfiguration(int *configuration) = 0;
+  virtual int setConfiguration(int configuration) = 0;
+  virtual int claimInterface(int interface_number) = 0;
+  virtual int releaseInterface(int interface_number) = 0;
+  virtual int setInterfaceAltSetting(int interface_number, int alternate_setting) = 0;
+
+  /** @return Number of bytes transferred, or a libusb error code. */
+  virtual int controlTransfer(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+                              unsigned char *data, uint16_t length, unsigned int timeout) = 0;
+
+  /** @return wBytesPerInterval of an isochronous endpoint, or a libusb error code. */
+  virtual int getMaxIsoPacketSize(int configuration, int alternate_setting, unsigned char endpoint) = 0;
+
+  virtual int bulkTransfer(unsigned char endpoint, unsigned char *data, int length, int *transferred, unsigned int timeout) = 0;
+
+  virtual int submitTransfer(libusb_transfer *transfer) = 0;
+  virtual int cancelTransfer(libusb_transfer *transfer) = 0;
+
+  /**
+   * Complete transfers in the calling thread, waiting at most @p timeout_ms for
+   * events. Needed when no event thread runs, see Freenect2(usb_context, false).
+   */
+  virtual int handleEvents(int timeout_ms) = 0;
+
+  /** Handle to set as libusb_transfer::dev_handle, NULL if the transport is not libusb. */
+  virtual libusb_device_handle *handle() = 0;
+
+  /** Close the device. Later operations fail with LIBUSB_ERROR_NO_DEVICE. */
+  virtual void close() = 0;
+};
+
+/** Transport of a device opened with libusb. */
+class LibUsbTransport : public Transport
+{
+public:
+  /** Takes ownership of @p handle, which was opened in @p context. */
+  LibUsbTransport(libusb_device_handle *handle, libusb_context *context);
+  virtual ~LibUsbTransport();
+
+  virtual int getConfiguration(int *configuration);
+  virtual int setConfiguration(int configuration);
+  virtual int claimInterface(int interface_number);
+  virtual int releaseInterface(int interface_number);
+  virtual int setInterfaceAltSetting(int interface_number, int alternate_setting);
+  virtual int controlTransfer(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+                              unsigned char *data, uint16_t length, unsigned int timeout);
+  virtual int getMaxIsoPacketSize(int configuration, int alternate_setting, unsigned char endpoint);
+  virtual int bulkTransfer(unsigned char endpoint, unsigned char *data, int length, int *transferred, unsigned int timeout);
+  virtual int submitTransfer(libusb_transfer *transfer);
+  virtual int cancelTransfer(libusb_transfer *transfer);
+  virtual int handleEvents(int timeout_ms);
+  virtual libusb_device_handle *handle();
+  virtual void close();
+private:
+  libusb_device_handle *handle_;
+  libusb_context *context_;
+};
+
+} /* namespace usb */
+} /* namespace libfreenect2 */
+#endif /* TRANSPORT_H_ */
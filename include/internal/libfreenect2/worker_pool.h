@@ -0,0 +1,90 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+
+
+/** @file worker_pool.h Threads shared by the packet processors of several devices. */
+
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <libfreenect2/threading.h>
+
+#include <deque>
+#include <vector>
+
+namespace libfreenect2
+{
+
+/**
+ * Fixed set of threads running posted tasks in FIFO order.
+ *
+ * A task is run once per post() by whichever thread is free. Tasks are not
+ * owned by the pool and must stay valid until they have run.
+ */
+class WorkerPool
+{
+public:
+  /** Unit of work posted to the pool. */
+  class Task
+  {
+  public:
+    virtual ~Task() {}
+    virtual void run() = 0;
+  };
+
+  /**
+   * Start the threads.
+   * @param threads Number of threads, 0 for defaultSize().
+   */
+  explicit WorkerPool(size_t threads = 0);
+
+  /** Stop the threads. Tasks still queued are not run. */
+  ~WorkerPool();
+
+  void post(Task *task);
+
+  size_t size() const;
+
+  /** One thread per CPU of the Worker thread policy, or per hardware thread if it pins none. */
+  static size_t defaultSize();
+private:
+  std::deque<Task *> tasks_;
+  bool shutdown_;
+  libfreenect2::mutex mutex_;
+  libfreenect2::condition_variable condition_;
+  std::vector<libfreenect2::thread *> threads_;
+
+  static void static_execute(void *data);
+  void execute();
+
+  /* Disable copy and assignment constructors */
+  WorkerPool(const WorkerPool&);
+  WorkerPool& operator=(const WorkerPool&);
+};
+
+} /* namespace libfreenect2 */
+#endif /* WORKER_POOL_H_ */
@@ -40,6 +40,19 @@ namespace libfreenect2
  * Receive decoded image frames, and the frame format.
  */
 
+/** Host times of a frame's way through the library.
+ * In nanoseconds of the host monotonic clock (std::chrono::steady_clock), 0 if not recorded.
+ */
+struct FrameTiming
+{
+  uint64_t usb_first;     ///< First USB byte of the frame received.
+  uint64_t usb_last;      ///< Last USB byte received, the packet is complete.
+  uint64_t process_start; ///< Decoding started.
+  uint64_t process_end;   ///< Decoding finished.
+  uint64_t delivered;     ///< Frame handed to the FrameListener.
+  uint64_t device_time;   ///< Frame::timestamp mapped to the host clock, 0 until enough frames were seen to estimate the mapping.
+};
+
 /** Frame format and metadata. @ingroup frame */
 class LIBFREENECT2_API Frame
 {
@@ -63,6 +76,13 @@ class LIBFREENECT2_API Frame
     Gray = 6, ///< 1 byte of gray per pixel
   };
 
+  /** Bits of #status. */
+  enum Status
+  {
+    Error = 1,   ///< Processing failed, the data is not usable.
+    Degraded = 2 ///< Decoded from an incomplete depth packet; pixels that could not be recovered are invalid.
+  };
+
   size_t width;           ///< Length of a line (in pixels).
   size_t height;          ///< Number of lines in the frame.
   size_t bytes_per_pixel; ///< Number of bytes in a pixel. If frame format is 'Raw' this is the buffer size.
@@ -72,8 +92,9 @@ class LIBFREENECT2_API Frame
   float exposure;         ///< From 0.5 (very bright) to ~60.0 (fully covered)
   float gain;             ///< From 1.0 (bright) to 1.5 (covered)
   float gamma;            ///< From 1.0 (bright) to 6.4 (covered)
-  uint32_t status;        ///< zero if ok; non-zero for errors.
+  uint32_t status;        ///< zero if ok; otherwise bits of #Status.
   Format format;          ///< Byte format. Informative only, doesn't indicate errors.
+  FrameTiming timing;     ///< Host timestamps for latency measurement.
 
   /** Construct a new frame.
    * @param width Width in pixel
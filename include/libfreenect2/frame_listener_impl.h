@@ -30,6 +30,7 @@
 #define FRAME_LISTENER_IMPL_H_
 
 #include <map>
+#include <vector>
 
 #include <libfreenect2/config.h>
 #include <libfreenect2/frame_listener.hpp>
@@ -81,6 +82,73 @@ private:
   SyncMultiFrameListener& operator=(const SyncMultiFrameListener&);
 };
 
+/** Clock of one device relative to the host monotonic clock (std::chrono::steady_clock). */
+struct DeviceClockEstimate
+{
+  bool valid;        ///< False until enough frames were seen.
+  int64_t offset_ns; ///< Host time minus device time (Frame::timestamp in ns) at the latest frame.
+  double drift_ppm;  ///< How much faster the device clock runs than the host clock, in parts per million.
+};
+
+/** Frames of several devices captured at about the same time. */
+struct FrameSet
+{
+  std::vector<FrameMap> frames; ///< One map per device, in the order of SyncMultiDeviceListener::getListener().
+  uint64_t capture_time;        ///< Mean host capture time of the frames in nanoseconds.
+};
+
+class SyncMultiDeviceListenerImpl;
+
+/**
+ * Collect frames of several devices into sets captured within a tolerance.
+ *
+ * Each device reports capture times in its own clock (Frame::timestamp). The
+ * listener estimates offset and drift of every device clock against the host
+ * monotonic clock online, from the arrival times of the frames, and matches
+ * frames by their capture time on the host clock. Frames that find no partner
+ * within the tolerance are dropped.
+ *
+ * Set getListener(i) as the color and IR/depth listener of device i.
+ */
+class LIBFREENECT2_API SyncMultiDeviceListener
+{
+public:
+  /**
+   * @param devices Number of devices.
+   * @param frame_types Frame types collected from every device, e.g. `Frame::Color | Frame::Depth`.
+   * @param tolerance_ms Maximum spread of the capture times in a set. The default, half a frame at 30 Hz, always pairs free-running devices.
+   */
+  SyncMultiDeviceListener(size_t devices, unsigned int frame_types, double tolerance_ms = 16.6);
+  virtual ~SyncMultiDeviceListener();
+
+  /** Listener receiving the frames of device @p device. */
+  FrameListener *getListener(size_t device);
+
+  /** Test if there is a new frame set. Non-blocking. */
+  bool hasNewFrameSet() const;
+
+  /** Wait milliseconds for a new frame set.
+   * @param[out] set Caller is responsible to release the frames in `set`.
+   * @return true if a frame set is received; false if not.
+   */
+  bool waitForNewFrameSet(FrameSet &set, int milliseconds);
+
+  /** Shortcut to delete all frames in `set`. */
+  void release(FrameSet &set);
+
+  /** Current clock estimate of device @p device. */
+  DeviceClockEstimate getClock(size_t device) const;
+
+  /** Frames dropped so far because they found no partner or a newer set replaced theirs. */
+  uint64_t getDroppedFrames() const;
+private:
+  SyncMultiDeviceListenerImpl *impl_;
+
+  /* Disable copy and assignment constructors */
+  SyncMultiDeviceListener(const SyncMultiDeviceListener&);
+  SyncMultiDeviceListener& operator=(const SyncMultiDeviceListener&);
+};
+
 ///@}
 } /* namespace libfreenect2 */
 #endif /* FRAME_LISTENER_IMPL_H_ */
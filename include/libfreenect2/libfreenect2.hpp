@@ -34,6 +34,7 @@
 #include <libfreenect2/packet_pipeline.h>
 #include <libfreenect2/color_settings.h>
 #include <libfreenect2/led_settings.h>
+#include <libfreenect2/telemetry.h>
 #include <string>
 #include <vector>
 
@@ -235,10 +236,30 @@ public:
    * @return true if ok, false if error.
    */
   virtual bool close() = 0;
+
+  // New virtuals go last so the vtable layout of existing binaries is kept.
+
+  /** Counters and latency histograms of the device's USB transfers and pipeline.
+   * Valid as long as the device object exists; NULL if the device does not collect them.
+   * @see Telemetry
+   */
+  virtual Telemetry *getTelemetry();
 };
 
 class Freenect2Impl;
 
+/** File descriptor to watch for USB events, see Freenect2::getPollFds(). */
+struct UsbPollFd
+{
+  int fd;       ///< File descriptor.
+  short events; ///< poll() events to watch for, e.g. POLLIN or POLLOUT.
+};
+
+/** Called when libusb starts watching a file descriptor. */
+typedef void (*UsbPollFdAdded)(int fd, short events, void *user_data);
+/** Called when libusb stops watching a file descriptor. */
+typedef void (*UsbPollFdRemoved)(int fd, void *user_data);
+
 /**
  * Library context to find and open devices.
  *
@@ -259,6 +280,15 @@ public:
    * Freenect2 will use it instead of creating one.
    */
   Freenect2(void *usb_context = 0);
+
+  /**
+   * @param usb_context If the libusb context is provided,
+   * Freenect2 will use it instead of creating one.
+   * @param event_thread Handle USB events on an internal thread. If false, the
+   * application must call handleEvents() when a descriptor from getPollFds()
+   * becomes ready or getNextTimeout() expires, or streams stall.
+   */
+  Freenect2(void *usb_context, bool event_thread);
   virtual ~Freenect2();
 
   /** Must be called before doing anything else.
@@ -313,6 +343,33 @@ public:
    * @return New device object, or NULL on failure
    */
   Freenect2Device *openDefaultDevice(const PacketPipeline *factory);
+
+  /** @name External event loop
+   * Drive USB completions from an application's own poll/epoll loop, after
+   * constructing with `event_thread = false`. Device::stop() handles events
+   * itself until its cancelled transfers have returned, so it works without
+   * the loop running but must not be called from a transfer callback.
+   */
+  ///@{
+  /** Descriptors the USB context currently waits on; empty where libusb does not support it (Windows). */
+  std::vector<UsbPollFd> getPollFds();
+
+  /** Be told when descriptors are added or removed, e.g. to update an epoll set. Pass NULLs to stop. */
+  void setPollFdNotifiers(UsbPollFdAdded added, UsbPollFdRemoved removed, void *user_data);
+
+  /** Milliseconds until handleEvents() must be called for libusb's timeouts even without descriptor activity,
+   * or -1 if there are none or the descriptors cover them (Linux timerfd).
+   */
+  int getNextTimeout();
+
+  /** Process pending USB events, completing transfers and running the stream parsers in the calling thread.
+   * Transfers of simulated devices are completed too, without waiting for them.
+   * Other threads may open and close devices meanwhile.
+   * @param timeout_ms Time to wait for events, 0 to return immediately.
+   * @return true if ok, false on a libusb error.
+   */
+  bool handleEvents(int timeout_ms = 0);
+  ///@}
 private:
   Freenect2Impl *impl_;
 
@@ -365,6 +422,92 @@ private:
   Freenect2Replay& operator=(const Freenect2Replay&);
 };
 
+/** Throughput and loss of one device since the previous Freenect2DeviceManager::getThroughput(). */
+struct DeviceThroughput
+{
+  std::string serial;
+  double seconds;      ///< Length of the interval.
+  double color_fps;    ///< Color frames decoded per second.
+  double depth_fps;    ///< Depth frames decoded per second.
+  double usb_mbps;     ///< USB payload of both streams in megabytes per second.
+  uint64_t color_lost; ///< Color frames lost or skipped as stale.
+  uint64_t depth_lost; ///< Depth frames lost or skipped as stale.
+  double color_loss;   ///< Fraction of color frames lost, 0 if none arrived.
+  double depth_loss;   ///< Fraction of depth frames lost, 0 if none arrived.
+};
+
+class Freenect2DeviceManagerImpl;
+
+/**
+ * Library context for capturing from several devices at once.
+ *
+ * All devices share one libusb context and USB event thread. Their color and
+ * depth decoding runs on a common pool of worker threads sized to the host,
+ * instead of two threads per device, so the thread count stays flat as
+ * sensors are added. Processors bound to one thread (OpenGL) keep their own.
+ *
+ * Devices opened here are owned by the manager: they are closed and deleted
+ * by closeDevice() or when the manager is destroyed.
+ */
+class LIBFREENECT2_API Freenect2DeviceManager
+{
+public:
+  /**
+   * @param workers Number of processing threads, 0 for one per CPU
+   * (or per CPU of the Worker ThreadPolicy if it pins any).
+   * @param usb_context If the libusb context is provided, it is used instead of creating one.
+   */
+  Freenect2DeviceManager(size_t workers = 0, void *usb_context = 0);
+  virtual ~Freenect2DeviceManager();
+
+  /** @copydoc Freenect2::enumerateDevices() */
+  int enumerateDevices();
+
+  /** @copydoc Freenect2::getDeviceSerialNumber() */
+  std::string getDeviceSerialNumber(int idx);
+
+  /** Open device by serial number with default pipeline.
+   * @return New device object, or NULL on failure
+   */
+  Freenect2Device *openDevice(const std::string &serial);
+
+  /** Open device by serial number.
+   * @param serial Serial number
+   * @param factory New PacketPipeline instance. This is always automatically freed.
+   * @return New device object, or NULL on failure
+   */
+  Freenect2Device *openDevice(const std::string &serial, const PacketPipeline *factory);
+
+  /** Enumerate and open every device not opened yet, with default pipelines.
+   * @return Number of devices opened by this call.
+   */
+  size_t openAllDevices();
+
+  /** Close and delete a device opened by this manager. */
+  void closeDevice(Freenect2Device *device);
+
+  /** Devices opened by this manager, in the order they were opened. */
+  std::vector<Freenect2Device *> getDevices();
+
+  /** Start all streams of every device. @return true if all devices started. */
+  bool startAll();
+
+  /** Stop every device. @return true if all devices stopped. */
+  bool stopAll();
+
+  /** Number of threads decoding packets. */
+  size_t getWorkerCount() const;
+
+  /** Per-device rates since the previous call, or since the device was opened. */
+  std::vector<DeviceThroughput> getThroughput();
+private:
+  Freenect2DeviceManagerImpl *impl_;
+
+  /* Disable copy and assignment constructors */
+  Freenect2DeviceManager(const Freenect2DeviceManager&);
+  Freenect2DeviceManager& operator=(const Freenect2DeviceManager&);
+};
+
 ///@}
 } /* namespace libfreenect2 */
 #endif /* LIBFREENECT2_HPP_ */
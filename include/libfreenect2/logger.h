@@ -82,9 +82,22 @@ LIBFREENECT2_API Logger *createConsoleLogger(Logger::Level level);
  *
  * %libfreenect2 will have an initial global logger created with createConsoleLoggerWithDefaultLevel().
  * You do not have to explicitly call this if the default is already what you want.
+ * If the environment variable `LIBFREENECT2_LOGGER_ASYNC` is set to 1, the initial
+ * global logger is wrapped with createAsyncLogger().
  */
 LIBFREENECT2_API Logger *createConsoleLoggerWithDefaultLevel();
 
+/** Allocate a Logger that queues messages and passes them on to @p logger from a background thread.
+ *
+ * Each thread queues into its own fixed-size ring, so logging never blocks the
+ * USB or processing threads. When a ring is full, messages are dropped and the
+ * number of dropped messages is logged later. A message repeated by the same
+ * thread within a second is suppressed and counted. Messages of different
+ * threads may be passed on out of order.
+ * @param logger Logger receiving the messages. It is freed with the returned logger.
+ */
+LIBFREENECT2_API Logger *createAsyncLogger(Logger *logger);
+
 /** Get the pointer to the current logger.
  * @return Pointer to the logger. This is purely informational. You should not free the pointer.
  */
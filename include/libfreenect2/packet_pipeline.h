@@ -40,6 +40,8 @@ class DataCallback;
 class RgbPacketProcessor;
 class DepthPacketProcessor;
 class PacketPipelineComponents;
+class Telemetry;
+class WorkerPool;
 
 /** @defgroup pipeline Packet Pipelines
  * Implement various methods to decode color and depth images with different performance and platform support
@@ -50,6 +52,10 @@ class PacketPipelineComponents;
 
 /** Base class for other pipeline classes.
  * Methods in this class are reserved for internal use.
+ *
+ * The color and the depth half (parser, processor and processing thread) are
+ * each constructed when first used, so a device that streams only one of them
+ * never pays for the other.
  */
 class LIBFREENECT2_API PacketPipeline
 {
@@ -64,7 +70,23 @@ public:
 
   virtual RgbPacketProcessor *getRgbPacketProcessor() const;
   virtual DepthPacketProcessor *getDepthPacketProcessor() const;
+
+  /** Whether the color or depth half has been constructed, without constructing it. */
+  bool hasRgbPacketProcessor() const;
+  bool hasDepthPacketProcessor() const;
+
+  virtual Telemetry *getTelemetry() const;
+
+  /** Process packets on @p pool instead of one thread per stream, where the processor allows it. */
+  virtual void setWorkerPool(WorkerPool *pool) const;
+
+  /** Block until packets queued for processing have been decoded and delivered. */
+  virtual void waitForIdle() const;
 protected:
+  /** Create the processor of a half on its first use, NULL if the pipeline has none. */
+  virtual RgbPacketProcessor *createRgbPacketProcessor() const;
+  virtual DepthPacketProcessor *createDepthPacketProcessor() const;
+
   PacketPipelineComponents *comp_;
 };
 
@@ -80,6 +102,9 @@ protected:
    const float* getDepthXTable(size_t* length);
    const float* getDepthZTable(size_t* length);
    const short* getDepthLookupTable(size_t* length);
+ protected:
+   virtual RgbPacketProcessor *createRgbPacketProcessor() const;
+   virtual DepthPacketProcessor *createDepthPacketProcessor() const;
  };
 
 /** Pipeline with CPU depth processing. */
@@ -88,6 +113,8 @@ class LIBFREENECT2_API CpuPacketPipeline : public PacketPipeline
 public:
   CpuPacketPipeline();
   virtual ~CpuPacketPipeline();
+protected:
+  virtual DepthPacketProcessor *createDepthPacketProcessor() const;
 };
 
 #ifdef LIBFREENECT2_WITH_OPENGL_SUPPORT
@@ -100,6 +127,8 @@ protected:
 public:
   OpenGLPacketPipeline(void *parent_opengl_context = 0, bool debug = false);
   virtual ~OpenGLPacketPipeline();
+protected:
+  virtual DepthPacketProcessor *createDepthPacketProcessor() const;
 };
 #endif // LIBFREENECT2_WITH_OPENGL_SUPPORT
 
@@ -112,6 +141,8 @@ protected:
 public:
   OpenCLPacketPipeline(const int deviceId = -1);
   virtual ~OpenCLPacketPipeline();
+protected:
+  virtual DepthPacketProcessor *createDepthPacketProcessor() const;
 };
 
 /*
@@ -127,6 +158,8 @@ protected:
 public:
   OpenCLKdePacketPipeline(const int deviceId = -1);
   virtual ~OpenCLKdePacketPipeline();
+protected:
+  virtual DepthPacketProcessor *createDepthPacketProcessor() const;
 };
 #endif // LIBFREENECT2_WITH_OPENCL_SUPPORT
 
@@ -182,6 +215,8 @@ public:
    */
   MetalPacketPipeline(const int deviceId = -1);
   virtual ~MetalPacketPipeline();
+protected:
+  virtual DepthPacketProcessor *createDepthPacketProcessor() const;
 };
 #endif
 
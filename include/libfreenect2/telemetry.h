@@ -0,0 +1,136 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file telemetry.h Pipeline counters and latency histograms. */
+
+#ifndef LIBFREENECT2_TELEMETRY_H_
+#define LIBFREENECT2_TELEMETRY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include <libfreenect2/config.h>
+
+namespace libfreenect2
+{
+
+class TelemetryImpl;
+
+/** @defgroup telemetry Telemetry
+ * Counters of a device's USB transfers, stream parsers and processors. */
+///@{
+
+/** Lock-free counters and latency histograms of one device.
+ *
+ * Every stage of the pipeline updates the counters with relaxed atomic
+ * operations, so reading them from another thread at any time is safe and
+ * never blocks the streams. A snapshot taken while streaming is not atomic
+ * across counters.
+ */
+class LIBFREENECT2_API Telemetry
+{
+public:
+  /** Streams of a device. */
+  enum Stream
+  {
+    Color = 0,
+    Depth = 1,
+    StreamCount = 2
+  };
+
+  /** Monotonic counters, kept per stream. */
+  enum Counter
+  {
+    TransfersCompleted = 0, ///< USB transfers that completed successfully.
+    TransfersFailed,        ///< USB transfers that completed with an error status.
+    BadIsoPackets,          ///< Iso packets with an error status (depth only).
+    BytesReceived,          ///< Payload bytes received over USB.
+    Resyncs,                ///< Times the parser discarded partial data to find the next boundary.
+    FramesCompleted,        ///< Packets assembled by the parser.
+    FramesSalvaged,         ///< Incomplete packets completed from the previous one.
+    FramesLost,             ///< Gaps in the sequence numbers of packets passed on, for any reason.
+    DroppedIncomplete,      ///< Packets dropped by the parser because parts were lost.
+    DroppedInvalid,         ///< Packets dropped by the parser because they were malformed.
+    DroppedBusy,            ///< Packets dropped because the processor queue was full.
+    DroppedStale,           ///< Queued packets skipped because they were too old.
+    FramesProcessed,        ///< Packets decoded by the processor.
+    CounterCount
+  };
+
+  /** Latency histograms, kept per stream. */
+  enum Histogram
+  {
+    QueueLatency = 0,  ///< From packet arrival to the start of processing.
+    ProcessLatency,    ///< Duration of processing.
+    FirstFrameLatency, ///< From markStart() to the first processed frame, once per start.
+    HistogramCount
+  };
+
+  /** Bucket i counts latencies up to 2^i microseconds, the last one everything above. */
+  static const size_t HistogramBuckets = 24;
+
+  Telemetry();
+  ~Telemetry();
+
+  void add(Stream stream, Counter counter, uint64_t n = 1);
+
+  /** Record a latency in nanoseconds. */
+  void record(Stream stream, Histogram histogram, uint64_t ns);
+
+  /** The stream starts now, the next FramesProcessed records FirstFrameLatency. */
+  void markStart(Stream stream);
+
+  uint64_t get(Stream stream, Counter counter) const;
+  uint64_t getBucket(Stream stream, Histogram histogram, size_t bucket) const;
+  uint64_t getCount(Stream stream, Histogram histogram) const;
+  uint64_t getSum(Stream stream, Histogram histogram) const; ///< Sum of recorded latencies in nanoseconds.
+
+  /** Set all counters and histograms to zero. */
+  void reset();
+
+  /** All counters and histograms as a JSON object keyed by stream name. */
+  std::string toJson() const;
+
+  /** All counters and histograms in the Prometheus text exposition format.
+   * @param labels Extra labels added to every sample, e.g. `serial="012345"`.
+   */
+  std::string toPrometheus(const std::string &labels = std::string()) const;
+
+  static const char *stream2str(Stream stream);
+  static const char *counter2str(Counter counter);
+  static const char *histogram2str(Histogram histogram);
+private:
+  TelemetryImpl *impl_;
+
+  /* Disable copy and assignment constructors */
+  Telemetry(const Telemetry&);
+  Telemetry& operator=(const Telemetry&);
+};
+
+///@}
+} /* namespace libfreenect2 */
+#endif /* LIBFREENECT2_TELEMETRY_H_ */
@@ -0,0 +1,106 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file thread_policy.h Scheduling and CPU affinity of library threads. */
+
+#ifndef LIBFREENECT2_THREAD_POLICY_H_
+#define LIBFREENECT2_THREAD_POLICY_H_
+
+#include <string>
+#include <vector>
+
+#include <libfreenect2/config.h>
+
+namespace libfreenect2
+{
+
+/** @defgroup threading Thread policies
+ * Pin library threads to CPUs and raise their scheduling priority. */
+///@{
+
+/** Scheduling and CPU affinity for one role of library thread.
+ *
+ * A policy is applied by the thread itself when it starts, so it must be set
+ * before the device is opened (USB event loop), the pipeline is created
+ * (processor threads) or the replay is started.
+ *
+ * The initial policy of each role is read from the environment variable
+ * `LIBFREENECT2_THREAD_<ROLE>`, where `<ROLE>` is `USB`, `RGB`, `DEPTH`,
+ * `REPLAY` or `WORKER`. The value is a list of `key=value` separated by `;`:
+ * - `cpus=0,2-3` pins the thread to CPUs 0, 2 and 3.
+ * - `fifo=50` uses SCHED_FIFO with priority 50 (needs CAP_SYS_NICE or root).
+ * - `nice=-5` sets the nice level of the thread (Linux only).
+ * - `exclusive=1` keeps threads of other roles without `cpus` off these CPUs.
+ *
+ * Failures to apply a policy are logged as warnings and otherwise ignored.
+ */
+class LIBFREENECT2_API ThreadPolicy
+{
+public:
+  /** Threads created by the library. */
+  enum Role
+  {
+    UsbEventLoop = 0,   ///< libusb event handling, receives all USB transfers.
+    RgbProcessor = 1,   ///< Asynchronous color decoding.
+    DepthProcessor = 2, ///< Asynchronous depth decoding.
+    Replay = 3,         ///< Freenect2ReplayDevice reader.
+    Worker = 4,         ///< Helper threads of worker pools.
+    RoleCount = 5
+  };
+
+  /** Scheduling class. */
+  enum Scheduling
+  {
+    Default, ///< Leave the scheduling unchanged.
+    Nice,    ///< Normal scheduling with nice level #priority.
+    Fifo     ///< Real-time SCHED_FIFO with priority #priority.
+  };
+
+  ThreadPolicy();
+
+  std::vector<int> cpus; ///< CPUs the thread may run on, empty for no pinning.
+  bool exclusive;        ///< Keep threads of other unpinned roles off #cpus.
+  Scheduling scheduling;
+  int priority;          ///< Nice level or SCHED_FIFO priority, see #scheduling.
+
+  /** Parse a policy string as described above. Return false on syntax errors. */
+  static bool parse(const std::string &str, ThreadPolicy &policy);
+
+  /** Name of a role as used in the environment variable. */
+  static std::string role2str(Role role);
+};
+
+/** Get the policy of a role. */
+LIBFREENECT2_API ThreadPolicy getThreadPolicy(ThreadPolicy::Role role);
+
+/** Set the policy of a role, overriding the environment.
+ * Threads that are already running are not affected.
+ */
+LIBFREENECT2_API void setThreadPolicy(ThreadPolicy::Role role, const ThreadPolicy &policy);
+
+///@}
+} /* namespace libfreenect2 */
+#endif /* LIBFREENECT2_THREAD_POLICY_H_ */
@@ -0,0 +1,69 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file tracing.h Recording of per-stage spans of the pipeline. */
+
+#ifndef LIBFREENECT2_TRACING_H_
+#define LIBFREENECT2_TRACING_H_
+
+#include <string>
+
+#include <libfreenect2/config.h>
+
+namespace libfreenect2
+{
+
+/** @defgroup tracing Tracing
+ * Record how long each pipeline stage takes per frame.
+ *
+ * When enabled, the library records a span for USB transfer handling, packet
+ * assembly, queue wait, processing stages, JPEG decoding, listener handoff and
+ * registration, keyed by frame sequence number. Spans go to a fixed-size ring
+ * per thread, so recording never blocks and old spans are overwritten.
+ *
+ * Setting the environment variable `LIBFREENECT2_TRACE=<file.json>` enables
+ * tracing at startup and writes the trace when the process exits.
+ */
+///@{
+
+/** Start or stop recording spans. */
+LIBFREENECT2_API void setTracing(bool enable);
+
+/** True if spans are being recorded. */
+LIBFREENECT2_API bool isTracing();
+
+/** Write the recorded spans as Chrome trace-event JSON (chrome://tracing, Perfetto).
+ * Spans recorded while writing may be torn; stop the device or tracing first for an exact trace.
+ * @return false if the file could not be written.
+ */
+LIBFREENECT2_API bool writeTrace(const std::string &filename);
+
+/** Discard the recorded spans. */
+LIBFREENECT2_API void clearTrace();
+
+///@}
+} /* namespace libfreenect2 */
+#endif /* LIBFREENECT2_TRACING_H_ */
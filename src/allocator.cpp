@@ -29,94 +29,382 @@
 #include "libfreenect2/allocator.h"
 #include "libfreenect2/threading.h"
 
+#include <cstdlib>
+#include <stdint.h>
+#include <string>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#if defined(__APPLE__)
+#include <mach/vm_statistics.h>
+#endif
+
 namespace libfreenect2
 {
-class NewAllocator: public Allocator
+Buffer *NewAllocator::allocate(size_t size)
+{
+  Buffer *b = new Buffer;
+  b->data = new unsigned char[size];
+  b->length = 0;
+  b->capacity = size;
+  b->allocator = this;
+  return b;
+}
+
+void NewAllocator::free(Buffer *b)
+{
+  if (b == NULL)
+    return;
+  delete[] b->data;
+  delete b;
+}
+
+/** Buffer of HugePageAllocator, remembers how its memory was obtained. */
+class HugePageBuffer: public Buffer
 {
 public:
-  virtual Buffer *allocate(size_t size)
+  size_t mapped_size;     ///< Size of the mapping, 0 if data comes from new[].
+  unsigned char *rawdata; ///< Unaligned start of the new[] fallback, which data points into.
+};
+
+HugePageAllocator::HugePageAllocator(int numa_node):
+  numa_node_(numa_node)
+{
+}
+
+#if defined(__linux__) || defined(__APPLE__)
+static void *mapLargeBuffer(size_t size, size_t &mapped_size, int numa_node)
+{
+  const size_t huge_page_size = 2 * 1024 * 1024;
+  mapped_size = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+  void *p = MAP_FAILED;
+
+#if defined(__linux__)
+  p = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (p == MAP_FAILED)
   {
-    Buffer *b = new Buffer;
-    b->data = new unsigned char[size];
-    b->length = 0;
-    b->capacity = size;
-    b->allocator = this;
-    return b;
+    p = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+    if (p != MAP_FAILED)
+      madvise(p, mapped_size, MADV_HUGEPAGE);
+#endif
   }
 
-  virtual void free(Buffer *b)
+#ifdef SYS_mbind
+  if (p != MAP_FAILED && numa_node >= 0)
   {
-    if (b == NULL)
-      return;
-    delete[] b->data;
-    delete b;
+    const int mpol_preferred = 1;
+    const unsigned long bits = 8 * sizeof(unsigned long);
+    if (static_cast<unsigned long>(numa_node) < bits)
+    {
+      unsigned long nodemask = 1UL << numa_node;
+      syscall(SYS_mbind, p, mapped_size, mpol_preferred, &nodemask, bits, 0);
+    }
   }
-};
+#endif
+#elif defined(__APPLE__)
+  (void)numa_node;
+#ifdef VM_FLAGS_SUPERPAGE_SIZE_ANY
+  p = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, VM_FLAGS_SUPERPAGE_SIZE_ANY, 0);
+#endif
+  if (p == MAP_FAILED)
+    p = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+#endif
+
+  return p == MAP_FAILED ? NULL : p;
+}
+#endif
+
+Buffer *HugePageAllocator::allocate(size_t size)
+{
+  HugePageBuffer *b = new HugePageBuffer;
+  b->data = NULL;
+  b->mapped_size = 0;
+  b->rawdata = NULL;
+#if defined(__linux__) || defined(__APPLE__)
+  size_t mapped_size = 0;
+  void *p = mapLargeBuffer(size, mapped_size, numa_node_);
+  if (p != NULL)
+  {
+    b->data = static_cast<unsigned char *>(p);
+    b->mapped_size = mapped_size;
+  }
+#endif
+  if (b->data == NULL)
+  {
+    // Aligned like Frame::data, since BufferFrame hands it out as frame data.
+    const size_t alignment = 64;
+    b->rawdata = new unsigned char[size + alignment];
+    uintptr_t ptr = reinterpret_cast<uintptr_t>(b->rawdata);
+    uintptr_t aligned = (ptr - 1u + alignment) & -alignment;
+    b->data = reinterpret_cast<unsigned char *>(aligned);
+  }
+  b->length = 0;
+  b->capacity = size;
+  b->allocator = this;
+  return b;
+}
+
+void HugePageAllocator::free(Buffer *b)
+{
+  if (b == NULL)
+    return;
+  HugePageBuffer *hb = static_cast<HugePageBuffer *>(b);
+#if defined(__linux__) || defined(__APPLE__)
+  if (hb->mapped_size > 0)
+    munmap(hb->data, hb->mapped_size);
+  else
+#endif
+    delete[] hb->rawdata;
+  delete hb;
+}
+
+static bool useHugePages(int &numa_node)
+{
+  const char *env = std::getenv("LIBFREENECT2_HUGEPAGES");
+  if (env == NULL || std::string(env) == "" || std::string(env) == "0")
+    return false;
+
+  const char *node = std::getenv("LIBFREENECT2_NUMA_NODE");
+  if (node != NULL && *node != '\0')
+    numa_node = std::atoi(node);
+  return true;
+}
+
+Allocator *createLargeBufferAllocator()
+{
+  int numa_node = -1;
+  if (useHugePages(numa_node))
+    return new HugePageAllocator(numa_node);
+  return new NewAllocator;
+}
+
+BufferFrame::BufferFrame(size_t width, size_t height, size_t bytes_per_pixel, Allocator *allocator):
+  Frame(width, height, bytes_per_pixel, (unsigned char*)-1),
+  buffer_(allocator->allocate(width * height * bytes_per_pixel))
+{
+  data = buffer_->data;
+}
+
+BufferFrame::~BufferFrame()
+{
+  buffer_->allocator->free(buffer_);
+  data = NULL;
+}
+
+Frame *newLargeFrame(size_t width, size_t height, size_t bytes_per_pixel)
+{
+  static int numa_node = -1;
+  static const bool enabled = useHugePages(numa_node);
+  if (!enabled)
+    return new Frame(width, height, bytes_per_pixel);
+
+  // Stateless apart from the node; lives as long as any frame may.
+  static HugePageAllocator *frame_allocator = new HugePageAllocator(numa_node);
+  return new BufferFrame(width, height, bytes_per_pixel, frame_allocator);
+}
 
 class PoolAllocatorImpl: public Allocator
 {
 private:
   Allocator *allocator;
-  Buffer *buffers[2];
-  bool used[2];
+  atomic<size_t> depth;
+  atomic<Buffer *> buffers[PoolAllocator::MaxDepth];
+  atomic<uint64_t> used; ///< Bit i is set while buffers[i] is handed out.
+  atomic<uint32_t> references[PoolAllocator::MaxDepth]; ///< free() calls left until buffers[i] is returned.
+
   mutex used_lock;
   condition_variable available_cond;
+  atomic<size_t> waiters;
+
+  atomic<size_t> in_use;
+  atomic<size_t> high_water_mark;
+  atomic<uint64_t> allocations;
+  atomic<uint64_t> waits;
+  atomic<uint64_t> wait_time_ns;
+  atomic<uint64_t> max_wait_time_ns;
+  atomic<uint64_t> failures;
+
+  /* Claim a free slot without locking. Return false if all slots are used. */
+  bool tryAcquire(size_t &slot)
+  {
+    const size_t d = depth.load();
+    const uint64_t all = d == 64 ? ~uint64_t(0) : (uint64_t(1) << d) - 1;
+    uint64_t cur = used.load();
+    while ((cur & all) != all)
+    {
+      size_t i = 0;
+      while (cur & (uint64_t(1) << i))
+        i++;
+      if (used.compare_exchange_weak(cur, cur | (uint64_t(1) << i)))
+      {
+        slot = i;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static void updateMax(atomic<uint64_t> &max, uint64_t value)
+  {
+    uint64_t cur = max.load();
+    while (value > cur && !max.compare_exchange_weak(cur, value)) {}
+  }
+
 public:
-  PoolAllocatorImpl(Allocator *a): allocator(a), buffers(), used() {}
+  PoolAllocatorImpl(Allocator *a, size_t d):
+    allocator(a),
+    depth(d < 1 ? 1 : (d > PoolAllocator::MaxDepth ? PoolAllocator::MaxDepth : d)),
+    used(0),
+    waiters(0),
+    in_use(0),
+    high_water_mark(0),
+    allocations(0),
+    waits(0),
+    wait_time_ns(0),
+    max_wait_time_ns(0),
+    failures(0)
+  {
+    for (size_t i = 0; i < PoolAllocator::MaxDepth; i++)
+    {
+      buffers[i] = NULL;
+      references[i] = 0;
+    }
+  }
 
   Buffer *allocate(size_t size)
   {
-    unique_lock guard(used_lock);
-    while (used[0] && used[1])
-      WAIT_CONDITION(available_cond, used_lock, guard);
-
-    if (!used[0]) {
-      if (buffers[0] == NULL)
-        buffers[0] = allocator->allocate(size);
-      buffers[0]->length = 0;
-      buffers[0]->allocator = this;
-      used[0] = true;
-      return buffers[0];
-    } else if (!used[1]) {
-      if (buffers[1] == NULL)
-        buffers[1] = allocator->allocate(size);
-      buffers[1]->length = 0;
-      buffers[1]->allocator = this;
-      used[1] = true;
-      return buffers[1];
-    } else {
-      // should never happen
-      return NULL;
+    size_t slot = 0;
+    if (!tryAcquire(slot))
+    {
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      {
+        unique_lock guard(used_lock);
+        waiters++;
+        while (!tryAcquire(slot))
+          WAIT_CONDITION(available_cond, used_lock, guard);
+        waiters--;
+      }
+      uint64_t waited = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+      waits++;
+      wait_time_ns += waited;
+      updateMax(max_wait_time_ns, waited);
     }
+
+    Buffer *b = buffers[slot].load();
+    if (b == NULL)
+    {
+      b = allocator->allocate(size);
+      buffers[slot] = b;
+    }
+    b->length = 0;
+    b->allocator = this;
+    references[slot] = 1;
+
+    allocations++;
+    if (b->data == NULL)
+      failures++;
+
+    size_t n = ++in_use;
+    size_t hwm = high_water_mark.load();
+    while (n > hwm && !high_water_mark.compare_exchange_weak(hwm, n)) {}
+    return b;
   }
 
   void free(Buffer *b)
   {
-    lock_guard guard(used_lock);
-    if (b == buffers[0]) {
-      used[0] = false;
-      available_cond.notify_one();
-    } else if (b == buffers[1]) {
-      used[1] = false;
-      available_cond.notify_one();
+    if (b == NULL)
+      return;
+    const size_t d = depth.load();
+    for (size_t i = 0; i < d; i++)
+    {
+      if (buffers[i].load() != b)
+        continue;
+      if (--references[i] > 0)
+        return;
+      used.fetch_and(~(uint64_t(1) << i));
+      in_use--;
+      // Only take the lock if allocate() may be sleeping.
+      if (waiters.load() > 0)
+      {
+        lock_guard guard(used_lock);
+        available_cond.notify_one();
+      }
+      return;
     }
   }
 
+  bool retain(Buffer *b)
+  {
+    const size_t d = depth.load();
+    for (size_t i = 0; i < d; i++)
+    {
+      if (buffers[i].load() != b)
+        continue;
+      // Never revive a slot whose last reference a concurrent free() just dropped.
+      uint32_t n = references[i].load();
+      while (n > 0 && !references[i].compare_exchange_weak(n, n + 1)) {}
+      return n > 0;
+    }
+    return false;
+  }
+
+  bool reserve(size_t d)
+  {
+    const size_t target = d > PoolAllocator::MaxDepth ? PoolAllocator::MaxDepth : d;
+    size_t cur = depth.load();
+    while (target > cur && !depth.compare_exchange_weak(cur, target)) {}
+    if (target > cur && waiters.load() > 0)
+    {
+      lock_guard guard(used_lock);
+      available_cond.notify_all();
+    }
+    return d <= PoolAllocator::MaxDepth;
+  }
+
+  PoolAllocatorStatistics getStatistics() const
+  {
+    PoolAllocatorStatistics s;
+    s.depth = depth;
+    s.in_use = in_use.load();
+    s.high_water_mark = high_water_mark.load();
+    s.allocations = allocations.load();
+    s.waits = waits.load();
+    s.wait_time_ns = wait_time_ns.load();
+    s.max_wait_time_ns = max_wait_time_ns.load();
+    s.failures = failures.load();
+    return s;
+  }
+
+  size_t getDepth() const
+  {
+    return depth;
+  }
+
   ~PoolAllocatorImpl()
   {
-    allocator->free(buffers[0]);
-    allocator->free(buffers[1]);
+    const size_t d = depth.load();
+    for (size_t i = 0; i < d; i++)
+      allocator->free(buffers[i].load());
     delete allocator;
   }
 };
 
-PoolAllocator::PoolAllocator():
-  impl_(new PoolAllocatorImpl(new NewAllocator))
+const size_t PoolAllocator::DefaultDepth;
+const size_t PoolAllocator::MaxDepth;
+
+PoolAllocator::PoolAllocator(size_t depth):
+  impl_(new PoolAllocatorImpl(new NewAllocator, depth))
 {
 }
 
-PoolAllocator::PoolAllocator(Allocator *a):
-  impl_(new PoolAllocatorImpl(a))
+PoolAllocator::PoolAllocator(Allocator *a, size_t depth):
+  impl_(new PoolAllocatorImpl(a, depth))
 {
 }
 
@@ -134,4 +422,24 @@ void PoolAllocator::free(Buffer *b)
 {
   impl_->free(b);
 }
+
+bool PoolAllocator::retain(Buffer *b)
+{
+  return impl_->retain(b);
+}
+
+bool PoolAllocator::reserve(size_t depth)
+{
+  return impl_->reserve(depth);
+}
+
+PoolAllocatorStatistics PoolAllocator::getStatistics() const
+{
+  return impl_->getStatistics();
+}
+
+size_t PoolAllocator::depth() const
+{
+  return impl_->getDepth();
+}
 } // namespace libfreenect2
@@ -0,0 +1,256 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+
+/** @file calibration_cache.cpp Cache of the fixed data read from a device on start. */
+
+#include <libfreenect2/protocol/calibration_cache.h>
+#include <libfreenect2/logging.h>
+#include <libfreenect2/threading.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+namespace libfreenect2
+{
+namespace protocol
+{
+
+namespace
+{
+const char Magic[4] = { 'L', 'F', '2', 'C' };
+const uint32_t Version = 1;
+
+typedef std::map<std::string, DeviceCalibration> CalibrationMap;
+
+/** Shared by all contexts of the process. */
+CalibrationMap &memoryCache()
+{
+  static CalibrationMap cache;
+  return cache;
+}
+
+libfreenect2::mutex &memoryCacheMutex()
+{
+  static libfreenect2::mutex mutex;
+  return mutex;
+}
+
+CommandTransaction::Result *fields(DeviceCalibration &c, size_t i)
+{
+  CommandTransaction::Result *all[] = { &c.firmware, &c.serial, &c.depth_params, &c.p0_tables, &c.rgb_params };
+  return i < 5 ? all[i] : 0;
+}
+
+bool makeDirectory(const std::string &path)
+{
+#ifdef _WIN32
+  return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+  return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+} /* namespace */
+
+bool DeviceCalibration::complete() const
+{
+  return !firmware.empty() && !serial.empty() && !depth_params.empty() && !p0_tables.empty() && !rgb_params.empty();
+}
+
+CalibrationCache::CalibrationCache(const std::string &directory) :
+  directory_(directory)
+{
+}
+
+std::string CalibrationCache::defaultDirectory()
+{
+  const char *env = std::getenv("LIBFREENECT2_CACHE_DIR");
+  if (env)
+    return env;
+#ifdef _WIN32
+  env = std::getenv("LOCALAPPDATA");
+  if (env)
+    return std::string(env) + "\\libfreenect2";
+#else
+  env = std::getenv("XDG_CACHE_HOME");
+  if (env && *env)
+    return std::string(env) + "/libfreenect2";
+  env = std::getenv("HOME");
+  if (env && *env)
+#ifdef __APPLE__
+    return std::string(env) + "/Library/Caches/libfreenect2";
+#else
+    return std::string(env) + "/.cache/libfreenect2";
+#endif
+#endif
+  return std::string();
+}
+
+bool CalibrationCache::makeDirectories(const std::string &path)
+{
+  for (size_t pos = path.find_first_of("/\\", 1); pos != std::string::npos; pos = path.find_first_of("/\\", pos + 1))
+    makeDirectory(path.substr(0, pos));
+  return makeDirectory(path);
+}
+
+std::string CalibrationCache::path(const std::string &serial) const
+{
+  std::string name = serial;
+  for (size_t i = 0; i < name.size(); i++)
+  {
+    const char c = name[i];
+    if (!((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')))
+      name[i] = '_';
+  }
+  return directory_ + "/" + name + ".calibration";
+}
+
+bool CalibrationCache::load(const std::string &serial, DeviceCalibration &calibration) const
+{
+  if (serial.empty())
+    return false;
+
+  {
+    libfreenect2::lock_guard guard(memoryCacheMutex());
+    CalibrationMap::const_iterator it = memoryCache().find(serial);
+    if (it != memoryCache().end())
+    {
+      calibration = it->second;
+      return true;
+    }
+  }
+
+  if (directory_.empty())
+    return false;
+
+  std::ifstream in(path(serial).c_str(), std::ios::binary);
+  if (!in)
+    return false;
+
+  char magic[sizeof(Magic)];
+  uint32_t version = 0;
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char *>(&version), sizeof(version));
+  if (!in || std::string(magic, sizeof(magic)) != std::string(Magic, sizeof(Magic)) || version != Version)
+  {
+    LOG_WARNING << "ignoring calibration cache " << path(serial) << " of a different format";
+    return false;
+  }
+
+  DeviceCalibration c;
+  for (size_t i = 0; fields(c, i); i++)
+  {
+    uint32_t length = 0;
+    in.read(reinterpret_cast<char *>(&length), sizeof(length));
+    if (!in || length > (1u << 20))
+      return false;
+    fields(c, i)->resize(length);
+    if (length > 0)
+      in.read(reinterpret_cast<char *>(&(*fields(c, i))[0]), length);
+  }
+  if (!in || !c.complete())
+  {
+    LOG_WARNING << "ignoring truncated calibration cache " << path(serial);
+    return false;
+  }
+
+  libfreenect2::lock_guard guard(memoryCacheMutex());
+  memoryCache()[serial] = c;
+  calibration = c;
+  return true;
+}
+
+bool CalibrationCache::store(const std::string &serial, const DeviceCalibration &calibration)
+{
+  if (serial.empty() || !calibration.complete())
+    return false;
+
+  {
+    libfreenect2::lock_guard guard(memoryCacheMutex());
+    memoryCache()[serial] = calibration;
+  }
+
+  if (directory_.empty())
+    return true;
+
+  if (!makeDirectories(directory_))
+  {
+    LOG_WARNING << "failed to create calibration cache directory " << directory_;
+    return false;
+  }
+
+  std::ostringstream tmp_name;
+  tmp_name << path(serial) << ".tmp" << chrono::steady_clock::now().time_since_epoch().count();
+  const std::string tmp = tmp_name.str();
+  {
+    std::ofstream out(tmp.c_str(), std::ios::binary | std::ios::trunc);
+    out.write(Magic, sizeof(Magic));
+    out.write(reinterpret_cast<const char *>(&Version), sizeof(Version));
+    DeviceCalibration c = calibration;
+    for (size_t i = 0; fields(c, i); i++)
+    {
+      const uint32_t length = fields(c, i)->size();
+      out.write(reinterpret_cast<const char *>(&length), sizeof(length));
+      out.write(reinterpret_cast<const char *>(&(*fields(c, i))[0]), length);
+    }
+    if (!out)
+    {
+      LOG_WARNING << "failed to write calibration cache " << tmp;
+      std::remove(tmp.c_str());
+      return false;
+    }
+  }
+
+#ifdef _WIN32
+  std::remove(path(serial).c_str());
+#endif
+  if (std::rename(tmp.c_str(), path(serial).c_str()) != 0)
+  {
+    LOG_WARNING << "failed to write calibration cache " << path(serial);
+    std::remove(tmp.c_str());
+    return false;
+  }
+  LOG_DEBUG << "cached calibration of " << serial << " in " << path(serial);
+  return true;
+}
+
+void CalibrationCache::clearMemory()
+{
+  libfreenect2::lock_guard guard(memoryCacheMutex());
+  memoryCache().clear();
+}
+
+} /* namespace protocol */
+} /* namespace libfreenect2 */
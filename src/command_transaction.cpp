@@ -37,8 +37,8 @@ namespace libfreenect2
 {
 namespace protocol
 {
-CommandTransaction::CommandTransaction(libusb_device_handle *handle, int inbound_endpoint, int outbound_endpoint) :
-  handle_(handle),
+CommandTransaction::CommandTransaction(usb::Transport *transport, int inbound_endpoint, int outbound_endpoint) :
+  transport_(transport),
   inbound_endpoint_(inbound_endpoint),
   outbound_endpoint_(outbound_endpoint),
   timeout_(1000)
@@ -83,7 +83,7 @@ bool CommandTransaction::execute(const CommandBase& command, Result& result)
 bool CommandTransaction::send(const CommandBase& command)
 {
   int transferred_bytes = 0;
-  int r = libusb_bulk_transfer(handle_, outbound_endpoint_, const_cast<uint8_t *>(command.data()), command.size(), &transferred_bytes, timeout_);
+  int r = transport_->bulkTransfer(outbound_endpoint_, const_cast<uint8_t *>(command.data()), command.size(), &transferred_bytes, timeout_);
 
   if(r != LIBUSB_SUCCESS)
   {
@@ -104,7 +104,7 @@ bool CommandTransaction::receive(CommandTransaction::Result& result, uint32_t mi
 {
   int length = 0;
 
-  int r = libusb_bulk_transfer(handle_, inbound_endpoint_, &result[0], result.size(), &length, timeout_);
+  int r = transport_->bulkTransfer(inbound_endpoint_, &result[0], result.size(), &length, timeout_);
   result.resize(length);
 
   if(r != LIBUSB_SUCCESS)
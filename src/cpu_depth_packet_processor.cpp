@@ -30,6 +30,7 @@
 #include <libfreenect2/resource.h>
 #include <libfreenect2/protocol/response.h>
 #include <libfreenect2/logging.h>
+#include <libfreenect2/trace_span.h>
 
 #include <fstream>
 
@@ -300,7 +301,7 @@ public:
   /** Allocate a new IR frame. */
   void newIrFrame()
   {
-    ir_frame = new Frame(512, 424, 4);
+    ir_frame = newLargeFrame(512, 424, 4);
     ir_frame->format = Frame::Float;
     //ir_frame = new Frame(512, 424, 12);
   }
@@ -314,7 +315,7 @@ public:
   /** Allocate a new depth frame. */
   void newDepthFrame()
   {
-    depth_frame = new Frame(512, 424, 4);
+    depth_frame = newLargeFrame(512, 424, 4);
     depth_frame->format = Frame::Float;
   }
 
@@ -895,15 +896,19 @@ void CpuDepthPacketProcessor::process(const DepthPacket &packet)
 
   float *m_ptr = (m.ptr(0, 0)->val);
 
-  for(int y = 0; y < 424; ++y)
-    for(int x = 0; x < 512; ++x, m_ptr += 9)
-    {
-      impl_->processPixelStage1(x, y, packet.buffer, m_ptr + 0, m_ptr + 3, m_ptr + 6);
-    }
+  {
+    trace::Span span("depth_stage1", packet.sequence);
+    for(int y = 0; y < 424; ++y)
+      for(int x = 0; x < 512; ++x, m_ptr += 9)
+      {
+        impl_->processPixelStage1(x, y, packet.buffer, m_ptr + 0, m_ptr + 3, m_ptr + 6);
+      }
+  }
 
   // bilateral filtering
   if(impl_->enable_bilateral_filter)
   {
+    trace::Span span("depth_bilateral_filter", packet.sequence);
     float *m_filtered_ptr = (m_filtered.ptr(0, 0)->val);
     unsigned char *m_max_edge_test_ptr = m_max_edge_test.ptr(0, 0);
 
@@ -924,6 +929,7 @@ void CpuDepthPacketProcessor::process(const DepthPacket &packet)
 
   Mat<float> out_ir(424, 512, impl_->ir_frame->data), out_depth(424, 512, impl_->depth_frame->data);
 
+  trace::Span stage2_span("depth_stage2", packet.sequence);
   if(impl_->enable_edge_filter)
   {
     Mat<Vec<float, 3> > depth_ir_sum(424, 512);
@@ -961,13 +967,17 @@ void CpuDepthPacketProcessor::process(const DepthPacket &packet)
 
   impl_->stopTiming(LOG_INFO);
 
+  salvage_filter_.apply(packet, impl_->ir_frame, impl_->depth_frame);
+  timer_.stamp(packet, impl_->ir_frame, impl_->depth_frame);
+
+  trace::Span listener_span("depth_listener", packet.sequence);
   if (listener_ != 0 ){
-    if(listener_->onNewFrame(Frame::Ir, impl_->ir_frame))
+    if(deliverFrame(listener_, Frame::Ir, impl_->ir_frame))
     {
       impl_->newIrFrame();
     }
 
-    if(listener_->onNewFrame(Frame::Depth, impl_->depth_frame))
+    if(deliverFrame(listener_, Frame::Depth, impl_->depth_frame))
     {
       impl_->newDepthFrame();
     }
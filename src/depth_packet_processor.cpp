@@ -29,6 +29,7 @@
 #include <libfreenect2/depth_packet_processor.h>
 #include <libfreenect2/async_packet_processor.h>
 
+#include <cmath>
 #include <cstring>
 
 namespace libfreenect2
@@ -97,6 +98,39 @@ DepthPacketProcessor::Parameters::Parameters()
   max_depth = 4500.0f; //set to > 8000 for best performance when using the kde pipeline
 }
 
+const float DepthSalvageFilter::MaxRelativeChange = 0.03f;
+
+void DepthSalvageFilter::apply(const DepthPacket &packet, Frame *ir, Frame *depth)
+{
+  // Sub-image 9 is not used by the decoders.
+  const bool degraded = (packet.missing & 0x1ff) != 0;
+  ir->status = degraded ? Frame::Degraded : 0;
+  depth->status = degraded ? Frame::Degraded : 0;
+
+  if (depth->format != Frame::Float)
+    return;
+
+  float *data = reinterpret_cast<float *>(depth->data);
+  const size_t size = depth->width * depth->height;
+
+  if (!degraded)
+  {
+    if (packet.salvage > 0)
+      reference_.assign(data, data + size);
+    else if (!reference_.empty())
+      std::vector<float>().swap(reference_);
+    return;
+  }
+
+  const bool has_reference = reference_.size() == size;
+  for (size_t i = 0; i < size; i++)
+  {
+    const float reference = has_reference ? reference_[i] : 0.0f;
+    if (!(data[i] > 0.0f && reference > 0.0f && std::fabs(data[i] - reference) <= MaxRelativeChange * reference))
+      data[i] = 0.0f;
+  }
+}
+
 DepthPacketProcessor::DepthPacketProcessor() :
     listener_(0)
 {
@@ -140,12 +174,13 @@ void DumpDepthPacketProcessor::process(const DepthPacket &packet) {
   ir_frame->sequence = packet.sequence;
   ir_frame->data = packet.buffer;
   ir_frame->format = Frame::Raw;
+  timer_.stamp(packet, ir_frame, depth_frame);
 
-  if (!listener_->onNewFrame(Frame::Ir, ir_frame)) {
+  if (!deliverFrame(listener_, Frame::Ir, ir_frame)) {
     delete ir_frame;
   }
   ir_frame = NULL;
-  if (!listener_->onNewFrame(Frame::Depth, depth_frame)) {
+  if (!deliverFrame(listener_, Frame::Depth, depth_frame)) {
     delete depth_frame;
   }
   depth_frame = NULL;
@@ -28,7 +28,10 @@
 
 #include <libfreenect2/depth_packet_stream_parser.h>
 #include <libfreenect2/logging.h>
+#include <libfreenect2/trace_span.h>
 #include <memory.h>
+#include <cstdlib>
+#include <string>
 
 namespace libfreenect2
 {
@@ -37,16 +40,35 @@ DepthPacketStreamParser::DepthPacketStreamParser() :
     processor_(noopProcessor<DepthPacket>()),
     processed_packets_(-1),
     current_sequence_(0),
-    current_subsequence_(0)
+    current_subsequence_(0),
+    zero_copy_(true),
+    expected_subsequence_(0),
+    misaligned_copies_(0),
+    max_missing_(0),
+    current_timestamp_(0),
+    previous_sequence_(0),
+    salvaged_packets_(0),
+    telemetry_(0),
+    sub_image_start_(0),
+    packet_start_(0)
 {
   size_t single_image = 512*424*11/8;
   buffer_size_ = 10 * single_image;
 
   processor_->allocateBuffer(packet_, buffer_size_);
+  previous_.memory = NULL;
 
   work_buffer_.data = new unsigned char[single_image];
   work_buffer_.capacity = single_image;
   work_buffer_.length = 0;
+
+  const char *zero_copy_str = std::getenv("LIBFREENECT2_DEPTH_ZERO_COPY");
+  if(zero_copy_str && std::string(zero_copy_str) == "0")
+    zero_copy_ = false;
+
+  const char *salvage_str = std::getenv("LIBFREENECT2_DEPTH_SALVAGE");
+  if(salvage_str)
+    setSalvage(std::atoi(salvage_str) > 0 ? std::atoi(salvage_str) : 0);
 }
 
 DepthPacketStreamParser::~DepthPacketStreamParser()
@@ -56,11 +78,173 @@ DepthPacketStreamParser::~DepthPacketStreamParser()
 
 void DepthPacketStreamParser::setPacketProcessor(libfreenect2::BaseDepthPacketProcessor *processor)
 {
+  releasePrevious();
   processor_->releaseBuffer(packet_);
   processor_ = (processor != 0) ? processor : noopProcessor<DepthPacket>();
   processor_->allocateBuffer(packet_, buffer_size_);
 }
 
+void DepthPacketStreamParser::setZeroCopy(bool enable)
+{
+  zero_copy_ = enable;
+  work_buffer_.length = 0;
+  current_subsequence_ = 0;
+  expected_subsequence_ = 0;
+}
+
+bool DepthPacketStreamParser::zeroCopy() const
+{
+  return zero_copy_;
+}
+
+uint64_t DepthPacketStreamParser::misalignedCopies() const
+{
+  return misaligned_copies_;
+}
+
+void DepthPacketStreamParser::setSalvage(unsigned max_missing)
+{
+  max_missing_ = max_missing > 9 ? 9 : max_missing;
+  if(max_missing_ == 0)
+    releasePrevious();
+}
+
+void DepthPacketStreamParser::releasePrevious()
+{
+  if(previous_.memory != NULL)
+    processor_->releaseBuffer(previous_);
+  previous_.memory = NULL;
+}
+
+unsigned DepthPacketStreamParser::salvage() const
+{
+  return max_missing_;
+}
+
+uint64_t DepthPacketStreamParser::salvagedPackets() const
+{
+  return salvaged_packets_;
+}
+
+void DepthPacketStreamParser::setTelemetry(Telemetry *telemetry)
+{
+  telemetry_ = telemetry;
+}
+
+unsigned char *DepthPacketStreamParser::slotData(uint32_t subsequence)
+{
+  return packet_.memory->data + subsequence * work_buffer_.capacity;
+}
+
+void DepthPacketStreamParser::dispatchPacket(uint32_t missing)
+{
+  if(processor_->ready())
+  {
+    DepthPacket &packet = packet_;
+    packet.sequence = current_sequence_;
+    packet.timestamp = current_timestamp_;
+    packet.buffer = packet_.memory->data;
+    packet.buffer_length = packet_.memory->capacity;
+    packet.arrival_time = packetArrivalTime();
+    packet.first_byte_time = packet_start_;
+    packet.process_start_time = packet.arrival_time;
+    packet.missing = missing;
+    packet.salvage = max_missing_;
+
+    if(trace::active())
+      trace::record("depth_assemble", current_sequence_, packet_start_, packet.arrival_time);
+
+    // Keep this packet's buffer as the reference for salvaging the next one.
+    DepthPacket previous = previous_;
+    previous_.memory = NULL;
+    if(max_missing_ > 0 && processor_->retainBuffer(packet))
+    {
+      previous_ = packet;
+      previous_sequence_ = current_sequence_;
+    }
+
+    processor_->process(packet);
+    if(previous.memory != NULL)
+      processor_->releaseBuffer(previous);
+    processor_->allocateBuffer(packet_, buffer_size_);
+    count(Telemetry::FramesCompleted);
+
+    processed_packets_++;
+    if (processed_packets_ == 0)
+      processed_packets_ = current_sequence_;
+    int diff = current_sequence_ - processed_packets_;
+    const int interval = 30;
+    if ((current_sequence_ % interval == 0 && diff != 0) || diff >= interval)
+    {
+      LOG_INFO << diff << " packets were lost";
+      if (diff > 0)
+        count(Telemetry::FramesLost, diff);
+      processed_packets_ = current_sequence_;
+    }
+  }
+  else
+  {
+    LOG_DEBUG << "skipping depth packet";
+    count(Telemetry::DroppedBusy);
+  }
+}
+
+unsigned char *DepthPacketStreamParser::subImageData()
+{
+  // Keep the expected slot if it already holds a sub-image of this packet, e.g. after reordering.
+  if(!zero_copy_ || (current_subsequence_ & (1u << expected_subsequence_)))
+    return work_buffer_.data;
+  return slotData(expected_subsequence_);
+}
+
+/**
+ * Complete the current packet with sub-images of the previous one and pass it on.
+ * Called when the first sub-image of the next packet has been received.
+ * @param incoming Where that sub-image was assembled.
+ * @param incoming_length Length of that sub-image.
+ */
+bool DepthPacketStreamParser::salvagePacket(const unsigned char *incoming, size_t incoming_length)
+{
+  const uint32_t missing = ~current_subsequence_ & 0x3ff;
+  unsigned missing_measurements = 0;
+  for(uint32_t bits = missing & 0x1ff; bits != 0; bits &= bits - 1)
+    missing_measurements++;
+
+  if(max_missing_ == 0 || missing_measurements > max_missing_ || previous_.memory == NULL ||
+     current_sequence_ - previous_sequence_ > 2)
+    return false;
+
+  // A busy processor would skip it anyway, don't patch it or count it as salvaged.
+  if(!processor_->ready())
+  {
+    LOG_DEBUG << "skipping depth packet";
+    count(Telemetry::DroppedBusy);
+    return true;
+  }
+
+  // In zero-copy mode the sub-image of the next packet may sit in a missing slot.
+  const size_t single_image = work_buffer_.capacity;
+  const bool in_slot = incoming != work_buffer_.data;
+  if(in_slot)
+    memcpy(work_buffer_.data, incoming, incoming_length);
+
+  for(uint32_t sub = 0; sub < 10; sub++)
+  {
+    if(missing & (1u << sub))
+      memcpy(slotData(sub), previous_.buffer + sub * single_image, single_image);
+  }
+  dispatchPacket(missing);
+  salvaged_packets_++;
+  count(Telemetry::FramesSalvaged);
+
+  // Put it back, into the fresh buffer if there is one.
+  if(in_slot)
+    memcpy(slotData(expected_subsequence_), work_buffer_.data, incoming_length);
+
+  LOG_DEBUG << "salvaged depth packet " << current_sequence_ << ", missing sub-images 0x" << std::hex << missing << std::dec;
+  return true;
+}
+
 void DepthPacketStreamParser::onDataReceived(unsigned char* buffer, size_t in_length)
 {
   if (packet_.memory == NULL || packet_.memory->data == NULL)
@@ -90,11 +274,16 @@ void DepthPacketStreamParser::onDataReceived(unsigned char* buffer, size_t in_le
     if(wb.length + in_length > wb.capacity)
     {
       LOG_DEBUG << "subpacket too large";
+      count(Telemetry::Resyncs);
       wb.length = 0;
       return;
     }
 
-    memcpy(wb.data + wb.length, buffer, in_length);
+    if(wb.length == 0)
+      sub_image_start_ = trace::now();
+
+    // In zero-copy mode wb usually only tracks the length of the sub-image.
+    memcpy(subImageData() + wb.length, buffer, in_length);
     wb.length += in_length;
 
     if(footer_found)
@@ -102,61 +291,64 @@ void DepthPacketStreamParser::onDataReceived(unsigned char* buffer, size_t in_le
       if(footer->length != wb.length)
       {
         LOG_DEBUG << "image data too short!";
+        count(Telemetry::Resyncs);
       }
       else
       {
+        const bool in_work_buffer = subImageData() == wb.data;
+
         if(current_sequence_ != footer->sequence)
         {
-          if(current_subsequence_ == 0x3ff)
+          if(!zero_copy_ && current_subsequence_ == 0x3ff)
           {
-            if(processor_->ready())
-            {
-              DepthPacket &packet = packet_;
-              packet.sequence = current_sequence_;
-              packet.timestamp = footer->timestamp;
-              packet.buffer = packet_.memory->data;
-              packet.buffer_length = packet_.memory->capacity;
-
-              processor_->process(packet);
-              processor_->allocateBuffer(packet_, buffer_size_);
-
-              processed_packets_++;
-              if (processed_packets_ == 0)
-                processed_packets_ = current_sequence_;
-              int diff = current_sequence_ - processed_packets_;
-              const int interval = 30;
-              if ((current_sequence_ % interval == 0 && diff != 0) || diff >= interval)
-              {
-                LOG_INFO << diff << " packets were lost";
-                processed_packets_ = current_sequence_;
-              }
-            }
-            else
-            {
-              LOG_DEBUG << "skipping depth packet";
-            }
+            dispatchPacket();
           }
-          else
+          else if(current_subsequence_ != 0 && !salvagePacket(subImageData(), wb.length))
           {
             LOG_DEBUG << "not all subsequences received " << current_subsequence_;
+            count(Telemetry::DroppedIncomplete);
           }
 
           current_sequence_ = footer->sequence;
           current_subsequence_ = 0;
         }
 
+        const unsigned char *incoming = in_work_buffer ? wb.data : slotData(expected_subsequence_);
+
         Buffer &fb = *packet_.memory;
 
+        if(current_subsequence_ == 0)
+          packet_start_ = sub_image_start_;
+
         // set the bit corresponding to the subsequence number to 1
         current_subsequence_ |= 1 << footer->subsequence;
+        current_timestamp_ = footer->timestamp;
 
-        if(footer->subsequence * footer->length > fb.capacity)
+        if((footer->subsequence + 1) * footer->length > fb.capacity)
         {
           LOG_DEBUG << "front buffer too short! subsequence number is " << footer->subsequence;
         }
-        else
+        else if(!zero_copy_)
         {
-          memcpy(fb.data + (footer->subsequence * footer->length), wb.data + (wb.length - footer->length), footer->length);
+          memcpy(fb.data + (footer->subsequence * footer->length), incoming, footer->length);
+        }
+        else if(incoming != slotData(footer->subsequence))
+        {
+          // written to the wrong slot, e.g. after lost sub-images
+          memcpy(slotData(footer->subsequence), incoming, footer->length);
+          misaligned_copies_++;
+        }
+
+        if(zero_copy_)
+        {
+          expected_subsequence_ = (footer->subsequence + 1) % 10;
+
+          // Pass the packet on now, the next sub-image must go to a fresh buffer.
+          if(current_subsequence_ == 0x3ff)
+          {
+            dispatchPacket();
+            current_subsequence_ = 0;
+          }
         }
       }
 
@@ -166,4 +358,37 @@ void DepthPacketStreamParser::onDataReceived(unsigned char* buffer, size_t in_le
   }
 }
 
+void DepthPacketStreamParser::onIsoPacketsReceived(const IsoPacket *packets, size_t count)
+{
+  Buffer &wb = work_buffer_;
+  size_t i = 0;
+
+  while(i < count)
+  {
+    // Packets that neither carry the footer nor overflow the sub-image are
+    // simply appended; when their slots are adjacent one copy does for all.
+    size_t end = i, run = 0;
+    while(end < count && packets[end].length > 0 && wb.length + run + packets[end].length <= wb.capacity &&
+          (end == i || packets[end].data == packets[end - 1].data + packets[end - 1].length))
+    {
+      run += packets[end].length;
+      end++;
+    }
+
+    if(end - i < 2 || packet_.memory == NULL || packet_.memory->data == NULL)
+    {
+      onDataReceived(packets[i].data, packets[i].length);
+      i++;
+      continue;
+    }
+
+    if(wb.length == 0)
+      sub_image_start_ = trace::now();
+
+    memcpy(subImageData() + wb.length, packets[i].data, run);
+    wb.length += run;
+    i = end;
+  }
+}
+
 } /* namespace libfreenect2 */
@@ -92,6 +92,7 @@ void EventLoop::stop()
 void EventLoop::execute()
 {
   this_thread::set_name("USB");
+  this_thread::apply_policy(ThreadPolicy::UsbEventLoop);
   timeval t;
   t.tv_sec = 0;
   t.tv_usec = 100000;
@@ -28,6 +28,10 @@
 
 #include <libfreenect2/frame_listener_impl.h>
 #include <libfreenect2/threading.h>
+#include <libfreenect2/frame_timing.h>
+
+#include <algorithm>
+#include <deque>
 
 namespace libfreenect2
 {
@@ -42,6 +46,7 @@ Frame::Frame(size_t width, size_t height, size_t bytes_per_pixel, unsigned char
   gamma(0.f),
   status(0),
   format(Frame::Invalid),
+  timing(),
   rawdata(NULL)
 {
   if (data_)
@@ -191,4 +196,269 @@ bool SyncMultiFrameListener::onNewFrame(Frame::Type type, Frame *frame)
   return true;
 }
 
+/** Implementation class for synchronizing frames of several devices. */
+class SyncMultiDeviceListenerImpl
+{
+public:
+  /** Frames of one type kept per device while waiting for partners. */
+  static const size_t MaxQueued = 8;
+  static const uint64_t NsPerTick = 125000;
+
+  struct Pending
+  {
+    Frame *frame;
+    uint64_t time; ///< Host capture time.
+  };
+
+  /** Listener of one device. */
+  class DeviceListener : public FrameListener
+  {
+  public:
+    DeviceListener(SyncMultiDeviceListenerImpl *impl, size_t device) : impl_(impl), device_(device) {}
+
+    virtual bool onNewFrame(Frame::Type type, Frame *frame)
+    {
+      return impl_->onNewFrame(device_, type, frame);
+    }
+  private:
+    SyncMultiDeviceListenerImpl *impl_;
+    size_t device_;
+  };
+
+  mutable libfreenect2::mutex mutex_;
+  libfreenect2::condition_variable condition_;
+
+  const unsigned int subscribed_frame_types_;
+  const uint64_t tolerance_;
+  Frame::Type clock_type_; ///< Frame type whose arrival times feed the clock estimate.
+  std::vector<Frame::Type> types_;
+  std::vector<DeviceListener *> listeners_;
+  std::vector<DeviceClock> clocks_;
+  std::vector<uint32_t> last_timestamp_;
+  std::vector<std::deque<Pending> > queues_; ///< Per device and subscribed type, oldest first.
+
+  bool has_set_;
+  FrameSet next_set_;
+  uint64_t dropped_;
+
+  SyncMultiDeviceListenerImpl(size_t devices, unsigned int frame_types, double tolerance_ms) :
+    subscribed_frame_types_(frame_types),
+    tolerance_(static_cast<uint64_t>(tolerance_ms * 1000000.0)),
+    clocks_(devices),
+    last_timestamp_(devices, 0),
+    has_set_(false),
+    dropped_(0)
+  {
+    const Frame::Type all[] = {Frame::Color, Frame::Ir, Frame::Depth};
+    for (size_t i = 0; i < 3; i++)
+      if (frame_types & all[i])
+        types_.push_back(all[i]);
+
+    // Depth packets arrive with less jitter than color, prefer them for the clock.
+    clock_type_ = (frame_types & Frame::Depth) ? Frame::Depth : (frame_types & Frame::Ir) ? Frame::Ir : Frame::Color;
+
+    for (size_t i = 0; i < devices; i++)
+      listeners_.push_back(new DeviceListener(this, i));
+    queues_.resize(devices * types_.size());
+  }
+
+  ~SyncMultiDeviceListenerImpl()
+  {
+    for (size_t i = 0; i < queues_.size(); i++)
+      for (size_t j = 0; j < queues_[i].size(); j++)
+        delete queues_[i][j].frame;
+    releaseSet(next_set_);
+    for (size_t i = 0; i < listeners_.size(); i++)
+      delete listeners_[i];
+  }
+
+  static void releaseSet(FrameSet &set)
+  {
+    for (size_t i = 0; i < set.frames.size(); i++)
+    {
+      for(FrameMap::iterator it = set.frames[i].begin(); it != set.frames[i].end(); ++it)
+        delete it->second;
+    }
+    set.frames.clear();
+  }
+
+  size_t queueIndex(size_t device, Frame::Type type) const
+  {
+    for (size_t i = 0; i < types_.size(); i++)
+      if (types_[i] == type)
+        return device * types_.size() + i;
+    return queues_.size();
+  }
+
+  bool onNewFrame(size_t device, Frame::Type type, Frame *frame)
+  {
+    if((subscribed_frame_types_ & type) == 0) return false;
+
+    bool emitted = false;
+    {
+      libfreenect2::lock_guard l(mutex_);
+
+      DeviceClock &clock = clocks_[device];
+      if (type == clock_type_ && frame->timing.usb_last != 0)
+      {
+        clock.update(frame->timestamp, frame->timing.usb_last);
+        last_timestamp_[device] = frame->timestamp;
+      }
+
+      Pending p;
+      p.frame = frame;
+      p.time = clock.toHost(frame->timestamp);
+      if (p.time == 0)
+        p.time = frame->timing.usb_last;
+
+      std::deque<Pending> &queue = queues_[queueIndex(device, type)];
+      queue.push_back(p);
+      if (queue.size() > MaxQueued)
+      {
+        delete queue.front().frame;
+        queue.pop_front();
+        dropped_++;
+      }
+
+      emitted = match();
+    }
+
+    if (emitted)
+      condition_.notify_one();
+    return true;
+  }
+
+  /** Emit sets while every queue has a head within the tolerance. Called with #mutex_ held. */
+  bool match()
+  {
+    bool emitted = false;
+
+    for (;;)
+    {
+      uint64_t oldest = UINT64_MAX, newest = 0;
+      for (size_t i = 0; i < queues_.size(); i++)
+      {
+        if (queues_[i].empty())
+          return emitted;
+        oldest = std::min(oldest, queues_[i].front().time);
+        newest = std::max(newest, queues_[i].front().time);
+      }
+
+      if (newest - oldest <= tolerance_)
+      {
+        emit(oldest);
+        emitted = true;
+        continue;
+      }
+
+      // Heads too old for the newest one will not match any later frame either.
+      for (size_t i = 0; i < queues_.size(); i++)
+      {
+        if (queues_[i].front().time + tolerance_ < newest)
+        {
+          delete queues_[i].front().frame;
+          queues_[i].pop_front();
+          dropped_++;
+        }
+      }
+    }
+  }
+
+  /** Move the queue heads into #next_set_, replacing an unclaimed set. */
+  void emit(uint64_t oldest)
+  {
+    if (has_set_)
+    {
+      for (size_t i = 0; i < next_set_.frames.size(); i++)
+        dropped_ += next_set_.frames[i].size();
+      releaseSet(next_set_);
+    }
+
+    const size_t devices = listeners_.size();
+    next_set_.frames.resize(devices);
+    uint64_t sum = 0;
+    for (size_t d = 0; d < devices; d++)
+    {
+      for (size_t t = 0; t < types_.size(); t++)
+      {
+        std::deque<Pending> &queue = queues_[d * types_.size() + t];
+        next_set_.frames[d][types_[t]] = queue.front().frame;
+        sum += queue.front().time - oldest;
+        queue.pop_front();
+      }
+    }
+    next_set_.capture_time = oldest + sum / queues_.size();
+    has_set_ = true;
+  }
+};
+
+SyncMultiDeviceListener::SyncMultiDeviceListener(size_t devices, unsigned int frame_types, double tolerance_ms) :
+    impl_(new SyncMultiDeviceListenerImpl(devices, frame_types, tolerance_ms))
+{
+}
+
+SyncMultiDeviceListener::~SyncMultiDeviceListener()
+{
+  delete impl_;
+}
+
+FrameListener *SyncMultiDeviceListener::getListener(size_t device)
+{
+  return device < impl_->listeners_.size() ? impl_->listeners_[device] : 0;
+}
+
+bool SyncMultiDeviceListener::hasNewFrameSet() const
+{
+  libfreenect2::lock_guard l(impl_->mutex_);
+
+  return impl_->has_set_;
+}
+
+bool SyncMultiDeviceListener::waitForNewFrameSet(FrameSet &set, int milliseconds)
+{
+  libfreenect2::unique_lock l(impl_->mutex_);
+
+  auto predicate = [this]{ return impl_->has_set_; };
+
+  if(!impl_->condition_.wait_for(l, std::chrono::milliseconds(milliseconds), predicate))
+    return false;
+
+  set = impl_->next_set_;
+  impl_->next_set_.frames.clear();
+  impl_->has_set_ = false;
+  return true;
+}
+
+void SyncMultiDeviceListener::release(FrameSet &set)
+{
+  SyncMultiDeviceListenerImpl::releaseSet(set);
+}
+
+DeviceClockEstimate SyncMultiDeviceListener::getClock(size_t device) const
+{
+  libfreenect2::lock_guard l(impl_->mutex_);
+
+  DeviceClockEstimate estimate = DeviceClockEstimate();
+  if (device >= impl_->clocks_.size())
+    return estimate;
+
+  const DeviceClock &clock = impl_->clocks_[device];
+  const uint32_t timestamp = impl_->last_timestamp_[device];
+  const uint64_t host = clock.toHost(timestamp);
+  if (host == 0)
+    return estimate;
+
+  estimate.valid = true;
+  estimate.offset_ns = static_cast<int64_t>(host - static_cast<uint64_t>(timestamp) * SyncMultiDeviceListenerImpl::NsPerTick);
+  estimate.drift_ppm = (SyncMultiDeviceListenerImpl::NsPerTick / clock.nsPerTick() - 1.0) * 1e6;
+  return estimate;
+}
+
+uint64_t SyncMultiDeviceListener::getDroppedFrames() const
+{
+  libfreenect2::lock_guard l(impl_->mutex_);
+
+  return impl_->dropped_;
+}
+
 } /* namespace libfreenect2 */
@@ -0,0 +1,115 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+
+/** @file frame_timing.cpp Device to host clock mapping. */
+
+#include <libfreenect2/frame_timing.h>
+
+#include <cmath>
+
+namespace libfreenect2
+{
+
+const double DeviceClock::Forgetting = 0.998;
+const double DeviceClock::MinWeight = 8.0;
+const double DeviceClock::MaxResidual = 1e9;
+
+DeviceClock::DeviceClock()
+{
+  reset();
+}
+
+void DeviceClock::reset()
+{
+  started_ = false;
+  last_timestamp_ = 0;
+  last_x_ = 0;
+  host_origin_ = 0;
+  weight_ = 0;
+  mean_x_ = mean_y_ = 0;
+  var_x_ = cov_xy_ = 0;
+}
+
+double DeviceClock::ticks(uint32_t timestamp) const
+{
+  // Timestamps are unwrapped relative to the last observation.
+  return last_x_ + (int32_t)(timestamp - last_timestamp_);
+}
+
+double DeviceClock::estimate(double x) const
+{
+  return mean_y_ + cov_xy_ / var_x_ * (x - mean_x_);
+}
+
+void DeviceClock::update(uint32_t timestamp, uint64_t host_ns)
+{
+  if (!started_)
+  {
+    started_ = true;
+    last_timestamp_ = timestamp;
+    host_origin_ = host_ns;
+  }
+
+  const double x = ticks(timestamp);
+  const double y = (double)(int64_t)(host_ns - host_origin_);
+
+  if (weight_ >= MinWeight && var_x_ > 0 && std::fabs(estimate(x) - y) > MaxResidual)
+  {
+    reset();
+    update(timestamp, host_ns);
+    return;
+  }
+
+  // Exponentially weighted update of the means and (co)variance sums.
+  weight_ = weight_ * Forgetting + 1.0;
+  const double dx = x - mean_x_;
+  mean_x_ += dx / weight_;
+  mean_y_ += (y - mean_y_) / weight_;
+  var_x_ = var_x_ * Forgetting + dx * (x - mean_x_);
+  cov_xy_ = cov_xy_ * Forgetting + dx * (y - mean_y_);
+
+  last_timestamp_ = timestamp;
+  last_x_ = x;
+}
+
+uint64_t DeviceClock::toHost(uint32_t timestamp) const
+{
+  if (weight_ < MinWeight || var_x_ <= 0)
+    return 0;
+
+  const double y = estimate(ticks(timestamp));
+  return host_origin_ + (int64_t)std::floor(y + 0.5);
+}
+
+double DeviceClock::nsPerTick() const
+{
+  if (weight_ < MinWeight || var_x_ <= 0)
+    return 0;
+  return cov_xy_ / var_x_;
+}
+
+} /* namespace libfreenect2 */
@@ -30,6 +30,11 @@
 #include <vector>
 #include <algorithm>
 #include <libusb.h>
+#ifdef _WIN32
+#include <winsock.h>
+#else
+#include <sys/time.h>
+#endif
 #include <limits>
 #include <cmath>
 #include <cstdlib>
@@ -42,14 +47,19 @@
 
 #include <libfreenect2/usb/event_loop.h>
 #include <libfreenect2/usb/transfer_pool.h>
+#include <libfreenect2/usb/simulated_kinect.h>
 #include <libfreenect2/depth_packet_processor.h>
+#include <libfreenect2/depth_tables.h>
 #include <libfreenect2/rgb_packet_processor.h>
 #include <libfreenect2/protocol/usb_control.h>
 #include <libfreenect2/protocol/command.h>
 #include <libfreenect2/protocol/response.h>
 #include <libfreenect2/protocol/command_transaction.h>
+#include <libfreenect2/protocol/calibration_cache.h>
 #include <libfreenect2/logging.h>
 #include <libfreenect2/threading.h>
+#include <libfreenect2/worker_pool.h>
+#include <libfreenect2/pipeline_selection.h>
 
 namespace libfreenect2
 {
@@ -57,154 +67,6 @@ using namespace libfreenect2;
 using namespace libfreenect2::usb;
 using namespace libfreenect2::protocol;
 
-/*
-For detailed analysis see https://github.com/OpenKinect/libfreenect2/issues/144
-
-The following discussion is in no way authoritative. It is the current best
-explanation considering the hardcoded parameters and decompiled code.
-
-p0 tables are the "initial shift" of phase values, as in US8587771 B2.
-
-Three p0 tables are used for "disamgibuation" in the first half of stage 2
-processing.
-
-At the end of stage 2 processing:
-
-phase_final is the phase shift used to compute the travel distance.
-
-What is being measured is max_depth (d), the total travel distance of the
-reflected ray.
-
-But what we want is depth_fit (z), the distance from reflection to the XY
-plane. There are two issues: the distance before reflection is not needed;
-and the measured ray is not normal to the XY plane.
-
-Suppose L is the distance between the light source and the focal point (a
-fixed constant), and xu,yu is the undistorted and normalized coordinates for
-each measured pixel at unit depth.
-
-Through some derivation, we have
-
-    z = (d*d - L*L)/(d*sqrt(xu*xu + yu*yu + 1) - xu*L)/2.
-
-The expression in stage 2 processing is a variant of this, with the term
-`-L*L` removed. Detailed derivation can be found in the above issue.
-
-Here, the two terms `sqrt(xu*xu + yu*yu + 1)` and `xu` requires undistorted
-coordinates, which is hard to compute in real-time because the inverse of
-radial and tangential distortion has no analytical solutions and requires
-numeric methods to solve. Thus these two terms are precomputed once and
-their variants are stored as ztable and xtable respectively.
-
-Even though x/ztable is derived with undistortion, they are only used to
-correct the effect of distortion on the z value. Image warping is needed for
-correcting distortion on x-y value, which happens in registration.cpp.
-*/
-struct IrCameraTables: Freenect2Device::IrCameraParams
-{
-  std::vector<float> xtable;
-  std::vector<float> ztable;
-  std::vector<short> lut;
-
-  IrCameraTables(const Freenect2Device::IrCameraParams &parent):
-    Freenect2Device::IrCameraParams(parent),
-    xtable(DepthPacketProcessor::TABLE_SIZE),
-    ztable(DepthPacketProcessor::TABLE_SIZE),
-    lut(DepthPacketProcessor::LUT_SIZE)
-  {
-    const double scaling_factor = 8192;
-    const double unambigious_dist = 6250.0/3;
-    size_t divergence = 0;
-    for (size_t i = 0; i < DepthPacketProcessor::TABLE_SIZE; i++)
-    {
-      size_t xi = i % 512;
-      size_t yi = i / 512;
-      double xd = (xi + 0.5 - cx)/fx;
-      double yd = (yi + 0.5 - cy)/fy;
-      double xu, yu;
-      divergence += !undistort(xd, yd, xu, yu);
-      xtable[i] = scaling_factor*xu;
-      ztable[i] = unambigious_dist/sqrt(xu*xu + yu*yu + 1);
-    }
-
-    if (divergence > 0)
-      LOG_ERROR << divergence << " pixels in x/ztable have incorrect undistortion.";
-
-    short y = 0;
-    for (int x = 0; x < 1024; x++)
-    {
-      unsigned inc = 1 << (x/128 - (x>=128));
-      lut[x] = y;
-      lut[1024 + x] = -y;
-      y += inc;
-    }
-    lut[1024] = 32767;
-  }
-
-  //x,y: undistorted, normalized coordinates
-  //xd,yd: distorted, normalized coordinates
-  void distort(double x, double y, double &xd, double &yd) const
-  {
-    double x2 = x * x;
-    double y2 = y * y;
-    double r2 = x2 + y2;
-    double xy = x * y;
-    double kr = ((k3 * r2 + k2) * r2 + k1) * r2 + 1.0;
-    xd = x*kr + p2*(r2 + 2*x2) + 2*p1*xy;
-    yd = y*kr + p1*(r2 + 2*y2) + 2*p2*xy;
-  }
-
-  //The inverse of distort() using Newton's method
-  //Return true if converged correctly
-  //This function considers tangential distortion with double precision.
-  bool undistort(double x, double y, double &xu, double &yu) const
-  {
-    double x0 = x;
-    double y0 = y;
-
-    double last_x = x;
-    double last_y = y;
-    const int max_iterations = 100;
-    int iter;
-    for (iter = 0; iter < max_iterations; iter++) {
-      double x2 = x*x;
-      double y2 = y*y;
-      double x2y2 = x2 + y2;
-      double x2y22 = x2y2*x2y2;
-      double x2y23 = x2y2*x2y22;
-
-      //Jacobian matrix
-      double Ja = k3*x2y23 + (k2+6*k3*x2)*x2y22 + (k1+4*k2*x2)*x2y2 + 2*k1*x2 + 6*p2*x + 2*p1*y + 1;
-      double Jb = 6*k3*x*y*x2y22 + 4*k2*x*y*x2y2 + 2*k1*x*y + 2*p1*x + 2*p2*y;
-      double Jc = Jb;
-      double Jd = k3*x2y23 + (k2+6*k3*y2)*x2y22 + (k1+4*k2*y2)*x2y2 + 2*k1*y2 + 2*p2*x + 6*p1*y + 1;
-
-      //Inverse Jacobian
-      double Jdet = 1/(Ja*Jd - Jb*Jc);
-      double a = Jd*Jdet;
-      double b = -Jb*Jdet;
-      double c = -Jc*Jdet;
-      double d = Ja*Jdet;
-
-      double f, g;
-      distort(x, y, f, g);
-      f -= x0;
-      g -= y0;
-
-      x -= a*f + b*g;
-      y -= c*f + d*g;
-      const double eps = std::numeric_limits<double>::epsilon()*16;
-      if (fabs(x - last_x) <= eps && fabs(y - last_y) <= eps)
-        break;
-      last_x = x;
-      last_y = y;
-    }
-    xu = x;
-    yu = y;
-    return iter < max_iterations;
-  }
-};
-
 /** Freenect2 device implementation. */
 class Freenect2DeviceImpl : public Freenect2Device
 {
@@ -221,8 +83,8 @@ private:
   bool has_usb_interfaces_;
 
   Freenect2Impl *context_;
-  libusb_device *usb_device_;
-  libusb_device_handle *usb_device_handle_;
+  libusb_device *usb_device_; ///< NULL for a simulated device.
+  Transport *transport_;
 
   BulkTransferPool rgb_transfer_pool_;
   IsoTransferPool ir_transfer_pool_;
@@ -235,11 +97,26 @@ private:
   std::string serial_, firmware_;
   Freenect2Device::IrCameraParams ir_camera_params_;
   Freenect2Device::ColorCameraParams rgb_camera_params_;
+
+  // Applied when a half of the pipeline is constructed, which startStreams() only does for the enabled streams.
+  FrameListener *rgb_frame_listener_;
+  FrameListener *ir_frame_listener_;
+  Freenect2Device::Config config_;
+  bool has_config_;
+
+  // Transfer pool sizes chosen by open(), the pools are allocated when their stream first starts.
+  unsigned rgb_xfer_size_, rgb_num_xfers_;
+  unsigned ir_pkts_per_xfer_, ir_num_xfers_;
+  int max_iso_packet_size_;
 public:
-  Freenect2DeviceImpl(Freenect2Impl *context, const PacketPipeline *pipeline, libusb_device *usb_device, libusb_device_handle *usb_device_handle, const std::string &serial);
+  Freenect2DeviceImpl(Freenect2Impl *context, const PacketPipeline *pipeline, libusb_device *usb_device, Transport *transport, const std::string &serial);
   virtual ~Freenect2DeviceImpl();
 
   bool isSameUsbDevice(libusb_device* other);
+  bool isSameSimulatedDevice(const std::string &serial);
+
+  /** Complete pending transfers of a simulated device without waiting, false for a USB device. */
+  bool handleSimulatedEvents();
 
   virtual std::string getSerialNumber();
   virtual std::string getFirmwareVersion();
@@ -264,6 +141,7 @@ public:
   virtual uint32_t getColorSetting(ColorSettingCommandType cmd);
   virtual float getColorSettingFloat(ColorSettingCommandType cmd);
   virtual void setLedStatus(LedSettings led);
+  virtual Telemetry *getTelemetry();
   virtual bool start();
   virtual bool startStreams(bool rgb, bool depth);
   virtual bool stop();
@@ -296,6 +174,7 @@ public:
   virtual uint32_t getColorSetting(ColorSettingCommandType cmd) { return 0u; }
   virtual float getColorSettingFloat(ColorSettingCommandType cmd) { return 0.0f; }
   virtual void setLedStatus(LedSettings led) {}
+  virtual Telemetry *getTelemetry() { return pipeline_->getTelemetry(); }
 
   bool open();
 
@@ -338,7 +217,10 @@ struct PrintBusAndDevice
 
 std::ostream &operator<<(std::ostream &out, const PrintBusAndDevice& dev)
 {
-  out << "@" << int(libusb_get_bus_number(dev.dev_)) << ":" << int(libusb_get_device_address(dev.dev_));
+  if (dev.dev_)
+    out << "@" << int(libusb_get_bus_number(dev.dev_)) << ":" << int(libusb_get_device_address(dev.dev_));
+  else
+    out << "@simulated";
   if (dev.status_)
     out << " " << WRITE_LIBUSB_ERROR(dev.status_);
   return out;
@@ -351,10 +233,11 @@ private:
   bool managed_usb_context_;
   libusb_context *usb_context_;
   EventLoop usb_event_loop_;
+  bool event_thread_;
 public:
   struct UsbDeviceWithSerial
   {
-    libusb_device *dev;
+    libusb_device *dev; ///< NULL for a simulated device.
     std::string serial;
   };
   typedef std::vector<UsbDeviceWithSerial> UsbDeviceVector;
@@ -363,13 +246,25 @@ public:
   bool has_device_enumeration_;
   UsbDeviceVector enumerated_devices_;
   DeviceVector devices_;
+  /** Guards devices_ against handleEvents() on the application's thread. Recursive
+   * because a listener called from there may close a device. */
+  std::recursive_mutex devices_mutex_;
+  typedef std::lock_guard<std::recursive_mutex> devices_guard;
+
+  UsbPollFdAdded poll_fd_added_;
+  UsbPollFdRemoved poll_fd_removed_;
+  void *poll_fd_user_data_;
 
   bool initialized;
 
-  Freenect2Impl(void *usb_context) :
+  Freenect2Impl(void *usb_context, bool event_thread) :
     managed_usb_context_(usb_context == 0),
     usb_context_(reinterpret_cast<libusb_context *>(usb_context)),
+    event_thread_(event_thread),
     has_device_enumeration_(false),
+    poll_fd_added_(0),
+    poll_fd_removed_(0),
+    poll_fd_user_data_(0),
     initialized(false)
   {
     if(managed_usb_context_)
@@ -383,7 +278,10 @@ public:
 
     }
 
-    usb_event_loop_.start(usb_context_);
+    if(event_thread)
+      usb_event_loop_.start(usb_context_);
+    else
+      LOG_INFO << "USB events are handled by the application";
     initialized = true;
   }
 
@@ -404,11 +302,23 @@ public:
     }
   }
 
+  libusb_context *usbContext()
+  {
+    return usb_context_;
+  }
+
+  /** False if the application handles USB events, see Freenect2::handleEvents(). */
+  bool eventThread() const
+  {
+    return event_thread_;
+  }
+
   void addDevice(Freenect2DeviceImpl *device)
   {
     if (!initialized)
       return;
 
+    devices_guard guard(devices_mutex_);
     devices_.push_back(device);
   }
 
@@ -417,6 +327,7 @@ public:
     if (!initialized)
       return;
 
+    devices_guard guard(devices_mutex_);
     DeviceVector::iterator it = std::find(devices_.begin(), devices_.end(), device);
 
     if(it != devices_.end())
@@ -434,6 +345,7 @@ public:
     if (!initialized)
       return false;
 
+    devices_guard guard(devices_mutex_);
     for(DeviceVector::iterator it = devices_.begin(); it != devices_.end(); ++it)
     {
       if((*it)->isSameUsbDevice(usb_device))
@@ -451,7 +363,11 @@ public:
     if (!initialized)
       return;
 
-    DeviceVector devices(devices_.begin(), devices_.end());
+    DeviceVector devices;
+    {
+      devices_guard guard(devices_mutex_);
+      devices.assign(devices_.begin(), devices_.end());
+    }
 
     for(DeviceVector::iterator it = devices.begin(); it != devices.end(); ++it)
     {
@@ -464,6 +380,29 @@ public:
     }
   }
 
+  /** Let simulated devices deliver their transfers, see Freenect2::handleEvents(). */
+  void handleSimulatedEvents()
+  {
+    devices_guard guard(devices_mutex_);
+    // By index, a listener may close a device meanwhile.
+    for (size_t i = 0; i < devices_.size(); ++i)
+      devices_[i]->handleSimulatedEvents();
+  }
+
+  static void LIBUSB_CALL onPollFdAdded(int fd, short events, void *user_data)
+  {
+    Freenect2Impl *self = static_cast<Freenect2Impl *>(user_data);
+    if (self->poll_fd_added_)
+      self->poll_fd_added_(fd, events, self->poll_fd_user_data_);
+  }
+
+  static void LIBUSB_CALL onPollFdRemoved(int fd, void *user_data)
+  {
+    Freenect2Impl *self = static_cast<Freenect2Impl *>(user_data);
+    if (self->poll_fd_removed_)
+      self->poll_fd_removed_(fd, self->poll_fd_user_data_);
+  }
+
   void clearDeviceEnumeration()
   {
     if (!initialized)
@@ -472,7 +411,8 @@ public:
     // free enumerated device pointers, this should not affect opened devices
     for(UsbDeviceVector::iterator it = enumerated_devices_.begin(); it != enumerated_devices_.end(); ++it)
     {
-      libusb_unref_device(it->dev);
+      if(it->dev)
+        libusb_unref_device(it->dev);
     }
 
     enumerated_devices_.clear();
@@ -554,11 +494,33 @@ public:
     }
 
     libusb_free_device_list(device_list, 0);
+
+    enumerateSimulatedDevices();
     has_device_enumeration_ = true;
 
     LOG_INFO << "found " << enumerated_devices_.size() << " devices";
   }
 
+  /** Add the simulated devices requested with LIBFREENECT2_SIMULATE=<count>. */
+  void enumerateSimulatedDevices()
+  {
+    const char *simulate_env = std::getenv("LIBFREENECT2_SIMULATE");
+    const int count = simulate_env ? std::atoi(simulate_env) : 0;
+
+    for(int i = 0; i < count; ++i)
+    {
+      UsbDeviceWithSerial dev_with_serial;
+      dev_with_serial.dev = 0;
+      dev_with_serial.serial = SimulatedKinectConfig().serial;
+      // SIMULATED000, SIMULATED001, ...
+      for(int n = i, digit = dev_with_serial.serial.size() - 1; n > 0 && digit >= 0; n /= 10, --digit)
+        dev_with_serial.serial[digit] = '0' + n % 10;
+
+      LOG_INFO << "found simulated Kinect v2 with serial " << dev_with_serial.serial;
+      enumerated_devices_.push_back(dev_with_serial);
+    }
+  }
+
   int getNumDevices()
   {
     if (!initialized)
@@ -572,6 +534,7 @@ public:
   }
 
   Freenect2Device *openDevice(int idx, const PacketPipeline *factory, bool attempting_reset);
+  Freenect2Device *openSimulatedDevice(const std::string &serial, const PacketPipeline *pipeline);
 };
 
 class Freenect2ReplayImpl
@@ -628,23 +591,43 @@ Freenect2Device::~Freenect2Device()
 {
 }
 
-Freenect2DeviceImpl::Freenect2DeviceImpl(Freenect2Impl *context, const PacketPipeline *pipeline, libusb_device *usb_device, libusb_device_handle *usb_device_handle, const std::string &serial) :
+Telemetry *Freenect2Device::getTelemetry()
+{
+  return 0;
+}
+
+Freenect2DeviceImpl::Freenect2DeviceImpl(Freenect2Impl *context, const PacketPipeline *pipeline, libusb_device *usb_device, Transport *transport, const std::string &serial) :
   state_(Created),
   has_usb_interfaces_(false),
   context_(context),
   usb_device_(usb_device),
-  usb_device_handle_(usb_device_handle),
-  rgb_transfer_pool_(usb_device_handle, 0x83),
-  ir_transfer_pool_(usb_device_handle, 0x84),
-  usb_control_(usb_device_handle_),
-  command_tx_(usb_device_handle_, 0x81, 0x02),
+  transport_(transport),
+  rgb_transfer_pool_(transport, 0x83),
+  ir_transfer_pool_(transport, 0x84),
+  usb_control_(transport),
+  command_tx_(transport, 0x81, 0x02),
   command_seq_(0),
   pipeline_(pipeline),
   serial_(serial),
-  firmware_("<unknown>")
+  firmware_("<unknown>"),
+  rgb_frame_listener_(0),
+  ir_frame_listener_(0),
+  has_config_(false),
+  rgb_xfer_size_(0),
+  rgb_num_xfers_(0),
+  ir_pkts_per_xfer_(0),
+  ir_num_xfers_(0),
+  max_iso_packet_size_(0)
 {
-  rgb_transfer_pool_.setCallback(pipeline_->getRgbPacketParser());
-  ir_transfer_pool_.setCallback(pipeline_->getIrPacketParser());
+  rgb_transfer_pool_.setTelemetry(pipeline_->getTelemetry(), Telemetry::Color);
+  ir_transfer_pool_.setTelemetry(pipeline_->getTelemetry(), Telemetry::Depth);
+  rgb_transfer_pool_.setExternalEvents(!context_->eventThread());
+  ir_transfer_pool_.setExternalEvents(!context_->eventThread());
+}
+
+Telemetry *Freenect2DeviceImpl::getTelemetry()
+{
+  return pipeline_->getTelemetry();
 }
 
 Freenect2DeviceImpl::~Freenect2DeviceImpl()
@@ -653,6 +636,7 @@ Freenect2DeviceImpl::~Freenect2DeviceImpl()
   context_->removeDevice(this);
 
   delete pipeline_;
+  delete transport_;
 }
 
 int Freenect2DeviceImpl::nextCommandSeq()
@@ -664,7 +648,7 @@ bool Freenect2DeviceImpl::isSameUsbDevice(libusb_device* other)
 {
   bool result = false;
 
-  if(state_ != Closed && usb_device_ != 0)
+  if(state_ != Closed && usb_device_ != 0 && other != 0)
   {
     unsigned char bus = libusb_get_bus_number(usb_device_);
     unsigned char address = libusb_get_device_address(usb_device_);
@@ -678,6 +662,19 @@ bool Freenect2DeviceImpl::isSameUsbDevice(libusb_device* other)
   return result;
 }
 
+bool Freenect2DeviceImpl::isSameSimulatedDevice(const std::string &serial)
+{
+  return state_ != Closed && usb_device_ == 0 && serial_ == serial;
+}
+
+bool Freenect2DeviceImpl::handleSimulatedEvents()
+{
+  if(usb_device_ != 0)
+    return false;
+  transport_->handleEvents(0);
+  return true;
+}
+
 std::string Freenect2DeviceImpl::getSerialNumber()
 {
   return serial_;
@@ -707,6 +704,8 @@ void Freenect2DeviceImpl::setColorCameraParams(const Freenect2Device::ColorCamer
 void Freenect2DeviceImpl::setIrCameraParams(const Freenect2Device::IrCameraParams &params)
 {
   ir_camera_params_ = params;
+  if (!pipeline_->hasDepthPacketProcessor())
+    return;
   DepthPacketProcessor *proc = pipeline_->getDepthPacketProcessor();
   if (proc != 0)
   {
@@ -724,22 +723,25 @@ Freenect2Device::Config::Config() :
 
 void Freenect2DeviceImpl::setConfiguration(const Freenect2Device::Config &config)
 {
-  DepthPacketProcessor *proc = pipeline_->getDepthPacketProcessor();
-  if (proc != 0)
-    proc->setConfiguration(config);
+  config_ = config;
+  has_config_ = true;
+  if (pipeline_->hasDepthPacketProcessor())
+    pipeline_->getDepthPacketProcessor()->setConfiguration(config);
 }
 
 void Freenect2DeviceImpl::setColorFrameListener(libfreenect2::FrameListener* rgb_frame_listener)
 {
   // TODO: should only be possible, if not started
-  if(pipeline_->getRgbPacketProcessor() != 0)
+  rgb_frame_listener_ = rgb_frame_listener;
+  if(pipeline_->hasRgbPacketProcessor())
     pipeline_->getRgbPacketProcessor()->setFrameListener(rgb_frame_listener);
 }
 
 void Freenect2DeviceImpl::setIrAndDepthFrameListener(libfreenect2::FrameListener* ir_frame_listener)
 {
   // TODO: should only be possible, if not started
-  if(pipeline_->getDepthPacketProcessor() != 0)
+  ir_frame_listener_ = ir_frame_listener;
+  if(pipeline_->hasDepthPacketProcessor())
     pipeline_->getDepthPacketProcessor()->setFrameListener(ir_frame_listener);
 }
 
@@ -849,11 +851,27 @@ bool Freenect2DeviceImpl::open()
   xfer_str = std::getenv("LIBFREENECT2_IR_TRANSFERS");
   if(xfer_str) ir_num_xfers = std::atoi(xfer_str);
 
+  // Start from the configured counts, grow on loss up to four times and shrink to half of them when calm.
+  xfer_str = std::getenv("LIBFREENECT2_ADAPTIVE_TRANSFERS");
+  if(xfer_str && std::atoi(xfer_str) > 0)
+  {
+    rgb_transfer_pool_.setAdaptive(std::max(1u, rgb_num_xfers / 2), rgb_num_xfers * 4);
+    ir_transfer_pool_.setAdaptive(std::max(1u, ir_num_xfers / 2), ir_num_xfers * 4);
+  }
+  else
+  {
+    rgb_transfer_pool_.setAdaptive(0, 0);
+    ir_transfer_pool_.setAdaptive(0, 0);
+  }
+
   LOG_INFO << "transfer pool sizes"
            << " rgb: " << rgb_num_xfers << "*" << rgb_xfer_size
            << " ir: " << ir_num_xfers << "*" << ir_pkts_per_xfer << "*" << max_iso_packet_size;
-  rgb_transfer_pool_.allocate(rgb_num_xfers, rgb_xfer_size);
-  ir_transfer_pool_.allocate(ir_num_xfers, ir_pkts_per_xfer, max_iso_packet_size);
+  rgb_xfer_size_ = rgb_xfer_size;
+  rgb_num_xfers_ = rgb_num_xfers;
+  ir_pkts_per_xfer_ = ir_pkts_per_xfer;
+  ir_num_xfers_ = ir_num_xfers;
+  max_iso_packet_size_ = max_iso_packet_size;
 
   state_ = Open;
 
@@ -872,50 +890,106 @@ bool Freenect2DeviceImpl::startStreams(bool enable_rgb, bool enable_depth)
   LOG_INFO << "starting...";
   if(state_ != Open) return false;
 
-  CommandTransaction::Result serial_result, firmware_result, result;
+  // Only the enabled streams get their half of the pipeline and their transfers.
+  if (enable_rgb)
+  {
+    RgbPacketProcessor *proc = pipeline_->getRgbPacketProcessor();
+    if (proc != 0)
+      proc->setFrameListener(rgb_frame_listener_);
+    rgb_transfer_pool_.setCallback(pipeline_->getRgbPacketParser());
+    if (!rgb_transfer_pool_.allocated())
+      rgb_transfer_pool_.allocate(rgb_num_xfers_, rgb_xfer_size_);
+  }
+  if (enable_depth)
+  {
+    DepthPacketProcessor *proc = pipeline_->getDepthPacketProcessor();
+    if (proc != 0)
+    {
+      proc->setFrameListener(ir_frame_listener_);
+      if (has_config_)
+        proc->setConfiguration(config_);
+    }
+    ir_transfer_pool_.setCallback(pipeline_->getIrPacketParser());
+    if (!ir_transfer_pool_.allocated())
+      ir_transfer_pool_.allocate(ir_num_xfers_, ir_pkts_per_xfer_, max_iso_packet_size_);
+  }
+
+  // Time to first frame counts from here.
+  Telemetry *telemetry = pipeline_->getTelemetry();
+  if (telemetry && enable_rgb)
+    telemetry->markStart(Telemetry::Color);
+  if (telemetry && enable_depth)
+    telemetry->markStart(Telemetry::Depth);
+
+  // Fast start reuses the calibration read by earlier starts and polls the status with backoff.
+  const char *fast_env = std::getenv("LIBFREENECT2_FAST_START");
+  const bool fast_start = fast_env && std::atoi(fast_env) > 0;
+  CalibrationCache cache(fast_start ? CalibrationCache::defaultDirectory() : std::string());
+
+  CommandTransaction::Result result;
+  DeviceCalibration calibration;
 
   if (usb_control_.setVideoTransferFunctionState(UsbControl::Enabled) != UsbControl::Success) return false;
 
-  if (!command_tx_.execute(ReadFirmwareVersionsCommand(nextCommandSeq()), firmware_result)) return false;
-  firmware_ = FirmwareVersionResponse(firmware_result).toString();
+  if (fast_start && cache.load(serial_, calibration))
+  {
+    LOG_INFO << "using cached calibration of " << serial_;
+  }
+  else
+  {
+    if (!command_tx_.execute(ReadFirmwareVersionsCommand(nextCommandSeq()), calibration.firmware)) return false;
+
+    if (!command_tx_.execute(ReadHardwareInfoCommand(nextCommandSeq()), result)) return false;
+    //The hardware version is currently useless.  It is only used to select the
+    //IR normalization table, but we don't have that.
+
+    if (!command_tx_.execute(ReadSerialNumberCommand(nextCommandSeq()), calibration.serial)) return false;
+    if (!command_tx_.execute(ReadDepthCameraParametersCommand(nextCommandSeq()), calibration.depth_params)) return false;
+    if (!command_tx_.execute(ReadP0TablesCommand(nextCommandSeq()), calibration.p0_tables)) return false;
+    if (!command_tx_.execute(ReadRgbCameraParametersCommand(nextCommandSeq()), calibration.rgb_params)) return false;
 
-  if (!command_tx_.execute(ReadHardwareInfoCommand(nextCommandSeq()), result)) return false;
-  //The hardware version is currently useless.  It is only used to select the
-  //IR normalization table, but we don't have that.
+    if (fast_start)
+      cache.store(serial_, calibration);
+  }
+
+  firmware_ = FirmwareVersionResponse(calibration.firmware).toString();
 
-  if (!command_tx_.execute(ReadSerialNumberCommand(nextCommandSeq()), serial_result)) return false;
-  std::string new_serial = SerialNumberResponse(serial_result).toString();
+  std::string new_serial = SerialNumberResponse(calibration.serial).toString();
 
   if(serial_ != new_serial)
   {
     LOG_WARNING << "serial number reported by libusb " << serial_ << " differs from serial number " << new_serial << " in device protocol! ";
   }
 
-  if (!command_tx_.execute(ReadDepthCameraParametersCommand(nextCommandSeq()), result)) return false;
-  setIrCameraParams(DepthCameraParamsResponse(result).toIrCameraParams());
+  setIrCameraParams(DepthCameraParamsResponse(calibration.depth_params).toIrCameraParams());
 
-  if (!command_tx_.execute(ReadP0TablesCommand(nextCommandSeq()), result)) return false;
-  if(pipeline_->getDepthPacketProcessor() != 0)
-    pipeline_->getDepthPacketProcessor()->loadP0TablesFromCommandResponse(&result[0], result.size());
+  if(pipeline_->hasDepthPacketProcessor())
+    pipeline_->getDepthPacketProcessor()->loadP0TablesFromCommandResponse(&calibration.p0_tables[0], calibration.p0_tables.size());
 
-  if (!command_tx_.execute(ReadRgbCameraParametersCommand(nextCommandSeq()), result)) return false;
-  setColorCameraParams(RgbCameraParamsResponse(result).toColorCameraParams());
+  setColorCameraParams(RgbCameraParamsResponse(calibration.rgb_params).toColorCameraParams());
 
   if (!command_tx_.execute(SetModeEnabledWith0x00640064Command(nextCommandSeq()), result)) return false;
   if (!command_tx_.execute(SetModeDisabledCommand(nextCommandSeq()), result)) return false;
 
-  int timeout = 50; // about 5 seconds (100ms x 50)
-  for (uint32_t status = 0, last = 0; (status & 1) == 0 && 0 < timeout; last = status, timeout--)
+  // Wait up to 5 seconds for the device to report ready. Polls are 100 ms apart, with fast start they back off from 1 ms to 10 ms.
+  const chrono::steady_clock::time_point status_deadline = chrono::steady_clock::now() + chrono::seconds(5);
+  chrono::milliseconds poll_delay(fast_start ? 1 : 100);
+  for (uint32_t status = 0, last = 0; (status & 1) == 0; last = status)
   {
     if (!command_tx_.execute(ReadStatus0x090000Command(nextCommandSeq()), result)) return false;
     status = Status0x090000Response(result).toNumber();
     if (status != last)
       LOG_DEBUG << "status 0x090000: " << status;
-    if ((status & 1) == 0)
-      this_thread::sleep_for(chrono::milliseconds(100));
-  }
-  if (timeout == 0) {
-    LOG_DEBUG << "status 0x090000: timeout";
+    if ((status & 1) != 0)
+      break;
+    if (chrono::steady_clock::now() >= status_deadline)
+    {
+      LOG_DEBUG << "status 0x090000: timeout";
+      break;
+    }
+    this_thread::sleep_for(poll_delay);
+    if (fast_start)
+      poll_delay = std::min(poll_delay * 2, chrono::milliseconds(10));
   }
 
   if (!command_tx_.execute(InitStreamsCommand(nextCommandSeq()), result)) return false;
@@ -978,6 +1052,7 @@ bool Freenect2DeviceImpl::stop()
     LOG_INFO << "canceling rgb transfers...";
     rgb_transfer_pool_.disableSubmission();
     rgb_transfer_pool_.cancel();
+    LOG_DEBUG << "rgb transfer count at stop: " << rgb_transfer_pool_.targetTransfers();
   }
 
   if (ir_transfer_pool_.enabled())
@@ -985,6 +1060,7 @@ bool Freenect2DeviceImpl::stop()
     LOG_INFO << "canceling depth transfers...";
     ir_transfer_pool_.disableSubmission();
     ir_transfer_pool_.cancel();
+    LOG_DEBUG << "depth transfer count at stop: " << ir_transfer_pool_.targetTransfers();
   }
 
   if (usb_control_.setIrInterfaceState(UsbControl::Disabled) != UsbControl::Success) return false;
@@ -1038,10 +1114,13 @@ bool Freenect2DeviceImpl::close()
   libfreenect2::this_thread::sleep_for(libfreenect2::chrono::milliseconds(4*1000));
 #endif
 
-  if(pipeline_->getRgbPacketProcessor() != 0)
+  // Packets queued before the transfers stopped still reach the listeners.
+  pipeline_->waitForIdle();
+
+  if(pipeline_->hasRgbPacketProcessor())
     pipeline_->getRgbPacketProcessor()->setFrameListener(0);
 
-  if(pipeline_->getDepthPacketProcessor() != 0)
+  if(pipeline_->hasDepthPacketProcessor())
     pipeline_->getDepthPacketProcessor()->setFrameListener(0);
 
   if(has_usb_interfaces_)
@@ -1058,8 +1137,7 @@ bool Freenect2DeviceImpl::close()
 
   LOG_INFO << "closing usb device...";
 
-  libusb_close(usb_device_handle_);
-  usb_device_handle_ = 0;
+  transport_->close();
   usb_device_ = 0;
 
   state_ = Closed;
@@ -1083,6 +1161,16 @@ PacketPipeline *createPacketPipelineByName(std::string name)
 #endif
   if (name == "cpu")
     return new CpuPacketPipeline();
+  if (name == "auto")
+  {
+    // Measured once per process, later processes on the host read the cached choice.
+    static libfreenect2::mutex mutex;
+    static std::string selected;
+    libfreenect2::lock_guard guard(mutex);
+    if (selected.empty())
+      selected = PipelineSelector(createPacketPipelineByName, protocol::CalibrationCache::defaultDirectory()).select();
+    return selected.empty() ? NULL : createPacketPipelineByName(selected);
+  }
   return NULL;
 }
 
@@ -1109,8 +1197,14 @@ PacketPipeline *createDefaultPacketPipeline()
 #endif
 }
 
+// Kept apart from the overload below so binaries built against it still load.
 Freenect2::Freenect2(void *usb_context) :
-    impl_(new Freenect2Impl(usb_context))
+    impl_(new Freenect2Impl(usb_context, true))
+{
+}
+
+Freenect2::Freenect2(void *usb_context, bool event_thread) :
+    impl_(new Freenect2Impl(usb_context, event_thread))
 {
 }
 
@@ -1166,6 +1260,9 @@ Freenect2Device *Freenect2Impl::openDevice(int idx, const PacketPipeline *pipeli
   Freenect2Impl::UsbDeviceWithSerial &dev = enumerated_devices_[idx];
   libusb_device_handle *dev_handle;
 
+  if(dev.dev == 0)
+    return openSimulatedDevice(dev.serial, pipeline);
+
   if(tryGetDevice(dev.dev, &device))
   {
     LOG_WARNING << "device " << PrintBusAndDevice(dev.dev)
@@ -1235,7 +1332,7 @@ Freenect2Device *Freenect2Impl::openDevice(int idx, const PacketPipeline *pipeli
     }
   }
 
-  device = new Freenect2DeviceImpl(this, pipeline, dev.dev, dev_handle, dev.serial);
+  device = new Freenect2DeviceImpl(this, pipeline, dev.dev, new LibUsbTransport(dev_handle, usb_context_), dev.serial);
   addDevice(device);
 
   if(!device->open())
@@ -1249,6 +1346,51 @@ Freenect2Device *Freenect2Impl::openDevice(int idx, const PacketPipeline *pipeli
   return device;
 }
 
+Freenect2Device *Freenect2Impl::openSimulatedDevice(const std::string &serial, const PacketPipeline *pipeline)
+{
+  {
+    devices_guard guard(devices_mutex_);
+    for(DeviceVector::iterator it = devices_.begin(); it != devices_.end(); ++it)
+    {
+      if((*it)->isSameSimulatedDevice(serial))
+      {
+        LOG_WARNING << "simulated device " << serial << " is already be open!";
+        delete pipeline;
+        return *it;
+      }
+    }
+  }
+
+  SimulatedKinectConfig config;
+  config.serial = serial;
+  config.external_events = !event_thread_;
+  const char *source_env = std::getenv("LIBFREENECT2_SIMULATE_DEPTH_FILE");
+  if(source_env)
+    config.depth_source = source_env;
+  source_env = std::getenv("LIBFREENECT2_SIMULATE_RGB_FILE");
+  if(source_env)
+    config.rgb_source = source_env;
+  source_env = std::getenv("LIBFREENECT2_SIMULATE_COMMAND_LATENCY_US");
+  if(source_env)
+    config.command_latency_us = std::atoi(source_env);
+  source_env = std::getenv("LIBFREENECT2_SIMULATE_STATUS_DELAY_MS");
+  if(source_env)
+    config.status_delay_ms = std::atoi(source_env);
+
+  Freenect2DeviceImpl *device = new Freenect2DeviceImpl(this, pipeline, 0, new SimulatedKinect(config), serial);
+  addDevice(device);
+
+  if(!device->open())
+  {
+    delete device;
+    device = 0;
+
+    LOG_ERROR << "failed to open simulated Kinect v2 " << serial;
+  }
+
+  return device;
+}
+
 Freenect2Device *Freenect2::openDevice(const std::string &serial)
 {
   return openDevice(serial, createDefaultPacketPipeline());
@@ -1281,6 +1423,74 @@ Freenect2Device *Freenect2::openDefaultDevice(const PacketPipeline *pipeline)
   return openDevice(0, pipeline);
 }
 
+std::vector<UsbPollFd> Freenect2::getPollFds()
+{
+  std::vector<UsbPollFd> result;
+  if (!impl_->initialized)
+    return result;
+
+  const libusb_pollfd **pollfds = libusb_get_pollfds(impl_->usbContext());
+  if (pollfds == 0)
+    return result;
+
+  for (size_t i = 0; pollfds[i] != 0; ++i)
+  {
+    UsbPollFd fd;
+    fd.fd = pollfds[i]->fd;
+    fd.events = pollfds[i]->events;
+    result.push_back(fd);
+  }
+  libusb_free_pollfds(pollfds);
+  return result;
+}
+
+void Freenect2::setPollFdNotifiers(UsbPollFdAdded added, UsbPollFdRemoved removed, void *user_data)
+{
+  if (!impl_->initialized)
+    return;
+
+  // The callbacks may not use libusb's calling convention, so they are called from trampolines.
+  impl_->poll_fd_added_ = added;
+  impl_->poll_fd_removed_ = removed;
+  impl_->poll_fd_user_data_ = user_data;
+  libusb_set_pollfd_notifiers(impl_->usbContext(),
+                              added ? &Freenect2Impl::onPollFdAdded : NULL,
+                              removed ? &Freenect2Impl::onPollFdRemoved : NULL,
+                              impl_);
+}
+
+int Freenect2::getNextTimeout()
+{
+  if (!impl_->initialized || libusb_pollfds_handle_timeouts(impl_->usbContext()) == 1)
+    return -1;
+
+  timeval tv;
+  if (libusb_get_next_timeout(impl_->usbContext(), &tv) != 1)
+    return -1;
+
+  // Round up so the application does not wake just before the timeout.
+  return static_cast<int>(tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000);
+}
+
+bool Freenect2::handleEvents(int timeout_ms)
+{
+  if (!impl_->initialized)
+    return false;
+
+  impl_->handleSimulatedEvents();
+
+  timeval tv;
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+  const int r = libusb_handle_events_timeout_completed(impl_->usbContext(), &tv, 0);
+  if (r != LIBUSB_SUCCESS)
+  {
+    LOG_ERROR << "failed to handle usb events: " << WRITE_LIBUSB_ERROR(r);
+    return false;
+  }
+  return true;
+}
+
 Freenect2ReplayDevice::Freenect2ReplayDevice(Freenect2ReplayImpl *context, const std::vector<std::string>& frame_filenames, const PacketPipeline* pipeline)
   :context_(context), pipeline_(pipeline), frame_filenames_(frame_filenames), running_(false)
 {
@@ -1384,10 +1594,10 @@ bool Freenect2ReplayDevice::close()
     stop();
   }
 
-  if(pipeline_->getRgbPacketProcessor() != 0)
+  if(pipeline_->hasRgbPacketProcessor())
     pipeline_->getRgbPacketProcessor()->setFrameListener(0);
 
-  if(pipeline_->getDepthPacketProcessor() != 0)
+  if(pipeline_->hasDepthPacketProcessor())
     pipeline_->getDepthPacketProcessor()->setFrameListener(0);
 
   running_ = false;
@@ -1426,6 +1636,9 @@ void Freenect2ReplayDevice::processRgbFrame(Frame* frame)
   packet.exposure = frame->exposure;
   packet.gain = frame->gain;
   packet.gamma = frame->gamma;
+  packet.arrival_time = packetArrivalTime();
+  packet.first_byte_time = packet.arrival_time;
+  packet.process_start_time = packet.arrival_time;
 
   pipeline_->getRgbPacketProcessor()->process(packet);
 }
@@ -1438,6 +1651,11 @@ void Freenect2ReplayDevice::processDepthFrame(Frame* frame)
   packet.sequence = frame->sequence;
   packet.buffer = frame->data;
   packet.buffer_length = frame->bytes_per_pixel;
+  packet.arrival_time = packetArrivalTime();
+  packet.first_byte_time = packet.arrival_time;
+  packet.process_start_time = packet.arrival_time;
+  packet.missing = 0;
+  packet.salvage = 0;
  
   pipeline_->getDepthPacketProcessor()->process(packet);
 }
@@ -1449,6 +1667,8 @@ void Freenect2ReplayDevice::loadP0Tables(unsigned char* buffer, size_t buffer_le
 
 void Freenect2ReplayDevice::static_execute(void* arg)
 {
+  this_thread::set_name("Replay");
+  this_thread::apply_policy(ThreadPolicy::Replay);
   static_cast<Freenect2ReplayDevice*>(arg)->run();
 }
 
@@ -1577,6 +1797,11 @@ void Freenect2ReplayDevice::run()
         packet_.sequence = timestamp_sequence[1];
         packet_.buffer = packet_.memory->data;
         packet_.buffer_length = length;
+        packet_.arrival_time = packetArrivalTime();
+        packet_.first_byte_time = packet_.arrival_time;
+        packet_.process_start_time = packet_.arrival_time;
+        packet_.missing = 0;
+        packet_.salvage = 0;
 
         pipeline_->getDepthPacketProcessor()->process(packet_);
         pipeline_->getDepthPacketProcessor()->allocateBuffer(packet_, buffer_size_);
@@ -1626,4 +1851,214 @@ Freenect2Device *Freenect2ReplayImpl::openDevice(const std::vector<std::string>&
   return device;
 }
 
+class Freenect2DeviceManagerImpl
+{
+public:
+  /** Counters of one stream at the start of the throughput interval. */
+  struct Snapshot
+  {
+    uint64_t processed, lost, bytes;
+  };
+
+  struct ManagedDevice
+  {
+    Freenect2Device *device;
+    std::string serial;
+    Snapshot last[Telemetry::StreamCount];
+    chrono::steady_clock::time_point since;
+  };
+
+  Freenect2 context_;
+  WorkerPool pool_;
+  std::vector<ManagedDevice> devices_;
+
+  Freenect2DeviceManagerImpl(size_t workers, void *usb_context) :
+    context_(usb_context),
+    pool_(workers)
+  {
+  }
+
+  ~Freenect2DeviceManagerImpl()
+  {
+    // Processors of the devices post to the pool, delete them first.
+    for (size_t i = 0; i < devices_.size(); i++)
+      delete devices_[i].device;
+    devices_.clear();
+  }
+
+  static Snapshot snapshot(const Telemetry *telemetry, Telemetry::Stream stream)
+  {
+    Snapshot s = Snapshot();
+    if (telemetry)
+    {
+      s.processed = telemetry->get(stream, Telemetry::FramesProcessed);
+      s.lost = telemetry->get(stream, Telemetry::FramesLost) + telemetry->get(stream, Telemetry::DroppedStale);
+      s.bytes = telemetry->get(stream, Telemetry::BytesReceived);
+    }
+    return s;
+  }
+
+  void add(Freenect2Device *device, const std::string &serial)
+  {
+    ManagedDevice d;
+    d.device = device;
+    d.serial = serial;
+    for (int stream = 0; stream < Telemetry::StreamCount; stream++)
+      d.last[stream] = snapshot(device->getTelemetry(), static_cast<Telemetry::Stream>(stream));
+    d.since = chrono::steady_clock::now();
+    devices_.push_back(d);
+  }
+
+  bool isOpen(const std::string &serial) const
+  {
+    for (size_t i = 0; i < devices_.size(); i++)
+      if (devices_[i].serial == serial)
+        return true;
+    return false;
+  }
+};
+
+Freenect2DeviceManager::Freenect2DeviceManager(size_t workers, void *usb_context) :
+    impl_(new Freenect2DeviceManagerImpl(workers, usb_context))
+{
+  LOG_INFO << "decoding on " << impl_->pool_.size() << " shared worker threads";
+}
+
+Freenect2DeviceManager::~Freenect2DeviceManager()
+{
+  delete impl_;
+}
+
+int Freenect2DeviceManager::enumerateDevices()
+{
+  return impl_->context_.enumerateDevices();
+}
+
+std::string Freenect2DeviceManager::getDeviceSerialNumber(int idx)
+{
+  return impl_->context_.getDeviceSerialNumber(idx);
+}
+
+Freenect2Device *Freenect2DeviceManager::openDevice(const std::string &serial)
+{
+  return openDevice(serial, createDefaultPacketPipeline());
+}
+
+Freenect2Device *Freenect2DeviceManager::openDevice(const std::string &serial, const PacketPipeline *pipeline)
+{
+  if (impl_->isOpen(serial))
+  {
+    LOG_ERROR << "device " << serial << " is already open";
+    delete pipeline;
+    return 0;
+  }
+
+  pipeline->setWorkerPool(&impl_->pool_);
+
+  Freenect2Device *device = impl_->context_.openDevice(serial, pipeline);
+  if (device)
+    impl_->add(device, serial);
+  return device;
+}
+
+size_t Freenect2DeviceManager::openAllDevices()
+{
+  size_t opened = 0;
+  const int num_devices = enumerateDevices();
+
+  for (int idx = 0; idx < num_devices; ++idx)
+  {
+    const std::string serial = getDeviceSerialNumber(idx);
+    if (!impl_->isOpen(serial) && openDevice(serial))
+      opened++;
+  }
+
+  return opened;
+}
+
+void Freenect2DeviceManager::closeDevice(Freenect2Device *device)
+{
+  for (size_t i = 0; i < impl_->devices_.size(); i++)
+  {
+    if (impl_->devices_[i].device == device)
+    {
+      impl_->devices_.erase(impl_->devices_.begin() + i);
+      device->close();
+      delete device;
+      return;
+    }
+  }
+  LOG_WARNING << "closeDevice: device was not opened by this manager";
+}
+
+std::vector<Freenect2Device *> Freenect2DeviceManager::getDevices()
+{
+  std::vector<Freenect2Device *> devices;
+  for (size_t i = 0; i < impl_->devices_.size(); i++)
+    devices.push_back(impl_->devices_[i].device);
+  return devices;
+}
+
+bool Freenect2DeviceManager::startAll()
+{
+  bool ok = true;
+  for (size_t i = 0; i < impl_->devices_.size(); i++)
+    ok = impl_->devices_[i].device->start() && ok;
+  return ok;
+}
+
+bool Freenect2DeviceManager::stopAll()
+{
+  bool ok = true;
+  for (size_t i = 0; i < impl_->devices_.size(); i++)
+    ok = impl_->devices_[i].device->stop() && ok;
+  return ok;
+}
+
+size_t Freenect2DeviceManager::getWorkerCount() const
+{
+  return impl_->pool_.size();
+}
+
+std::vector<DeviceThroughput> Freenect2DeviceManager::getThroughput()
+{
+  typedef Freenect2DeviceManagerImpl::Snapshot Snapshot;
+  std::vector<DeviceThroughput> result;
+  const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+  for (size_t i = 0; i < impl_->devices_.size(); i++)
+  {
+    Freenect2DeviceManagerImpl::ManagedDevice &d = impl_->devices_[i];
+    const Telemetry *telemetry = d.device->getTelemetry();
+    const double seconds = chrono::duration<double>(now - d.since).count();
+
+    Snapshot delta[Telemetry::StreamCount];
+    for (int stream = 0; stream < Telemetry::StreamCount; stream++)
+    {
+      const Snapshot current = Freenect2DeviceManagerImpl::snapshot(telemetry, static_cast<Telemetry::Stream>(stream));
+      delta[stream].processed = current.processed - d.last[stream].processed;
+      delta[stream].lost = current.lost - d.last[stream].lost;
+      delta[stream].bytes = current.bytes - d.last[stream].bytes;
+      d.last[stream] = current;
+    }
+    d.since = now;
+
+    DeviceThroughput t;
+    t.serial = d.serial;
+    t.seconds = seconds;
+    t.color_fps = seconds > 0 ? delta[Telemetry::Color].processed / seconds : 0;
+    t.depth_fps = seconds > 0 ? delta[Telemetry::Depth].processed / seconds : 0;
+    t.usb_mbps = seconds > 0 ? (delta[Telemetry::Color].bytes + delta[Telemetry::Depth].bytes) / seconds / 1e6 : 0;
+    t.color_lost = delta[Telemetry::Color].lost;
+    t.depth_lost = delta[Telemetry::Depth].lost;
+    const uint64_t color_total = delta[Telemetry::Color].processed + t.color_lost;
+    const uint64_t depth_total = delta[Telemetry::Depth].processed + t.depth_lost;
+    t.color_loss = color_total ? double(t.color_lost) / color_total : 0;
+    t.depth_loss = depth_total ? double(t.depth_lost) / depth_total : 0;
+    result.push_back(t);
+  }
+
+  return result;
+}
+
 } /* namespace libfreenect2 */
@@ -27,10 +27,14 @@
 /** @file logging.cpp Logging message handler classes. */
 
 #include <libfreenect2/logging.h>
+#include <libfreenect2/threading.h>
 #include <iostream>
 #include <cstdlib>
 #include <string>
+#include <sstream>
 #include <algorithm>
+#include <memory>
+#include <vector>
 
 #ifdef LIBFREENECT2_WITH_PROFILING
 #include <vector>
@@ -122,6 +126,297 @@ public:
   }
 };
 
+/** Logger passing messages on to another logger from a background thread. */
+class AsyncLogger : public Logger
+{
+public:
+  static const size_t RingCapacity = 256;               ///< Queued messages per thread.
+  static const size_t MessageReserve = 256;             ///< Bytes reserved per queued message.
+  static const uint64_t RepeatIntervalNs = 1000000000;  ///< Window in which a repeated message is suppressed.
+
+  AsyncLogger(Logger *logger):
+    logger_(logger),
+    id_(next_id_.fetch_add(1) + 1),
+    running_(true),
+    stopped_(false)
+  {
+    level_ = logger_->level();
+    thread_ = new thread(&AsyncLogger::run, this);
+  }
+
+  virtual ~AsyncLogger()
+  {
+    stop();
+    delete logger_;
+  }
+
+  virtual void log(Level level, const std::string &message)
+  {
+    if(level > level_) return;
+
+    // Nobody drains the rings any more, e.g. in static destructors at exit.
+    if (stopped_.load())
+    {
+      lock_guard guard(stopped_mutex_);
+      logger_->log(level, message);
+      return;
+    }
+
+    Ring &r = ring();
+
+    const uint64_t now = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    // The last message is compared in its slot, which is not reused before RingCapacity further messages.
+    if (r.has_last && now - r.last_time.load(std::memory_order_relaxed) < RepeatIntervalNs &&
+        r.slots[r.last_index % RingCapacity].message == message)
+    {
+      // The writer may have taken the count meanwhile, then counting starts over.
+      uint64_t pending = r.pending.load(std::memory_order_relaxed);
+      uint64_t next;
+      do
+      {
+        next = repeatCount(pending) == 0 ? packPending(r.last_index, level, 1) :
+               repeatCount(pending) < RepeatCountMask ? pending + 1 : pending;
+      } while (!r.pending.compare_exchange_weak(pending, next, std::memory_order_acq_rel));
+      return;
+    }
+
+    const uint64_t pending = r.pending.exchange(0, std::memory_order_acq_rel);
+    if (repeatCount(pending) > 0)
+      push(r, pendingLevel(pending), repeatNote(repeatCount(pending)));
+    r.last_time.store(now, std::memory_order_relaxed);
+    r.last_index = r.head.load(std::memory_order_relaxed);
+    r.has_last = push(r, level, message);
+
+    // stop() may have drained the rings before the push, then pass it on here.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (stopped_.load())
+    {
+      lock_guard guard(stopped_mutex_);
+      passQueued(r);
+    }
+  }
+
+  /** Stop the writer thread after passing on all queued messages. Later messages are passed on directly. */
+  void stop()
+  {
+    if (thread_ == 0)
+      return;
+    {
+      lock_guard guard(mutex_);
+      running_ = false;
+    }
+    wakeup_.notify_one();
+    thread_->join();
+    delete thread_;
+    thread_ = 0;
+
+    stopped_.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    lock_guard guard(stopped_mutex_);
+    drain(true);
+  }
+private:
+  struct Slot
+  {
+    Level level;
+    std::string message;
+  };
+
+  /** Messages of one thread. Only the owning thread writes slots and #head; the writer owns #tail. */
+  struct Ring
+  {
+    std::vector<Slot> slots;
+    atomic<uint64_t> head;
+    atomic<uint64_t> tail;
+    atomic<size_t> dropped;
+    atomic<bool> closed; ///< The owning thread exited.
+
+    // Repeat suppression. Only the owning thread accesses #has_last and #last_index.
+    bool has_last;       ///< The slot at #last_index holds the last message.
+    uint64_t last_index;
+    atomic<uint64_t> last_time; ///< Start of the suppression window, read by the writer.
+    atomic<uint64_t> pending;   ///< Suppressed repeats, see packPending(). Taken by whoever reports them.
+
+    Ring(): slots(RingCapacity), head(0), tail(0), dropped(0), closed(false),
+      has_last(false), last_index(0), last_time(0), pending(0)
+    {
+      for (size_t i = 0; i < slots.size(); i++)
+        slots[i].message.reserve(MessageReserve);
+    }
+  };
+
+  /** The calling thread's ring for the logger it last logged to. */
+  struct ThreadRing
+  {
+    uint64_t owner;
+    std::shared_ptr<Ring> ring;
+
+    ThreadRing(): owner(0) {}
+    ~ThreadRing()
+    {
+      if (ring)
+        ring->closed = true;
+    }
+  };
+
+  Ring &ring()
+  {
+    static thread_local ThreadRing current;
+    if (current.owner != id_)
+    {
+      if (current.ring)
+        current.ring->closed = true;
+      current.ring = std::make_shared<Ring>();
+      current.owner = id_;
+
+      lock_guard guard(mutex_);
+      rings_.push_back(current.ring);
+    }
+    return *current.ring;
+  }
+
+  /* Pending repeats are one word, so the owning thread and the writer hand them over without a lock:
+   * the low 32 bits of the repeated message's index, its level, and the count. */
+  static const uint64_t RepeatCountMask = 0xffffff;
+
+  static uint64_t packPending(uint64_t index, Level level, uint64_t count)
+  {
+    return (index & 0xffffffff) << 32 | uint64_t(level & 0xff) << 24 | count;
+  }
+
+  static uint64_t repeatCount(uint64_t pending) { return pending & RepeatCountMask; }
+  static Level pendingLevel(uint64_t pending) { return static_cast<Level>((pending >> 24) & 0xff); }
+
+  static std::string repeatNote(size_t repeats)
+  {
+    std::ostringstream note;
+    note << "last message repeated " << repeats << " times";
+    return note.str();
+  }
+
+  /** Queue a message. False if the ring was full and the message was dropped. */
+  static bool push(Ring &r, Level level, const std::string &message)
+  {
+    const uint64_t head = r.head.load(std::memory_order_relaxed);
+    if (head - r.tail.load(std::memory_order_acquire) >= RingCapacity)
+    {
+      r.dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    Slot &slot = r.slots[head % RingCapacity];
+    slot.level = level;
+    slot.message.assign(message);
+    r.head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** Pass on queued messages, up to but excluding index @p end. */
+  void passQueued(Ring &r, uint64_t end = ~uint64_t(0))
+  {
+    const uint64_t head = std::min(end, r.head.load(std::memory_order_acquire));
+    for (uint64_t t = r.tail.load(std::memory_order_relaxed); t < head; t++)
+    {
+      const Slot &slot = r.slots[t % RingCapacity];
+      logger_->log(slot.level, slot.message);
+      r.tail.store(t + 1, std::memory_order_release);
+    }
+  }
+
+  /** Report repeats of a message that was not followed by another one within the interval. */
+  void flushRepeats(Ring &r, bool force)
+  {
+    const uint64_t now = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    if (repeatCount(r.pending.load(std::memory_order_relaxed)) == 0 ||
+        (!force && now - r.last_time.load(std::memory_order_relaxed) < RepeatIntervalNs))
+      return;
+
+    const uint64_t pending = r.pending.exchange(0, std::memory_order_acq_rel);
+    if (repeatCount(pending) == 0)
+      return; // The owning thread reported them.
+
+    // The note follows the repeated message, but precedes messages queued after it.
+    const uint64_t tail = r.tail.load(std::memory_order_relaxed);
+    const uint64_t ahead = static_cast<uint32_t>((pending >> 32) - tail);
+    if (ahead < RingCapacity)
+      passQueued(r, tail + ahead + 1);
+    logger_->log(pendingLevel(pending), repeatNote(repeatCount(pending)));
+  }
+
+  /** Pass on all queued messages and due repeat notes, and forget rings of exited threads. */
+  void drain(bool force = false)
+  {
+    std::vector<std::shared_ptr<Ring> > rings;
+    {
+      lock_guard guard(mutex_);
+      rings = rings_;
+    }
+
+    bool any_closed = false;
+    for (size_t i = 0; i < rings.size(); i++)
+    {
+      Ring &r = *rings[i];
+      const bool closed = r.closed;
+      passQueued(r);
+      flushRepeats(r, force || closed);
+
+      const size_t dropped = r.dropped.exchange(0, std::memory_order_relaxed);
+      if (dropped > 0)
+      {
+        std::ostringstream note;
+        note << "[AsyncLogger] " << dropped << " messages dropped";
+        logger_->log(Warning, note.str());
+      }
+      any_closed = any_closed || closed;
+    }
+
+    if (any_closed)
+    {
+      lock_guard guard(mutex_);
+      for (size_t i = 0; i < rings_.size();)
+      {
+        // Checked before draining, so nothing was queued after the last drain.
+        if (rings_[i]->closed && rings_[i]->tail.load() == rings_[i]->head.load())
+          rings_.erase(rings_.begin() + i);
+        else
+          i++;
+      }
+    }
+  }
+
+  void run()
+  {
+    this_thread::set_name("Logger");
+    unique_lock guard(mutex_);
+    while (running_)
+    {
+      guard.unlock();
+      drain();
+      guard.lock();
+      if (running_)
+        wakeup_.wait_for(guard, chrono::milliseconds(10));
+    }
+  }
+
+  static atomic<uint64_t> next_id_;
+
+  Logger *logger_;
+  const uint64_t id_; ///< Identifies this logger to the thread-local rings.
+  thread *thread_;
+  mutex mutex_;
+  condition_variable wakeup_;
+  bool running_;
+  atomic<bool> stopped_;
+  mutex stopped_mutex_; ///< Serializes passing on messages once the writer thread is gone.
+  std::vector<std::shared_ptr<Ring> > rings_;
+};
+
+atomic<uint64_t> AsyncLogger::next_id_(0);
+
+Logger *createAsyncLogger(Logger *logger)
+{
+  return new AsyncLogger(logger);
+}
+
 Logger *createConsoleLogger(Logger::Level level)
 {
   return new ConsoleLogger(level);
@@ -132,7 +427,53 @@ Logger *createConsoleLoggerWithDefaultLevel()
   return new ConsoleLogger(Logger::getDefaultLevel());
 }
 
-LogMessage::LogMessage(Logger *logger, Logger::Level level) : logger_(logger), level_(level)
+LogBuffer::int_type LogBuffer::overflow(int_type c)
+{
+  if (!traits_type::eq_int_type(c, traits_type::eof()))
+    text_->push_back(traits_type::to_char_type(c));
+  return traits_type::not_eof(c);
+}
+
+std::streamsize LogBuffer::xsputn(const char *s, std::streamsize n)
+{
+  text_->append(s, n);
+  return n;
+}
+
+/** Formatting buffer of the calling thread; its capacity is kept so steady logging does not allocate. */
+struct ThreadLogText
+{
+  std::string text;
+  bool busy;
+
+  ThreadLogText(): busy(false) {}
+};
+
+static ThreadLogText &threadLogText()
+{
+  static thread_local ThreadLogText current;
+  return current;
+}
+
+static std::string *acquireLogText(std::string *fallback)
+{
+  ThreadLogText &current = threadLogText();
+  if (current.busy)
+    return fallback;
+  current.busy = true;
+  current.text.clear();
+  return &current.text;
+}
+
+static void releaseLogText(std::string *text)
+{
+  ThreadLogText &current = threadLogText();
+  if (text == &current.text)
+    current.busy = false;
+}
+
+LogMessage::LogMessage(Logger *logger, Logger::Level level):
+  logger_(logger), level_(level), text_(acquireLogText(&own_text_)), buffer_(text_), stream_(&buffer_)
 {
 
 }
@@ -154,19 +495,16 @@ std::string getShortName(const char *func)
 }
 
 LogMessage::LogMessage(Logger *logger, Logger::Level level, const char *source):
-  logger_(logger), level_(level)
+  logger_(logger), level_(level), text_(acquireLogText(&own_text_)), buffer_(text_), stream_(&buffer_)
 {
   stream_ << "[" << getShortName(source) << "] ";
 }
 
 LogMessage::~LogMessage()
 {
-  if(logger_ != 0 && stream_.good())
-  {
-    const std::string &message = stream_.str();
-    if (message.size())
-      logger_->log(level_, message);
-  }
+  if(logger_ != 0 && stream_.good() && text_->size())
+    logger_->log(level_, *text_);
+  releaseLogText(text_);
 }
 
 std::ostream &LogMessage::stream()
@@ -174,9 +512,34 @@ std::ostream &LogMessage::stream()
   return stream_;
 }
 
+std::ostream &nullLogStream()
+{
+  // Without a buffer the stream is bad, so operator<< returns without formatting.
+  static thread_local std::ostream stream(NULL);
+  return stream;
+}
+
 static ConsoleLogger defaultLogger_(Logger::getDefaultLevel());
 static Logger *userLogger_ = &defaultLogger_;
 
+/* Installs the asynchronous default logger, and flushes an asynchronous global logger at exit. */
+static struct AsyncLoggerInit
+{
+  AsyncLoggerInit()
+  {
+    const char *env = std::getenv("LIBFREENECT2_LOGGER_ASYNC");
+    if (env && std::string(env) == "1")
+      userLogger_ = createAsyncLogger(createConsoleLoggerWithDefaultLevel());
+  }
+
+  ~AsyncLoggerInit()
+  {
+    AsyncLogger *async = dynamic_cast<AsyncLogger *>(userLogger_);
+    if (async)
+      async->stop();
+  }
+} asyncLoggerInit_;
+
 Logger *getGlobalLogger()
 {
   return userLogger_;
@@ -292,10 +655,11 @@ public:
     Timer::stop();
 #else
     double this_duration = Timer::stop();
-    if (name.empty())
+    // LOG_* streams format into a LogBuffer, whose text so far is the source prefix.
+    const LogBuffer *buffer = dynamic_cast<const LogBuffer *>(stream.rdbuf());
+    if (name.empty() && buffer)
     {
-      std::stringstream &ss = static_cast<std::stringstream &>(stream);
-      name = ss.str();
+      name = buffer->text();
     }
     stats.push_back(this_duration*1e3);
 #endif
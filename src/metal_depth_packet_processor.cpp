@@ -31,6 +31,7 @@
 #include <libfreenect2/resource.h>
 #include <libfreenect2/protocol/response.h>
 #include <libfreenect2/logging.h>
+#include <libfreenect2/trace_span.h>
 
 #include <sstream>
 #include <cstring>
@@ -243,11 +244,19 @@ void MetalDepthPacketProcessor::process(const DepthPacket &packet)
   impl_->ir_frame->sequence = packet.sequence;
   impl_->depth_frame->sequence = packet.sequence;
   
-  impl_->process(packet);
+  {
+    // Encodes the compute passes and waits for the command buffer.
+    trace::Span span("depth_metal_run", packet.sequence);
+    impl_->process(packet);
+  }
+
+  salvage_filter_.apply(packet, impl_->ir_frame, impl_->depth_frame);
+  timer_.stamp(packet, impl_->ir_frame, impl_->depth_frame);
   
-  if (listener_->onNewFrame(Frame::Ir, impl_->ir_frame))
+  trace::Span listener_span("depth_listener", packet.sequence);
+  if (deliverFrame(listener_, Frame::Ir, impl_->ir_frame))
     impl_->newIrFrame();
-  if (listener_->onNewFrame(Frame::Depth, impl_->depth_frame))
+  if (deliverFrame(listener_, Frame::Depth, impl_->depth_frame))
     impl_->newDepthFrame();
 }
 
@@ -30,6 +30,7 @@
 #include <libfreenect2/resource.h>
 #include <libfreenect2/protocol/response.h>
 #include <libfreenect2/logging.h>
+#include <libfreenect2/trace_span.h>
 
 #include <sstream>
 
@@ -613,6 +614,8 @@ public:
     std::vector<cl::Event> eventWrite(1), eventPPS1(1), eventFPS1(1), eventPPS2(1), eventFPS2(1);
     cl::Event eventReadIr, eventReadDepth;
 
+    // Kernels run asynchronously: trace the time spent enqueueing and the time spent waiting for the results.
+    const uint64_t trace_start = trace::active() ? trace::now() : 0;
     CHECK_CL_RETURN(queue.enqueueWriteBuffer(buf_packet, CL_FALSE, 0, buf_packet_size, packet.buffer, NULL, &eventWrite[0]));
     CHECK_CL_RETURN(queue.enqueueNDRangeKernel(kernel_processPixelStage1, cl::NullRange, cl::NDRange(IMAGE_SIZE), cl::NullRange, &eventWrite, &eventPPS1[0]));
     CHECK_CL_RETURN(queue.enqueueReadBuffer(buf_ir, CL_FALSE, 0, buf_ir_size, ir_frame->data, &eventPPS1, &eventReadIr));
@@ -631,8 +634,14 @@ public:
     CHECK_CL_RETURN(queue.enqueueNDRangeKernel(kernel_filter_kde, cl::NullRange, cl::NDRange(IMAGE_SIZE), cl::NullRange, &eventPPS2, &eventFPS2[0]));
 
     CHECK_CL_RETURN(queue.enqueueReadBuffer(buf_depth, CL_FALSE, 0, buf_depth_size, depth_frame->data, &eventFPS2, &eventReadDepth));
+    const uint64_t trace_enqueued = trace_start != 0 ? trace::now() : 0;
     CHECK_CL_RETURN(eventReadIr.wait());
     CHECK_CL_RETURN(eventReadDepth.wait());
+    if(trace_start != 0)
+    {
+      trace::record("depth_opencl_enqueue", packet.sequence, trace_start, trace_enqueued);
+      trace::record("depth_opencl_wait", packet.sequence, trace_enqueued, trace::now());
+    }
 
 #ifdef LIBFREENECT2_WITH_PROFILING_CL
     if(count == 0)
@@ -874,15 +883,19 @@ void OpenCLKdeDepthPacketProcessor::process(const DepthPacket &packet)
 
   impl_->stopTiming(LOG_INFO);
 
+  salvage_filter_.apply(packet, impl_->ir_frame, impl_->depth_frame);
+  timer_.stamp(packet, impl_->ir_frame, impl_->depth_frame);
+
   if (!impl_->runtimeOk)
   {
     impl_->ir_frame->status = 1;
     impl_->depth_frame->status = 1;
   }
 
-  if(listener_->onNewFrame(Frame::Ir, impl_->ir_frame))
+  trace::Span listener_span("depth_listener", packet.sequence);
+  if(deliverFrame(listener_, Frame::Ir, impl_->ir_frame))
     impl_->newIrFrame();
-  if(listener_->onNewFrame(Frame::Depth, impl_->depth_frame))
+  if(deliverFrame(listener_, Frame::Depth, impl_->depth_frame))
     impl_->newDepthFrame();
 }
 
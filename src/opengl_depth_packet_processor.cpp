@@ -30,6 +30,7 @@
 #include <libfreenect2/resource.h>
 #include <libfreenect2/protocol/response.h>
 #include <libfreenect2/logging.h>
+#include <libfreenect2/trace_span.h>
 #include "flextGL.h"
 #include <GLFW/glfw3.h>
 
@@ -963,9 +964,16 @@ void OpenGLDepthPacketProcessor::process(const DepthPacket &packet)
 
   glfwMakeContextCurrent(impl_->opengl_context_ptr);
 
-  std::copy(packet.buffer, packet.buffer + packet.buffer_length/10*9, impl_->input_data.data);
-  impl_->input_data.upload();
-  impl_->run(&ir, &depth);
+  {
+    trace::Span span("depth_opengl_upload", packet.sequence);
+    std::copy(packet.buffer, packet.buffer + packet.buffer_length/10*9, impl_->input_data.data);
+    impl_->input_data.upload();
+  }
+  {
+    // Includes reading the frames back, which waits for the GPU.
+    trace::Span span("depth_opengl_run", packet.sequence);
+    impl_->run(&ir, &depth);
+  }
 
   if(impl_->do_debug) glfwSwapBuffers(impl_->opengl_context_ptr);
 
@@ -976,10 +984,14 @@ void OpenGLDepthPacketProcessor::process(const DepthPacket &packet)
   ir->sequence = packet.sequence;
   depth->sequence = packet.sequence;
 
-  if(!listener_->onNewFrame(Frame::Ir, ir))
+  salvage_filter_.apply(packet, ir, depth);
+  timer_.stamp(packet, ir, depth);
+
+  trace::Span listener_span("depth_listener", packet.sequence);
+  if(!deliverFrame(listener_, Frame::Ir, ir))
     delete ir;
 
-  if(!listener_->onNewFrame(Frame::Depth, depth))
+  if(!deliverFrame(listener_, Frame::Depth, depth))
     delete depth;
 }
 
@@ -33,6 +33,8 @@
 #include <libfreenect2/depth_packet_stream_parser.h>
 #include <libfreenect2/protocol/response.h>
 
+#include <cstdlib>
+
 #ifdef LIBFREENECT2_WITH_METAL_SUPPORT
 #include <libfreenect2/metal_depth_packet_processor.h>
 #endif
@@ -58,6 +60,25 @@ static RgbPacketProcessor *getDefaultRgbPacketProcessor()
 #endif
 }
 
+/* Depth of the queues in front of the processors, LIBFREENECT2_PACKET_QUEUE_DEPTH overrides the default. */
+static size_t getPacketQueueDepth()
+{
+  size_t depth = AsyncPacketProcessor<RgbPacket>::DefaultQueueDepth;
+  const char *depth_str = std::getenv("LIBFREENECT2_PACKET_QUEUE_DEPTH");
+  if(depth_str && std::atoi(depth_str) > 0)
+    depth = std::atoi(depth_str);
+  return depth;
+}
+
+/* Maximum age of queued packets in ns from LIBFREENECT2_MAX_PACKET_AGE_MS, 0 if unset. */
+static uint64_t getMaxPacketAge()
+{
+  const char *age_str = std::getenv("LIBFREENECT2_MAX_PACKET_AGE_MS");
+  if(age_str && std::atof(age_str) > 0)
+    return static_cast<uint64_t>(std::atof(age_str) * 1000000.0);
+  return 0;
+}
+
 class PacketPipelineComponents
 {
 public:
@@ -65,27 +86,68 @@ public:
   DepthPacketStreamParser *depth_parser_;
 
   RgbPacketProcessor *rgb_processor_;
-  BaseRgbPacketProcessor *async_rgb_processor_;
+  AsyncPacketProcessor<RgbPacket> *async_rgb_processor_;
   DepthPacketProcessor *depth_processor_;
-  BaseDepthPacketProcessor *async_depth_processor_;
+  AsyncPacketProcessor<DepthPacket> *async_depth_processor_;
+
+  bool rgb_initialized_;
+  bool depth_initialized_;
+  WorkerPool *pool_;
+  libfreenect2::mutex mutex_; ///< Guards the construction of the halves.
+
+  Telemetry telemetry_;
 
+  PacketPipelineComponents();
   ~PacketPipelineComponents();
-  void initialize(RgbPacketProcessor *rgb, DepthPacketProcessor *depth);
+  void initializeRgb(RgbPacketProcessor *rgb);
+  void initializeDepth(DepthPacketProcessor *depth);
 };
 
-void PacketPipelineComponents::initialize(RgbPacketProcessor *rgb, DepthPacketProcessor *depth)
+PacketPipelineComponents::PacketPipelineComponents() :
+  rgb_parser_(0),
+  depth_parser_(0),
+  rgb_processor_(0),
+  async_rgb_processor_(0),
+  depth_processor_(0),
+  async_depth_processor_(0),
+  rgb_initialized_(false),
+  depth_initialized_(false),
+  pool_(0)
 {
-  rgb_parser_ = new RgbPacketStreamParser();
-  depth_parser_ = new DepthPacketStreamParser();
+}
+
+void PacketPipelineComponents::initializeRgb(RgbPacketProcessor *rgb)
+{
+  rgb_initialized_ = true;
+  if (rgb == 0)
+    return;
 
+  rgb_parser_ = new RgbPacketStreamParser();
   rgb_processor_ = rgb;
-  depth_processor_ = depth;
+  async_rgb_processor_ = new AsyncPacketProcessor<RgbPacket>(rgb_processor_, ThreadPolicy::RgbProcessor, getPacketQueueDepth());
+  async_rgb_processor_->setMaxPacketAge(getMaxPacketAge());
+  async_rgb_processor_->setTelemetry(&telemetry_, Telemetry::Color);
+  rgb_parser_->setTelemetry(&telemetry_);
+  rgb_parser_->setPacketProcessor(async_rgb_processor_);
+  if (pool_)
+    async_rgb_processor_->setWorkerPool(pool_);
+}
 
-  async_rgb_processor_ = new AsyncPacketProcessor<RgbPacket>(rgb_processor_);
-  async_depth_processor_ = new AsyncPacketProcessor<DepthPacket>(depth_processor_);
+void PacketPipelineComponents::initializeDepth(DepthPacketProcessor *depth)
+{
+  depth_initialized_ = true;
+  if (depth == 0)
+    return;
 
-  rgb_parser_->setPacketProcessor(async_rgb_processor_);
+  depth_parser_ = new DepthPacketStreamParser();
+  depth_processor_ = depth;
+  async_depth_processor_ = new AsyncPacketProcessor<DepthPacket>(depth_processor_, ThreadPolicy::DepthProcessor, getPacketQueueDepth());
+  async_depth_processor_->setMaxPacketAge(getMaxPacketAge());
+  async_depth_processor_->setTelemetry(&telemetry_, Telemetry::Depth);
+  depth_parser_->setTelemetry(&telemetry_);
   depth_parser_->setPacketProcessor(async_depth_processor_);
+  if (pool_ && !async_depth_processor_->setWorkerPool(pool_))
+    LOG_INFO << depth_processor_->name() << " depth processing keeps its own thread";
 }
 
 PacketPipelineComponents::~PacketPipelineComponents()
@@ -107,76 +169,152 @@ PacketPipeline::~PacketPipeline()
 
 PacketPipeline::PacketParser *PacketPipeline::getRgbPacketParser() const
 {
+  getRgbPacketProcessor();
   return comp_->rgb_parser_;
 }
 
 PacketPipeline::PacketParser *PacketPipeline::getIrPacketParser() const
 {
+  getDepthPacketProcessor();
   return comp_->depth_parser_;
 }
 
 RgbPacketProcessor *PacketPipeline::getRgbPacketProcessor() const
 {
+  libfreenect2::lock_guard guard(comp_->mutex_);
+  if (!comp_->rgb_initialized_)
+    comp_->initializeRgb(createRgbPacketProcessor());
   return comp_->rgb_processor_;
 }
 
 DepthPacketProcessor *PacketPipeline::getDepthPacketProcessor() const
 {
+  libfreenect2::lock_guard guard(comp_->mutex_);
+  if (!comp_->depth_initialized_)
+    comp_->initializeDepth(createDepthPacketProcessor());
   return comp_->depth_processor_;
 }
 
-CpuPacketPipeline::CpuPacketPipeline()
+bool PacketPipeline::hasRgbPacketProcessor() const
+{
+  libfreenect2::lock_guard guard(comp_->mutex_);
+  return comp_->rgb_processor_ != 0;
+}
+
+bool PacketPipeline::hasDepthPacketProcessor() const
+{
+  libfreenect2::lock_guard guard(comp_->mutex_);
+  return comp_->depth_processor_ != 0;
+}
+
+RgbPacketProcessor *PacketPipeline::createRgbPacketProcessor() const
+{
+  return getDefaultRgbPacketProcessor();
+}
+
+DepthPacketProcessor *PacketPipeline::createDepthPacketProcessor() const
+{
+  return 0;
+}
+
+Telemetry *PacketPipeline::getTelemetry() const
 {
-  comp_->initialize(getDefaultRgbPacketProcessor(), new CpuDepthPacketProcessor());
+  return &comp_->telemetry_;
 }
 
+void PacketPipeline::setWorkerPool(WorkerPool *pool) const
+{
+  libfreenect2::lock_guard guard(comp_->mutex_);
+  // Halves constructed later pick the pool up in initializeRgb() and initializeDepth().
+  comp_->pool_ = pool;
+  if (comp_->async_rgb_processor_)
+    comp_->async_rgb_processor_->setWorkerPool(pool);
+  if (comp_->async_depth_processor_ && !comp_->async_depth_processor_->setWorkerPool(pool))
+    LOG_INFO << comp_->depth_processor_->name() << " depth processing keeps its own thread";
+}
+
+void PacketPipeline::waitForIdle() const
+{
+  AsyncPacketProcessor<RgbPacket> *rgb;
+  AsyncPacketProcessor<DepthPacket> *depth;
+  {
+    libfreenect2::lock_guard guard(comp_->mutex_);
+    rgb = comp_->async_rgb_processor_;
+    depth = comp_->async_depth_processor_;
+  }
+  if (rgb)
+    rgb->waitForIdle();
+  if (depth)
+    depth->waitForIdle();
+}
+
+CpuPacketPipeline::CpuPacketPipeline() {}
+
 CpuPacketPipeline::~CpuPacketPipeline() { }
 
-#ifdef LIBFREENECT2_WITH_METAL_SUPPORT
-MetalPacketPipeline::MetalPacketPipeline(const int deviceId) : deviceId(deviceId)
+DepthPacketProcessor *CpuPacketPipeline::createDepthPacketProcessor() const
 {
-  comp_->initialize(getDefaultRgbPacketProcessor(), new MetalDepthPacketProcessor(deviceId));
+  return new CpuDepthPacketProcessor();
 }
 
+#ifdef LIBFREENECT2_WITH_METAL_SUPPORT
+MetalPacketPipeline::MetalPacketPipeline(const int deviceId) : deviceId(deviceId) {}
+
 MetalPacketPipeline::~MetalPacketPipeline() { }
-#endif // LIBFREENECT2_WITH_METAL_SUPPORT
 
-#ifdef LIBFREENECT2_WITH_OPENGL_SUPPORT
-OpenGLPacketPipeline::OpenGLPacketPipeline(void *parent_opengl_context, bool debug) : parent_opengl_context_(parent_opengl_context), debug_(debug)
+DepthPacketProcessor *MetalPacketPipeline::createDepthPacketProcessor() const
 {
-  comp_->initialize(getDefaultRgbPacketProcessor(), new OpenGLDepthPacketProcessor(parent_opengl_context_, debug_));
+  return new MetalDepthPacketProcessor(deviceId);
 }
+#endif // LIBFREENECT2_WITH_METAL_SUPPORT
+
+#ifdef LIBFREENECT2_WITH_OPENGL_SUPPORT
+OpenGLPacketPipeline::OpenGLPacketPipeline(void *parent_opengl_context, bool debug) : parent_opengl_context_(parent_opengl_context), debug_(debug) {}
 
 OpenGLPacketPipeline::~OpenGLPacketPipeline() { }
+
+DepthPacketProcessor *OpenGLPacketPipeline::createDepthPacketProcessor() const
+{
+  return new OpenGLDepthPacketProcessor(parent_opengl_context_, debug_);
+}
 #endif // LIBFREENECT2_WITH_OPENGL_SUPPORT
 
 
 #ifdef LIBFREENECT2_WITH_OPENCL_SUPPORT
-OpenCLPacketPipeline::OpenCLPacketPipeline(const int deviceId) : deviceId(deviceId)
-{
-  comp_->initialize(getDefaultRgbPacketProcessor(), new OpenCLDepthPacketProcessor(deviceId));
-}
+OpenCLPacketPipeline::OpenCLPacketPipeline(const int deviceId) : deviceId(deviceId) {}
 
 OpenCLPacketPipeline::~OpenCLPacketPipeline() { }
 
-
-OpenCLKdePacketPipeline::OpenCLKdePacketPipeline(const int deviceId) : deviceId(deviceId)
+DepthPacketProcessor *OpenCLPacketPipeline::createDepthPacketProcessor() const
 {
-  comp_->initialize(getDefaultRgbPacketProcessor(), new OpenCLKdeDepthPacketProcessor(deviceId));
+  return new OpenCLDepthPacketProcessor(deviceId);
 }
 
+
+OpenCLKdePacketPipeline::OpenCLKdePacketPipeline(const int deviceId) : deviceId(deviceId) {}
+
 OpenCLKdePacketPipeline::~OpenCLKdePacketPipeline() { }
-#endif // LIBFREENECT2_WITH_OPENCL_SUPPORT
 
-DumpPacketPipeline::DumpPacketPipeline()
+DepthPacketProcessor *OpenCLKdePacketPipeline::createDepthPacketProcessor() const
 {
-  RgbPacketProcessor *rgb = new DumpRgbPacketProcessor();
-  DepthPacketProcessor *depth = new DumpDepthPacketProcessor();
-  comp_->initialize(rgb, depth);
+  return new OpenCLKdeDepthPacketProcessor(deviceId);
 }
+#endif // LIBFREENECT2_WITH_OPENCL_SUPPORT
+
+DumpPacketPipeline::DumpPacketPipeline() {}
 
 DumpPacketPipeline::~DumpPacketPipeline() {}
 
+RgbPacketProcessor *DumpPacketPipeline::createRgbPacketProcessor() const
+{
+  return new DumpRgbPacketProcessor();
+}
+
+DepthPacketProcessor *DumpPacketPipeline::createDepthPacketProcessor() const
+{
+  return new DumpDepthPacketProcessor();
+}
+
 const unsigned char* DumpPacketPipeline::getDepthP0Tables(size_t* length) {
   *length = sizeof(libfreenect2::protocol::P0TablesResponse);
   return static_cast<DumpDepthPacketProcessor*>(getDepthPacketProcessor())->getP0Tables();
@@ -0,0 +1,263 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+
+/** @file pipeline_selection.cpp Choice of the fastest depth pipeline on the host. */
+
+#include <libfreenect2/pipeline_selection.h>
+#include <libfreenect2/depth_packet_processor.h>
+#include <libfreenect2/depth_tables.h>
+#include <libfreenect2/logging.h>
+#include <libfreenect2/stream_generator.h>
+#include <libfreenect2/threading.h>
+#include <libfreenect2/protocol/calibration_cache.h>
+#include <libfreenect2/protocol/response.h>
+#include <libfreenect2/usb/simulated_kinect.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace libfreenect2
+{
+
+namespace
+{
+const size_t WarmupFrames = 2;
+const size_t MinFrames = 3;
+const size_t MaxFrames = 200;
+
+class DiscardingListener: public FrameListener
+{
+public:
+  virtual bool onNewFrame(Frame::Type, Frame *) { return false; }
+};
+
+std::string hostName()
+{
+#ifdef _WIN32
+  const char *env = std::getenv("COMPUTERNAME");
+  std::string name = env ? env : "";
+#else
+  char buffer[256] = {0};
+  std::string name = gethostname(buffer, sizeof(buffer) - 1) == 0 ? buffer : "";
+#endif
+  for (size_t i = 0; i < name.size(); i++)
+  {
+    const char c = name[i];
+    if (!((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '-'))
+      name[i] = '_';
+  }
+  return name.empty() ? "localhost" : name;
+}
+
+double milliseconds(chrono::steady_clock::duration d)
+{
+  return chrono::duration<double, std::milli>(d).count();
+}
+} /* namespace */
+
+PipelineSelector::PipelineSelector(Factory factory, const std::string &cache_directory, double budget_ms) :
+  factory_(factory),
+  cache_directory_(cache_directory),
+  budget_ms_(budget_ms)
+{
+}
+
+std::vector<std::string> PipelineSelector::candidates()
+{
+  std::vector<std::string> names;
+#ifdef LIBFREENECT2_WITH_METAL_SUPPORT
+  names.push_back("metal");
+#endif
+#ifdef LIBFREENECT2_WITH_OPENGL_SUPPORT
+  // OpenGL needs a window system.
+#if defined(__linux__)
+  if (std::getenv("DISPLAY") || std::getenv("WAYLAND_DISPLAY"))
+#endif
+    names.push_back("gl");
+#endif
+#ifdef LIBFREENECT2_WITH_OPENCL_SUPPORT
+  names.push_back("cl");
+#endif
+  names.push_back("cpu");
+  return names;
+}
+
+std::vector<PipelineTiming> PipelineSelector::measure(const std::vector<std::string> &names) const
+{
+  // The calibration of the simulated device and a generated pattern stand in for a real device.
+  std::vector<unsigned char> p0_tables = usb::SimulatedKinect::p0TablesResponse();
+  const IrCameraTables tables(protocol::DepthCameraParamsResponse(usb::SimulatedKinect::depthCameraParamsResponse()).toIrCameraParams());
+  StreamGenerator generator;
+  std::vector<unsigned char> data = generator.depthSource();
+
+  std::vector<PipelineTiming> timings;
+  for (size_t i = 0; i < names.size(); i++)
+  {
+    PipelineTiming timing;
+    timing.name = names[i];
+    timing.frames = 0;
+    timing.median_ms = 0;
+    timing.mean_ms = 0;
+
+    PacketPipeline *pipeline = factory_(names[i]);
+    DepthPacketProcessor *processor = pipeline ? pipeline->getDepthPacketProcessor() : 0;
+    if (processor)
+    {
+      processor->loadP0TablesFromCommandResponse(&p0_tables[0], p0_tables.size());
+      processor->loadXZTables(&tables.xtable[0], &tables.ztable[0]);
+      processor->loadLookupTable(&tables.lut[0]);
+    }
+    if (!processor || !processor->good())
+    {
+      LOG_INFO << names[i] << " pipeline cannot process depth on this host";
+      timings.push_back(timing);
+      delete pipeline;
+      continue;
+    }
+
+    DiscardingListener listener;
+    processor->setFrameListener(&listener);
+
+    DepthPacket packet;
+    std::memset(&packet, 0, sizeof(packet));
+    packet.buffer = &data[0];
+    packet.buffer_length = data.size();
+
+    // The first frames pay for uploads and kernel compilation.
+    for (size_t frame = 0; frame < WarmupFrames; frame++, packet.sequence++)
+      processor->process(packet);
+
+    std::vector<double> times;
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    while (times.size() < MinFrames ||
+           (times.size() < MaxFrames && milliseconds(chrono::steady_clock::now() - start) < budget_ms_))
+    {
+      const chrono::steady_clock::time_point frame_start = chrono::steady_clock::now();
+      processor->process(packet);
+      times.push_back(milliseconds(chrono::steady_clock::now() - frame_start));
+      packet.sequence++;
+      packet.timestamp += 267;
+    }
+    processor->setFrameListener(0);
+    delete pipeline;
+
+    timing.frames = times.size();
+    for (size_t t = 0; t < times.size(); t++)
+      timing.mean_ms += times[t] / times.size();
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    timing.median_ms = times[times.size() / 2];
+    LOG_INFO << names[i] << " pipeline: " << timing.median_ms << " ms per depth frame (median of "
+             << timing.frames << ", mean " << timing.mean_ms << " ms)";
+    timings.push_back(timing);
+  }
+  return timings;
+}
+
+std::string PipelineSelector::cachePath() const
+{
+  if (cache_directory_.empty())
+    return std::string();
+  return cache_directory_ + "/" + hostName() + ".pipeline";
+}
+
+std::string PipelineSelector::signature(const std::vector<std::string> &names) const
+{
+  std::ostringstream s;
+  s << LIBFREENECT2_VERSION;
+  for (size_t i = 0; i < names.size(); i++)
+    s << " " << names[i];
+  return s.str();
+}
+
+std::string PipelineSelector::select()
+{
+  const std::vector<std::string> names = candidates();
+  const std::string path = cachePath();
+
+  if (!path.empty())
+  {
+    std::ifstream in(path.c_str());
+    std::string cached_signature, name;
+    if (std::getline(in, cached_signature) && std::getline(in, name))
+    {
+      if (cached_signature == signature(names) && std::find(names.begin(), names.end(), name) != names.end())
+      {
+        LOG_INFO << "using " << name << " pipeline, measured earlier in " << path;
+        return name;
+      }
+      LOG_INFO << "pipelines changed since " << path << ", measuring again";
+    }
+  }
+
+  const std::vector<PipelineTiming> timings = measure(names);
+  const PipelineTiming *best = 0;
+  for (size_t i = 0; i < timings.size(); i++)
+    if (timings[i].frames > 0 && (!best || timings[i].median_ms < best->median_ms))
+      best = &timings[i];
+  if (!best)
+  {
+    LOG_WARNING << "no pipeline can process depth on this host";
+    return std::string();
+  }
+  LOG_INFO << "selected " << best->name << " pipeline";
+
+  if (!path.empty())
+  {
+    if (!protocol::CalibrationCache::makeDirectories(cache_directory_))
+    {
+      LOG_WARNING << "failed to create cache directory " << cache_directory_;
+      return best->name;
+    }
+    std::ostringstream tmp_name;
+    tmp_name << path << ".tmp" << chrono::steady_clock::now().time_since_epoch().count();
+    const std::string tmp = tmp_name.str();
+    bool written;
+    {
+      std::ofstream out(tmp.c_str(), std::ios::trunc);
+      out << signature(names) << "\n" << best->name << "\n";
+      written = bool(out);
+    }
+#ifdef _WIN32
+    std::remove(path.c_str());
+#endif
+    if (!written || std::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+      LOG_WARNING << "failed to write pipeline choice " << path;
+      std::remove(tmp.c_str());
+    }
+  }
+  return best->name;
+}
+
+} /* namespace libfreenect2 */
@@ -29,6 +29,7 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <libfreenect2/registration.h>
+#include <libfreenect2/trace_span.h>
 #include <limits>
 
 namespace libfreenect2
@@ -122,6 +123,7 @@ void RegistrationImpl::apply( int dx, int dy, float dz, float& cx, float &cy) co
 
 void Registration::apply(const Frame *rgb, const Frame *depth, Frame *undistorted, Frame *registered, const bool enable_filter, Frame *bigdepth, int *color_depth_map) const
 {
+  trace::Span span("registration", depth ? depth->sequence : trace::NoSequence);
   impl_->apply(rgb, depth, undistorted, registered, enable_filter, bigdepth, color_depth_map);
 }
 
@@ -275,6 +277,7 @@ void RegistrationImpl::apply(const Frame *rgb, const Frame *depth, Frame *undist
 
 void Registration::undistortDepth(const Frame *depth, Frame *undistorted) const
 {
+  trace::Span span("undistort_depth", depth ? depth->sequence : trace::NoSequence);
   impl_->undistortDepth(depth, undistorted);
 }
 
@@ -65,8 +65,9 @@ void DumpRgbPacketProcessor::process(const RgbPacket &packet)
   frame->bytes_per_pixel = packet.jpeg_buffer_length;
 
   std::memcpy(frame->data, packet.jpeg_buffer, packet.jpeg_buffer_length);
+  timer_.stamp(packet, frame);
 
-  if (!listener_->onNewFrame(Frame::Color, frame)) {
+  if (!deliverFrame(listener_, Frame::Color, frame)) {
     delete frame;
   }
   frame = NULL;
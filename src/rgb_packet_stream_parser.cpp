@@ -29,43 +29,30 @@
 #include <libfreenect2/config.h>
 #include <libfreenect2/rgb_packet_stream_parser.h>
 #include <libfreenect2/logging.h>
+#include <libfreenect2/trace_span.h>
 #include <memory.h>
+#include <cstdlib>
+#include <string>
 
 namespace libfreenect2
 {
 
-
-LIBFREENECT2_PACK(struct RawRgbPacket
-{
-  uint32_t sequence;
-  uint32_t magic_header; // is 'BBBB' equal 0x42424242
-
-  unsigned char jpeg_buffer[0];
-});
-
-// starting from JPEG EOI: 0xff 0xd9
-// char pad_0xa5[]; //0-3 bytes alignment of 0xa5
-// char filler[filler_length] = "ZZZZ...";
-LIBFREENECT2_PACK(struct RgbPacketFooter {
-  uint32_t magic_header; // is '9999' equal 0x39393939
-  uint32_t sequence;
-  uint32_t filler_length;
-  uint32_t unknown1; // seems 0 always
-  uint32_t unknown2; // seems 0 always
-  uint32_t timestamp;
-  float exposure; // ? ranges from 0.5 to about 60.0 with powerfull light at camera or totally covered
-  float gain; // ? ranges from 1.0 when camera is clear to 1.5 when camera is covered.
-  uint32_t magic_footer; // is 'BBBB' equal 0x42424242
-  uint32_t packet_size;
-  float gamma; // ranges from 1.0f to about 6.4 when camera is fully covered
-  uint32_t unknown4[3]; // seems to be 0 all the time.
-});
-
 RgbPacketStreamParser::RgbPacketStreamParser() :
     buffer_size_(2*1024*1024),
-    processor_(noopProcessor<RgbPacket>())
+    processor_(noopProcessor<RgbPacket>()),
+    zero_copy_(true),
+    in_place_bytes_(0),
+    copied_bytes_(0),
+    telemetry_(0),
+    last_sequence_(0),
+    has_sequence_(false),
+    packet_start_(0)
 {
   processor_->allocateBuffer(packet_, buffer_size_);
+
+  const char *zero_copy_str = std::getenv("LIBFREENECT2_RGB_ZERO_COPY");
+  if(zero_copy_str && std::string(zero_copy_str) == "0")
+    zero_copy_ = false;
 }
 
 RgbPacketStreamParser::~RgbPacketStreamParser()
@@ -79,8 +66,85 @@ void RgbPacketStreamParser::setPacketProcessor(BaseRgbPacketProcessor *processor
   processor_->allocateBuffer(packet_, buffer_size_);
 }
 
+void RgbPacketStreamParser::setZeroCopy(bool enable)
+{
+  zero_copy_ = enable;
+}
+
+uint64_t RgbPacketStreamParser::inPlaceBytes() const
+{
+  return in_place_bytes_;
+}
+
+uint64_t RgbPacketStreamParser::copiedBytes() const
+{
+  return copied_bytes_;
+}
+
+void RgbPacketStreamParser::setTelemetry(Telemetry *telemetry)
+{
+  telemetry_ = telemetry;
+}
+
+bool RgbPacketStreamParser::overlapsInFlight(const unsigned char *data, size_t length) const
+{
+  for(std::deque<Slice>::const_iterator it = in_flight_.begin(); it != in_flight_.end(); ++it)
+  {
+    if(data < it->data + it->length && it->data < data + length)
+      return true;
+  }
+  return false;
+}
+
+void RgbPacketStreamParser::releaseSlice(const unsigned char *data)
+{
+  // Transfers complete in order. Slices in front of this one belong to
+  // cancelled transfers and are dropped as well.
+  for(size_t i = 0; i < in_flight_.size(); i++)
+  {
+    if(in_flight_[i].data == data)
+    {
+      in_flight_.erase(in_flight_.begin(), in_flight_.begin() + i + 1);
+      return;
+    }
+  }
+}
+
+unsigned char *RgbPacketStreamParser::getTransferBuffer(size_t length, size_t queued_bytes)
+{
+  if(!zero_copy_ || length == 0 || packet_.memory == NULL || packet_.memory->data == NULL)
+    return NULL;
+  Buffer &fb = *packet_.memory;
+
+  // At most queued_bytes / length transfers are still in flight, older slices
+  // belong to cancelled transfers.
+  while(in_flight_.size() > queued_bytes / length)
+    in_flight_.pop_front();
+
+  // Where the data lands if the queued transfers before it are all full.
+  size_t offset = fb.length + queued_bytes;
+
+  // No wrap-around: a frame is contiguous from the start of the buffer, so
+  // the end of the buffer is left to the pool's own memory.
+  if(offset + length > fb.capacity)
+    return NULL;
+
+  unsigned char *data = fb.data + offset;
+
+  // After a resynchronization older transfers may still target this region.
+  if(overlapsInFlight(data, length))
+    return NULL;
+
+  Slice slice = {data, length};
+  in_flight_.push_back(slice);
+  return data;
+}
+
 void RgbPacketStreamParser::onDataReceived(unsigned char* buffer, size_t length)
 {
+  if(!in_flight_.empty())
+    releaseSlice(buffer);
+
   if (packet_.memory == NULL || packet_.memory->data == NULL)
   {
     LOG_ERROR << "Packet buffer is NULL";
@@ -91,14 +155,27 @@ void RgbPacketStreamParser::onDataReceived(unsigned char* buffer, size_t length)
   // package containing data
   if(length > 0)
   {
+    if(fb.length == 0)
+      packet_start_ = trace::now();
+
     if(fb.length + length <= fb.capacity)
     {
-      memcpy(fb.data + fb.length, buffer, length);
+      if(buffer == fb.data + fb.length)
+      {
+        in_place_bytes_ += length;
+      }
+      else
+      {
+        // May overlap when a transfer landed behind a short one in the same buffer.
+        memmove(fb.data + fb.length, buffer, length);
+        copied_bytes_ += length;
+      }
       fb.length += length;
     }
     else
     {
       LOG_INFO << "buffer overflow!";
+      count(Telemetry::Resyncs);
       fb.length = 0;
       return;
     }
@@ -116,6 +193,7 @@ void RgbPacketStreamParser::onDataReceived(unsigned char* buffer, size_t length)
       if (fb.length != footer->packet_size || raw_packet->sequence != footer->sequence)
       {
         LOG_INFO << "packetsize or sequence doesn't match!";
+        count(Telemetry::DroppedInvalid);
         fb.length = 0;
         return;
       }
@@ -123,6 +201,7 @@ void RgbPacketStreamParser::onDataReceived(unsigned char* buffer, size_t length)
       if (fb.length - sizeof(RawRgbPacket) - sizeof(RgbPacketFooter) < footer->filler_length)
       {
         LOG_INFO << "not enough space for packet filler!";
+        count(Telemetry::DroppedInvalid);
         fb.length = 0;
         return;
       }
@@ -143,6 +222,7 @@ void RgbPacketStreamParser::onDataReceived(unsigned char* buffer, size_t length)
       if (jpeg_length == 0)
       {
         LOG_INFO << "no JPEG detected!";
+        count(Telemetry::DroppedInvalid);
         fb.length = 0;
         return;
       }
@@ -150,6 +230,12 @@ void RgbPacketStreamParser::onDataReceived(unsigned char* buffer, size_t length)
       // can the processor handle the next image?
       if(processor_->ready())
       {
+        // Gaps between packets passed on, so packets skipped while busy count as lost too.
+        if(has_sequence_ && raw_packet->sequence - last_sequence_ > 1 && raw_packet->sequence - last_sequence_ < 0x80000000u)
+          count(Telemetry::FramesLost, raw_packet->sequence - last_sequence_ - 1);
+        last_sequence_ = raw_packet->sequence;
+        has_sequence_ = true;
+
         RgbPacket &rgb_packet = packet_;
         rgb_packet.sequence = raw_packet->sequence;
         rgb_packet.timestamp = footer->timestamp;
@@ -158,15 +244,23 @@ void RgbPacketStreamParser::onDataReceived(unsigned char* buffer, size_t length)
         rgb_packet.gamma = footer->gamma;
         rgb_packet.jpeg_buffer = raw_packet->jpeg_buffer;
         rgb_packet.jpeg_buffer_length = jpeg_length;
+        rgb_packet.arrival_time = packetArrivalTime();
+        rgb_packet.first_byte_time = packet_start_;
+        rgb_packet.process_start_time = rgb_packet.arrival_time;
+
+        if(trace::active())
+          trace::record("color_assemble", rgb_packet.sequence, packet_start_, rgb_packet.arrival_time);
 
         // call the processor
         processor_->process(rgb_packet);
         //allocatePacket() should never return NULL when processor is ready()
         processor_->allocateBuffer(packet_, buffer_size_);
+        count(Telemetry::FramesCompleted);
       }
       else
       {
         LOG_DEBUG << "skipping rgb packet!";
+        count(Telemetry::DroppedBusy);
       }
 
       // reset front buffer
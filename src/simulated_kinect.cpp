@@ -0,0 +1,688 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+
+/** @file simulated_kinect.cpp In-process Kinect v2 behind the USB transport. */
+
+#include <libfreenect2/usb/simulated_kinect.h>
+#include <libfreenect2/protocol/command.h>
+#include <libfreenect2/protocol/command_transaction.h>
+#include <libfreenect2/logging.h>
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef LIBFREENECT2_WITH_TURBOJPEG_SUPPORT
+#include <turbojpeg.h>
+#endif
+
+namespace libfreenect2
+{
+namespace usb
+{
+
+using namespace libfreenect2::protocol;
+
+SimulatedKinectConfig::SimulatedKinectConfig() :
+  serial("SIMULATED000"),
+  frame_rate(30),
+  status_delay_ms(0),
+  command_latency_us(0),
+  external_events(false)
+{
+}
+
+/** Receives the generated streams and writes them into the submitted transfers. */
+class SimulatedKinect::Sink : public DataCallback
+{
+public:
+  Sink(SimulatedKinect *device, unsigned char endpoint) : device_(device), endpoint_(endpoint) {}
+
+  virtual void onDataReceived(unsigned char *buffer, size_t n)
+  {
+    if(endpoint_ == IrEndpoint)
+      device_->sendIsoPacket(buffer, n);
+    else
+      device_->sendBulkPayload(buffer, n);
+  }
+private:
+  SimulatedKinect *device_;
+  unsigned char endpoint_;
+};
+
+const unsigned char SimulatedKinect::CommandInEndpoint;
+const unsigned char SimulatedKinect::CommandOutEndpoint;
+const unsigned char SimulatedKinect::RgbEndpoint;
+const unsigned char SimulatedKinect::IrEndpoint;
+const int SimulatedKinect::MaxIsoPacketSize;
+
+SimulatedKinect::SimulatedKinect(const SimulatedKinectConfig &config) :
+  config_(config),
+  generator_(0),
+  thread_(0),
+  shutdown_(false),
+  closed_(false),
+  configuration_(0),
+  claimed_interfaces_(0),
+  ir_alternate_setting_(0),
+  video_suspended_(true),
+  streaming_(false),
+  delivering_(0),
+  ir_current_(0),
+  ir_current_packet_(0),
+  rgb_current_(0),
+  frame_lock_(0)
+{
+  std::memset(&stats_, 0, sizeof(stats_));
+  if(config_.frame_rate <= 0)
+    config_.frame_rate = 30;
+
+  thread_ = new libfreenect2::thread(&SimulatedKinect::static_execute, this);
+}
+
+SimulatedKinect::~SimulatedKinect()
+{
+  close();
+  delete generator_;
+}
+
+#define CHECK_OPEN() if(closed_) return LIBUSB_ERROR_NO_DEVICE
+
+int SimulatedKinect::getConfiguration(int *configuration)
+{
+  libfreenect2::lock_guard guard(mutex_);
+  CHECK_OPEN();
+  *configuration = configuration_;
+  return LIBUSB_SUCCESS;
+}
+
+int SimulatedKinect::setConfiguration(int configuration)
+{
+  libfreenect2::lock_guard guard(mutex_);
+  CHECK_OPEN();
+  if(configuration != 1)
+    return LIBUSB_ERROR_NOT_FOUND;
+  configuration_ = configuration;
+  return LIBUSB_SUCCESS;
+}
+
+int SimulatedKinect::claimInterface(int interface_number)
+{
+  libfreenect2::lock_guard guard(mutex_);
+  CHECK_OPEN();
+  if(configuration_ != 1 || interface_number < 0 || interface_number > 1)
+    return LIBUSB_ERROR_NOT_FOUND;
+  claimed_interfaces_ |= 1u << interface_number;
+  return LIBUSB_SUCCESS;
+}
+
+int SimulatedKinect::releaseInterface(int interface_number)
+{
+  libfreenect2::lock_guard guard(mutex_);
+  CHECK_OPEN();
+  if(interface_number < 0 || interface_number > 1 || (claimed_interfaces_ & (1u << interface_number)) == 0)
+    return LIBUSB_ERROR_NOT_FOUND;
+  claimed_interfaces_ &= ~(1u << interface_number);
+  return LIBUSB_SUCCESS;
+}
+
+int SimulatedKinect::setInterfaceAltSetting(int interface_number, int alternate_setting)
+{
+  libfreenect2::lock_guard guard(mutex_);
+  CHECK_OPEN();
+  if(interface_number < 0 || interface_number > 1 || (claimed_interfaces_ & (1u << interface_number)) == 0)
+    return LIBUSB_ERROR_NOT_FOUND;
+  // Only the IR interface has a second setting, the one with the iso endpoint.
+  if(alternate_setting < 0 || alternate_setting > interface_number)
+    return LIBUSB_ERROR_NOT_FOUND;
+  if(interface_number == 1)
+    ir_alternate_setting_ = alternate_setting;
+  return LIBUSB_SUCCESS;
+}
+
+int SimulatedKinect::controlTransfer(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+                                     unsigned char *data, uint16_t length, unsigned int timeout)
+{
+  libfreenect2::lock_guard guard(mutex_);
+  CHECK_OPEN();
+
+  // SET_FEATURE(FUNCTION_SUSPEND) on the interface suspends or resumes the video function.
+  if((request_type & 0x1f) == LIBUSB_RECIPIENT_INTERFACE && request == LIBUSB_REQUEST_SET_FEATURE && value == 0)
+  {
+    const bool suspend = ((index >> 8) & 1) != 0;
+    if(video_suspended_ && !suspend)
+      video_enabled_time_ = libfreenect2::chrono::steady_clock::now();
+    video_suspended_ = suspend;
+    condition_.notify_all();
+  }
+  return length;
+}
+
+int SimulatedKinect::getMaxIsoPacketSize(int configuration, int alternate_setting, unsigned char endpoint)
+{
+  libfreenect2::lock_guard guard(mutex_);
+  CHECK_OPEN();
+  if(configuration == 1 && alternate_setting == 1 && endpoint == IrEndpoint)
+    return MaxIsoPacketSize;
+  return LIBUSB_ERROR_NOT_FOUND;
+}
+
+int SimulatedKinect::bulkTransfer(unsigned char endpoint, unsigned char *data, int length, int *transferred, unsigned int timeout)
+{
+  *transferred = 0;
+
+  if(endpoint == CommandOutEndpoint)
+  {
+    if(config_.command_latency_us > 0)
+      libfreenect2::this_thread::sleep_for(libfreenect2::chrono::microseconds(config_.command_latency_us));
+
+    libfreenect2::lock_guard guard(mutex_);
+    CHECK_OPEN();
+    if(!execute(data, length))
+      return LIBUSB_ERROR_PIPE;
+    *transferred = length;
+    condition_.notify_all();
+    return LIBUSB_SUCCESS;
+  }
+
+  if(endpoint == CommandInEndpoint)
+  {
+    libfreenect2::lock_guard guard(mutex_);
+    CHECK_OPEN();
+    if(responses_.empty())
+      return LIBUSB_ERROR_TIMEOUT;
+
+    const std::vector<unsigned char> &response = responses_.front();
+    const size_t n = std::min(response.size(), size_t(length));
+    if(n > 0)
+      std::memcpy(data, &response[0], n);
+    *transferred = n;
+    const bool overflow = response.size() > size_t(length);
+    responses_.pop_front();
+    return overflow ? LIBUSB_ERROR_OVERFLOW : LIBUSB_SUCCESS;
+  }
+
+  return LIBUSB_ERROR_NOT_SUPPORTED;
+}
+
+int SimulatedKinect::submitTransfer(libusb_transfer *transfer)
+{
+  libfreenect2::lock_guard guard(mutex_);
+  CHECK_OPEN();
+
+  if(transfer->endpoint == IrEndpoint && transfer->type == LIBUSB_TRANSFER_TYPE_ISOCHRONOUS)
+  {
+    if(ir_alternate_setting_ != 1)
+      return LIBUSB_ERROR_NOT_FOUND;
+    ir_transfers_.push_back(transfer);
+  }
+  else if(transfer->endpoint == RgbEndpoint && transfer->type == LIBUSB_TRANSFER_TYPE_BULK)
+  {
+    rgb_transfers_.push_back(transfer);
+  }
+  else
+  {
+    return LIBUSB_ERROR_INVALID_PARAM;
+  }
+
+  transfer->actual_length = 0;
+  // Color data may be waiting for the application to resubmit.
+  if(config_.external_events)
+    condition_.notify_all();
+  return LIBUSB_SUCCESS;
+}
+
+int SimulatedKinect::cancelTransfer(libusb_transfer *transfer)
+{
+  libfreenect2::lock_guard guard(mutex_);
+  CHECK_OPEN();
+
+  TransferQueue *queues[] = { &rgb_transfers_, &ir_transfers_ };
+  for(size_t i = 0; i < 2; ++i)
+  {
+    TransferQueue::iterator it = std::find(queues[i]->begin(), queues[i]->end(), transfer);
+    if(it != queues[i]->end())
+    {
+      queues[i]->erase(it);
+      transfer->status = LIBUSB_TRANSFER_CANCELLED;
+      completed_.push_back(transfer);
+      condition_.notify_all();
+      return LIBUSB_SUCCESS;
+    }
+  }
+
+  // Already completed, its callback is on the way.
+  return LIBUSB_ERROR_NOT_FOUND;
+}
+
+int SimulatedKinect::handleEvents(int timeout_ms)
+{
+  libfreenect2::unique_lock lock(mutex_);
+  if(!config_.external_events)
+    return LIBUSB_SUCCESS;
+
+  if(completed_.empty() && timeout_ms > 0)
+    condition_.wait_for(lock, libfreenect2::chrono::milliseconds(timeout_ms));
+  deliverCompleted(lock);
+  return LIBUSB_SUCCESS;
+}
+
+libusb_device_handle *SimulatedKinect::handle()
+{
+  return 0;
+}
+
+void SimulatedKinect::close()
+{
+  {
+    libfreenect2::lock_guard guard(mutex_);
+    if(closed_)
+      return;
+    closed_ = true;
+    shutdown_ = true;
+    condition_.notify_all();
+  }
+
+  thread_->join();
+  delete thread_;
+  thread_ = 0;
+
+  if(!rgb_transfers_.empty() || !ir_transfers_.empty())
+    LOG_WARNING << "closing with " << rgb_transfers_.size() + ir_transfers_.size() << " transfers pending";
+}
+
+SimulatedKinectStatistics SimulatedKinect::getStatistics()
+{
+  libfreenect2::lock_guard guard(mutex_);
+  return stats_;
+}
+
+bool SimulatedKinect::execute(const unsigned char *command, size_t length)
+{
+  CommandData<0> header;
+  if(length < sizeof(header))
+    return false;
+  std::memcpy(&header, command, sizeof(header));
+  if(header.magic != ReadFirmwareVersionsCommand::MagicNumber)
+    return false;
+
+  std::vector<uint32_t> parameters((length - sizeof(header)) / sizeof(uint32_t));
+  if(!parameters.empty())
+    std::memcpy(&parameters[0], command + sizeof(header), parameters.size() * sizeof(uint32_t));
+
+  stats_.commands++;
+  const std::vector<unsigned char> response = respond(header.command, parameters.empty() ? 0 : &parameters[0], parameters.size(), header.max_response_length);
+  if(!response.empty())
+    responses_.push_back(response);
+
+  std::vector<unsigned char> complete(CommandTransaction::ResponseCompleteLength, 0);
+  const uint32_t complete_header[2] = { CommandTransaction::ResponseCompleteMagic, header.sequence };
+  std::memcpy(&complete[0], complete_header, sizeof(complete_header));
+  responses_.push_back(complete);
+  return true;
+}
+
+std::vector<unsigned char> SimulatedKinect::respond(uint32_t command, const uint32_t *parameters, size_t num_parameters, uint32_t max_length)
+{
+  const uint32_t parameter = num_parameters > 0 ? parameters[0] : 0;
+  std::vector<unsigned char> response;
+
+  switch(command)
+  {
+  case KCMD_READ_FIRMWARE_VERSIONS:
+  {
+    // Seven subsystem versions, the main one third: 2.3.3913.0
+    response.resize(max_length);
+    const uint32_t version[4] = { (2u << 16) | 3u, 3913, 0, 0 };
+    for(size_t i = 0; i < 7 && (i + 1) * sizeof(version) <= response.size(); ++i)
+      std::memcpy(&response[i * sizeof(version)], version, sizeof(version));
+    break;
+  }
+  case KCMD_READ_DATA_PAGE:
+    if(parameter == 1)
+    {
+      // UTF-16 serial number
+      response.resize(max_length);
+      for(size_t i = 0; i < config_.serial.size() && 2 * i + 1 < response.size(); ++i)
+        response[2 * i] = config_.serial[i];
+    }
+    else if(parameter == 2)
+      response = p0TablesResponse();
+    else if(parameter == 3)
+      response = depthCameraParamsResponse();
+    else if(parameter == 4)
+      response = rgbCameraParamsResponse();
+    break;
+  case KCMD_READ_STATUS:
+    response.resize(max_length);
+    if(parameter == 0x090000 && !video_suspended_ && response.size() >= sizeof(uint32_t))
+    {
+      const libfreenect2::chrono::steady_clock::duration up = libfreenect2::chrono::steady_clock::now() - video_enabled_time_;
+      const uint32_t status = up >= libfreenect2::chrono::milliseconds(config_.status_delay_ms) ? 1 : 0;
+      std::memcpy(&response[0], &status, sizeof(status));
+    }
+    break;
+  case KCMD_SET_STREAMING:
+    streaming_ = parameter == 1;
+    break;
+  case KCMD_STOP:
+  case KCMD_SHUTDOWN:
+    streaming_ = false;
+    break;
+  default:
+    break;
+  }
+
+  // Everything else is acknowledged with zeros of the requested length.
+  if(response.empty())
+    response.resize(max_length);
+  if(response.size() > max_length)
+    response.resize(max_length);
+  return response;
+}
+
+void SimulatedKinect::createGenerator()
+{
+  StreamGeneratorConfig config;
+  config.iso_packet_size = MaxIsoPacketSize;
+  generator_ = new StreamGenerator(config);
+
+  if(!config_.depth_source.empty() && !generator_->loadDepthSource(config_.depth_source))
+    LOG_WARNING << "streaming the generated depth pattern instead of " << config_.depth_source;
+
+  if(!config_.rgb_source.empty())
+  {
+    if(!generator_->loadRgbSource(config_.rgb_source))
+      LOG_WARNING << "streaming a generated color image instead of " << config_.rgb_source;
+  }
+  else
+  {
+    std::vector<unsigned char> jpeg = syntheticJpeg();
+    if(!jpeg.empty())
+      generator_->setRgbSource(&jpeg[0], jpeg.size());
+  }
+}
+
+void SimulatedKinect::static_execute(void *cookie)
+{
+  this_thread::set_name("USB");
+  this_thread::apply_policy(ThreadPolicy::UsbEventLoop);
+  static_cast<SimulatedKinect *>(cookie)->run();
+}
+
+void SimulatedKinect::run()
+{
+  createGenerator();
+
+  const libfreenect2::chrono::nanoseconds period(static_cast<int64_t>(1e9 / config_.frame_rate));
+  libfreenect2::unique_lock lock(mutex_);
+  libfreenect2::chrono::steady_clock::time_point next_frame = libfreenect2::chrono::steady_clock::now() + period;
+
+  while(!shutdown_)
+  {
+    if(!config_.external_events)
+      deliverCompleted(lock);
+    if(shutdown_)
+      break;
+
+    const libfreenect2::chrono::steady_clock::time_point now = libfreenect2::chrono::steady_clock::now();
+    if(!streaming_ || video_suspended_)
+    {
+      condition_.wait(lock);
+      next_frame = libfreenect2::chrono::steady_clock::now() + period;
+      continue;
+    }
+    if(now < next_frame)
+    {
+      condition_.wait_until(lock, next_frame);
+      continue;
+    }
+
+    // A host that stalls the thread gets the frames it missed dropped, not in a burst.
+    next_frame += period;
+    if(next_frame < now)
+      next_frame = now + period;
+    sendFrame(lock);
+    if(config_.external_events && !completed_.empty())
+      condition_.notify_all();
+  }
+}
+
+void SimulatedKinect::sendFrame(libfreenect2::unique_lock &lock)
+{
+  frame_lock_ = &lock;
+
+  // A stream is only sent once the host listens to its endpoint.
+  if(ir_alternate_setting_ == 1 && !ir_transfers_.empty())
+  {
+    Sink sink(this, IrEndpoint);
+    generator_->feedDepthFrame(sink);
+    finishIsoTransfer();
+    stats_.depth_frames++;
+  }
+
+  if(!rgb_transfers_.empty())
+  {
+    Sink sink(this, RgbEndpoint);
+    generator_->feedRgbFrame(sink);
+    finishBulkTransfer();
+    stats_.rgb_frames++;
+  }
+
+  generator_->advanceTimestamp(static_cast<uint32_t>(8000 / config_.frame_rate + 0.5));
+  frame_lock_ = 0;
+}
+
+void SimulatedKinect::sendIsoPacket(const unsigned char *data, size_t length)
+{
+  if(ir_current_ == 0)
+  {
+    if(ir_transfers_.empty())
+    {
+      stats_.dropped++;
+      return;
+    }
+    ir_current_ = ir_transfers_.front();
+    ir_transfers_.pop_front();
+    ir_current_packet_ = 0;
+  }
+
+  // Every iso packet has a slot of its descriptor's length.
+  libusb_iso_packet_descriptor &desc = ir_current_->iso_packet_desc[ir_current_packet_];
+  const size_t n = std::min(length, size_t(desc.length));
+  if(n > 0)
+    std::memcpy(ir_current_->buffer + ir_current_packet_ * desc.length, data, n);
+  desc.actual_length = n;
+  desc.status = n < length ? LIBUSB_TRANSFER_OVERFLOW : LIBUSB_TRANSFER_COMPLETED;
+
+  if(++ir_current_packet_ == ir_current_->num_iso_packets)
+    finishIsoTransfer();
+}
+
+void SimulatedKinect::finishIsoTransfer()
+{
+  if(ir_current_ == 0)
+    return;
+
+  // The bus is idle until the next frame.
+  for(int i = ir_current_packet_; i < ir_current_->num_iso_packets; ++i)
+  {
+    ir_current_->iso_packet_desc[i].actual_length = 0;
+    ir_current_->iso_packet_desc[i].status = LIBUSB_TRANSFER_COMPLETED;
+  }
+  ir_current_->status = LIBUSB_TRANSFER_COMPLETED;
+  completed_.push_back(ir_current_);
+  ir_current_ = 0;
+}
+
+void SimulatedKinect::sendBulkPayload(const unsigned char *data, size_t length)
+{
+  while(length > 0)
+  {
+    if(rgb_current_ == 0)
+    {
+      // Bulk data is flow controlled: wait for the host to resubmit.
+      while(rgb_transfers_.empty() && (!completed_.empty() || delivering_ > 0) && !shutdown_)
+      {
+        if(config_.external_events)
+        {
+          condition_.notify_all();
+          condition_.wait(*frame_lock_);
+        }
+        else
+        {
+          deliverCompleted(*frame_lock_);
+        }
+      }
+
+      if(rgb_transfers_.empty() || shutdown_)
+      {
+        stats_.dropped++;
+        return;
+      }
+      rgb_current_ = rgb_transfers_.front();
+      rgb_transfers_.pop_front();
+    }
+
+    const size_t n = std::min(length, size_t(rgb_current_->length - rgb_current_->actual_length));
+    std::memcpy(rgb_current_->buffer + rgb_current_->actual_length, data, n);
+    rgb_current_->actual_length += n;
+    data += n;
+    length -= n;
+
+    if(rgb_current_->actual_length == rgb_current_->length)
+      finishBulkTransfer();
+  }
+}
+
+void SimulatedKinect::finishBulkTransfer()
+{
+  // The short packet at the end of a frame completes the transfer.
+  if(rgb_current_ == 0)
+    return;
+
+  rgb_current_->status = LIBUSB_TRANSFER_COMPLETED;
+  completed_.push_back(rgb_current_);
+  rgb_current_ = 0;
+}
+
+void SimulatedKinect::deliverCompleted(libfreenect2::unique_lock &lock)
+{
+  while(!completed_.empty())
+  {
+    TransferQueue completed;
+    completed.swap(completed_);
+    stats_.transfers += completed.size();
+
+    // Callbacks resubmit, like with libusb they run without the device lock.
+    delivering_++;
+    lock.unlock();
+    for(TransferQueue::iterator it = completed.begin(); it != completed.end(); ++it)
+      (*it)->callback(*it);
+    lock.lock();
+    delivering_--;
+  }
+  if(config_.external_events)
+    condition_.notify_all();
+}
+
+std::vector<unsigned char> SimulatedKinect::depthCameraParamsResponse()
+{
+  std::vector<unsigned char> buffer(sizeof(DepthCameraParamsResponse), 0);
+  DepthCameraParamsResponse *r = reinterpret_cast<DepthCameraParamsResponse *>(&buffer[0]);
+  r->fx = 365.456f; r->fy = 365.456f;
+  r->cx = 254.878f; r->cy = 205.395f;
+  r->k1 = 0.0905474f; r->k2 = -0.26819f; r->k3 = 0.0950862f;
+  r->p1 = 0.0f; r->p2 = 0.0f;
+  return buffer;
+}
+
+std::vector<unsigned char> SimulatedKinect::rgbCameraParamsResponse()
+{
+  std::vector<unsigned char> buffer(sizeof(RgbCameraParamsResponse), 0);
+  RgbCameraParamsResponse *r = reinterpret_cast<RgbCameraParamsResponse *>(&buffer[0]);
+  r->table_id = 1;
+  r->color_f = 1081.37f;
+  r->color_cx = 959.5f; r->color_cy = 539.5f;
+  r->shift_d = 863.0f; r->shift_m = 52.0f;
+
+  r->mx_x3y0 = 0.000449294f; r->mx_x0y3 = 1.91656e-05f; r->mx_x2y1 = 4.81909e-05f; r->mx_x1y2 = 0.000195845f;
+  r->mx_x2y0 = -0.000949852f; r->mx_x0y2 = 0.000121157f; r->mx_x1y1 = 0.000153428f;
+  r->mx_x1y0 = 0.639622f; r->mx_x0y1 = -0.00236094f; r->mx_x0y0 = 0.142063f;
+
+  r->my_x3y0 = 4.48937e-05f; r->my_x0y3 = 0.000654617f; r->my_x2y1 = 0.000463647f; r->my_x1y2 = 4.79404e-05f;
+  r->my_x2y0 = -0.000142302f; r->my_x0y2 = -0.000850055f; r->my_x1y1 = -0.000948412f;
+  r->my_x1y0 = 0.00297236f; r->my_x0y1 = 0.640061f; r->my_x0y0 = 0.0015013f;
+  return buffer;
+}
+
+std::vector<unsigned char> SimulatedKinect::p0TablesResponse()
+{
+  // Around the values seen on devices.
+  std::vector<unsigned char> buffer(sizeof(P0TablesResponse), 0);
+  P0TablesResponse *r = reinterpret_cast<P0TablesResponse *>(&buffer[0]);
+  for(size_t i = 0; i < 512 * 424; i++)
+  {
+    const uint16_t wobble = static_cast<uint16_t>((i % 512) * 7 % 97);
+    r->p0table0[i] = 0x2c9a + wobble;
+    r->p0table1[i] = 0x08ec + wobble;
+    r->p0table2[i] = 0x42e8 + wobble;
+  }
+  return buffer;
+}
+
+std::vector<unsigned char> SimulatedKinect::syntheticJpeg()
+{
+  std::vector<unsigned char> jpeg;
+#ifdef LIBFREENECT2_WITH_TURBOJPEG_SUPPORT
+  std::vector<unsigned char> image(1920 * 1080 * 4);
+  for(size_t y = 0; y < 1080; y++)
+    for(size_t x = 0; x < 1920; x++)
+    {
+      unsigned char *p = &image[(y * 1920 + x) * 4];
+      p[0] = static_cast<unsigned char>(x / 8);
+      p[1] = static_cast<unsigned char>(y / 5);
+      p[2] = static_cast<unsigned char>((x + y) % 256);
+      p[3] = 0;
+    }
+
+  tjhandle compressor = tjInitCompress();
+  unsigned char *out = NULL;
+  unsigned long size = 0;
+  if(compressor && tjCompress2(compressor, &image[0], 1920, 1920 * 4, 1080, TJPF_BGRX, &out, &size, TJSAMP_422, 90, 0) == 0)
+    jpeg.assign(out, out + size);
+  else
+    LOG_WARNING << "failed to encode the synthetic JPEG: " << tjGetErrorStr();
+  if(out)
+    tjFree(out);
+  if(compressor)
+    tjDestroy(compressor);
+#endif
+  return jpeg;
+}
+
+} /* namespace usb */
+} /* namespace libfreenect2 */
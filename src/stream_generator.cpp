@@ -0,0 +1,308 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file stream_generator.cpp Synthetic USB streams of a Kinect v2. */
+
+#include <libfreenect2/stream_generator.h>
+#include <libfreenect2/depth_packet_stream_parser.h>
+#include <libfreenect2/rgb_packet_stream_parser.h>
+#include <libfreenect2/threading.h>
+#include <libfreenect2/logging.h>
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace libfreenect2
+{
+
+StreamGeneratorConfig::StreamGeneratorConfig():
+  iso_packet_size(33792),
+  bulk_transfer_size(0x4000),
+  loss(0),
+  reorder(0),
+  jitter_us(0),
+  frame_rate(0),
+  seed(0)
+{
+}
+
+const size_t StreamGenerator::DepthSubImageSize;
+const size_t StreamGenerator::DepthSubImages;
+
+StreamGenerator::StreamGenerator(const StreamGeneratorConfig &config):
+  config_(config),
+  random_(config.seed),
+  depth_sequence_(1),
+  rgb_sequence_(1),
+  timestamp_(1000)
+{
+  std::memset(&stats_, 0, sizeof(stats_));
+  if (config_.iso_packet_size <= sizeof(DepthSubPacketFooter))
+    config_.iso_packet_size = 33792;
+  if (config_.bulk_transfer_size == 0)
+    config_.bulk_transfer_size = 0x4000;
+
+  // Generated scene: a pattern that changes across the image.
+  depth_source_.resize(DepthSubImages * DepthSubImageSize);
+  for (size_t i = 0; i < depth_source_.size(); i++)
+    depth_source_[i] = static_cast<unsigned char>(i * 31 + (i >> 12));
+
+  // Generated JPEG-shaped payload: SOI, data without markers, EOI.
+  rgb_source_.resize(400000);
+  for (size_t i = 0; i < rgb_source_.size(); i++)
+    rgb_source_[i] = static_cast<unsigned char>((i * 7 + (i >> 10)) % 0xff);
+  rgb_source_[0] = 0xff;
+  rgb_source_[1] = 0xd8;
+  rgb_source_[rgb_source_.size() - 2] = 0xff;
+  rgb_source_[rgb_source_.size() - 1] = 0xd9;
+}
+
+bool StreamGenerator::setDepthSource(const unsigned char *data, size_t length)
+{
+  if (length != DepthSubImages * DepthSubImageSize)
+  {
+    LOG_ERROR << "depth source must be " << DepthSubImages * DepthSubImageSize << " bytes, got " << length;
+    return false;
+  }
+  depth_source_.assign(data, data + length);
+  return true;
+}
+
+static bool readFile(const std::string &filename, std::vector<unsigned char> &data)
+{
+  std::ifstream fd(filename.c_str(), std::ios::binary);
+  if (!fd)
+  {
+    LOG_ERROR << "failed to open " << filename;
+    return false;
+  }
+  data.assign(std::istreambuf_iterator<char>(fd), std::istreambuf_iterator<char>());
+  return true;
+}
+
+bool StreamGenerator::loadDepthSource(const std::string &filename)
+{
+  std::vector<unsigned char> data;
+  return readFile(filename, data) && setDepthSource(data.data(), data.size());
+}
+
+bool StreamGenerator::setRgbSource(const unsigned char *jpeg, size_t length)
+{
+  if (length < 4 || jpeg[length - 2] != 0xff || jpeg[length - 1] != 0xd9)
+  {
+    LOG_ERROR << "color source is not a JPEG image ending with EOI";
+    return false;
+  }
+  rgb_source_.assign(jpeg, jpeg + length);
+  return true;
+}
+
+bool StreamGenerator::loadRgbSource(const std::string &filename)
+{
+  std::vector<unsigned char> data;
+  return readFile(filename, data) && setRgbSource(data.data(), data.size());
+}
+
+const std::vector<unsigned char> &StreamGenerator::depthSource() const
+{
+  return depth_source_;
+}
+
+const std::vector<unsigned char> &StreamGenerator::rgbSource() const
+{
+  return rgb_source_;
+}
+
+bool StreamGenerator::chance(double probability)
+{
+  if (probability <= 0)
+    return false;
+  return std::uniform_real_distribution<double>(0.0, 1.0)(random_) < probability;
+}
+
+void StreamGenerator::deliver(DataCallback &callback, std::vector<std::pair<const unsigned char *, size_t> > &payloads)
+{
+  if (config_.reorder > 0)
+  {
+    for (size_t i = 0; i + 1 < payloads.size(); i++)
+    {
+      // Empty iso packets mark the gaps between sub-images.
+      if (payloads[i].second != 0 && payloads[i + 1].second != 0 && chance(config_.reorder))
+      {
+        std::swap(payloads[i], payloads[i + 1]);
+        stats_.reordered++;
+        i++;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < payloads.size(); i++)
+  {
+    if (payloads[i].second != 0 && chance(config_.loss))
+    {
+      stats_.lost++;
+      continue;
+    }
+    // The parsers do not modify the data.
+    callback.onDataReceived(const_cast<unsigned char *>(payloads[i].first), payloads[i].second);
+    stats_.payloads++;
+    stats_.bytes += payloads[i].second;
+  }
+}
+
+void StreamGenerator::feedDepthFrame(DataCallback &callback)
+{
+  const size_t packet_size = config_.iso_packet_size;
+  const size_t chunk_size = DepthSubImageSize + sizeof(DepthSubPacketFooter);
+  const size_t tail_offset = (chunk_size - 1) / packet_size * packet_size;
+  const size_t tail_size = chunk_size - tail_offset;
+
+  // Only the last packet of a sub-image is assembled, it carries the footer.
+  depth_scratch_.resize(DepthSubImages * tail_size);
+
+  std::vector<std::pair<const unsigned char *, size_t> > payloads;
+  for (size_t sub = 0; sub < DepthSubImages; sub++)
+  {
+    const unsigned char *image = &depth_source_[sub * DepthSubImageSize];
+    for (size_t offset = 0; offset < tail_offset; offset += packet_size)
+      payloads.push_back(std::make_pair(image + offset, packet_size));
+
+    unsigned char *tail = &depth_scratch_[sub * tail_size];
+    const size_t tail_data = DepthSubImageSize - tail_offset;
+    std::memcpy(tail, image + tail_offset, tail_data);
+
+    DepthSubPacketFooter footer;
+    std::memset(&footer, 0, sizeof(footer));
+    footer.timestamp = timestamp_;
+    footer.sequence = depth_sequence_;
+    footer.subsequence = sub;
+    footer.length = DepthSubImageSize;
+    std::memcpy(tail + tail_data, &footer, sizeof(footer));
+
+    payloads.push_back(std::make_pair(const_cast<const unsigned char *>(tail), tail_size));
+    payloads.push_back(std::make_pair(const_cast<const unsigned char *>(tail), size_t(0)));
+  }
+
+  deliver(callback, payloads);
+  depth_sequence_++;
+  stats_.depth_frames++;
+}
+
+void StreamGenerator::serializeRgbFrame(std::vector<unsigned char> &frame)
+{
+  const size_t pad = (4 - rgb_source_.size() % 4) % 4;
+  const size_t filler = 32;
+  const size_t size = sizeof(RawRgbPacket) + rgb_source_.size() + pad + filler + sizeof(RgbPacketFooter);
+  frame.resize(size);
+
+  RawRgbPacket header;
+  header.sequence = rgb_sequence_;
+  header.magic_header = 0x42424242;
+  std::memcpy(&frame[0], &header, sizeof(header));
+
+  size_t offset = sizeof(header);
+  std::memcpy(&frame[offset], rgb_source_.data(), rgb_source_.size());
+  offset += rgb_source_.size();
+  std::memset(&frame[offset], 0xa5, pad);
+  offset += pad;
+  std::memset(&frame[offset], 'Z', filler);
+  offset += filler;
+
+  RgbPacketFooter footer;
+  std::memset(&footer, 0, sizeof(footer));
+  footer.magic_header = 0x39393939;
+  footer.sequence = rgb_sequence_;
+  footer.filler_length = filler;
+  footer.timestamp = timestamp_;
+  footer.exposure = 10.0f;
+  footer.gain = 1.0f;
+  footer.magic_footer = 0x42424242;
+  footer.packet_size = size;
+  footer.gamma = 1.0f;
+  std::memcpy(&frame[offset], &footer, sizeof(footer));
+}
+
+void StreamGenerator::feedRgbFrame(DataCallback &callback)
+{
+  serializeRgbFrame(rgb_scratch_);
+
+  std::vector<std::pair<const unsigned char *, size_t> > payloads;
+  for (size_t offset = 0; offset < rgb_scratch_.size(); offset += config_.bulk_transfer_size)
+  {
+    size_t length = rgb_scratch_.size() - offset;
+    if (length > config_.bulk_transfer_size)
+      length = config_.bulk_transfer_size;
+    payloads.push_back(std::make_pair(const_cast<const unsigned char *>(&rgb_scratch_[offset]), length));
+  }
+
+  deliver(callback, payloads);
+  rgb_sequence_++;
+  stats_.rgb_frames++;
+}
+
+void StreamGenerator::advanceTimestamp(uint32_t ticks)
+{
+  // The device timestamp counts 0.125 ms ticks.
+  timestamp_ += ticks;
+}
+
+double StreamGenerator::run(DataCallback *rgb, DataCallback *depth, size_t frames)
+{
+  const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  const bool paced = config_.frame_rate > 0;
+  const chrono::nanoseconds period(paced ? static_cast<int64_t>(1e9 / config_.frame_rate) : 0);
+  chrono::steady_clock::time_point deadline = start;
+
+  for (size_t i = 0; i < frames; i++)
+  {
+    if (paced)
+    {
+      deadline += period;
+      this_thread::sleep_until(deadline);
+      if (config_.jitter_us > 0)
+      {
+        double jitter = std::uniform_real_distribution<double>(0.0, config_.jitter_us)(random_);
+        this_thread::sleep_for(chrono::microseconds(static_cast<int64_t>(jitter)));
+      }
+    }
+
+    if (depth)
+      feedDepthFrame(*depth);
+    if (rgb)
+      feedRgbFrame(*rgb);
+    advanceTimestamp();
+  }
+
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+StreamGeneratorStatistics StreamGenerator::getStatistics() const
+{
+  return stats_;
+}
+
+} /* namespace libfreenect2 */
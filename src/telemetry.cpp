@@ -0,0 +1,279 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file telemetry.cpp Pipeline counters and latency histograms. */
+
+#include <libfreenect2/telemetry.h>
+#include <libfreenect2/threading.h>
+
+#include <sstream>
+
+namespace libfreenect2
+{
+
+class TelemetryImpl
+{
+public:
+  struct Histogram
+  {
+    atomic<uint64_t> buckets[Telemetry::HistogramBuckets];
+    atomic<uint64_t> count;
+    atomic<uint64_t> sum;
+  };
+
+  atomic<uint64_t> counters[Telemetry::StreamCount][Telemetry::CounterCount];
+  Histogram histograms[Telemetry::StreamCount][Telemetry::HistogramCount];
+  atomic<uint64_t> started[Telemetry::StreamCount]; ///< markStart() time until the first frame, else 0.
+
+  void reset()
+  {
+    for (size_t s = 0; s < Telemetry::StreamCount; s++)
+    {
+      started[s].store(0, std::memory_order_relaxed);
+      for (size_t c = 0; c < Telemetry::CounterCount; c++)
+        counters[s][c].store(0, std::memory_order_relaxed);
+      for (size_t h = 0; h < Telemetry::HistogramCount; h++)
+      {
+        for (size_t b = 0; b < Telemetry::HistogramBuckets; b++)
+          histograms[s][h].buckets[b].store(0, std::memory_order_relaxed);
+        histograms[s][h].count.store(0, std::memory_order_relaxed);
+        histograms[s][h].sum.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+};
+
+Telemetry::Telemetry() :
+  impl_(new TelemetryImpl)
+{
+  impl_->reset();
+}
+
+Telemetry::~Telemetry()
+{
+  delete impl_;
+}
+
+static uint64_t steadyNow()
+{
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** Write value / 10^digits exactly, without the rounding of floating point output. */
+static void writeScaled(std::ostream &out, uint64_t value, unsigned digits)
+{
+  uint64_t scale = 1;
+  for (unsigned i = 0; i < digits; i++)
+    scale *= 10;
+  out << value / scale;
+
+  uint64_t fraction = value % scale;
+  if (fraction == 0)
+    return;
+  for (; fraction % 10 == 0; digits--)
+    fraction /= 10;
+  const std::string text = std::to_string(fraction);
+  out << "." << std::string(digits - text.size(), '0') << text;
+}
+
+void Telemetry::add(Stream stream, Counter counter, uint64_t n)
+{
+  impl_->counters[stream][counter].fetch_add(n, std::memory_order_relaxed);
+
+  if (counter == FramesProcessed)
+  {
+    uint64_t start = impl_->started[stream].load(std::memory_order_relaxed);
+    if (start != 0 && impl_->started[stream].compare_exchange_strong(start, 0, std::memory_order_relaxed))
+    {
+      const uint64_t now = steadyNow();
+      record(stream, FirstFrameLatency, now > start ? now - start : 0);
+    }
+  }
+}
+
+void Telemetry::markStart(Stream stream)
+{
+  impl_->started[stream].store(steadyNow(), std::memory_order_relaxed);
+}
+
+void Telemetry::record(Stream stream, Histogram histogram, uint64_t ns)
+{
+  TelemetryImpl::Histogram &h = impl_->histograms[stream][histogram];
+
+  // smallest i with ns <= 2^i us
+  size_t bucket = 0;
+  for (uint64_t bound = 1000; bucket + 1 < HistogramBuckets && ns > bound; bound *= 2)
+    bucket++;
+
+  h.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  h.count.fetch_add(1, std::memory_order_relaxed);
+  h.sum.fetch_add(ns, std::memory_order_relaxed);
+}
+
+uint64_t Telemetry::get(Stream stream, Counter counter) const
+{
+  return impl_->counters[stream][counter].load(std::memory_order_relaxed);
+}
+
+uint64_t Telemetry::getBucket(Stream stream, Histogram histogram, size_t bucket) const
+{
+  if (bucket >= HistogramBuckets)
+    return 0;
+  return impl_->histograms[stream][histogram].buckets[bucket].load(std::memory_order_relaxed);
+}
+
+uint64_t Telemetry::getCount(Stream stream, Histogram histogram) const
+{
+  return impl_->histograms[stream][histogram].count.load(std::memory_order_relaxed);
+}
+
+uint64_t Telemetry::getSum(Stream stream, Histogram histogram) const
+{
+  return impl_->histograms[stream][histogram].sum.load(std::memory_order_relaxed);
+}
+
+void Telemetry::reset()
+{
+  impl_->reset();
+}
+
+const char *Telemetry::stream2str(Stream stream)
+{
+  switch (stream)
+  {
+  case Color: return "color";
+  case Depth: return "depth";
+  default: return "unknown";
+  }
+}
+
+const char *Telemetry::counter2str(Counter counter)
+{
+  switch (counter)
+  {
+  case TransfersCompleted: return "transfers_completed";
+  case TransfersFailed: return "transfers_failed";
+  case BadIsoPackets: return "bad_iso_packets";
+  case BytesReceived: return "bytes_received";
+  case Resyncs: return "resyncs";
+  case FramesCompleted: return "frames_completed";
+  case FramesSalvaged: return "frames_salvaged";
+  case FramesLost: return "frames_lost";
+  case DroppedIncomplete: return "dropped_incomplete";
+  case DroppedInvalid: return "dropped_invalid";
+  case DroppedBusy: return "dropped_busy";
+  case DroppedStale: return "dropped_stale";
+  case FramesProcessed: return "frames_processed";
+  default: return "unknown";
+  }
+}
+
+const char *Telemetry::histogram2str(Histogram histogram)
+{
+  switch (histogram)
+  {
+  case QueueLatency: return "queue_latency";
+  case ProcessLatency: return "process_latency";
+  case FirstFrameLatency: return "first_frame_latency";
+  default: return "unknown";
+  }
+}
+
+std::string Telemetry::toJson() const
+{
+  std::ostringstream out;
+  out << "{";
+  for (size_t s = 0; s < StreamCount; s++)
+  {
+    const Stream stream = static_cast<Stream>(s);
+    out << (s ? "," : "") << "\"" << stream2str(stream) << "\":{";
+    for (size_t c = 0; c < CounterCount; c++)
+    {
+      const Counter counter = static_cast<Counter>(c);
+      out << "\"" << counter2str(counter) << "\":" << get(stream, counter) << ",";
+    }
+    for (size_t h = 0; h < HistogramCount; h++)
+    {
+      const Histogram histogram = static_cast<Histogram>(h);
+      out << (h ? "," : "") << "\"" << histogram2str(histogram) << "\":{\"count\":" << getCount(stream, histogram)
+          << ",\"sum_ns\":" << getSum(stream, histogram) << ",\"buckets_us\":[";
+      for (size_t b = 0; b < HistogramBuckets; b++)
+        out << (b ? "," : "") << getBucket(stream, histogram, b);
+      out << "]}";
+    }
+    out << "}";
+  }
+  out << "}";
+  return out.str();
+}
+
+std::string Telemetry::toPrometheus(const std::string &labels) const
+{
+  std::ostringstream out;
+  const std::string extra = labels.empty() ? std::string() : "," + labels;
+
+  for (size_t c = 0; c < CounterCount; c++)
+  {
+    const Counter counter = static_cast<Counter>(c);
+    const std::string name = std::string("freenect2_") + counter2str(counter) + "_total";
+    out << "# TYPE " << name << " counter\n";
+    for (size_t s = 0; s < StreamCount; s++)
+    {
+      const Stream stream = static_cast<Stream>(s);
+      out << name << "{stream=\"" << stream2str(stream) << "\"" << extra << "} " << get(stream, counter) << "\n";
+    }
+  }
+
+  for (size_t h = 0; h < HistogramCount; h++)
+  {
+    const Histogram histogram = static_cast<Histogram>(h);
+    const std::string name = std::string("freenect2_") + histogram2str(histogram) + "_seconds";
+    out << "# TYPE " << name << " histogram\n";
+    for (size_t s = 0; s < StreamCount; s++)
+    {
+      const Stream stream = static_cast<Stream>(s);
+      const std::string series = std::string("stream=\"") + stream2str(stream) + "\"" + extra;
+      uint64_t cumulative = 0;
+      for (size_t b = 0; b < HistogramBuckets; b++)
+      {
+        cumulative += getBucket(stream, histogram, b);
+        out << name << "_bucket{" << series << ",le=\"";
+        if (b + 1 < HistogramBuckets)
+          writeScaled(out, uint64_t(1) << b, 6);
+        else
+          out << "+Inf";
+        out << "\"} " << cumulative << "\n";
+      }
+      out << name << "_sum{" << series << "} ";
+      writeScaled(out, getSum(stream, histogram), 9);
+      out << "\n";
+      out << name << "_count{" << series << "} " << getCount(stream, histogram) << "\n";
+    }
+  }
+  return out.str();
+}
+
+} /* namespace libfreenect2 */
@@ -0,0 +1,309 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file thread_policy.cpp Scheduling and CPU affinity of library threads. */
+
+#include <libfreenect2/thread_policy.h>
+#include <libfreenect2/threading.h>
+#include <libfreenect2/logging.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace libfreenect2
+{
+
+ThreadPolicy::ThreadPolicy():
+  exclusive(false),
+  scheduling(Default),
+  priority(0)
+{
+}
+
+/* CPUs a policy can name, the size of the affinity mask. */
+#if defined(__linux__)
+static const int MaxCpus = CPU_SETSIZE;
+#else
+static const int MaxCpus = 1024;
+#endif
+
+static bool parseInt(const std::string &str, int &value)
+{
+  if (str.empty())
+    return false;
+  char *end = NULL;
+  errno = 0;
+  long v = std::strtol(str.c_str(), &end, 10);
+  if (*end != '\0' || errno == ERANGE || v < INT_MIN || v > INT_MAX)
+    return false;
+  value = static_cast<int>(v);
+  return true;
+}
+
+/* Parse "0,2-3" into a list of CPUs. */
+static bool parseCpuList(const std::string &str, std::vector<int> &cpus)
+{
+  std::istringstream in(str);
+  std::string item;
+  while (std::getline(in, item, ','))
+  {
+    size_t dash = item.find('-');
+    int first = 0, last = 0;
+    if (dash == std::string::npos)
+    {
+      if (!parseInt(item, first))
+        return false;
+      last = first;
+    }
+    else if (!parseInt(item.substr(0, dash), first) || !parseInt(item.substr(dash + 1), last))
+    {
+      return false;
+    }
+    if (first < 0 || last < first || last >= MaxCpus)
+      return false;
+    for (int cpu = first; cpu <= last; cpu++)
+      cpus.push_back(cpu);
+  }
+  return !cpus.empty();
+}
+
+bool ThreadPolicy::parse(const std::string &str, ThreadPolicy &policy)
+{
+  ThreadPolicy p;
+  std::istringstream in(str);
+  std::string item;
+  while (std::getline(in, item, ';'))
+  {
+    if (item.empty())
+      continue;
+    size_t eq = item.find('=');
+    if (eq == std::string::npos)
+      return false;
+    std::string key = item.substr(0, eq);
+    std::string value = item.substr(eq + 1);
+
+    if (key == "cpus")
+    {
+      if (!parseCpuList(value, p.cpus))
+        return false;
+    }
+    else if (key == "fifo")
+    {
+      if (!parseInt(value, p.priority) || p.priority < 1 || p.priority > 99)
+        return false;
+      p.scheduling = Fifo;
+    }
+    else if (key == "nice")
+    {
+      if (!parseInt(value, p.priority) || p.priority < -20 || p.priority > 19)
+        return false;
+      p.scheduling = Nice;
+    }
+    else if (key == "exclusive")
+    {
+      p.exclusive = value == "1";
+    }
+    else
+    {
+      return false;
+    }
+  }
+  policy = p;
+  return true;
+}
+
+std::string ThreadPolicy::role2str(Role role)
+{
+  switch (role)
+  {
+  case UsbEventLoop:
+    return "USB";
+  case RgbProcessor:
+    return "RGB";
+  case DepthProcessor:
+    return "DEPTH";
+  case Replay:
+    return "REPLAY";
+  case Worker:
+    return "WORKER";
+  default:
+    return "";
+  }
+}
+
+class ThreadPolicyRegistry
+{
+public:
+  mutex lock;
+  ThreadPolicy policies[ThreadPolicy::RoleCount];
+
+  ThreadPolicyRegistry()
+  {
+    for (int i = 0; i < ThreadPolicy::RoleCount; i++)
+    {
+      ThreadPolicy::Role role = static_cast<ThreadPolicy::Role>(i);
+      std::string var = "LIBFREENECT2_THREAD_" + ThreadPolicy::role2str(role);
+      const char *env = std::getenv(var.c_str());
+      if (env == NULL)
+        continue;
+      if (!ThreadPolicy::parse(env, policies[i]))
+        LOG_WARNING << "ignoring invalid " << var << "=" << env;
+    }
+  }
+
+  static ThreadPolicyRegistry &instance()
+  {
+    static ThreadPolicyRegistry registry;
+    return registry;
+  }
+};
+
+ThreadPolicy getThreadPolicy(ThreadPolicy::Role role)
+{
+  ThreadPolicyRegistry &r = ThreadPolicyRegistry::instance();
+  lock_guard guard(r.lock);
+  return r.policies[role];
+}
+
+void setThreadPolicy(ThreadPolicy::Role role, const ThreadPolicy &policy)
+{
+  ThreadPolicyRegistry &r = ThreadPolicyRegistry::instance();
+  lock_guard guard(r.lock);
+  r.policies[role] = policy;
+}
+
+/* CPUs claimed exclusively by roles other than the given one. */
+static std::vector<int> exclusiveCpus(ThreadPolicy::Role role)
+{
+  std::vector<int> cpus;
+  for (int i = 0; i < ThreadPolicy::RoleCount; i++)
+  {
+    if (i == role)
+      continue;
+    ThreadPolicy other = getThreadPolicy(static_cast<ThreadPolicy::Role>(i));
+    if (other.exclusive)
+      cpus.insert(cpus.end(), other.cpus.begin(), other.cpus.end());
+  }
+  return cpus;
+}
+
+namespace this_thread
+{
+
+void apply_policy(ThreadPolicy::Role role)
+{
+  const ThreadPolicy policy = getThreadPolicy(role);
+  const std::string name = ThreadPolicy::role2str(role);
+
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  bool pin = false;
+  if (!policy.cpus.empty())
+  {
+    for (size_t i = 0; i < policy.cpus.size(); i++)
+      if (policy.cpus[i] < CPU_SETSIZE)
+        CPU_SET(policy.cpus[i], &set);
+    pin = true;
+  }
+  else
+  {
+    std::vector<int> excluded = exclusiveCpus(role);
+    if (!excluded.empty() && pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+    {
+      cpu_set_t all = set;
+      for (size_t i = 0; i < excluded.size(); i++)
+        if (excluded[i] < CPU_SETSIZE)
+          CPU_CLR(excluded[i], &set);
+      // Do not starve the thread if everything is claimed.
+      if (CPU_COUNT(&set) == 0)
+        set = all;
+      pin = true;
+    }
+  }
+  if (pin)
+  {
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0)
+      LOG_WARNING << name << " thread: failed to set CPU affinity: " << std::strerror(err);
+  }
+
+  if (policy.scheduling == ThreadPolicy::Nice)
+  {
+    if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), policy.priority) != 0)
+      LOG_WARNING << name << " thread: failed to set nice " << policy.priority << ": " << std::strerror(errno);
+  }
+#elif defined(__APPLE__)
+  if (!policy.cpus.empty())
+    LOG_WARNING << name << " thread: CPU pinning is not supported on this platform";
+  if (policy.scheduling == ThreadPolicy::Nice)
+    LOG_WARNING << name << " thread: per-thread nice is not supported on this platform";
+#else
+  if (!policy.cpus.empty() || policy.scheduling != ThreadPolicy::Default)
+    LOG_WARNING << name << " thread: thread policies are not supported on this platform";
+#endif
+
+#if defined(__linux__) || defined(__APPLE__)
+  if (policy.scheduling == ThreadPolicy::Fifo)
+  {
+    sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    param.sched_priority = policy.priority;
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0)
+      LOG_WARNING << name << " thread: failed to set SCHED_FIFO " << policy.priority << ": " << std::strerror(err);
+  }
+#endif
+
+  if (!policy.cpus.empty() || policy.scheduling != ThreadPolicy::Default)
+  {
+    std::ostringstream desc;
+    for (size_t i = 0; i < policy.cpus.size(); i++)
+      desc << (i == 0 ? " cpus " : ",") << policy.cpus[i];
+    if (policy.scheduling == ThreadPolicy::Fifo)
+      desc << " fifo " << policy.priority;
+    else if (policy.scheduling == ThreadPolicy::Nice)
+      desc << " nice " << policy.priority;
+    LOG_INFO << name << " thread policy:" << desc.str();
+  }
+}
+
+} /* namespace this_thread */
+} /* namespace libfreenect2 */
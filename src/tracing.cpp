@@ -0,0 +1,293 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file tracing.cpp Per-thread span rings and Chrome trace export. */
+
+#include <libfreenect2/trace_span.h>
+#include <libfreenect2/logging.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/prctl.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+namespace libfreenect2
+{
+namespace trace
+{
+
+atomic<bool> enabled(false);
+
+namespace
+{
+
+struct Event
+{
+  const char *name;
+  uint32_t sequence;
+  uint64_t start;
+  uint64_t end;
+};
+
+/** A thread that wrote to a ring, from event index #begin on. */
+struct Writer
+{
+  uint64_t begin;
+  size_t tid;
+  std::string thread_name;
+};
+
+/**
+ * Spans of one thread at a time. Only the owning thread writes; #head is
+ * published with release order. When the thread exits the ring is reused
+ * by the next new thread, its older spans stay until they are overwritten.
+ */
+struct Ring
+{
+  static const size_t Capacity = 16384;
+
+  std::vector<Event> events;
+  atomic<uint64_t> head;
+  std::vector<Writer> writers; ///< Oldest first, changed under Registry::lock.
+
+  Ring() : events(Capacity), head(0) {}
+
+  /** Hand the ring to the calling thread. */
+  void claim(size_t tid)
+  {
+    char name[32] = {0};
+#if defined(__linux__)
+    prctl(PR_GET_NAME, name);
+#elif defined(__APPLE__)
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+#endif
+    Writer w;
+    w.begin = head.load(std::memory_order_acquire);
+    w.tid = tid;
+    w.thread_name = name;
+
+    // Forget writers whose spans have all been overwritten, or that recorded none.
+    const uint64_t oldest = w.begin > Capacity ? w.begin - Capacity : 0;
+    std::vector<Writer> kept;
+    for (size_t i = 0; i < writers.size(); i++)
+    {
+      const uint64_t end = i + 1 < writers.size() ? writers[i + 1].begin : w.begin;
+      if (end > oldest && end > writers[i].begin)
+        kept.push_back(writers[i]);
+    }
+    kept.push_back(w);
+    writers.swap(kept);
+  }
+};
+
+/** Set when the registry is destroyed, threads exiting later keep their ring. */
+atomic<bool> registry_destroyed(false);
+
+class Registry
+{
+public:
+  mutex lock;
+  std::vector<Ring *> rings; ///< Kept after their thread exits so the trace can still be written.
+  std::vector<Ring *> free_rings; ///< Rings of exited threads, reused by new threads.
+  size_t next_tid;
+  std::string exit_filename;
+
+  Registry() : next_tid(1)
+  {
+    const char *filename = std::getenv("LIBFREENECT2_TRACE");
+    if (filename && filename[0] != '\0')
+    {
+      exit_filename = filename;
+      enabled = true;
+    }
+  }
+
+  ~Registry()
+  {
+    if (!exit_filename.empty())
+    {
+      enabled = false;
+      write(exit_filename);
+    }
+    // The rings are not freed: threads that outlive static destruction may still hold them.
+    registry_destroyed = true;
+  }
+
+  Ring *add()
+  {
+    lock_guard guard(lock);
+    Ring *ring;
+    if (!free_rings.empty())
+    {
+      ring = free_rings.back();
+      free_rings.pop_back();
+    }
+    else
+    {
+      ring = new Ring();
+      rings.push_back(ring);
+    }
+    ring->claim(next_tid++);
+    return ring;
+  }
+
+  /** Called when the thread that owns @p ring exits. */
+  void release(Ring *ring)
+  {
+    lock_guard guard(lock);
+    free_rings.push_back(ring);
+  }
+
+  static void writeEvent(std::ostream &out, const Event &e, size_t tid)
+  {
+    out << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"libfreenect2\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+        << ",\"ts\":" << e.start / 1000 << "." << (e.start % 1000) / 100
+        << ",\"dur\":" << (e.end - e.start) / 1000 << "." << ((e.end - e.start) % 1000) / 100;
+    if (e.sequence != NoSequence)
+      out << ",\"args\":{\"sequence\":" << e.sequence << "}";
+    out << "}";
+  }
+
+  bool write(const std::string &filename)
+  {
+    std::ofstream out(filename.c_str());
+    if (!out)
+    {
+      LOG_ERROR << "failed to write trace " << filename;
+      return false;
+    }
+
+    lock_guard guard(lock);
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    for (size_t r = 0; r < rings.size(); r++)
+    {
+      const Ring &ring = *rings[r];
+      const uint64_t head = ring.head.load(std::memory_order_acquire);
+      const uint64_t oldest = head > Ring::Capacity ? head - Ring::Capacity : 0;
+      for (size_t w = 0; w < ring.writers.size(); w++)
+      {
+        const Writer &writer = ring.writers[w];
+        out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << writer.tid
+            << ",\"args\":{\"name\":\"" << writer.thread_name << "\"}}";
+        first = false;
+
+        const uint64_t begin = writer.begin > oldest ? writer.begin : oldest;
+        const uint64_t end = w + 1 < ring.writers.size() ? ring.writers[w + 1].begin : head;
+        for (uint64_t i = begin; i < end; i++)
+          writeEvent(out, ring.events[i % Ring::Capacity], writer.tid);
+      }
+    }
+    out << "\n]}\n";
+    return out.good();
+  }
+
+  void clear()
+  {
+    lock_guard guard(lock);
+    for (size_t i = 0; i < rings.size(); i++)
+    {
+      rings[i]->head.store(0, std::memory_order_release);
+      if (!rings[i]->writers.empty())
+        rings[i]->writers.erase(rings[i]->writers.begin(), rings[i]->writers.end() - 1);
+      for (size_t w = 0; w < rings[i]->writers.size(); w++)
+        rings[i]->writers[w].begin = 0;
+    }
+  }
+};
+
+Registry &registry()
+{
+  static Registry instance;
+  return instance;
+}
+
+/** Returns the ring of a thread to the registry when the thread exits. */
+struct RingOwner
+{
+  Ring *ring;
+
+  RingOwner() : ring(0) {}
+  ~RingOwner()
+  {
+    if (ring && !registry_destroyed)
+      registry().release(ring);
+  }
+};
+
+/* Read the environment before the first span is recorded. */
+struct RegistryInit
+{
+  RegistryInit() { registry(); }
+} registry_init;
+
+} /* namespace */
+
+void record(const char *name, uint32_t sequence, uint64_t start_ns, uint64_t end_ns)
+{
+  static thread_local RingOwner owner;
+  if (owner.ring == 0)
+    owner.ring = registry().add();
+  Ring *ring = owner.ring;
+
+  const uint64_t head = ring->head.load(std::memory_order_relaxed);
+  Event &e = ring->events[head % Ring::Capacity];
+  e.name = name;
+  e.sequence = sequence;
+  e.start = start_ns;
+  e.end = end_ns;
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+} /* namespace trace */
+
+void setTracing(bool enable)
+{
+  trace::registry();
+  trace::enabled = enable;
+}
+
+bool isTracing()
+{
+  return trace::active();
+}
+
+bool writeTrace(const std::string &filename)
+{
+  return trace::registry().write(filename);
+}
+
+void clearTrace()
+{
+  trace::registry().clear();
+}
+
+} /* namespace libfreenect2 */
@@ -26,8 +26,12 @@
 
 /** @file transfer_pool.cpp Data transfer implementation. */
 
+#include <algorithm>
+#include <limits>
+
 #include <libfreenect2/usb/transfer_pool.h>
 #include <libfreenect2/logging.h>
+#include <libfreenect2/trace_span.h>
 
 #define WRITE_LIBUSB_ERROR(__RESULT) libusb_error_name(__RESULT) << " " << libusb_strerror((libusb_error)__RESULT)
 
@@ -36,19 +40,106 @@ namespace libfreenect2
 namespace usb
 {
 
-TransferPool::TransferPool(libusb_device_handle* device_handle, unsigned char device_endpoint) :
+AdaptiveTransferCount::AdaptiveTransferCount() :
+    min_(0),
+    max_(0),
+    target_(0),
+    baseline_(true),
+    window_start_(0),
+    errors_(0),
+    parser_loss_(0),
+    low_water_(0),
+    calm_(0)
+{
+}
+
+void AdaptiveTransferCount::setBounds(size_t min_transfers, size_t max_transfers, size_t initial)
+{
+  min_ = min_transfers;
+  max_ = std::max(min_transfers, max_transfers);
+  target_ = std::min(std::max(initial, min_), max_);
+  restart();
+}
+
+void AdaptiveTransferCount::restart()
+{
+  baseline_ = true;
+  window_start_ = 0;
+  errors_ = 0;
+  calm_ = 0;
+}
+
+size_t AdaptiveTransferCount::onCompletion(uint64_t now_ns, size_t in_flight, bool failed, uint64_t parser_loss)
+{
+  if(window_start_ == 0)
+  {
+    window_start_ = now_ns;
+    parser_loss_ = parser_loss;
+    low_water_ = std::numeric_limits<size_t>::max();
+  }
+
+  if(failed)
+    errors_++;
+  low_water_ = std::min(low_water_, in_flight);
+
+  if(now_ns - window_start_ < WindowNs)
+    return target_;
+
+  const bool stressed = errors_ > 0 || parser_loss != parser_loss_ || low_water_ == 0;
+  const bool calm = !stressed && low_water_ * 2 >= target_;
+  const size_t previous = target_;
+
+  if(baseline_)
+  {
+    baseline_ = false;
+  }
+  else if(stressed)
+  {
+    target_ = std::min(max_, target_ + std::max<size_t>(1, target_ / 4));
+    calm_ = 0;
+  }
+  else if(!calm)
+  {
+    calm_ = 0;
+  }
+  else if(++calm_ >= CalmWindows)
+  {
+    target_ = std::max(min_, target_ - 1);
+    calm_ = 0;
+  }
+
+  if(target_ != previous)
+    LOG_DEBUG << "transfers " << previous << " -> " << target_ << " (errors: " << errors_
+              << " parser loss: " << parser_loss - parser_loss_ << " lowest in flight: " << low_water_ << ")";
+
+  window_start_ = now_ns;
+  errors_ = 0;
+  parser_loss_ = parser_loss;
+  low_water_ = std::numeric_limits<size_t>::max();
+  return target_;
+}
+
+TransferPool::TransferPool(Transport *transport, unsigned char device_endpoint) :
+    active_transfers(0),
     callback_(0),
-    device_handle_(device_handle),
+    transport_(transport),
     device_endpoint_(device_endpoint),
-    buffer_(0),
-    buffer_size_(0),
-    enable_submit_(false)
+    allocator_(createLargeBufferAllocator()),
+    transfer_size_(0),
+    adaptive_min_(0),
+    adaptive_max_(0),
+    enable_submit_(false),
+    external_events_(false),
+    in_flight_(0),
+    telemetry_(0),
+    stream_(Telemetry::Depth)
 {
 }
 
 TransferPool::~TransferPool()
 {
   deallocate();
+  delete allocator_;
 }
 
 void TransferPool::enableSubmission()
@@ -74,12 +165,9 @@ void TransferPool::deallocate()
   }
   transfers_.clear();
 
-  if(buffer_ != 0)
-  {
-    delete[] buffer_;
-    buffer_ = 0;
-    buffer_size_ = 0;
-  }
+  for(size_t i = 0; i < buffers_.size(); ++i)
+    allocator_->free(buffers_[i]);
+  buffers_.clear();
 }
 
 bool TransferPool::submit()
@@ -90,23 +178,30 @@ bool TransferPool::submit()
     return false;
   }
 
+  // Transfers above the adaptive target stay parked until it grows.
+  const size_t num_transfers = adaptive_.enabled() ? std::min(adaptive_.target(), transfers_.size()) : transfers_.size();
+  adaptive_.restart();
+
   size_t failcount = 0;
-  for(size_t i = 0; i < transfers_.size(); ++i)
+  for(size_t i = 0; i < num_transfers; ++i)
   {
     libusb_transfer *transfer = transfers_[i].transfer;
+    transfer->buffer = transfers_[i].buffer;
     transfers_[i].setStopped(false);
 
-    int r = libusb_submit_transfer(transfer);
+    in_flight_++;
+    int r = transport_->submitTransfer(transfer);
 
     if(r != LIBUSB_SUCCESS)
     {
       LOG_ERROR << "failed to submit transfer: " << WRITE_LIBUSB_ERROR(r);
+      in_flight_--;
       transfers_[i].setStopped(true);
       failcount++;
     }
   }
 
-  if (failcount == transfers_.size())
+  if (failcount == num_transfers)
   {
     LOG_ERROR << "all submissions failed. Try debugging with environment variable: LIBUSB_DEBUG=3.";
     return false;
@@ -117,61 +212,152 @@ bool TransferPool::submit()
 
 void TransferPool::cancel()
 {
+  libfreenect2::unique_lock transfers_lock(transfers_mutex_);
   for(TransferQueue::iterator it = transfers_.begin(); it != transfers_.end(); ++it)
   {
-    int r = libusb_cancel_transfer(it->transfer);
+    int r = transport_->cancelTransfer(it->transfer);
 
     if(r != LIBUSB_SUCCESS && r != LIBUSB_ERROR_NOT_FOUND)
     {
       LOG_ERROR << "failed to cancel transfer: " << WRITE_LIBUSB_ERROR(r);
     }
   }
+  transfers_lock.unlock();
 
-  for(;;)
+  libfreenect2::unique_lock lock(stopped_mutex);
+  libfreenect2::chrono::steady_clock::time_point next_report = libfreenect2::chrono::steady_clock::now() + libfreenect2::chrono::milliseconds(1000);
+  while(active_transfers > 0)
   {
-    libfreenect2::this_thread::sleep_for(libfreenect2::chrono::milliseconds(100));
-    size_t stopped_transfers = 0;
-    for(TransferQueue::iterator it = transfers_.begin(); it != transfers_.end(); ++it)
-      stopped_transfers += it->getStopped();
-    if (stopped_transfers == transfers_.size())
-      break;
-    LOG_INFO << "waiting for transfer cancellation";
-    libfreenect2::this_thread::sleep_for(libfreenect2::chrono::milliseconds(1000));
+    if(external_events_)
+    {
+      // Cancelled transfers only call back from an event handler, and no thread runs one.
+      lock.unlock();
+      const int r = transport_->handleEvents(10);
+      lock.lock();
+      if(r != LIBUSB_SUCCESS && r != LIBUSB_ERROR_INTERRUPTED)
+      {
+        // The transfers may still return, freeing them now is not safe.
+        LOG_ERROR << "failed to handle usb events: " << WRITE_LIBUSB_ERROR(r);
+        stopped_condition.wait_until(lock, next_report);
+      }
+    }
+    else
+    {
+      stopped_condition.wait_until(lock, next_report);
+    }
+
+    if(active_transfers > 0 && libfreenect2::chrono::steady_clock::now() >= next_report)
+    {
+      LOG_INFO << "waiting for transfer cancellation";
+      next_report += libfreenect2::chrono::milliseconds(1000);
+    }
   }
 }
 
+void TransferPool::setExternalEvents(bool external)
+{
+  external_events_ = external;
+}
+
 void TransferPool::setCallback(DataCallback *callback)
 {
   callback_ = callback;
 }
 
+void TransferPool::setTelemetry(Telemetry *telemetry, Telemetry::Stream stream)
+{
+  telemetry_ = telemetry;
+  stream_ = stream;
+}
+
+void TransferPool::setAdaptive(size_t min_transfers, size_t max_transfers)
+{
+  adaptive_min_ = min_transfers;
+  adaptive_max_ = max_transfers;
+}
+
+size_t TransferPool::targetTransfers() const
+{
+  return adaptive_.enabled() ? adaptive_.target() : transfers_.size();
+}
+
 void TransferPool::allocateTransfers(size_t num_transfers, size_t transfer_size)
 {
-  buffer_size_ = num_transfers * transfer_size;
-  buffer_ = new unsigned char[buffer_size_];
-  transfers_.reserve(num_transfers);
+  transfer_size_ = transfer_size;
+  adaptive_.setBounds(adaptive_min_, adaptive_max_, num_transfers);
+  transfers_.reserve(std::max(num_transfers, adaptive_.maximum()));
+  addTransfers(num_transfers);
+}
 
-  unsigned char *ptr = buffer_;
+void TransferPool::addTransfers(size_t num_transfers)
+{
+  Buffer *buffer = allocator_->allocate(num_transfers * transfer_size_);
+  buffers_.push_back(buffer);
+
+  unsigned char *ptr = buffer->data;
 
   for(size_t i = 0; i < num_transfers; ++i)
   {
     libusb_transfer *transfer = allocateTransfer();
     fillTransfer(transfer);
 
-    transfers_.push_back(TransferPool::Transfer(transfer, this));
+    transfers_.push_back(TransferPool::Transfer(transfer, this, ptr));
 
-    transfer->dev_handle = device_handle_;
+    transfer->dev_handle = transport_->handle();
     transfer->endpoint = device_endpoint_;
     transfer->buffer = ptr;
-    transfer->length = transfer_size;
+    transfer->length = transfer_size_;
     transfer->timeout = 1000;
     transfer->callback = (libusb_transfer_cb_fn) &TransferPool::onTransferCompleteStatic;
     transfer->user_data = &transfers_.back();
 
-    ptr += transfer_size;
+    ptr += transfer_size_;
+  }
+}
+
+void TransferPool::growTo(size_t target)
+{
+  libfreenect2::lock_guard guard(transfers_mutex_);
+  size_t active;
+  {
+    libfreenect2::lock_guard stopped_guard(stopped_mutex);
+    active = active_transfers;
+  }
+
+  // Parked transfers are resubmitted before new ones are allocated.
+  if(transfers_.size() < target)
+    addTransfers(target - transfers_.size());
+
+  for(size_t i = 0; i < transfers_.size() && active < target && enable_submit_; ++i)
+  {
+    Transfer *t = &transfers_[i];
+    if(!t->getStopped())
+      continue;
+
+    t->transfer->buffer = nextTransferBuffer(t);
+    t->setStopped(false);
+    in_flight_++;
+    int r = transport_->submitTransfer(t->transfer);
+
+    if(r != LIBUSB_SUCCESS)
+    {
+      LOG_ERROR << "failed to submit transfer: " << WRITE_LIBUSB_ERROR(r);
+      in_flight_--;
+      t->setStopped(true);
+      return;
+    }
+    active++;
   }
 }
 
+uint64_t TransferPool::parserLoss() const
+{
+  if(!telemetry_)
+    return 0;
+  return telemetry_->get(stream_, Telemetry::Resyncs) + telemetry_->get(stream_, Telemetry::DroppedIncomplete) +
+         telemetry_->get(stream_, Telemetry::DroppedInvalid) + telemetry_->get(stream_, Telemetry::FramesSalvaged);
+}
+
 void TransferPool::onTransferCompleteStatic(libusb_transfer* transfer)
 {
   TransferPool::Transfer *t = reinterpret_cast<TransferPool::Transfer*>(transfer->user_data);
@@ -180,14 +366,21 @@ void TransferPool::onTransferCompleteStatic(libusb_transfer* transfer)
 
 void TransferPool::onTransferComplete(TransferPool::Transfer* t)
 {
+  in_flight_--;
+
   if(t->transfer->status == LIBUSB_TRANSFER_CANCELLED)
   {
     t->setStopped(true);
     return;
   }
 
+  count(t->transfer->status == LIBUSB_TRANSFER_COMPLETED ? Telemetry::TransfersCompleted : Telemetry::TransfersFailed);
+
   // process data
-  processTransfer(t->transfer);
+  {
+    trace::Span span(stream_ == Telemetry::Color ? "usb_color_transfer" : "usb_depth_transfer");
+    processTransfer(t->transfer);
+  }
 
   if(!enable_submit_)
   {
@@ -195,18 +388,43 @@ void TransferPool::onTransferComplete(TransferPool::Transfer* t)
     return;
   }
 
+  size_t target = 0;
+  if(adaptive_.enabled())
+  {
+    target = adaptive_.onCompletion(trace::now(), inFlight(), t->transfer->status != LIBUSB_TRANSFER_COMPLETED, parserLoss());
+
+    size_t active;
+    {
+      libfreenect2::lock_guard guard(stopped_mutex);
+      active = active_transfers;
+    }
+    // Park this transfer if there are too many.
+    if(active > target)
+    {
+      t->setStopped(true);
+      return;
+    }
+  }
+
   // resubmit self
-  int r = libusb_submit_transfer(t->transfer);
+  t->transfer->buffer = nextTransferBuffer(t);
+  in_flight_++;
+  int r = transport_->submitTransfer(t->transfer);
 
   if(r != LIBUSB_SUCCESS)
   {
     LOG_ERROR << "failed to submit transfer: " << WRITE_LIBUSB_ERROR(r);
+    in_flight_--;
     t->setStopped(true);
+    return;
   }
+
+  if(target > 0)
+    growTo(target);
 }
 
-BulkTransferPool::BulkTransferPool(libusb_device_handle* device_handle, unsigned char device_endpoint) :
-    TransferPool(device_handle, device_endpoint)
+BulkTransferPool::BulkTransferPool(Transport *transport, unsigned char device_endpoint) :
+    TransferPool(transport, device_endpoint)
 {
 }
 
@@ -231,14 +449,31 @@ void BulkTransferPool::fillTransfer(libusb_transfer* transfer)
 
 void BulkTransferPool::processTransfer(libusb_transfer* transfer)
 {
-  if(transfer->status != LIBUSB_TRANSFER_COMPLETED) return;
+  if(!callback_)
+    return;
 
-  if(callback_)
+  // A failed transfer is still reported so the callback can reclaim its buffer.
+  if(transfer->status != LIBUSB_TRANSFER_COMPLETED)
+  {
+    callback_->onDataReceived(transfer->buffer, 0);
+  }
+  else
+  {
+    count(Telemetry::BytesReceived, transfer->actual_length);
     callback_->onDataReceived(transfer->buffer, transfer->actual_length);
+  }
 }
 
-IsoTransferPool::IsoTransferPool(libusb_device_handle* device_handle, unsigned char device_endpoint) :
-    TransferPool(device_handle, device_endpoint),
+unsigned char *BulkTransferPool::nextTransferBuffer(Transfer *t)
+{
+  unsigned char *buffer = NULL;
+  if(callback_)
+    buffer = callback_->getTransferBuffer(t->transfer->length, inFlight() * t->transfer->length);
+  return buffer != NULL ? buffer : t->buffer;
+}
+
+IsoTransferPool::IsoTransferPool(Transport *transport, unsigned char device_endpoint) :
+    TransferPool(transport, device_endpoint),
     num_packets_(0),
     packet_size_(0)
 {
@@ -252,6 +487,7 @@ void IsoTransferPool::allocate(size_t num_transfers, size_t num_packets, size_t
 {
   num_packets_ = num_packets;
   packet_size_ = packet_size;
+  received_.reserve(num_packets_);
 
   allocateTransfers(num_transfers, num_packets_ * packet_size_);
 }
@@ -272,15 +508,35 @@ void IsoTransferPool::fillTransfer(libusb_transfer* transfer)
 void IsoTransferPool::processTransfer(libusb_transfer* transfer)
 {
   unsigned char *ptr = transfer->buffer;
+  uint64_t bytes = 0, bad_packets = 0;
 
+  // Hand the whole transfer over at once, the depth parser copies runs of packets in bulk.
+  received_.clear();
   for(size_t i = 0; i < num_packets_; ++i)
   {
-    if(transfer->iso_packet_desc[i].status != LIBUSB_TRANSFER_COMPLETED) continue;
+    // Each packet has its own slot of the buffer, also if it failed.
+    unsigned char *packet = ptr;
+    ptr += transfer->iso_packet_desc[i].length;
 
-    if(callback_)
-      callback_->onDataReceived(ptr, transfer->iso_packet_desc[i].actual_length);
+    if(transfer->iso_packet_desc[i].status != LIBUSB_TRANSFER_COMPLETED)
+    {
+      bad_packets++;
+      continue;
+    }
 
-    ptr += transfer->iso_packet_desc[i].length;
+    const DataCallback::IsoPacket received = { packet, transfer->iso_packet_desc[i].actual_length };
+    received_.push_back(received);
+    bytes += received.length;
+  }
+
+  if(callback_ && !received_.empty())
+    callback_->onIsoPacketsReceived(&received_[0], received_.size());
+
+  count(Telemetry::BytesReceived, bytes);
+  if(bad_packets > 0)
+  {
+    count(Telemetry::BadIsoPackets, bad_packets);
+    countErrors(bad_packets);
   }
 }
 
@@ -28,6 +28,7 @@
 
 #include <libfreenect2/rgb_packet_processor.h>
 #include <libfreenect2/logging.h>
+#include <libfreenect2/trace_span.h>
 #include <turbojpeg.h>
 
 namespace libfreenect2
@@ -68,7 +69,7 @@ public:
 
   void newFrame()
   {
-    frame = new Frame(1920, 1080, tjPixelSize[TJPF_BGRX]);
+    frame = newLargeFrame(1920, 1080, tjPixelSize[TJPF_BGRX]);
     frame->format = Frame::BGRX;
   }
 };
@@ -95,13 +96,19 @@ void TurboJpegRgbPacketProcessor::process(const RgbPacket &packet)
     impl_->frame->gain = packet.gain;
     impl_->frame->gamma = packet.gamma;
 
-    int r = tjDecompress2(impl_->decompressor, packet.jpeg_buffer, packet.jpeg_buffer_length, impl_->frame->data, 1920, 1920 * tjPixelSize[TJPF_BGRX], 1080, TJPF_BGRX, 0);
+    int r;
+    {
+      trace::Span span("jpeg_decode", packet.sequence);
+      r = tjDecompress2(impl_->decompressor, packet.jpeg_buffer, packet.jpeg_buffer_length, impl_->frame->data, 1920, 1920 * tjPixelSize[TJPF_BGRX], 1080, TJPF_BGRX, 0);
+    }
 
     impl_->stopTiming(LOG_INFO);
 
     if(r == 0)
     {
-      if(listener_->onNewFrame(Frame::Color, impl_->frame))
+      timer_.stamp(packet, impl_->frame);
+      trace::Span span("color_listener", packet.sequence);
+      if(deliverFrame(listener_, Frame::Color, impl_->frame))
       {
         impl_->newFrame();
       }
@@ -67,7 +67,7 @@ namespace libusb_ext
     static uint8_t get() { return LIBUSB_RECIPIENT_INTERFACE; };
   };
 
-  int set_isochronous_delay(libusb_device_handle *handle, int timeout)
+  int set_isochronous_delay(usb::Transport *transport, int timeout)
   {
     // for details see USB 3.1 r1 spec section 9.4.11
 
@@ -79,10 +79,10 @@ namespace libusb_ext
     uint16_t wLength = 0;
     uint8_t *data    = 0;
 
-    return libusb_control_transfer(handle, bmRequestType, bRequest, wValue, wIndex, data, wLength, timeout);
+    return transport->controlTransfer(bmRequestType, bRequest, wValue, wIndex, data, wLength, timeout);
   }
 
-  int set_sel(libusb_device_handle *handle, int timeout, uint8_t u1sel, uint8_t u1pel, uint8_t u2sel, uint8_t u2pel)
+  int set_sel(usb::Transport *transport, int timeout, uint8_t u1sel, uint8_t u1pel, uint8_t u2sel, uint8_t u2pel)
   {
     // for details see USB 3.1 r1 spec section 9.4.12
 
@@ -93,11 +93,11 @@ namespace libusb_ext
     uint16_t wLength = 6;
     unsigned char data[6]   = { 0x55, 0, 0x55, 0, 0, 0 };
 
-    return libusb_control_transfer(handle, bmRequestType, bRequest, wValue, wIndex, data, wLength, timeout);
+    return transport->controlTransfer(bmRequestType, bRequest, wValue, wIndex, data, wLength, timeout);
   }
 
   template<typename TFeatureSelector>
-  int set_feature(libusb_device_handle *handle, int timeout, TFeatureSelector feature_selector)
+  int set_feature(usb::Transport *transport, int timeout, TFeatureSelector feature_selector)
   {
     // for details see USB 3.1 r1 spec section 9.4.9
 
@@ -108,10 +108,10 @@ namespace libusb_ext
     uint16_t wLength = 0;
     uint8_t *data    = 0;
 
-    return libusb_control_transfer(handle, bmRequestType, bRequest, wValue, wIndex, data, wLength, timeout);
+    return transport->controlTransfer(bmRequestType, bRequest, wValue, wIndex, data, wLength, timeout);
   }
 
-  int set_feature_function_suspend(libusb_device_handle *handle, int timeout, bool low_power_suspend, bool function_remote_wake)
+  int set_feature_function_suspend(usb::Transport *transport, int timeout, bool low_power_suspend, bool function_remote_wake)
   {
     uint8_t suspend_options = 0;
     suspend_options |= low_power_suspend ? 1 : 0;
@@ -127,60 +127,12 @@ namespace libusb_ext
     uint16_t wLength = 0;
     uint8_t *data    = 0;
 
-    return libusb_control_transfer(handle, bmRequestType, bRequest, wValue, wIndex, data, wLength, timeout);
-  }
-
-  int get_max_iso_packet_size(libusb_device *device, int configuration, int alternate_setting, int endpoint)
-  {
-    libusb_config_descriptor *config_desc;
-    int r = LIBUSB_ERROR_NOT_FOUND;
-
-    r = libusb_get_config_descriptor_by_value(device, configuration, &config_desc);
-
-    if(r == LIBUSB_SUCCESS)
-    {
-      for(int interface_idx = 0; interface_idx < config_desc->bNumInterfaces; ++interface_idx)
-      {
-        const libusb_interface &interface = config_desc->interface[interface_idx];
-
-        if(interface.num_altsetting > alternate_setting)
-        {
-          const libusb_interface_descriptor &interface_desc = interface.altsetting[alternate_setting];
-          const libusb_endpoint_descriptor *endpoint_desc = 0;
-
-          for(int endpoint_idx = 0; endpoint_idx < interface_desc.bNumEndpoints; ++endpoint_idx)
-          {
-            if(interface_desc.endpoint[endpoint_idx].bEndpointAddress == endpoint && (interface_desc.endpoint[endpoint_idx].bmAttributes & 0x3) == LIBUSB_TRANSFER_TYPE_ISOCHRONOUS)
-            {
-              endpoint_desc = interface_desc.endpoint + endpoint_idx;
-              break;
-            }
-          }
-
-          if(endpoint_desc != 0)
-          {
-            libusb_ss_endpoint_companion_descriptor *companion_desc;
-            // ctx is only used for error reporting, libusb should better ask for a libusb_device anyway...
-            r = libusb_get_ss_endpoint_companion_descriptor(NULL /* ctx */, endpoint_desc, &companion_desc);
-
-            if(r != LIBUSB_SUCCESS) continue;
-
-            r = companion_desc->wBytesPerInterval;
-
-            libusb_free_ss_endpoint_companion_descriptor(companion_desc);
-            break;
-          }
-        }
-      }
-    }
-    libusb_free_config_descriptor(config_desc);
-
-    return r;
+    return transport->controlTransfer(bmRequestType, bRequest, wValue, wIndex, data, wLength, timeout);
   }
 }
 
-UsbControl::UsbControl(libusb_device_handle *handle) :
-    handle_(handle),
+UsbControl::UsbControl(usb::Transport *transport) :
+    transport_(transport),
     timeout_(1000)
 {
 }
@@ -199,14 +151,14 @@ UsbControl::ResultCode UsbControl::setConfiguration()
   int current_config_id = -1;
   int r;
 
-  r = libusb_get_configuration(handle_, &current_config_id);
+  r = transport_->getConfiguration(&current_config_id);
   CHECK_LIBUSB_RESULT(code, r) << "failed to get configuration! " << WRITE_LIBUSB_ERROR(r);
 
   if(code == Success)
   {
     if(current_config_id != desired_config_id)
     {
-      r = libusb_set_configuration(handle_, desired_config_id);
+      r = transport_->setConfiguration(desired_config_id);
       CHECK_LIBUSB_RESULT(code, r) << "failed to set configuration! " << WRITE_LIBUSB_ERROR(r);
     }
   }
@@ -219,12 +171,12 @@ UsbControl::ResultCode UsbControl::claimInterfaces()
   UsbControl::ResultCode code = Success;
   int r;
 
-  r = libusb_claim_interface(handle_, ControlAndRgbInterfaceId);
+  r = transport_->claimInterface(ControlAndRgbInterfaceId);
   CHECK_LIBUSB_RESULT(code, r) << "failed to claim interface with ControlAndRgbInterfaceId(="<< ControlAndRgbInterfaceId << ")! " << WRITE_LIBUSB_ERROR(r);
 
   if(code == Success)
   {
-    r = libusb_claim_interface(handle_, IrInterfaceId);
+    r = transport_->claimInterface(IrInterfaceId);
     CHECK_LIBUSB_RESULT(code, r) << "failed to claim interface with IrInterfaceId(="<< IrInterfaceId << ")! " << WRITE_LIBUSB_ERROR(r);
   }
 
@@ -236,12 +188,12 @@ UsbControl::ResultCode UsbControl::releaseInterfaces()
   UsbControl::ResultCode code = Success;
   int r;
 
-  r = libusb_release_interface(handle_, ControlAndRgbInterfaceId);
+  r = transport_->releaseInterface(ControlAndRgbInterfaceId);
   CHECK_LIBUSB_RESULT(code, r) << "failed to release interface with ControlAndRgbInterfaceId(="<< ControlAndRgbInterfaceId << ")! " << WRITE_LIBUSB_ERROR(r);
 
   if(code == Success)
   {
-    r = libusb_release_interface(handle_, IrInterfaceId);
+    r = transport_->releaseInterface(IrInterfaceId);
     CHECK_LIBUSB_RESULT(code, r) << "failed to release interface with IrInterfaceId(="<< IrInterfaceId << ")! " << WRITE_LIBUSB_ERROR(r);
   }
 
@@ -250,7 +202,7 @@ UsbControl::ResultCode UsbControl::releaseInterfaces()
 
 UsbControl::ResultCode UsbControl::setIsochronousDelay()
 {
-  int r = libusb_ext::set_isochronous_delay(handle_, timeout_);
+  int r = libusb_ext::set_isochronous_delay(transport_, timeout_);
 
   UsbControl::ResultCode code;
   CHECK_LIBUSB_RESULT(code, r) << "failed to set isochronous delay! " << WRITE_LIBUSB_ERROR(r);
@@ -259,7 +211,7 @@ UsbControl::ResultCode UsbControl::setIsochronousDelay()
 
 UsbControl::ResultCode UsbControl::setPowerStateLatencies()
 {
-  int r = libusb_ext::set_sel(handle_, timeout_, 0x55, 0, 0x55, 0);
+  int r = libusb_ext::set_sel(transport_, timeout_, 0x55, 0, 0x55, 0);
 
   UsbControl::ResultCode code;
   CHECK_LIBUSB_RESULT(code, r) << "failed to set power state latencies! " << WRITE_LIBUSB_ERROR(r);
@@ -271,12 +223,12 @@ UsbControl::ResultCode UsbControl::enablePowerStates()
   UsbControl::ResultCode code;
   int r;
 
-  r = libusb_ext::set_feature(handle_, timeout_, libusb_ext::U1_ENABLE);
+  r = libusb_ext::set_feature(transport_, timeout_, libusb_ext::U1_ENABLE);
   CHECK_LIBUSB_RESULT(code, r) << "failed to enable power states U1! " << WRITE_LIBUSB_ERROR(r);
 
   if(code == Success)
   {
-    r = libusb_ext::set_feature(handle_, timeout_, libusb_ext::U2_ENABLE);
+    r = libusb_ext::set_feature(transport_, timeout_, libusb_ext::U2_ENABLE);
     CHECK_LIBUSB_RESULT(code, r) << "failed to enable power states U2! " << WRITE_LIBUSB_ERROR(r);
   }
 
@@ -286,7 +238,7 @@ UsbControl::ResultCode UsbControl::enablePowerStates()
 UsbControl::ResultCode UsbControl::setVideoTransferFunctionState(UsbControl::State state)
 {
   bool suspend = state == Enabled ? false : true;
-  int r = libusb_ext::set_feature_function_suspend(handle_, timeout_, suspend, suspend);
+  int r = libusb_ext::set_feature_function_suspend(transport_, timeout_, suspend, suspend);
 
   UsbControl::ResultCode code;
   CHECK_LIBUSB_RESULT(code, r) << "failed to set video transfer function state! " << WRITE_LIBUSB_ERROR(r);
@@ -296,7 +248,7 @@ UsbControl::ResultCode UsbControl::setVideoTransferFunctionState(UsbControl::Sta
 UsbControl::ResultCode UsbControl::setIrInterfaceState(UsbControl::State state)
 {
   int alternate_setting = state == Enabled ? 1 : 0;
-  int r = libusb_set_interface_alt_setting(handle_, IrInterfaceId, alternate_setting);
+  int r = transport_->setInterfaceAltSetting(IrInterfaceId, alternate_setting);
 
   UsbControl::ResultCode code;
   CHECK_LIBUSB_RESULT(code, r) << "failed to set ir interface state! " << WRITE_LIBUSB_ERROR(r);
@@ -307,8 +259,7 @@ UsbControl::ResultCode UsbControl::setIrInterfaceState(UsbControl::State state)
 UsbControl::ResultCode UsbControl::getIrMaxIsoPacketSize(int &size)
 {
   size = 0;
-  libusb_device *dev = libusb_get_device(handle_);
-  int r = libusb_ext::get_max_iso_packet_size(dev, 1, 1, 0x84);
+  int r = transport_->getMaxIsoPacketSize(1, 1, 0x84);
 
   if(r > LIBUSB_SUCCESS)
   {
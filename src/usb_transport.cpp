@@ -0,0 +1,179 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+
+/** @file usb_transport.cpp Transport over libusb. */
+
+#include <libfreenect2/usb/transport.h>
+
+#include <cstddef>
+
+namespace libfreenect2
+{
+namespace usb
+{
+
+LibUsbTransport::LibUsbTransport(libusb_device_handle *handle, libusb_context *context) :
+    handle_(handle),
+    context_(context)
+{
+}
+
+LibUsbTransport::~LibUsbTransport()
+{
+  close();
+}
+
+#define CHECK_OPEN() if(handle_ == 0) return LIBUSB_ERROR_NO_DEVICE
+
+int LibUsbTransport::getConfiguration(int *configuration)
+{
+  CHECK_OPEN();
+  return libusb_get_configuration(handle_, configuration);
+}
+
+int LibUsbTransport::setConfiguration(int configuration)
+{
+  CHECK_OPEN();
+  return libusb_set_configuration(handle_, configuration);
+}
+
+int LibUsbTransport::claimInterface(int interface_number)
+{
+  CHECK_OPEN();
+  return libusb_claim_interface(handle_, interface_number);
+}
+
+int LibUsbTransport::releaseInterface(int interface_number)
+{
+  CHECK_OPEN();
+  return libusb_release_interface(handle_, interface_number);
+}
+
+int LibUsbTransport::setInterfaceAltSetting(int interface_number, int alternate_setting)
+{
+  CHECK_OPEN();
+  return libusb_set_interface_alt_setting(handle_, interface_number, alternate_setting);
+}
+
+int LibUsbTransport::controlTransfer(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+                                     unsigned char *data, uint16_t length, unsigned int timeout)
+{
+  CHECK_OPEN();
+  return libusb_control_transfer(handle_, request_type, request, value, index, data, length, timeout);
+}
+
+int LibUsbTransport::getMaxIsoPacketSize(int configuration, int alternate_setting, unsigned char endpoint)
+{
+  CHECK_OPEN();
+  libusb_device *device = libusb_get_device(handle_);
+  libusb_config_descriptor *config_desc;
+  int r = LIBUSB_ERROR_NOT_FOUND;
+
+  r = libusb_get_config_descriptor_by_value(device, configuration, &config_desc);
+
+  if(r == LIBUSB_SUCCESS)
+  {
+    for(int interface_idx = 0; interface_idx < config_desc->bNumInterfaces; ++interface_idx)
+    {
+      const libusb_interface &interface = config_desc->interface[interface_idx];
+
+      if(interface.num_altsetting > alternate_setting)
+      {
+        const libusb_interface_descriptor &interface_desc = interface.altsetting[alternate_setting];
+        const libusb_endpoint_descriptor *endpoint_desc = 0;
+
+        for(int endpoint_idx = 0; endpoint_idx < interface_desc.bNumEndpoints; ++endpoint_idx)
+        {
+          if(interface_desc.endpoint[endpoint_idx].bEndpointAddress == endpoint && (interface_desc.endpoint[endpoint_idx].bmAttributes & 0x3) == LIBUSB_TRANSFER_TYPE_ISOCHRONOUS)
+          {
+            endpoint_desc = interface_desc.endpoint + endpoint_idx;
+            break;
+          }
+        }
+
+        if(endpoint_desc != 0)
+        {
+          libusb_ss_endpoint_companion_descriptor *companion_desc;
+          // ctx is only used for error reporting, libusb should better ask for a libusb_device anyway...
+          r = libusb_get_ss_endpoint_companion_descriptor(NULL /* ctx */, endpoint_desc, &companion_desc);
+
+          if(r != LIBUSB_SUCCESS) continue;
+
+          r = companion_desc->wBytesPerInterval;
+
+          libusb_free_ss_endpoint_companion_descriptor(companion_desc);
+          break;
+        }
+      }
+    }
+  }
+  libusb_free_config_descriptor(config_desc);
+
+  return r;
+}
+
+int LibUsbTransport::bulkTransfer(unsigned char endpoint, unsigned char *data, int length, int *transferred, unsigned int timeout)
+{
+  CHECK_OPEN();
+  return libusb_bulk_transfer(handle_, endpoint, data, length, transferred, timeout);
+}
+
+int LibUsbTransport::submitTransfer(libusb_transfer *transfer)
+{
+  return libusb_submit_transfer(transfer);
+}
+
+int LibUsbTransport::cancelTransfer(libusb_transfer *transfer)
+{
+  return libusb_cancel_transfer(transfer);
+}
+
+int LibUsbTransport::handleEvents(int timeout_ms)
+{
+  // Events belong to the context: this completes the transfers of every device in it.
+  timeval tv;
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+  return libusb_handle_events_timeout_completed(context_, &tv, 0);
+}
+
+libusb_device_handle *LibUsbTransport::handle()
+{
+  return handle_;
+}
+
+void LibUsbTransport::close()
+{
+  if(handle_ != 0)
+  {
+    libusb_close(handle_);
+    handle_ = 0;
+  }
+}
+
+} /* namespace usb */
+} /* namespace libfreenect2 */
@@ -538,8 +538,9 @@ void VTRgbPacketProcessor::process(const RgbPacket &packet)
           frame->exposure = packet.exposure;
           frame->gain = packet.gain;
           frame->gamma = packet.gamma;
+          timer_.stamp(packet, frame);
 
-          if (!listener_->onNewFrame(Frame::Color, frame)) {
+          if (!deliverFrame(listener_, Frame::Color, frame)) {
               // The listener didn't take ownership of the frame, so we delete it
               delete frame;
           }
@@ -0,0 +1,113 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+
+
+/** @file worker_pool.cpp Threads shared by the packet processors of several devices. */
+
+#include <libfreenect2/worker_pool.h>
+
+namespace libfreenect2
+{
+
+WorkerPool::WorkerPool(size_t threads) :
+  shutdown_(false)
+{
+  if (threads == 0)
+    threads = defaultSize();
+
+  for (size_t i = 0; i < threads; i++)
+    threads_.push_back(new libfreenect2::thread(&WorkerPool::static_execute, this));
+}
+
+WorkerPool::~WorkerPool()
+{
+  {
+    libfreenect2::lock_guard l(mutex_);
+    shutdown_ = true;
+  }
+  condition_.notify_all();
+
+  for (size_t i = 0; i < threads_.size(); i++)
+  {
+    threads_[i]->join();
+    delete threads_[i];
+  }
+}
+
+void WorkerPool::post(Task *task)
+{
+  {
+    libfreenect2::lock_guard l(mutex_);
+    tasks_.push_back(task);
+  }
+  condition_.notify_one();
+}
+
+size_t WorkerPool::size() const
+{
+  return threads_.size();
+}
+
+size_t WorkerPool::defaultSize()
+{
+  const size_t pinned = getThreadPolicy(ThreadPolicy::Worker).cpus.size();
+  if (pinned > 0)
+    return pinned;
+
+  const size_t cpus = libfreenect2::thread::hardware_concurrency();
+  return cpus > 0 ? cpus : 2;
+}
+
+void WorkerPool::static_execute(void *data)
+{
+  static_cast<WorkerPool *>(data)->execute();
+}
+
+void WorkerPool::execute()
+{
+  this_thread::set_name("Worker");
+  this_thread::apply_policy(ThreadPolicy::Worker);
+  libfreenect2::unique_lock l(mutex_);
+
+  while (!shutdown_)
+  {
+    if (tasks_.empty())
+    {
+      WAIT_CONDITION(condition_, mutex_, l);
+      continue;
+    }
+
+    Task *task = tasks_.front();
+    tasks_.pop_front();
+
+    l.unlock();
+    task->run();
+    l.lock();
+  }
+}
+
+} /* namespace libfreenect2 */
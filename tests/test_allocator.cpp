@@ -0,0 +1,121 @@
+#include <catch2/catch_test_macros.hpp>
+#include <libfreenect2/allocator.h>
+#include <libfreenect2/threading.h>
+#include <vector>
+
+using namespace libfreenect2;
+
+TEST_CASE("PoolAllocator depth", "[allocator]") {
+    SECTION("Default pool is double buffered") {
+        PoolAllocator pool;
+        REQUIRE(pool.depth() == 2);
+    }
+
+    SECTION("Depth is clamped") {
+        PoolAllocator empty(size_t(0));
+        PoolAllocator huge(1000);
+        REQUIRE(empty.depth() == 1);
+        REQUIRE(huge.depth() == PoolAllocator::MaxDepth);
+    }
+
+    SECTION("All buffers can be held at once") {
+        PoolAllocator pool(4);
+        std::vector<Buffer *> held;
+        for (int i = 0; i < 4; i++)
+            held.push_back(pool.allocate(1024));
+
+        for (size_t i = 0; i < held.size(); i++) {
+            REQUIRE(held[i]->data != NULL);
+            REQUIRE(held[i]->capacity == 1024);
+            for (size_t j = i + 1; j < held.size(); j++)
+                REQUIRE(held[i] != held[j]);
+        }
+
+        PoolAllocatorStatistics stats = pool.getStatistics();
+        REQUIRE(stats.in_use == 4);
+        REQUIRE(stats.high_water_mark == 4);
+        REQUIRE(stats.waits == 0);
+
+        for (size_t i = 0; i < held.size(); i++)
+            pool.free(held[i]);
+        REQUIRE(pool.getStatistics().in_use == 0);
+    }
+}
+
+TEST_CASE("PoolAllocator reuses buffers", "[allocator]") {
+    PoolAllocator pool(2);
+    Buffer *a = pool.allocate(64);
+    a->length = 10;
+    pool.free(a);
+    Buffer *b = pool.allocate(64);
+    REQUIRE(b == a);
+    REQUIRE(b->length == 0);
+    pool.free(b);
+
+    PoolAllocatorStatistics stats = pool.getStatistics();
+    REQUIRE(stats.allocations == 2);
+    REQUIRE(stats.high_water_mark == 1);
+    REQUIRE(stats.failures == 0);
+}
+
+TEST_CASE("PoolAllocator blocks when exhausted", "[allocator]") {
+    PoolAllocator pool(1);
+    Buffer *a = pool.allocate(64);
+
+    thread releaser([&pool, a]() {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        pool.free(a);
+    });
+
+    Buffer *b = pool.allocate(64);
+    releaser.join();
+
+    REQUIRE(b == a);
+    PoolAllocatorStatistics stats = pool.getStatistics();
+    REQUIRE(stats.waits == 1);
+    REQUIRE(stats.wait_time_ns > 0);
+    REQUIRE(stats.max_wait_time_ns == stats.wait_time_ns);
+    pool.free(b);
+}
+
+TEST_CASE("PoolAllocator grows on reserve", "[allocator]") {
+    PoolAllocator pool(1);
+    Buffer *a = pool.allocate(64);
+
+    REQUIRE(pool.reserve(3));
+    REQUIRE(pool.depth() == 3);
+    Buffer *b = pool.allocate(64);
+    Buffer *c = pool.allocate(64);
+    REQUIRE(pool.getStatistics().waits == 0);
+
+    REQUIRE(pool.reserve(2));
+    REQUIRE(pool.depth() == 3);
+    REQUIRE_FALSE(pool.reserve(PoolAllocator::MaxDepth + 1));
+    REQUIRE(pool.depth() == PoolAllocator::MaxDepth);
+
+    pool.free(a);
+    pool.free(b);
+    pool.free(c);
+}
+
+TEST_CASE("PoolAllocator keeps retained buffers", "[allocator]") {
+    PoolAllocator pool(2);
+    Buffer *a = pool.allocate(16);
+    REQUIRE(pool.retain(a));
+
+    // The first free() leaves the buffer with the other owner.
+    pool.free(a);
+    REQUIRE(pool.getStatistics().in_use == 1);
+    Buffer *b = pool.allocate(16);
+    REQUIRE(b != a);
+
+    pool.free(a);
+    REQUIRE(pool.getStatistics().in_use == 1);
+    REQUIRE(pool.allocate(16) == a);
+
+    Buffer other;
+    REQUIRE_FALSE(pool.retain(&other));
+    pool.free(a);
+    pool.free(b);
+    REQUIRE_FALSE(pool.retain(a));
+}
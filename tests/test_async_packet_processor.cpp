@@ -0,0 +1,171 @@
+#include <catch2/catch_test_macros.hpp>
+#include <libfreenect2/async_packet_processor.h>
+#include <libfreenect2/depth_packet_processor.h>
+#include <libfreenect2/telemetry.h>
+#include <libfreenect2/threading.h>
+
+#include <cstring>
+#include <vector>
+
+using namespace libfreenect2;
+
+namespace
+{
+/** Records the sequence of each packet, blocking in process() until opened. */
+class BlockingProcessor: public PacketProcessor<DepthPacket>
+{
+public:
+    BlockingProcessor(): open(false), entered(0) {}
+
+    virtual void process(const DepthPacket &packet)
+    {
+        entered++;
+        while (!open)
+            this_thread::sleep_for(chrono::milliseconds(1));
+        sequences.push_back(packet.sequence);
+    }
+
+    atomic<bool> open;
+    atomic<int> entered;
+    std::vector<uint32_t> sequences; ///< Read after AsyncPacketProcessor::waitForIdle().
+};
+
+/** Processor that failed to initialize. */
+class BrokenProcessor: public PacketProcessor<DepthPacket>
+{
+public:
+    BrokenProcessor(): calls(0) {}
+    virtual bool good() { return false; }
+    virtual void process(const DepthPacket &) { calls++; }
+    atomic<int> calls;
+};
+
+DepthPacket packet(uint32_t sequence)
+{
+    DepthPacket p;
+    std::memset(&p, 0, sizeof(p));
+    p.sequence = sequence;
+    p.arrival_time = packetArrivalTime();
+    return p;
+}
+
+void waitForEntered(BlockingProcessor &inner, int count)
+{
+    const chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(5);
+    while (inner.entered < count && chrono::steady_clock::now() < deadline)
+        this_thread::sleep_for(chrono::milliseconds(1));
+    REQUIRE(inner.entered == count);
+}
+}
+
+TEST_CASE("Async processor queues packets in order and counts drops", "[async]") {
+    BlockingProcessor inner;
+    AsyncPacketProcessor<DepthPacket> async(&inner, ThreadPolicy::DepthProcessor, 3);
+
+    // The first packet is taken by the worker and blocks it.
+    REQUIRE(async.ready());
+    async.process(packet(0));
+    waitForEntered(inner, 1);
+
+    for (uint32_t sequence = 1; sequence <= 3; sequence++)
+    {
+        REQUIRE(async.ready());
+        async.process(packet(sequence));
+    }
+
+    AsyncPacketProcessorStatistics stats = async.getStatistics();
+    REQUIRE(stats.queue_depth == 3);
+    REQUIRE(stats.occupancy == 3);
+    REQUIRE(stats.high_water_mark == 3);
+    REQUIRE(stats.dropped == 0);
+
+    // A full queue refuses packets, whether or not the caller checks ready().
+    REQUIRE(!async.ready());
+    async.process(packet(4));
+
+    stats = async.getStatistics();
+    REQUIRE(stats.queued == 4);
+    REQUIRE(stats.dropped == 2);
+
+    inner.open = true;
+    async.waitForIdle();
+
+    std::vector<uint32_t> expected;
+    for (uint32_t sequence = 0; sequence <= 3; sequence++)
+        expected.push_back(sequence);
+    REQUIRE(inner.sequences == expected);
+
+    stats = async.getStatistics();
+    REQUIRE(stats.processed == 4);
+    REQUIRE(stats.occupancy == 0);
+    REQUIRE(stats.high_water_mark == 3);
+}
+
+TEST_CASE("Async processor skips stale packets for the newest one", "[async]") {
+    BlockingProcessor inner;
+    Telemetry telemetry;
+    AsyncPacketProcessor<DepthPacket> async(&inner, ThreadPolicy::DepthProcessor, 3);
+    async.setMaxPacketAge(10000000ull); // 10 ms
+    async.setTelemetry(&telemetry, Telemetry::Depth);
+
+    async.process(packet(0));
+    waitForEntered(inner, 1);
+
+    // Two packets that arrived long ago wait behind the blocked worker, then a fresh one.
+    const uint64_t old = packetArrivalTime() - 1000000000ull;
+    for (uint32_t sequence = 1; sequence <= 2; sequence++)
+    {
+        DepthPacket p = packet(sequence);
+        p.arrival_time = old;
+        async.process(p);
+    }
+    async.process(packet(3));
+
+    inner.open = true;
+    async.waitForIdle();
+
+    std::vector<uint32_t> expected;
+    expected.push_back(0);
+    expected.push_back(3);
+    REQUIRE(inner.sequences == expected);
+
+    const AsyncPacketProcessorStatistics stats = async.getStatistics();
+    REQUIRE(stats.skipped == 2);
+    REQUIRE(stats.processed == 2);
+    REQUIRE(stats.dropped == 0);
+    REQUIRE(telemetry.get(Telemetry::Depth, Telemetry::DroppedStale) == 2);
+}
+
+TEST_CASE("Async processor keeps every packet without a maximum age", "[async]") {
+    BlockingProcessor inner;
+    AsyncPacketProcessor<DepthPacket> async(&inner, ThreadPolicy::DepthProcessor, 3);
+
+    async.process(packet(0));
+    waitForEntered(inner, 1);
+    DepthPacket p = packet(1);
+    p.arrival_time = packetArrivalTime() - 1000000000ull;
+    async.process(p);
+    async.process(packet(2));
+
+    inner.open = true;
+    async.waitForIdle();
+    REQUIRE(inner.sequences.size() == 3);
+    REQUIRE(async.getStatistics().skipped == 0);
+}
+
+TEST_CASE("Async processor does not count packets a broken processor skipped", "[async]") {
+    BrokenProcessor inner;
+    Telemetry telemetry;
+    AsyncPacketProcessor<DepthPacket> async(&inner, ThreadPolicy::DepthProcessor, 3);
+    async.setTelemetry(&telemetry, Telemetry::Depth);
+
+    for (uint32_t sequence = 0; sequence < 3; sequence++)
+        async.process(packet(sequence));
+    async.waitForIdle();
+
+    REQUIRE(inner.calls == 0);
+    REQUIRE(async.getStatistics().queued == 3);
+    REQUIRE(async.getStatistics().processed == 0);
+    REQUIRE(telemetry.get(Telemetry::Depth, Telemetry::FramesProcessed) == 0);
+    REQUIRE(telemetry.getCount(Telemetry::Depth, Telemetry::ProcessLatency) == 0);
+}
@@ -0,0 +1,309 @@
+#include <catch2/catch_test_macros.hpp>
+#include <libfreenect2/depth_packet_stream_parser.h>
+#include <libfreenect2/stream_generator.h>
+
+#include <cstring>
+#include <vector>
+
+using namespace libfreenect2;
+
+namespace
+{
+/** Keeps a copy of every packet it receives. */
+class CapturingProcessor: public PacketProcessor<DepthPacket>
+{
+public:
+  std::vector<std::vector<unsigned char> > frames;
+  std::vector<uint32_t> sequences;
+  std::vector<uint32_t> missing;
+  std::vector<uint32_t> timestamps;
+
+  virtual void process(const DepthPacket &packet)
+  {
+    frames.push_back(std::vector<unsigned char>(packet.buffer, packet.buffer + packet.buffer_length));
+    sequences.push_back(packet.sequence);
+    timestamps.push_back(packet.timestamp);
+    missing.push_back(packet.missing);
+    DepthPacket p = packet;
+    releaseBuffer(p);
+  }
+};
+
+/** A CapturingProcessor that can be made to refuse packets. */
+class BusyProcessor: public CapturingProcessor
+{
+public:
+  bool busy;
+
+  BusyProcessor(): busy(false) {}
+
+  virtual bool ready() { return !busy; }
+};
+
+/** Passes depth frames of a StreamGenerator on, optionally leaving out one sub-image. */
+class SubImageDropper: public DataCallback
+{
+public:
+    SubImageDropper(StreamGenerator &generator): generator_(generator), next_(0), sub_(0), lost_(0) {}
+
+    /** Feed one frame to @p next, leaving out the sub-image @p lost (or none if >= 10). */
+    void feedFrame(DataCallback &next, unsigned lost = 10)
+    {
+        next_ = &next;
+        sub_ = 0;
+        lost_ = lost;
+        generator_.feedDepthFrame(*this);
+        generator_.advanceTimestamp();
+    }
+
+    virtual void onDataReceived(unsigned char *buffer, size_t n)
+    {
+        const bool drop = sub_ == lost_;
+        // The generator ends each sub-image with an empty packet.
+        if (n == 0)
+            sub_++;
+        if (!drop)
+            next_->onDataReceived(buffer, n);
+    }
+private:
+    StreamGenerator &generator_;
+    DataCallback *next_;
+    unsigned sub_;
+    unsigned lost_;
+};
+
+/** Passes depth frames of a StreamGenerator on with one sub-image delivered after the next one. */
+class SubImageSwapper: public DataCallback
+{
+public:
+    SubImageSwapper(StreamGenerator &generator): generator_(generator), next_(0), sub_(0), first_(0) {}
+
+    /** Feed one frame to @p next, sending the sub-image @p first after the sub-image first + 1. */
+    void feedFrame(DataCallback &next, unsigned first)
+    {
+        next_ = &next;
+        sub_ = 0;
+        first_ = first;
+        generator_.feedDepthFrame(*this);
+        generator_.advanceTimestamp();
+    }
+
+    virtual void onDataReceived(unsigned char *buffer, size_t n)
+    {
+        if (sub_ == first_)
+            held_.push_back(std::vector<unsigned char>(buffer, buffer + n));
+        else
+            next_->onDataReceived(buffer, n);
+
+        if (n == 0 && sub_++ == first_ + 1)
+        {
+            for (size_t i = 0; i < held_.size(); i++)
+                next_->onDataReceived(held_[i].empty() ? buffer : &held_[i][0], held_[i].size());
+            held_.clear();
+        }
+    }
+private:
+    StreamGenerator &generator_;
+    DataCallback *next_;
+    unsigned sub_;
+    unsigned first_;
+    std::vector<std::vector<unsigned char> > held_;
+};
+
+/** Lays packets out in iso transfer slots and passes them on in batches of PacketsPerTransfer. */
+class IsoTransferBatcher: public DataCallback
+{
+public:
+  static const size_t PacketsPerTransfer = 16;
+
+  virtual void onDataReceived(unsigned char *buffer, size_t n)
+  {
+    payloads.push_back(std::vector<unsigned char>(buffer, buffer + n));
+  }
+
+  void flush(DataCallback &parser)
+  {
+    const size_t slot_size = StreamGeneratorConfig().iso_packet_size;
+    std::vector<unsigned char> transfer(PacketsPerTransfer * slot_size);
+    for (size_t first = 0; first < payloads.size(); first += PacketsPerTransfer)
+    {
+      std::vector<IsoPacket> packets;
+      for (size_t i = first; i < payloads.size() && i < first + PacketsPerTransfer; i++)
+      {
+        unsigned char *slot = &transfer[(i - first) * slot_size];
+        std::memcpy(slot, &payloads[i][0], payloads[i].size());
+        const IsoPacket packet = { slot, payloads[i].size() };
+        packets.push_back(packet);
+      }
+      parser.onIsoPacketsReceived(&packets[0], packets.size());
+    }
+    payloads.clear();
+  }
+
+  std::vector<std::vector<unsigned char> > payloads;
+};
+}
+
+TEST_CASE("Depth stream parser modes", "[parser]") {
+    for (int zero_copy = 0; zero_copy < 2; zero_copy++) {
+        CapturingProcessor processor;
+        DepthPacketStreamParser parser;
+        parser.setZeroCopy(zero_copy != 0);
+        parser.setPacketProcessor(&processor);
+        StreamGenerator generator;
+        SubImageDropper stream(generator);
+        const std::vector<unsigned char> &frame = generator.depthSource();
+
+        SubImageSwapper swapped(generator);
+
+        stream.feedFrame(parser);
+        stream.feedFrame(parser, 3);
+        stream.feedFrame(parser);
+        swapped.feedFrame(parser, 3);
+        stream.feedFrame(parser);
+
+        // The copy mode passes a packet on when the next sequence starts.
+        const size_t complete = zero_copy ? 4 : 3;
+        REQUIRE(processor.frames.size() == complete);
+        REQUIRE(processor.sequences[0] == 1);
+        REQUIRE(processor.sequences[1] == 3);
+        REQUIRE(processor.sequences[2] == 4);
+        for (size_t i = 0; i < complete; i++) {
+            REQUIRE(std::memcmp(&processor.frames[i][0], &frame[0], frame.size()) == 0);
+            // Each packet carries its own timestamp, one frame apart at 30 Hz.
+            REQUIRE(processor.timestamps[i] == 1000 + 267 * (processor.sequences[i] - 1));
+        }
+
+        // Only these are copied: the sub-image following the lost one, the first one
+        // of the next packet (its slot still held the incomplete packet), and the
+        // swapped pair with the sub-image after it.
+        if (zero_copy)
+            REQUIRE(parser.misalignedCopies() == 5);
+    }
+}
+
+TEST_CASE("Depth stream parser handles batched iso transfers", "[parser]") {
+    for (int zero_copy = 0; zero_copy < 2; zero_copy++) {
+        CapturingProcessor processor;
+        DepthPacketStreamParser parser;
+        parser.setZeroCopy(zero_copy != 0);
+        parser.setPacketProcessor(&processor);
+        StreamGenerator generator;
+        SubImageDropper stream(generator);
+        const std::vector<unsigned char> &frame = generator.depthSource();
+        IsoTransferBatcher batcher;
+
+        // Transfers end in the middle of sub-images.
+        stream.feedFrame(batcher);
+        stream.feedFrame(batcher, 3);
+        stream.feedFrame(batcher);
+        stream.feedFrame(batcher);
+        batcher.flush(parser);
+
+        const size_t complete = zero_copy ? 3 : 2;
+        REQUIRE(processor.frames.size() == complete);
+        REQUIRE(processor.sequences[1] == 3);
+        for (size_t i = 0; i < complete; i++)
+            REQUIRE(std::memcmp(&processor.frames[i][0], &frame[0], frame.size()) == 0);
+    }
+}
+
+TEST_CASE("Depth stream parser salvages incomplete packets", "[parser]") {
+    for (int zero_copy = 0; zero_copy < 2; zero_copy++) {
+        CapturingProcessor processor;
+        DepthPacketStreamParser parser;
+        parser.setZeroCopy(zero_copy != 0);
+        parser.setSalvage(1);
+        parser.setPacketProcessor(&processor);
+        StreamGenerator generator;
+        SubImageDropper stream(generator);
+        const std::vector<unsigned char> &frame = generator.depthSource();
+
+        stream.feedFrame(parser);
+        stream.feedFrame(parser, 3);
+        stream.feedFrame(parser, 5);
+        stream.feedFrame(parser);
+        stream.feedFrame(parser);
+
+        const size_t complete = zero_copy ? 5 : 4;
+        REQUIRE(processor.frames.size() == complete);
+        REQUIRE(parser.salvagedPackets() == 2);
+        REQUIRE(processor.missing[0] == 0);
+        REQUIRE(processor.missing[1] == (1u << 3));
+        REQUIRE(processor.missing[2] == (1u << 5));
+        REQUIRE(processor.missing[3] == 0);
+        for (size_t i = 0; i < complete; i++) {
+            REQUIRE(std::memcmp(&processor.frames[i][0], &frame[0], frame.size()) == 0);
+            REQUIRE(processor.timestamps[i] == 1000 + 267 * (processor.sequences[i] - 1));
+        }
+    }
+}
+
+TEST_CASE("Depth stream parser does not salvage for a busy processor", "[parser]") {
+    for (int zero_copy = 0; zero_copy < 2; zero_copy++) {
+        BusyProcessor processor;
+        Telemetry telemetry;
+        DepthPacketStreamParser parser;
+        parser.setZeroCopy(zero_copy != 0);
+        parser.setSalvage(1);
+        parser.setTelemetry(&telemetry);
+        parser.setPacketProcessor(&processor);
+        StreamGenerator generator;
+        SubImageDropper stream(generator);
+        const std::vector<unsigned char> &frame = generator.depthSource();
+
+        stream.feedFrame(parser);
+        stream.feedFrame(parser, 3);
+        // The incomplete packet is completed when the next one starts, while the processor is busy.
+        processor.busy = true;
+        stream.feedFrame(parser);
+        processor.busy = false;
+        stream.feedFrame(parser);
+        stream.feedFrame(parser);
+
+        REQUIRE(parser.salvagedPackets() == 0);
+        REQUIRE(telemetry.get(Telemetry::Depth, Telemetry::FramesSalvaged) == 0);
+        REQUIRE(telemetry.get(Telemetry::Depth, Telemetry::DroppedIncomplete) == 0);
+        // The zero-copy mode also skips the third packet, which completes while busy.
+        REQUIRE(telemetry.get(Telemetry::Depth, Telemetry::DroppedBusy) == (zero_copy ? 2u : 1u));
+        for (size_t i = 0; i < processor.frames.size(); i++) {
+            REQUIRE(processor.missing[i] == 0);
+            REQUIRE(std::memcmp(&processor.frames[i][0], &frame[0], frame.size()) == 0);
+        }
+    }
+}
+
+TEST_CASE("Depth salvage filter invalidates moved pixels", "[parser]") {
+    DepthSalvageFilter filter;
+    Frame ir(4, 1, 4), depth(4, 1, 4);
+    depth.format = Frame::Float;
+    float *d = reinterpret_cast<float *>(depth.data);
+
+    DepthPacket packet;
+    packet.missing = 0;
+    packet.salvage = 1;
+    d[0] = 1000; d[1] = 1000; d[2] = 0; d[3] = 2000;
+    filter.apply(packet, &ir, &depth);
+    REQUIRE(depth.status == 0);
+
+    packet.missing = 1u << 4;
+    d[0] = 1010; d[1] = 1500; d[2] = 1000; d[3] = 2000;
+    filter.apply(packet, &ir, &depth);
+    REQUIRE(depth.status == Frame::Degraded);
+    REQUIRE(ir.status == Frame::Degraded);
+    REQUIRE(d[0] == 1010);
+    REQUIRE(d[1] == 0);
+    REQUIRE(d[2] == 0);
+    REQUIRE(d[3] == 2000);
+
+    // Without salvaging no reference is kept, so nothing of a degraded frame can be trusted.
+    DepthSalvageFilter unused;
+    packet.missing = 0;
+    packet.salvage = 0;
+    d[0] = 1000; d[1] = 1000; d[2] = 1000; d[3] = 1000;
+    unused.apply(packet, &ir, &depth);
+    packet.missing = 1u << 4;
+    unused.apply(packet, &ir, &depth);
+    REQUIRE(d[0] == 0);
+    REQUIRE(d[3] == 0);
+}
@@ -0,0 +1,147 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <libfreenect2/frame_timing.h>
+#include <libfreenect2/frame_listener_impl.h>
+#include <libfreenect2/rgb_packet_processor.h>
+#include <libfreenect2/rgb_packet_stream_parser.h>
+#include <libfreenect2/stream_generator.h>
+
+#include <cstdlib>
+
+using namespace libfreenect2;
+
+namespace
+{
+class TimingListener: public FrameListener
+{
+public:
+    TimingListener(): frames(0), timing() {}
+
+    virtual bool onNewFrame(Frame::Type, Frame *frame)
+    {
+        frames++;
+        timing = frame->timing;
+        return false;
+    }
+
+    int frames;
+    FrameTiming timing;
+};
+
+// Stands in for AsyncPacketProcessor, which releases the buffers after processing.
+class ReleasingRgbProcessor: public DumpRgbPacketProcessor
+{
+public:
+    virtual void process(const RgbPacket &packet)
+    {
+        DumpRgbPacketProcessor::process(packet);
+        RgbPacket p = packet;
+        releaseBuffer(p);
+    }
+};
+}
+
+TEST_CASE("Device clock mapping follows drift and wraparound", "[timing]") {
+    DeviceClock clock;
+    REQUIRE(clock.toHost(0) == 0);
+
+    // 30 Hz frames, 266 ticks of 125 us apart, host clock 100 ppm faster, up to 2 ms jitter.
+    const double ns_per_tick = 125000.0 * 1.0001;
+    const uint64_t host_origin = 5000000000ull;
+    uint32_t timestamp = 0xffffffffu - 266 * 200;
+    std::srand(1);
+    for (int i = 0; i < 400; ++i, timestamp += 266)
+    {
+        const double host = host_origin + i * 266 * ns_per_tick + std::rand() % 2000000;
+        clock.update(timestamp, (uint64_t)host);
+    }
+
+    REQUIRE_THAT(clock.nsPerTick(), Catch::Matchers::WithinRel(ns_per_tick, 1e-4));
+    const double expected = host_origin + 400 * 266 * ns_per_tick + 1000000;
+    REQUIRE_THAT((double)clock.toHost(timestamp), Catch::Matchers::WithinAbs(expected, 500000));
+
+    // A device reset restarts the estimate.
+    for (int i = 0; i < 2; ++i)
+        clock.update(i * 266, host_origin + 1000000000000ull);
+    REQUIRE(clock.toHost(266) == 0);
+}
+
+TEST_CASE("Frames carry host timestamps in pipeline order", "[timing]") {
+    TimingListener listener;
+    ReleasingRgbProcessor processor;
+    processor.setFrameListener(&listener);
+    RgbPacketStreamParser parser;
+    parser.setPacketProcessor(&processor);
+
+    StreamGenerator generator;
+    generator.run(&parser, 0, 20);
+
+    REQUIRE(listener.frames == 20);
+    const FrameTiming &t = listener.timing;
+    REQUIRE(t.usb_first > 0);
+    REQUIRE(t.usb_first <= t.usb_last);
+    REQUIRE(t.usb_last <= t.process_start);
+    REQUIRE(t.process_start <= t.process_end);
+    REQUIRE(t.process_end <= t.delivered);
+    REQUIRE(t.device_time > 0);
+}
+
+TEST_CASE("Multi-device listener aligns device clocks and matches frames", "[timing]") {
+    // Device 1 starts 10 ms after device 0 with an unrelated timestamp origin, and its clock runs 200 ppm fast.
+    SyncMultiDeviceListener sync(2, Frame::Depth, 5.0);
+    const uint64_t host_origin = 5000000000ull;
+    const uint64_t start[2] = {host_origin, host_origin + 10000000};
+    const uint32_t origin[2] = {1000, 0xfffff000u};
+    const double ns_per_tick[2] = {125000.0, 125000.0 / 1.0002};
+
+    FrameSet set;
+    int sets = 0;
+    for (int i = 0; i < 60; ++i)
+    {
+        for (size_t d = 0; d < 2; ++d)
+        {
+            Frame *frame = new Frame(1, 1, 4);
+            frame->timestamp = origin[d] + 266 * i;
+            frame->timing.usb_last = start[d] + (uint64_t)(266 * i * ns_per_tick[d]) + 3000000;
+            REQUIRE(sync.getListener(d)->onNewFrame(Frame::Depth, frame));
+        }
+        if (sync.waitForNewFrameSet(set, 0))
+        {
+            sets++;
+            REQUIRE(set.frames.size() == 2);
+            REQUIRE(set.frames[0].count(Frame::Depth) == 1);
+            REQUIRE(set.frames[1].count(Frame::Depth) == 1);
+            sync.release(set);
+        }
+    }
+    // Device 1 captures 10 ms after device 0, never within 5 ms.
+    REQUIRE(sets == 0);
+    REQUIRE(sync.getDroppedFrames() > 0);
+
+    const DeviceClockEstimate clock = sync.getClock(1);
+    REQUIRE(clock.valid);
+    REQUIRE_THAT(clock.drift_ppm, Catch::Matchers::WithinAbs(200.0, 1.0));
+    REQUIRE(sync.getClock(2).valid == false);
+
+    // With a tolerance of half a frame every frame pairs once the clocks are estimated.
+    SyncMultiDeviceListener loose(2, Frame::Depth);
+    for (int i = 0; i < 60; ++i)
+    {
+        for (size_t d = 0; d < 2; ++d)
+        {
+            Frame *frame = new Frame(1, 1, 4);
+            frame->timestamp = origin[d] + 266 * i;
+            frame->timing.usb_last = start[d] + (uint64_t)(266 * i * ns_per_tick[d]) + 3000000;
+            loose.getListener(d)->onNewFrame(Frame::Depth, frame);
+        }
+        if (loose.waitForNewFrameSet(set, 0))
+        {
+            sets++;
+            const uint64_t t0 = set.frames[0][Frame::Depth]->timing.usb_last;
+            const uint64_t t1 = set.frames[1][Frame::Depth]->timing.usb_last;
+            REQUIRE((t0 > t1 ? t0 - t1 : t1 - t0) <= 16600000);
+            loose.release(set);
+        }
+    }
+    REQUIRE(sets >= 50);
+}
@@ -0,0 +1,125 @@
+#include <catch2/catch_test_macros.hpp>
+#include <libfreenect2/logging.h>
+#include <libfreenect2/threading.h>
+
+#include <string>
+#include <vector>
+
+using namespace libfreenect2;
+
+namespace
+{
+class CapturingLogger: public Logger
+{
+public:
+    CapturingLogger(Level level, std::vector<std::string> *messages): messages_(messages) { level_ = level; }
+
+    virtual void log(Level, const std::string &message)
+    {
+        messages_->push_back(message);
+    }
+private:
+    std::vector<std::string> *messages_;
+};
+
+struct Formatted
+{
+    int *count;
+};
+
+std::ostream &operator<<(std::ostream &stream, const Formatted &f)
+{
+    // Like the standard inserters, only format into a good stream.
+    std::ostream::sentry sentry(stream);
+    if (sentry)
+        (*f.count)++;
+    return stream << "formatted";
+}
+
+void logRepeatedly(Logger *logger)
+{
+    for (int i = 0; i < 100; ++i)
+        logger->log(Logger::Info, "repeated");
+    logger->log(Logger::Info, "done");
+}
+}
+
+TEST_CASE("Disabled log levels skip formatting", "[logging]") {
+    std::vector<std::string> messages;
+    setGlobalLogger(new CapturingLogger(Logger::Info, &messages));
+
+    int count = 0;
+    Formatted f = { &count };
+    LOG_DEBUG << f;
+    REQUIRE(count == 0);
+    LOG_INFO << f;
+    REQUIRE(count == 1);
+    REQUIRE(messages.size() == 1);
+    REQUIRE(messages[0].find("formatted") != std::string::npos);
+
+    setGlobalLogger(createConsoleLogger(Logger::getDefaultLevel()));
+}
+
+TEST_CASE("Async logger passes messages on and suppresses repeats", "[logging]") {
+    std::vector<std::string> messages;
+    Logger *logger = createAsyncLogger(new CapturingLogger(Logger::Info, &messages));
+    REQUIRE(logger->level() == Logger::Info);
+
+    thread a(&logRepeatedly, logger);
+    thread b(&logRepeatedly, logger);
+    a.join();
+    b.join();
+    logger->log(Logger::Debug, "filtered");
+    delete logger;
+
+    size_t repeated = 0, notes = 0, done = 0;
+    for (size_t i = 0; i < messages.size(); ++i)
+    {
+        if (messages[i] == "repeated")
+            repeated++;
+        else if (messages[i] == "last message repeated 99 times")
+            notes++;
+        else if (messages[i] == "done")
+            done++;
+    }
+    REQUIRE(repeated == 2);
+    REQUIRE(notes == 2);
+    REQUIRE(done == 2);
+    REQUIRE(messages.size() == 6);
+}
+
+TEST_CASE("Async logger reports pending repeats when stopped", "[logging]") {
+    std::vector<std::string> messages;
+    Logger *logger = createAsyncLogger(new CapturingLogger(Logger::Info, &messages));
+
+    for (int i = 0; i < 3; ++i)
+        logger->log(Logger::Info, "repeated");
+    delete logger;
+
+    REQUIRE(messages.size() == 2);
+    REQUIRE(messages[0] == "repeated");
+    REQUIRE(messages[1] == "last message repeated 2 times");
+}
+
+TEST_CASE("Log messages formatted inside another message are kept apart", "[logging]") {
+    std::vector<std::string> messages;
+    setGlobalLogger(new CapturingLogger(Logger::Info, &messages));
+
+    struct Inner
+    {
+        static int value()
+        {
+            LOG_INFO << "inner";
+            return 1;
+        }
+    };
+    LOG_INFO << "outer " << Inner::value();
+    LOG_INFO << "next";
+
+    REQUIRE(messages.size() == 3);
+    REQUIRE(messages[0].find("inner") != std::string::npos);
+    REQUIRE(messages[1].find("outer 1") != std::string::npos);
+    REQUIRE(messages[2].find("outer") == std::string::npos);
+
+    setGlobalLogger(createConsoleLogger(Logger::getDefaultLevel()));
+}
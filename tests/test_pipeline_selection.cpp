@@ -0,0 +1,60 @@
+#include <catch2/catch_test_macros.hpp>
+#include <libfreenect2/pipeline_selection.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+using namespace libfreenect2;
+
+namespace
+{
+int created = 0;
+
+PacketPipeline *createCpuOnly(std::string name)
+{
+    created++;
+    return name == "cpu" ? new CpuPacketPipeline() : 0;
+}
+}
+
+TEST_CASE("Pipeline selector times depth processing", "[pipeline]") {
+    std::vector<std::string> names;
+    names.push_back("cpu");
+    names.push_back("missing");
+    const std::vector<PipelineTiming> timings = PipelineSelector(createCpuOnly, "", 20).measure(names);
+
+    REQUIRE(timings.size() == 2);
+    REQUIRE(timings[0].name == "cpu");
+    REQUIRE(timings[0].frames >= 3);
+    REQUIRE(timings[0].median_ms > 0);
+    REQUIRE(timings[1].frames == 0);
+}
+
+TEST_CASE("Pipeline selector caches the choice per host", "[pipeline]") {
+    char dir[] = "/tmp/freenect2_pipeline_XXXXXX";
+    REQUIRE(mkdtemp(dir) != 0);
+
+    created = 0;
+    PipelineSelector selector(createCpuOnly, dir, 20);
+    REQUIRE(selector.select() == "cpu");
+    REQUIRE(created > 0);
+    REQUIRE(std::ifstream(selector.cachePath().c_str()).good());
+
+    // A second process reads the choice instead of measuring.
+    created = 0;
+    REQUIRE(PipelineSelector(createCpuOnly, dir, 20).select() == "cpu");
+    REQUIRE(created == 0);
+
+    // A choice made with other pipelines compiled in is measured again.
+    {
+        std::ofstream out(selector.cachePath().c_str(), std::ios::trunc);
+        out << "0.0 metal\nmetal\n";
+    }
+    REQUIRE(PipelineSelector(createCpuOnly, dir, 20).select() == "cpu");
+    REQUIRE(created > 0);
+
+    std::remove(selector.cachePath().c_str());
+    rmdir(dir);
+}
@@ -0,0 +1,130 @@
+#include <catch2/catch_test_macros.hpp>
+#include <libfreenect2/rgb_packet_stream_parser.h>
+
+#include <cstring>
+#include <deque>
+#include <vector>
+
+using namespace libfreenect2;
+
+namespace
+{
+/** Keeps a copy of every JPEG it receives. */
+class CapturingProcessor: public PacketProcessor<RgbPacket>
+{
+public:
+  std::vector<std::vector<unsigned char> > jpegs;
+
+  virtual void process(const RgbPacket &packet)
+  {
+    jpegs.push_back(std::vector<unsigned char>(packet.jpeg_buffer, packet.jpeg_buffer + packet.jpeg_buffer_length));
+    RgbPacket p = packet;
+    releaseBuffer(p);
+  }
+};
+
+/** Serializes a color frame the way the device sends it. */
+std::vector<unsigned char> makeFrame(uint32_t sequence, const std::vector<unsigned char> &jpeg)
+{
+  const size_t pad = (4 - jpeg.size() % 4) % 4;
+  const size_t filler = 64;
+  std::vector<unsigned char> frame(sizeof(RawRgbPacket) + jpeg.size() + pad + filler + sizeof(RgbPacketFooter));
+
+  RawRgbPacket header = {sequence, 0x42424242};
+  std::memcpy(&frame[0], &header, sizeof(header));
+  std::memcpy(&frame[sizeof(header)], &jpeg[0], jpeg.size());
+  std::memset(&frame[sizeof(header) + jpeg.size()], 0xa5, pad);
+  std::memset(&frame[sizeof(header) + jpeg.size() + pad], 'Z', filler);
+
+  RgbPacketFooter footer;
+  std::memset(&footer, 0, sizeof(footer));
+  footer.magic_header = 0x39393939;
+  footer.magic_footer = 0x42424242;
+  footer.sequence = sequence;
+  footer.filler_length = filler;
+  footer.packet_size = frame.size();
+  std::memcpy(&frame[frame.size() - sizeof(footer)], &footer, sizeof(footer));
+  return frame;
+}
+
+/**
+ * Bulk transfer queue: transfers complete in order, each ends at a frame
+ * boundary or after transfer_size bytes, and is resubmitted with the memory
+ * the parser asks for.
+ */
+class SimulatedBulkPool
+{
+public:
+  SimulatedBulkPool(DataCallback &callback, size_t num_transfers, size_t transfer_size):
+    callback_(callback), transfer_size_(transfer_size), own_(num_transfers * transfer_size)
+  {
+    for (size_t i = 0; i < num_transfers; i++)
+      queue_.push_back(&own_[i * transfer_size]);
+  }
+
+  void receive(const std::vector<unsigned char> &frame)
+  {
+    for (size_t offset = 0; offset < frame.size(); offset += transfer_size_)
+    {
+      size_t length = frame.size() - offset;
+      if (length > transfer_size_)
+        length = transfer_size_;
+
+      unsigned char *buffer = queue_.front();
+      queue_.pop_front();
+      std::memcpy(buffer, &frame[offset], length);
+      callback_.onDataReceived(buffer, length);
+
+      unsigned char *next = callback_.getTransferBuffer(transfer_size_, queue_.size() * transfer_size_);
+      queue_.push_back(next ? next : own_buffer(buffer));
+    }
+  }
+
+private:
+  unsigned char *own_buffer(unsigned char *buffer)
+  {
+    // Give the transfer a slice of pool memory that is not queued.
+    for (size_t i = 0; i < own_.size(); i += transfer_size_)
+    {
+      bool queued = false;
+      for (size_t j = 0; j < queue_.size(); j++)
+        queued = queued || queue_[j] == &own_[i];
+      if (!queued)
+        return &own_[i];
+    }
+    return buffer;
+  }
+
+  DataCallback &callback_;
+  size_t transfer_size_;
+  std::vector<unsigned char> own_;
+  std::deque<unsigned char *> queue_;
+};
+}
+
+TEST_CASE("RGB stream parser zero-copy reassembly", "[parser]") {
+    CapturingProcessor processor;
+    RgbPacketStreamParser parser;
+    parser.setZeroCopy(true);
+    parser.setPacketProcessor(&processor);
+    SimulatedBulkPool pool(parser, 8, 0x4000);
+
+    std::vector<std::vector<unsigned char> > jpegs;
+    for (uint32_t seq = 0; seq < 12; seq++)
+    {
+        std::vector<unsigned char> jpeg(300000 + seq * 7777);
+        for (size_t i = 0; i < jpeg.size(); i++)
+            jpeg[i] = static_cast<unsigned char>(i * 13 + seq);
+        jpeg[jpeg.size() - 2] = 0xff;
+        jpeg[jpeg.size() - 1] = 0xd9;
+        jpegs.push_back(jpeg);
+        pool.receive(makeFrame(seq, jpeg));
+    }
+
+    REQUIRE(processor.jpegs.size() == jpegs.size());
+    for (size_t i = 0; i < jpegs.size(); i++)
+        REQUIRE(processor.jpegs[i] == jpegs[i]);
+
+    // Only the transfers queued across a frame boundary are copied.
+    REQUIRE(parser.inPlaceBytes() > parser.copiedBytes());
+}
@@ -0,0 +1,308 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <libfreenect2/libfreenect2.hpp>
+#include <libfreenect2/packet_pipeline.h>
+#include <libfreenect2/protocol/calibration_cache.h>
+#include <libfreenect2/threading.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <unistd.h>
+
+using namespace libfreenect2;
+
+namespace
+{
+class CountingListener: public FrameListener
+{
+public:
+    CountingListener(): color(0), depth(0) {}
+
+    virtual bool onNewFrame(Frame::Type type, Frame *)
+    {
+        if (type == Frame::Color)
+            color++;
+        else if (type == Frame::Depth)
+            depth++;
+        return false;
+    }
+
+    atomic<int> color, depth;
+};
+}
+
+TEST_CASE("Simulated device opens, streams and stops", "[simulator]") {
+    setenv("LIBFREENECT2_SIMULATE", "1", 1);
+    Freenect2 freenect2;
+    REQUIRE(freenect2.enumerateDevices() >= 1);
+
+    Freenect2Device *device = freenect2.openDevice("SIMULATED000", new DumpPacketPipeline());
+    unsetenv("LIBFREENECT2_SIMULATE");
+    REQUIRE(device != 0);
+
+    CountingListener listener;
+    device->setColorFrameListener(&listener);
+    device->setIrAndDepthFrameListener(&listener);
+    REQUIRE(device->start());
+
+    REQUIRE(device->getSerialNumber() == "SIMULATED000");
+    REQUIRE(device->getFirmwareVersion() == "2.3.3913.0");
+    REQUIRE_THAT(device->getIrCameraParams().fx, Catch::Matchers::WithinRel(365.456f, 1e-6f));
+    REQUIRE_THAT(device->getColorCameraParams().cx, Catch::Matchers::WithinRel(959.5f, 1e-6f));
+
+    // 30 Hz, allow a slow host.
+    const chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(5);
+    while ((listener.color < 3 || listener.depth < 3) && chrono::steady_clock::now() < deadline)
+        this_thread::sleep_for(chrono::milliseconds(10));
+    REQUIRE(listener.color >= 3);
+    REQUIRE(listener.depth >= 3);
+
+    // Cancellation completes without waiting for a timeout.
+    const chrono::steady_clock::time_point stop_start = chrono::steady_clock::now();
+    REQUIRE(device->stop());
+    REQUIRE(chrono::steady_clock::now() - stop_start < chrono::milliseconds(500));
+
+    const int color = listener.color;
+    this_thread::sleep_for(chrono::milliseconds(100));
+    REQUIRE(listener.color == color);
+
+    REQUIRE(device->close());
+    delete device;
+}
+
+TEST_CASE("Device manager streams several simulated devices on a shared pool", "[simulator]") {
+    setenv("LIBFREENECT2_SIMULATE", "3", 1);
+    Freenect2DeviceManager manager(2);
+    REQUIRE(manager.getWorkerCount() == 2);
+    REQUIRE(manager.openAllDevices() >= 3);
+    unsetenv("LIBFREENECT2_SIMULATE");
+
+    std::vector<Freenect2Device *> devices = manager.getDevices();
+    std::vector<CountingListener> listeners(devices.size());
+    for (size_t i = 0; i < devices.size(); i++)
+    {
+        devices[i]->setColorFrameListener(&listeners[i]);
+        devices[i]->setIrAndDepthFrameListener(&listeners[i]);
+    }
+    REQUIRE(manager.startAll());
+
+    const chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(5);
+    bool streaming = false;
+    while (!streaming && chrono::steady_clock::now() < deadline)
+    {
+        this_thread::sleep_for(chrono::milliseconds(10));
+        streaming = true;
+        for (size_t i = 0; i < listeners.size(); i++)
+            streaming = streaming && listeners[i].color >= 3 && listeners[i].depth >= 3;
+    }
+    REQUIRE(streaming);
+
+    std::vector<DeviceThroughput> throughput = manager.getThroughput();
+    REQUIRE(throughput.size() == devices.size());
+    for (size_t i = 0; i < throughput.size(); i++)
+    {
+        REQUIRE(throughput[i].serial == devices[i]->getSerialNumber());
+        REQUIRE(throughput[i].color_fps > 0);
+        REQUIRE(throughput[i].depth_fps > 0);
+        REQUIRE(throughput[i].usb_mbps > 0);
+    }
+
+    REQUIRE(manager.stopAll());
+    manager.closeDevice(devices[0]);
+    REQUIRE(manager.getDevices().size() == devices.size() - 1);
+
+    // Packets queued before stop() may still be decoded; delete the devices before their listeners.
+    for (size_t i = 1; i < devices.size(); i++)
+        manager.closeDevice(devices[i]);
+}
+
+TEST_CASE("Application drives USB events without the internal thread", "[simulator]") {
+    setenv("LIBFREENECT2_SIMULATE", "1", 1);
+    Freenect2 freenect2(0, false);
+    REQUIRE(freenect2.enumerateDevices() >= 1);
+    Freenect2Device *device = freenect2.openDevice("SIMULATED000", new DumpPacketPipeline());
+    unsetenv("LIBFREENECT2_SIMULATE");
+    REQUIRE(device != 0);
+
+    CountingListener listener;
+    device->setColorFrameListener(&listener);
+    device->setIrAndDepthFrameListener(&listener);
+    REQUIRE(device->start());
+
+    // Transfers only complete in handleEvents().
+    this_thread::sleep_for(chrono::milliseconds(200));
+    REQUIRE(listener.color == 0);
+    REQUIRE(listener.depth == 0);
+
+    const chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(5);
+    while ((listener.color < 3 || listener.depth < 3) && chrono::steady_clock::now() < deadline)
+    {
+        const int timeout = freenect2.getNextTimeout();
+        REQUIRE(freenect2.handleEvents(timeout < 0 || timeout > 10 ? 10 : timeout));
+    }
+    REQUIRE(listener.color >= 3);
+    REQUIRE(listener.depth >= 3);
+
+    // With the loop no longer running, stop() handles the cancelled transfers itself.
+    const chrono::steady_clock::time_point stop_start = chrono::steady_clock::now();
+    REQUIRE(device->stop());
+    REQUIRE(chrono::steady_clock::now() - stop_start < chrono::milliseconds(500));
+    REQUIRE(device->close());
+    delete device;
+}
+
+TEST_CASE("Adaptive transfer pools grow while streaming", "[simulator]") {
+    setenv("LIBFREENECT2_SIMULATE", "1", 1);
+    setenv("LIBFREENECT2_ADAPTIVE_TRANSFERS", "1", 1);
+    // One iso transfer leaves the device without a queued one after every completion.
+    setenv("LIBFREENECT2_IR_TRANSFERS", "1", 1);
+    Freenect2 freenect2;
+    REQUIRE(freenect2.enumerateDevices() >= 1);
+    Freenect2Device *device = freenect2.openDevice("SIMULATED000", new DumpPacketPipeline());
+    unsetenv("LIBFREENECT2_SIMULATE");
+    unsetenv("LIBFREENECT2_ADAPTIVE_TRANSFERS");
+    unsetenv("LIBFREENECT2_IR_TRANSFERS");
+    REQUIRE(device != 0);
+
+    CountingListener listener;
+    device->setColorFrameListener(&listener);
+    device->setIrAndDepthFrameListener(&listener);
+    REQUIRE(device->start());
+
+    // Stream past a few adaptation windows, the pool grows after the baseline one.
+    const chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(5);
+    while (listener.depth < 45 && chrono::steady_clock::now() < deadline)
+        this_thread::sleep_for(chrono::milliseconds(10));
+    REQUIRE(listener.depth >= 45);
+
+    REQUIRE(device->stop());
+    REQUIRE(device->start());
+    REQUIRE(device->stop());
+    REQUIRE(device->close());
+    delete device;
+}
+
+TEST_CASE("Fast start reuses cached calibration", "[simulator]") {
+    char dir[] = "/tmp/freenect2_cache_XXXXXX";
+    REQUIRE(mkdtemp(dir) != 0);
+    setenv("LIBFREENECT2_CACHE_DIR", dir, 1);
+    setenv("LIBFREENECT2_FAST_START", "1", 1);
+    setenv("LIBFREENECT2_SIMULATE", "1", 1);
+    setenv("LIBFREENECT2_SIMULATE_STATUS_DELAY_MS", "50", 1);
+    Freenect2 freenect2;
+    REQUIRE(freenect2.enumerateDevices() >= 1);
+    Freenect2Device *device = freenect2.openDevice("SIMULATED000", new DumpPacketPipeline());
+    unsetenv("LIBFREENECT2_SIMULATE");
+    unsetenv("LIBFREENECT2_SIMULATE_STATUS_DELAY_MS");
+    REQUIRE(device != 0);
+
+    CountingListener listener;
+    device->setColorFrameListener(&listener);
+    device->setIrAndDepthFrameListener(&listener);
+    for (int start = 0; start < 2; start++)
+    {
+        REQUIRE(device->start());
+        const chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(5);
+        while (device->getTelemetry()->getCount(Telemetry::Depth, Telemetry::FirstFrameLatency) <= size_t(start) &&
+               chrono::steady_clock::now() < deadline)
+            this_thread::sleep_for(chrono::milliseconds(10));
+        REQUIRE(device->getTelemetry()->getCount(Telemetry::Depth, Telemetry::FirstFrameLatency) == size_t(start + 1));
+        REQUIRE(device->stop());
+    }
+    unsetenv("LIBFREENECT2_FAST_START");
+    unsetenv("LIBFREENECT2_CACHE_DIR");
+
+    // The second start had the same calibration without reading it.
+    REQUIRE(device->getFirmwareVersion() == "2.3.3913.0");
+    REQUIRE_THAT(device->getIrCameraParams().fx, Catch::Matchers::WithinRel(365.456f, 1e-6f));
+    const std::string file = std::string(dir) + "/SIMULATED000.calibration";
+    REQUIRE(std::ifstream(file.c_str()).good());
+
+    // A later process finds it in the file.
+    protocol::CalibrationCache::clearMemory();
+    protocol::DeviceCalibration cached;
+    REQUIRE(protocol::CalibrationCache(dir).load("SIMULATED000", cached));
+    REQUIRE(cached.complete());
+
+    REQUIRE(device->close());
+    delete device;
+    std::remove(file.c_str());
+    rmdir(dir);
+}
+
+TEST_CASE("Calibration cache files round-trip and reject bad files", "[simulator]") {
+    char dir[] = "/tmp/freenect2_cache_XXXXXX";
+    REQUIRE(mkdtemp(dir) != 0);
+    const std::string file = std::string(dir) + "/SERIAL_1.calibration";
+
+    protocol::DeviceCalibration calibration;
+    calibration.firmware.assign(20, 1);
+    calibration.serial.assign(16, 2);
+    calibration.depth_params.assign(300, 3);
+    calibration.p0_tables.assign(1000, 4);
+    calibration.rgb_params.assign(200, 5);
+    REQUIRE(protocol::CalibrationCache(dir).store("SERIAL-1", calibration));
+
+    protocol::CalibrationCache::clearMemory();
+    protocol::DeviceCalibration loaded;
+    REQUIRE(protocol::CalibrationCache(dir).load("SERIAL-1", loaded));
+    REQUIRE(loaded.firmware == calibration.firmware);
+    REQUIRE(loaded.serial == calibration.serial);
+    REQUIRE(loaded.depth_params == calibration.depth_params);
+    REQUIRE(loaded.p0_tables == calibration.p0_tables);
+    REQUIRE(loaded.rgb_params == calibration.rgb_params);
+
+    std::vector<char> bytes;
+    {
+        std::ifstream in(file.c_str(), std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    REQUIRE(bytes.size() > 8);
+
+    // Another format version.
+    std::vector<char> other = bytes;
+    other[4]++;
+    std::ofstream(file.c_str(), std::ios::binary | std::ios::trunc).write(&other[0], other.size());
+    protocol::CalibrationCache::clearMemory();
+    REQUIRE(!protocol::CalibrationCache(dir).load("SERIAL-1", loaded));
+
+    // Cut off in the last response.
+    std::ofstream(file.c_str(), std::ios::binary | std::ios::trunc).write(&bytes[0], bytes.size() - 10);
+    REQUIRE(!protocol::CalibrationCache(dir).load("SERIAL-1", loaded));
+
+    std::remove(file.c_str());
+    REQUIRE(!protocol::CalibrationCache(dir).load("SERIAL-1", loaded));
+    rmdir(dir);
+}
+
+TEST_CASE("Depth-only streaming leaves the color half unconstructed", "[simulator]") {
+    setenv("LIBFREENECT2_SIMULATE", "1", 1);
+    Freenect2 freenect2;
+    REQUIRE(freenect2.enumerateDevices() >= 1);
+    DumpPacketPipeline *pipeline = new DumpPacketPipeline();
+    Freenect2Device *device = freenect2.openDevice("SIMULATED000", pipeline);
+    unsetenv("LIBFREENECT2_SIMULATE");
+    REQUIRE(device != 0);
+    REQUIRE(!pipeline->hasRgbPacketProcessor());
+    REQUIRE(!pipeline->hasDepthPacketProcessor());
+
+    CountingListener listener;
+    device->setColorFrameListener(&listener);
+    device->setIrAndDepthFrameListener(&listener);
+    REQUIRE(device->startStreams(false, true));
+    REQUIRE(pipeline->hasDepthPacketProcessor());
+
+    const chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(5);
+    while (listener.depth < 3 && chrono::steady_clock::now() < deadline)
+        this_thread::sleep_for(chrono::milliseconds(10));
+    REQUIRE(listener.depth >= 3);
+    REQUIRE(listener.color == 0);
+
+    REQUIRE(device->stop());
+    REQUIRE(device->close());
+    REQUIRE(!pipeline->hasRgbPacketProcessor());
+    delete device;
+}
@@ -0,0 +1,73 @@
+#include <catch2/catch_test_macros.hpp>
+#include <libfreenect2/stream_generator.h>
+#include <libfreenect2/depth_packet_stream_parser.h>
+#include <libfreenect2/rgb_packet_stream_parser.h>
+
+#include <vector>
+
+using namespace libfreenect2;
+
+namespace
+{
+class DepthCapture: public PacketProcessor<DepthPacket>
+{
+public:
+  std::vector<std::vector<unsigned char> > frames;
+
+  virtual void process(const DepthPacket &packet)
+  {
+    frames.push_back(std::vector<unsigned char>(packet.buffer, packet.buffer + packet.buffer_length));
+    DepthPacket p = packet;
+    releaseBuffer(p);
+  }
+};
+
+class RgbCapture: public PacketProcessor<RgbPacket>
+{
+public:
+  std::vector<std::vector<unsigned char> > jpegs;
+
+  virtual void process(const RgbPacket &packet)
+  {
+    jpegs.push_back(std::vector<unsigned char>(packet.jpeg_buffer, packet.jpeg_buffer + packet.jpeg_buffer_length));
+    RgbPacket p = packet;
+    releaseBuffer(p);
+  }
+};
+}
+
+TEST_CASE("Stream generator feeds the parsers", "[generator]") {
+    DepthCapture depth;
+    DepthPacketStreamParser depth_parser;
+    depth_parser.setPacketProcessor(&depth);
+    RgbCapture rgb;
+    RgbPacketStreamParser rgb_parser;
+    rgb_parser.setPacketProcessor(&rgb);
+
+    StreamGenerator generator;
+    generator.run(&rgb_parser, &depth_parser, 3);
+
+    REQUIRE(rgb.jpegs.size() == 3);
+    REQUIRE(rgb.jpegs[2] == generator.rgbSource());
+    REQUIRE(depth.frames.size() >= 2);
+    REQUIRE(depth.frames[0] == generator.depthSource());
+    REQUIRE(generator.getStatistics().lost == 0);
+}
+
+TEST_CASE("Stream generator loses payloads", "[generator]") {
+    DepthCapture depth;
+    DepthPacketStreamParser depth_parser;
+    depth_parser.setPacketProcessor(&depth);
+
+    StreamGeneratorConfig config;
+    config.loss = 0.05;
+    config.reorder = 0.05;
+    StreamGenerator generator(config);
+    generator.run(NULL, &depth_parser, 20);
+
+    StreamGeneratorStatistics stats = generator.getStatistics();
+    REQUIRE(stats.depth_frames == 20);
+    REQUIRE(stats.lost > 0);
+    REQUIRE(stats.reordered > 0);
+    REQUIRE(depth.frames.size() < 20);
+}
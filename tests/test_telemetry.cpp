@@ -0,0 +1,121 @@
+#include <catch2/catch_test_macros.hpp>
+#include <libfreenect2/telemetry.h>
+#include <libfreenect2/stream_generator.h>
+#include <libfreenect2/depth_packet_stream_parser.h>
+#include <libfreenect2/rgb_packet_stream_parser.h>
+
+#include <string>
+
+using namespace libfreenect2;
+
+namespace
+{
+template<typename PacketT>
+class ReleasingProcessor: public PacketProcessor<PacketT>
+{
+public:
+  virtual void process(const PacketT &packet)
+  {
+    PacketT p = packet;
+    this->releaseBuffer(p);
+  }
+};
+
+/** Refuses packets while busy, like a processor whose queue is full. */
+class BusyProcessor: public ReleasingProcessor<RgbPacket>
+{
+public:
+  bool busy;
+
+  BusyProcessor(): busy(false) {}
+  virtual bool ready() { return !busy; }
+};
+}
+
+TEST_CASE("Telemetry histogram buckets and exports", "[telemetry]") {
+    Telemetry telemetry;
+    telemetry.add(Telemetry::Color, Telemetry::BytesReceived, 100);
+    telemetry.record(Telemetry::Depth, Telemetry::ProcessLatency, 500);      // <= 1 us
+    telemetry.record(Telemetry::Depth, Telemetry::ProcessLatency, 3000);     // <= 4 us
+    telemetry.record(Telemetry::Depth, Telemetry::ProcessLatency, 100000000000ull);
+
+    REQUIRE(telemetry.get(Telemetry::Color, Telemetry::BytesReceived) == 100);
+    REQUIRE(telemetry.getBucket(Telemetry::Depth, Telemetry::ProcessLatency, 0) == 1);
+    REQUIRE(telemetry.getBucket(Telemetry::Depth, Telemetry::ProcessLatency, 2) == 1);
+    REQUIRE(telemetry.getBucket(Telemetry::Depth, Telemetry::ProcessLatency, Telemetry::HistogramBuckets - 1) == 1);
+    REQUIRE(telemetry.getCount(Telemetry::Depth, Telemetry::ProcessLatency) == 3);
+
+    const std::string json = telemetry.toJson();
+    REQUIRE(json.find("\"color\":{\"transfers_completed\":0,") != std::string::npos);
+    REQUIRE(json.find("\"bytes_received\":100") != std::string::npos);
+
+    const std::string prom = telemetry.toPrometheus("serial=\"42\"");
+    REQUIRE(prom.find("freenect2_bytes_received_total{stream=\"color\",serial=\"42\"} 100\n") != std::string::npos);
+    REQUIRE(prom.find("freenect2_process_latency_seconds_bucket{stream=\"depth\",serial=\"42\",le=\"+Inf\"} 3\n") != std::string::npos);
+    // Bounds and sums are exact, however large they get.
+    REQUIRE(prom.find("freenect2_process_latency_seconds_bucket{stream=\"depth\",serial=\"42\",le=\"0.000004\"} 2\n") != std::string::npos);
+    REQUIRE(prom.find("freenect2_process_latency_seconds_bucket{stream=\"depth\",serial=\"42\",le=\"1.048576\"} 2\n") != std::string::npos);
+    REQUIRE(prom.find("freenect2_process_latency_seconds_sum{stream=\"depth\",serial=\"42\"} 100.0000035\n") != std::string::npos);
+
+    telemetry.reset();
+    REQUIRE(telemetry.get(Telemetry::Color, Telemetry::BytesReceived) == 0);
+}
+
+TEST_CASE("Telemetry records the first frame after a start", "[telemetry]") {
+    Telemetry telemetry;
+    telemetry.add(Telemetry::Depth, Telemetry::FramesProcessed);
+    REQUIRE(telemetry.getCount(Telemetry::Depth, Telemetry::FirstFrameLatency) == 0);
+
+    telemetry.markStart(Telemetry::Depth);
+    telemetry.add(Telemetry::Color, Telemetry::FramesProcessed);
+    telemetry.add(Telemetry::Depth, Telemetry::FramesProcessed);
+    telemetry.add(Telemetry::Depth, Telemetry::FramesProcessed);
+    REQUIRE(telemetry.getCount(Telemetry::Color, Telemetry::FirstFrameLatency) == 0);
+    REQUIRE(telemetry.getCount(Telemetry::Depth, Telemetry::FirstFrameLatency) == 1);
+    REQUIRE(telemetry.toJson().find("\"first_frame_latency\"") != std::string::npos);
+}
+
+TEST_CASE("Parsers count frames and drops", "[telemetry]") {
+    Telemetry telemetry;
+    ReleasingProcessor<DepthPacket> depth;
+    ReleasingProcessor<RgbPacket> rgb;
+    DepthPacketStreamParser depth_parser;
+    RgbPacketStreamParser rgb_parser;
+    depth_parser.setPacketProcessor(&depth);
+    rgb_parser.setPacketProcessor(&rgb);
+    depth_parser.setTelemetry(&telemetry);
+    rgb_parser.setTelemetry(&telemetry);
+
+    StreamGeneratorConfig config;
+    config.loss = 0.01;
+    StreamGenerator generator(config);
+    generator.run(&rgb_parser, &depth_parser, 50);
+
+    const uint64_t depth_total = telemetry.get(Telemetry::Depth, Telemetry::FramesCompleted) +
+                                 telemetry.get(Telemetry::Depth, Telemetry::DroppedIncomplete);
+    REQUIRE(telemetry.get(Telemetry::Depth, Telemetry::FramesCompleted) > 0);
+    REQUIRE(telemetry.get(Telemetry::Depth, Telemetry::DroppedIncomplete) > 0);
+    REQUIRE(depth_total <= 50);
+    REQUIRE(telemetry.get(Telemetry::Color, Telemetry::FramesCompleted) > 0);
+    REQUIRE(telemetry.get(Telemetry::Color, Telemetry::FramesCompleted) < 50);
+}
+
+TEST_CASE("Color packets skipped while the processor is busy count as lost", "[telemetry]") {
+    Telemetry telemetry;
+    BusyProcessor rgb;
+    RgbPacketStreamParser rgb_parser;
+    rgb_parser.setPacketProcessor(&rgb);
+    rgb_parser.setTelemetry(&telemetry);
+
+    StreamGenerator generator;
+    for (int i = 0; i < 6; ++i)
+    {
+        rgb.busy = i >= 2 && i < 5;
+        generator.feedRgbFrame(rgb_parser);
+        generator.advanceTimestamp();
+    }
+
+    REQUIRE(telemetry.get(Telemetry::Color, Telemetry::FramesCompleted) == 3);
+    REQUIRE(telemetry.get(Telemetry::Color, Telemetry::DroppedBusy) == 3);
+    REQUIRE(telemetry.get(Telemetry::Color, Telemetry::FramesLost) == 3);
+}
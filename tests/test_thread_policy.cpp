@@ -0,0 +1,47 @@
+#include <catch2/catch_test_macros.hpp>
+#include <libfreenect2/thread_policy.h>
+
+using namespace libfreenect2;
+
+TEST_CASE("ThreadPolicy parsing", "[threading]") {
+    ThreadPolicy p;
+
+    SECTION("CPU list with ranges") {
+        REQUIRE(ThreadPolicy::parse("cpus=0,2-4;exclusive=1", p));
+        REQUIRE(p.cpus == std::vector<int>({0, 2, 3, 4}));
+        REQUIRE(p.exclusive);
+        REQUIRE(p.scheduling == ThreadPolicy::Default);
+    }
+
+    SECTION("Scheduling") {
+        REQUIRE(ThreadPolicy::parse("fifo=50", p));
+        REQUIRE(p.scheduling == ThreadPolicy::Fifo);
+        REQUIRE(p.priority == 50);
+        REQUIRE(ThreadPolicy::parse("nice=-5;cpus=1", p));
+        REQUIRE(p.scheduling == ThreadPolicy::Nice);
+        REQUIRE(p.priority == -5);
+        REQUIRE(p.cpus == std::vector<int>({1}));
+    }
+
+    SECTION("Invalid strings leave the policy untouched") {
+        REQUIRE(ThreadPolicy::parse("cpus=3", p));
+        REQUIRE_FALSE(ThreadPolicy::parse("fifo=0", p));
+        REQUIRE_FALSE(ThreadPolicy::parse("cpus=3-1", p));
+        REQUIRE_FALSE(ThreadPolicy::parse("bogus=1", p));
+        REQUIRE_FALSE(ThreadPolicy::parse("cpus", p));
+        REQUIRE_FALSE(ThreadPolicy::parse("cpus=0-2000000000", p));
+        REQUIRE_FALSE(ThreadPolicy::parse("cpus=99999999999999999999", p));
+        REQUIRE_FALSE(ThreadPolicy::parse("nice=4294967296", p));
+        REQUIRE(p.cpus == std::vector<int>({3}));
+    }
+}
+
+TEST_CASE("ThreadPolicy registry", "[threading]") {
+    ThreadPolicy p;
+    p.cpus.push_back(0);
+    setThreadPolicy(ThreadPolicy::Worker, p);
+    REQUIRE(getThreadPolicy(ThreadPolicy::Worker).cpus == p.cpus);
+    setThreadPolicy(ThreadPolicy::Worker, ThreadPolicy());
+    REQUIRE(getThreadPolicy(ThreadPolicy::Worker).cpus.empty());
+    REQUIRE(ThreadPolicy::role2str(ThreadPolicy::UsbEventLoop) == "USB");
+}
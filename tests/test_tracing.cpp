@@ -0,0 +1,83 @@
+#include <catch2/catch_test_macros.hpp>
+#include <libfreenect2/tracing.h>
+#include <libfreenect2/trace_span.h>
+#include <libfreenect2/threading.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace libfreenect2;
+
+TEST_CASE("Tracing writes recorded spans as Chrome trace events", "[tracing]") {
+    clearTrace();
+    setTracing(false);
+    {
+        trace::Span span("test_disabled", 1);
+    }
+
+    setTracing(true);
+    REQUIRE(isTracing());
+    {
+        trace::Span span("test_span", 42);
+    }
+    setTracing(false);
+
+    const std::string filename = "test_tracing.json";
+    REQUIRE(writeTrace(filename));
+
+    std::ifstream in(filename.c_str());
+    std::stringstream ss;
+    ss << in.rdbuf();
+    const std::string json = ss.str();
+    std::remove(filename.c_str());
+
+    REQUIRE(json.find("\"traceEvents\"") != std::string::npos);
+    REQUIRE(json.find("\"name\":\"test_span\"") != std::string::npos);
+    REQUIRE(json.find("\"sequence\":42") != std::string::npos);
+    REQUIRE(json.find("test_disabled") == std::string::npos);
+    clearTrace();
+}
+
+namespace
+{
+void recordThreadSpan(void *sequence)
+{
+    trace::Span span("test_thread_span", static_cast<uint32_t>(reinterpret_cast<size_t>(sequence)));
+}
+}
+
+TEST_CASE("Tracing keeps spans of exited threads apart when reusing their rings", "[tracing]") {
+    clearTrace();
+    setTracing(true);
+    const size_t threads = 8;
+    for (size_t i = 0; i < threads; i++)
+    {
+        libfreenect2::thread t(&recordThreadSpan, reinterpret_cast<void *>(i));
+        t.join();
+    }
+    setTracing(false);
+
+    const std::string filename = "test_tracing_threads.json";
+    REQUIRE(writeTrace(filename));
+    std::ifstream in(filename.c_str());
+    std::string line;
+    std::vector<std::string> tids;
+    while (std::getline(in, line))
+    {
+        if (line.find("test_thread_span") == std::string::npos)
+            continue;
+        const size_t tid = line.find("\"tid\":");
+        tids.push_back(line.substr(tid, line.find(',', tid) - tid));
+    }
+    std::remove(filename.c_str());
+
+    // Each thread's span is still there, attributed to its own thread.
+    REQUIRE(tids.size() == threads);
+    std::sort(tids.begin(), tids.end());
+    REQUIRE(std::unique(tids.begin(), tids.end()) == tids.end());
+    clearTrace();
+}
@@ -0,0 +1,65 @@
+#include <catch2/catch_test_macros.hpp>
+#include <libfreenect2/usb/transfer_pool.h>
+
+using namespace libfreenect2;
+using namespace libfreenect2::usb;
+
+namespace
+{
+const uint64_t Window = AdaptiveTransferCount::WindowNs;
+
+/** Complete transfers every millisecond for one window, with in_flight others still submitted. */
+size_t runWindow(AdaptiveTransferCount &count, uint64_t &now, size_t in_flight, uint64_t parser_loss = 0)
+{
+    size_t target = count.target();
+    for (uint64_t t = 0; t < Window; t += 1000000)
+        target = count.onCompletion(now += 1000000, in_flight, false, parser_loss);
+    return target;
+}
+}
+
+TEST_CASE("Adaptive transfer count grows on stress and shrinks when calm", "[usb]") {
+    AdaptiveTransferCount count;
+    REQUIRE_FALSE(count.enabled());
+
+    count.setBounds(2, 16, 4);
+    REQUIRE(count.enabled());
+    REQUIRE(count.target() == 4);
+
+    // The first completion opens a window, which only sets the baseline.
+    uint64_t now = 1;
+    count.onCompletion(now, 0, false, 0);
+    REQUIRE(runWindow(count, now, 0) == 4);
+
+    // Queue ran dry.
+    REQUIRE(runWindow(count, now, 0) == 5);
+
+    // Parser loss.
+    REQUIRE(runWindow(count, now, 3, 1) == 6);
+
+    // Failed iso packets.
+    count.addErrors(2);
+    REQUIRE(runWindow(count, now, 3, 1) == 7);
+
+    // Some headroom left, but not enough to give any back.
+    for (unsigned i = 0; i < AdaptiveTransferCount::CalmWindows; i++)
+        REQUIRE(runWindow(count, now, 2, 1) == 7);
+
+    for (unsigned i = 1; i < AdaptiveTransferCount::CalmWindows; i++)
+        REQUIRE(runWindow(count, now, 6, 1) == 7);
+    REQUIRE(runWindow(count, now, 6, 1) == 6);
+
+    // Never beyond the bounds.
+    for (int i = 0; i < 20; i++)
+        runWindow(count, now, 0);
+    REQUIRE(count.target() == 16);
+    for (int i = 0; i < 400; i++)
+        runWindow(count, now, 16);
+    REQUIRE(count.target() == 2);
+
+    // A restart begins with a baseline window again.
+    count.restart();
+    count.onCompletion(now, 0, false, 0);
+    REQUIRE(runWindow(count, now, 0) == 2);
+    REQUIRE(runWindow(count, now, 0) == 3);
+}
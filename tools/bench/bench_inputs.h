@@ -0,0 +1,176 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+
+/** @file bench_inputs.h Synthetic camera parameters, tables and depth processors for the benchmark tools. */
+
+#ifndef BENCH_INPUTS_H_
+#define BENCH_INPUTS_H_
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <libfreenect2/libfreenect2.hpp>
+#include <libfreenect2/depth_packet_processor.h>
+#include <libfreenect2/depth_tables.h>
+#include <libfreenect2/protocol/response.h>
+#include <libfreenect2/usb/simulated_kinect.h>
+#ifdef LIBFREENECT2_WITH_METAL_SUPPORT
+#include <libfreenect2/metal_depth_packet_processor.h>
+#endif
+
+namespace libfreenect2
+{
+namespace bench
+{
+
+/** IR camera parameters of a typical device, as reported by the simulated device. */
+inline Freenect2Device::IrCameraParams irCameraParams()
+{
+  return protocol::DepthCameraParamsResponse(usb::SimulatedKinect::depthCameraParamsResponse()).toIrCameraParams();
+}
+
+/** Color camera parameters of a typical device, as reported by the simulated device. */
+inline Freenect2Device::ColorCameraParams colorCameraParams()
+{
+  return protocol::RgbCameraParamsResponse(usb::SimulatedKinect::rgbCameraParamsResponse()).toColorCameraParams();
+}
+
+/** Command response with P0 tables around the values seen on devices. */
+inline std::vector<unsigned char> p0TablesResponse()
+{
+  return usb::SimulatedKinect::p0TablesResponse();
+}
+
+/** Load a raw file, e.g. a depth packet or a P0 tables response. */
+inline bool readFile(const std::string &filename, std::vector<unsigned char> &data)
+{
+  FILE *f = std::fopen(filename.c_str(), "rb");
+  if (!f)
+    return false;
+  data.clear();
+  unsigned char chunk[65536];
+  size_t n;
+  while ((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0)
+    data.insert(data.end(), chunk, chunk + n);
+  std::fclose(f);
+  return true;
+}
+
+struct DepthBackend
+{
+  std::string name;
+  DepthPacketProcessor *processor;
+};
+
+/** Names of the depth processors compiled into the library. */
+inline std::vector<std::string> depthBackendNames()
+{
+  std::vector<std::string> names;
+  names.push_back("cpu");
+#ifdef LIBFREENECT2_WITH_OPENCL_SUPPORT
+  names.push_back("opencl");
+  names.push_back("opencl_kde");
+#endif
+#ifdef LIBFREENECT2_WITH_CUDA_SUPPORT
+  names.push_back("cuda");
+  names.push_back("cuda_kde");
+#endif
+#ifdef LIBFREENECT2_WITH_OPENGL_SUPPORT
+  // OpenGL needs a window system.
+#if defined(__linux__)
+  if (std::getenv("DISPLAY") || std::getenv("WAYLAND_DISPLAY"))
+#endif
+    names.push_back("opengl");
+#endif
+#ifdef LIBFREENECT2_WITH_METAL_SUPPORT
+  names.push_back("metal");
+#endif
+  return names;
+}
+
+/**
+ * Create the depth processor @p name loaded with the given tables.
+ * @return The processor, or NULL if it failed to initialize, e.g. OpenCL without a device.
+ */
+inline DepthPacketProcessor *createDepthBackend(const std::string &name, std::vector<unsigned char> &p0_tables,
+                                                const IrCameraTables &tables)
+{
+  DepthPacketProcessor *processor = 0;
+  if (name == "cpu")
+    processor = new CpuDepthPacketProcessor();
+#ifdef LIBFREENECT2_WITH_OPENCL_SUPPORT
+  else if (name == "opencl")
+    processor = new OpenCLDepthPacketProcessor();
+  else if (name == "opencl_kde")
+    processor = new OpenCLKdeDepthPacketProcessor();
+#endif
+#ifdef LIBFREENECT2_WITH_CUDA_SUPPORT
+  else if (name == "cuda")
+    processor = new CudaDepthPacketProcessor();
+  else if (name == "cuda_kde")
+    processor = new CudaKdeDepthPacketProcessor();
+#endif
+#ifdef LIBFREENECT2_WITH_OPENGL_SUPPORT
+  else if (name == "opengl")
+    processor = new OpenGLDepthPacketProcessor(0, false);
+#endif
+#ifdef LIBFREENECT2_WITH_METAL_SUPPORT
+  else if (name == "metal")
+    processor = new MetalDepthPacketProcessor();
+#endif
+  if (!processor)
+    return 0;
+
+  processor->loadP0TablesFromCommandResponse(&p0_tables[0], p0_tables.size());
+  processor->loadXZTables(&tables.xtable[0], &tables.ztable[0]);
+  processor->loadLookupTable(&tables.lut[0]);
+  if (!processor->good())
+  {
+    delete processor;
+    return 0;
+  }
+  return processor;
+}
+
+/** Depth packet pointing into @p data. */
+inline DepthPacket depthPacket(const std::vector<unsigned char> &data, uint32_t sequence)
+{
+  DepthPacket packet;
+  std::memset(&packet, 0, sizeof(packet));
+  packet.sequence = sequence;
+  packet.timestamp = sequence * 267;
+  packet.buffer = const_cast<unsigned char *>(&data[0]);
+  packet.buffer_length = data.size();
+  return packet;
+}
+
+} /* namespace bench */
+} /* namespace libfreenect2 */
+#endif /* BENCH_INPUTS_H_ */
@@ -0,0 +1,532 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+
+/** @file freenect2_bench.cpp Microbenchmarks of the processing hot paths on synthetic inputs. */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <libfreenect2/libfreenect2.hpp>
+#include <libfreenect2/frame_listener.hpp>
+#include <libfreenect2/registration.h>
+#include <libfreenect2/logger.h>
+#include <libfreenect2/threading.h>
+#include <libfreenect2/depth_packet_processor.h>
+#include <libfreenect2/depth_packet_stream_parser.h>
+#include <libfreenect2/rgb_packet_processor.h>
+#include <libfreenect2/rgb_packet_stream_parser.h>
+#include <libfreenect2/depth_tables.h>
+#include <libfreenect2/stream_generator.h>
+
+#include "bench_inputs.h"
+
+using namespace libfreenect2;
+
+/* Count heap allocations of the whole process, including the library. */
+static atomic<size_t> allocation_count(0);
+static atomic<size_t> allocation_bytes(0);
+
+/* The replaced operators go through this matching pair. Kept out of line, so the compiler does
+ * not see malloc/free inlined into new/delete and report them as mismatched. */
+#if defined(__GNUC__) || defined(__clang__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE
+#endif
+
+BENCH_NOINLINE static void *countedAllocate(size_t size)
+{
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+  void *p = std::malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+BENCH_NOINLINE static void countedRelease(void *p)
+{
+  std::free(p);
+}
+
+void *operator new(size_t size) { return countedAllocate(size); }
+void *operator new[](size_t size) { return countedAllocate(size); }
+void operator delete(void *p) noexcept { countedRelease(p); }
+void operator delete[](void *p) noexcept { countedRelease(p); }
+void operator delete(void *p, size_t) noexcept { countedRelease(p); }
+void operator delete[](void *p, size_t) noexcept { countedRelease(p); }
+
+namespace
+{
+
+/** One hot path, run once per frame. */
+class Fixture
+{
+public:
+  virtual ~Fixture() {}
+  virtual std::string name() const = 0;
+  /** Input bytes consumed per frame. */
+  virtual size_t bytes() const = 0;
+  /** Callback invocations per frame, 0 if not meaningful. */
+  virtual size_t events() const { return 0; }
+  virtual void run() = 0;
+};
+
+/** Hands frames back to the processors. */
+class DiscardingListener: public FrameListener
+{
+public:
+  virtual bool onNewFrame(Frame::Type, Frame *) { return false; }
+};
+
+/** Releases packets like AsyncPacketProcessor does after processing. */
+template<typename PacketT>
+class ReleasingProcessor: public PacketProcessor<PacketT>
+{
+public:
+  virtual void process(const PacketT &packet)
+  {
+    PacketT p = packet;
+    this->releaseBuffer(p);
+  }
+};
+
+class DepthProcessorFixture: public Fixture
+{
+public:
+  DepthProcessorFixture(const bench::DepthBackend &backend, const std::vector<unsigned char> &packet):
+    backend_(backend), packet_(packet), sequence_(0)
+  {
+    backend_.processor->setFrameListener(&listener_);
+  }
+  virtual ~DepthProcessorFixture() { delete backend_.processor; }
+
+  virtual std::string name() const { return "depth_" + backend_.name; }
+  virtual size_t bytes() const { return packet_.size(); }
+  virtual void run() { backend_.processor->process(bench::depthPacket(packet_, ++sequence_)); }
+private:
+  bench::DepthBackend backend_;
+  const std::vector<unsigned char> &packet_;
+  DiscardingListener listener_;
+  uint32_t sequence_;
+};
+
+/** Color and depth frames for registration. */
+struct RegistrationFrames
+{
+  Frame rgb, depth, undistorted, registered, bigdepth;
+
+  RegistrationFrames():
+    rgb(1920, 1080, 4), depth(512, 424, 4), undistorted(512, 424, 4), registered(512, 424, 4), bigdepth(1920, 1082, 4)
+  {
+    for (size_t i = 0; i < 1920 * 1080 * 4; i++)
+      rgb.data[i] = static_cast<unsigned char>(i * 13);
+    float *d = reinterpret_cast<float *>(depth.data);
+    for (size_t y = 0; y < 424; y++)
+      for (size_t x = 0; x < 512; x++)
+        d[y * 512 + x] = 500.0f + 4000.0f * ((x + 2 * y) % 512) / 512.0f;
+  }
+};
+
+class RegistrationApplyFixture: public Fixture
+{
+public:
+  RegistrationApplyFixture(): registration_(bench::irCameraParams(), bench::colorCameraParams()) {}
+  virtual std::string name() const { return "registration_apply"; }
+  virtual size_t bytes() const { return 1920 * 1080 * 4 + 512 * 424 * 4; }
+  virtual void run()
+  {
+    registration_.apply(&frames_.rgb, &frames_.depth, &frames_.undistorted, &frames_.registered, true, &frames_.bigdepth);
+  }
+private:
+  Registration registration_;
+  RegistrationFrames frames_;
+};
+
+class UndistortDepthFixture: public Fixture
+{
+public:
+  UndistortDepthFixture(): registration_(bench::irCameraParams(), bench::colorCameraParams()) {}
+  virtual std::string name() const { return "undistort_depth"; }
+  virtual size_t bytes() const { return 512 * 424 * 4; }
+  virtual void run() { registration_.undistortDepth(&frames_.depth, &frames_.undistorted); }
+private:
+  Registration registration_;
+  RegistrationFrames frames_;
+};
+
+class IrTablesFixture: public Fixture
+{
+public:
+  virtual std::string name() const { return "ir_tables"; }
+  virtual size_t bytes() const { return 0; }
+  virtual void run() { IrCameraTables tables(bench::irCameraParams()); }
+};
+
+class RegistrationTablesFixture: public Fixture
+{
+public:
+  virtual std::string name() const { return "registration_tables"; }
+  virtual size_t bytes() const { return 0; }
+  virtual void run() { Registration registration(bench::irCameraParams(), bench::colorCameraParams()); }
+};
+
+/** Parses depth frames fed one iso packet at a time, writing into the packet buffer or copying through the work buffer. */
+class DepthParserFixture: public Fixture
+{
+public:
+  DepthParserFixture(const std::vector<unsigned char> &source, bool zero_copy): zero_copy_(zero_copy)
+  {
+    generator_.setDepthSource(&source[0], source.size());
+    parser_.setZeroCopy(zero_copy);
+    parser_.setPacketProcessor(&processor_);
+  }
+  virtual std::string name() const { return zero_copy_ ? "depth_parser" : "depth_parser_copy"; }
+  virtual size_t bytes() const { return generator_.depthSource().size(); }
+  virtual void run() { generator_.feedDepthFrame(parser_); }
+private:
+  bool zero_copy_;
+  StreamGenerator generator_;
+  ReleasingProcessor<DepthPacket> processor_;
+  DepthPacketStreamParser parser_;
+};
+
+/**
+ * Replays depth frames laid out like completed iso transfers, either with one
+ * onDataReceived() per packet or with one onIsoPacketsReceived() per transfer.
+ */
+class DepthIsoTransferFixture: public Fixture, private DataCallback
+{
+public:
+  static const size_t PacketsPerTransfer = 128;
+
+  DepthIsoTransferFixture(const std::vector<unsigned char> &source, bool batched):
+    batched_(batched), slot_size_(StreamGeneratorConfig().iso_packet_size), frame_(0)
+  {
+    StreamGenerator generator;
+    generator.setDepthSource(&source[0], source.size());
+    // Two frames, so that the sequence number changes on every replay.
+    for (frame_ = 0; frame_ < 2; frame_++)
+    {
+      generator.feedDepthFrame(*this);
+      generator.advanceTimestamp();
+      for (size_t i = 0; i < packets_[frame_].size(); i++)
+        packets_[frame_][i].data = &slots_[frame_][i * slot_size_];
+    }
+    frame_ = 0;
+    parser_.setPacketProcessor(&processor_);
+  }
+  virtual std::string name() const { return batched_ ? "depth_iso_batched" : "depth_iso_per_packet"; }
+  virtual size_t bytes() const { return StreamGenerator::DepthSubImageSize * StreamGenerator::DepthSubImages; }
+  virtual size_t events() const { return packets_[0].size(); }
+  virtual void run()
+  {
+    const std::vector<IsoPacket> &packets = packets_[frame_];
+    frame_ ^= 1;
+    DataCallback &callback = parser_;
+    for (size_t first = 0; first < packets.size(); first += PacketsPerTransfer)
+    {
+      const size_t count = std::min(PacketsPerTransfer, packets.size() - first);
+      if (batched_)
+      {
+        callback.onIsoPacketsReceived(&packets[first], count);
+        continue;
+      }
+      for (size_t i = first; i < first + count; i++)
+        callback.onDataReceived(packets[i].data, packets[i].length);
+    }
+  }
+private:
+  /** Records a generated payload into its own slot, like IsoTransferPool receives it. */
+  virtual void onDataReceived(unsigned char *buffer, size_t n)
+  {
+    std::vector<unsigned char> &slots = slots_[frame_];
+    slots.resize(slots.size() + slot_size_);
+    std::copy(buffer, buffer + n, slots.end() - slot_size_);
+    const IsoPacket packet = { NULL, n };
+    packets_[frame_].push_back(packet);
+  }
+
+  bool batched_;
+  size_t slot_size_;
+  size_t frame_;
+  std::vector<unsigned char> slots_[2];
+  std::vector<IsoPacket> packets_[2];
+  ReleasingProcessor<DepthPacket> processor_;
+  DepthPacketStreamParser parser_;
+};
+
+class RgbParserFixture: public Fixture
+{
+public:
+  RgbParserFixture() { parser_.setPacketProcessor(&processor_); }
+  virtual std::string name() const { return "rgb_parser"; }
+  virtual size_t bytes() const { return generator_.rgbSource().size(); }
+  virtual void run() { generator_.feedRgbFrame(parser_); }
+private:
+  StreamGenerator generator_;
+  ReleasingProcessor<RgbPacket> processor_;
+  RgbPacketStreamParser parser_;
+};
+
+#ifdef LIBFREENECT2_WITH_TURBOJPEG_SUPPORT
+class TurboJpegFixture: public Fixture
+{
+public:
+  /** Decode @p jpeg, or an encoded synthetic 1080p image if empty. */
+  TurboJpegFixture(const std::vector<unsigned char> &jpeg): jpeg_(jpeg), sequence_(0)
+  {
+    if (jpeg_.empty())
+      encodeSynthetic();
+    processor_.setFrameListener(&listener_);
+  }
+  virtual std::string name() const { return "turbojpeg_decode"; }
+  virtual size_t bytes() const { return jpeg_.size(); }
+  virtual void run()
+  {
+    RgbPacket packet;
+    std::memset(&packet, 0, sizeof(packet));
+    packet.sequence = ++sequence_;
+    packet.jpeg_buffer = &jpeg_[0];
+    packet.jpeg_buffer_length = jpeg_.size();
+    processor_.process(packet);
+  }
+private:
+  void encodeSynthetic()
+  {
+    jpeg_ = usb::SimulatedKinect::syntheticJpeg();
+    if (jpeg_.empty())
+      std::cerr << "failed to encode the synthetic JPEG" << std::endl;
+  }
+
+  std::vector<unsigned char> jpeg_;
+  TurboJpegRgbPacketProcessor processor_;
+  DiscardingListener listener_;
+  uint32_t sequence_;
+};
+#endif
+
+struct Result
+{
+  std::string name;
+  size_t frames;
+  size_t bytes;
+  size_t events;
+  double mean, p50, p90, p99, max; ///< Nanoseconds per frame.
+  double allocations;              ///< Per frame.
+  double allocated_bytes;          ///< Per frame.
+};
+
+Result measure(Fixture &fixture, size_t iterations, size_t warmup)
+{
+  for (size_t i = 0; i < warmup; i++)
+    fixture.run();
+
+  std::vector<double> ns(iterations);
+  const size_t count_before = allocation_count.load();
+  const size_t bytes_before = allocation_bytes.load();
+  for (size_t i = 0; i < iterations; i++)
+  {
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    fixture.run();
+    ns[i] = chrono::duration<double, std::nano>(chrono::steady_clock::now() - start).count();
+  }
+  const size_t count = allocation_count.load() - count_before;
+  const size_t bytes = allocation_bytes.load() - bytes_before;
+
+  Result r;
+  r.name = fixture.name();
+  r.frames = iterations;
+  r.bytes = fixture.bytes();
+  r.events = fixture.events();
+  double sum = 0;
+  for (size_t i = 0; i < iterations; i++)
+    sum += ns[i];
+  std::sort(ns.begin(), ns.end());
+  r.mean = sum / iterations;
+  r.p50 = ns[iterations * 50 / 100];
+  r.p90 = ns[iterations * 90 / 100];
+  r.p99 = ns[iterations * 99 / 100];
+  r.max = ns.back();
+  r.allocations = double(count) / iterations;
+  r.allocated_bytes = double(bytes) / iterations;
+  return r;
+}
+
+std::string toJson(const std::vector<Result> &results)
+{
+  std::ostringstream out;
+  out << "{\"version\":\"" << LIBFREENECT2_VERSION << "\",\"fixtures\":[";
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const Result &r = results[i];
+    out << (i ? "," : "") << "\n{\"name\":\"" << r.name << "\",\"frames\":" << r.frames
+        << ",\"bytes_per_frame\":" << r.bytes
+        << ",\"ns_per_frame\":{\"mean\":" << r.mean << ",\"p50\":" << r.p50 << ",\"p90\":" << r.p90
+        << ",\"p99\":" << r.p99 << ",\"max\":" << r.max << "}"
+        << ",\"allocations_per_frame\":" << r.allocations
+        << ",\"allocated_bytes_per_frame\":" << r.allocated_bytes
+        << ",\"bytes_per_second\":" << (r.mean > 0 ? r.bytes * 1e9 / r.mean : 0);
+    if (r.events > 0)
+      out << ",\"events_per_frame\":" << r.events
+          << ",\"events_per_second\":" << (r.mean > 0 ? r.events * 1e9 / r.mean : 0);
+    out << "}";
+  }
+  out << "\n]}\n";
+  return out.str();
+}
+
+} /* namespace */
+
+int main(int argc, char *argv[])
+{
+  std::string program_path(argv[0]);
+  std::cerr << "Version: " << LIBFREENECT2_VERSION << std::endl;
+  std::cerr << "Usage: " << program_path << " [-iterations <n>] [-filter <name>] [-depth <file.depth>] [-p0 <file>]" << std::endl;
+  std::cerr << "        [-rgb <file.jpg>] [-list] [-json]" << std::endl;
+
+  setGlobalLogger(createConsoleLogger(Logger::Warning));
+
+  size_t iterations = 100;
+  std::string filter, depth_file, p0_file, rgb_file;
+  bool list = false, json = false;
+
+  for (int argI = 1; argI < argc; ++argI)
+  {
+    const std::string arg(argv[argI]);
+    const bool has_value = argI + 1 < argc;
+
+    if (arg == "-iterations" && has_value)
+      iterations = std::strtoul(argv[++argI], 0, 10);
+    else if (arg == "-filter" && has_value)
+      filter = argv[++argI];
+    else if (arg == "-depth" && has_value)
+      depth_file = argv[++argI];
+    else if (arg == "-p0" && has_value)
+      p0_file = argv[++argI];
+    else if (arg == "-rgb" && has_value)
+      rgb_file = argv[++argI];
+    else if (arg == "-list")
+      list = true;
+    else if (arg == "-json")
+      json = true;
+    else
+      std::cerr << "Unknown argument: " << arg << std::endl;
+  }
+  if (iterations == 0)
+    iterations = 100;
+
+  StreamGenerator generator;
+  std::vector<unsigned char> depth_packet = generator.depthSource();
+  if (!depth_file.empty() && !bench::readFile(depth_file, depth_packet))
+  {
+    std::cerr << "failed to read " << depth_file << std::endl;
+    return -1;
+  }
+  std::vector<unsigned char> p0_tables = bench::p0TablesResponse();
+  if (!p0_file.empty() && !bench::readFile(p0_file, p0_tables))
+  {
+    std::cerr << "failed to read " << p0_file << std::endl;
+    return -1;
+  }
+  std::vector<unsigned char> jpeg;
+  if (!rgb_file.empty() && !bench::readFile(rgb_file, jpeg))
+  {
+    std::cerr << "failed to read " << rgb_file << std::endl;
+    return -1;
+  }
+
+  const IrCameraTables tables(bench::irCameraParams());
+  std::vector<Fixture *> fixtures;
+  // Depth processors are only created when selected: some open devices or windows.
+  const std::vector<std::string> backends = bench::depthBackendNames();
+  for (size_t i = 0; i < backends.size(); i++)
+  {
+    if (("depth_" + backends[i]).find(filter) == std::string::npos)
+      continue;
+    bench::DepthBackend backend = { backends[i], bench::createDepthBackend(backends[i], p0_tables, tables) };
+    if (backend.processor)
+      fixtures.push_back(new DepthProcessorFixture(backend, depth_packet));
+    else
+      std::cerr << "depth_" << backends[i] << " is not available" << std::endl;
+  }
+  fixtures.push_back(new RegistrationApplyFixture());
+  fixtures.push_back(new UndistortDepthFixture());
+  fixtures.push_back(new IrTablesFixture());
+  fixtures.push_back(new RegistrationTablesFixture());
+  fixtures.push_back(new DepthParserFixture(depth_packet, true));
+  fixtures.push_back(new DepthParserFixture(depth_packet, false));
+  fixtures.push_back(new DepthIsoTransferFixture(depth_packet, false));
+  fixtures.push_back(new DepthIsoTransferFixture(depth_packet, true));
+  fixtures.push_back(new RgbParserFixture());
+#ifdef LIBFREENECT2_WITH_TURBOJPEG_SUPPORT
+  fixtures.push_back(new TurboJpegFixture(jpeg));
+#endif
+
+  std::vector<Result> results;
+  for (size_t i = 0; i < fixtures.size(); i++)
+  {
+    Fixture &fixture = *fixtures[i];
+    if (fixture.name().find(filter) == std::string::npos)
+      continue;
+    if (list)
+    {
+      std::cout << fixture.name() << std::endl;
+      continue;
+    }
+
+    // Table builders take much longer than a frame.
+    const bool slow = fixture.bytes() == 0;
+    const size_t n = slow ? std::max<size_t>(iterations / 10, 1) : iterations;
+    results.push_back(measure(fixture, n, slow ? 1 : 5));
+
+    if (!json)
+    {
+      const Result &r = results.back();
+      std::printf("%-20s %6zu frames %12.0f ns/frame (p50 %.0f, p90 %.0f, p99 %.0f) %8.1f allocs/frame %9.1f MB/s\n",
+                  r.name.c_str(), r.frames, r.mean, r.p50, r.p90, r.p99, r.allocations,
+                  r.mean > 0 ? r.bytes * 1e3 / r.mean : 0.0);
+      if (r.events > 0)
+        std::printf("%-20s %6zu events/frame %9.2f Mevents/s\n", "", r.events, r.mean > 0 ? r.events * 1e3 / r.mean : 0.0);
+    }
+  }
+
+  if (json)
+    std::cout << toJson(results);
+
+  for (size_t i = 0; i < fixtures.size(); i++)
+    delete fixtures[i];
+  return 0;
+}
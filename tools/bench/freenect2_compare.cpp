@@ -0,0 +1,301 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+
+/** @file freenect2_compare.cpp Compare the output and speed of the depth processors on the same packets. */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <libfreenect2/libfreenect2.hpp>
+#include <libfreenect2/frame_listener.hpp>
+#include <libfreenect2/logger.h>
+#include <libfreenect2/threading.h>
+#include <libfreenect2/depth_packet_processor.h>
+#include <libfreenect2/depth_tables.h>
+#include <libfreenect2/stream_generator.h>
+
+#include "bench_inputs.h"
+
+using namespace libfreenect2;
+
+namespace
+{
+
+/** Copies the IR and depth images of each processed packet. */
+class CapturingListener: public FrameListener
+{
+public:
+  std::vector<float> ir, depth;
+
+  virtual bool onNewFrame(Frame::Type type, Frame *frame)
+  {
+    const float *data = reinterpret_cast<const float *>(frame->data);
+    std::vector<float> &out = type == Frame::Ir ? ir : depth;
+    out.assign(data, data + frame->width * frame->height);
+    return false;
+  }
+};
+
+/** Difference of one image to the reference, accumulated over all packets. */
+struct Difference
+{
+  std::vector<float> abs_diff; ///< Of pixels valid in both.
+  size_t pixels;
+  size_t validity_mismatch;    ///< Pixels valid in only one of the images.
+  double sum, sum_sqr;
+
+  Difference(): pixels(0), validity_mismatch(0), sum(0), sum_sqr(0) {}
+
+  static bool valid(float v) { return v > 0 && std::isfinite(v); }
+
+  void add(const std::vector<float> &reference, const std::vector<float> &image)
+  {
+    const size_t n = std::min(reference.size(), image.size());
+    pixels += n;
+    for (size_t i = 0; i < n; i++)
+    {
+      const bool a = valid(reference[i]), b = valid(image[i]);
+      if (a != b)
+      {
+        validity_mismatch++;
+        continue;
+      }
+      if (!a)
+        continue;
+      const double d = std::fabs(double(reference[i]) - image[i]);
+      abs_diff.push_back(float(d));
+      sum += d;
+      sum_sqr += d * d;
+    }
+  }
+
+  double mean() const { return abs_diff.empty() ? 0 : sum / abs_diff.size(); }
+  double rms() const { return abs_diff.empty() ? 0 : std::sqrt(sum_sqr / abs_diff.size()); }
+  double percentile(size_t p)
+  {
+    if (abs_diff.empty())
+      return 0;
+    const size_t k = std::min(abs_diff.size() - 1, abs_diff.size() * p / 100);
+    std::nth_element(abs_diff.begin(), abs_diff.begin() + k, abs_diff.end());
+    return abs_diff[k];
+  }
+  double max() const { return abs_diff.empty() ? 0 : *std::max_element(abs_diff.begin(), abs_diff.end()); }
+  double mismatchRatio() const { return pixels ? double(validity_mismatch) / pixels : 0; }
+};
+
+struct BackendResult
+{
+  std::string name;
+  double ms_per_frame;
+  Difference depth, ir;
+  double depth_p99, ir_p99;
+};
+
+std::string toJson(std::vector<BackendResult> &results)
+{
+  std::ostringstream out;
+  out << "{\"reference\":\"cpu\",\"backends\":[";
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    BackendResult &r = results[i];
+    out << (i ? "," : "") << "\n{\"name\":\"" << r.name << "\",\"ms_per_frame\":" << r.ms_per_frame
+        << ",\"fps\":" << (r.ms_per_frame > 0 ? 1000.0 / r.ms_per_frame : 0);
+    Difference *d[2] = { &r.depth, &r.ir };
+    const char *names[2] = { "depth", "ir" };
+    for (int k = 0; k < 2; k++)
+    {
+      out << ",\"" << names[k] << "\":{\"mean_abs\":" << d[k]->mean() << ",\"rms\":" << d[k]->rms()
+          << ",\"p99_abs\":" << (k == 0 ? r.depth_p99 : r.ir_p99) << ",\"max_abs\":" << d[k]->max()
+          << ",\"validity_mismatch\":" << d[k]->mismatchRatio() << "}";
+    }
+    out << "}";
+  }
+  out << "\n]}\n";
+  return out.str();
+}
+
+} /* namespace */
+
+int main(int argc, char *argv[])
+{
+  std::string program_path(argv[0]);
+  std::cerr << "Version: " << LIBFREENECT2_VERSION << std::endl;
+  std::cerr << "Usage: " << program_path << " [-depth <file.depth>]... [-p0 <file>] [-backends <a,b,...>]" << std::endl;
+  std::cerr << "        [-repeat <n>] [-tolerance <mm>] [-json]" << std::endl;
+  std::cerr << "Runs each depth packet through every available depth processor and compares the images to the CPU processor." << std::endl;
+
+  setGlobalLogger(createConsoleLogger(Logger::Warning));
+
+  std::vector<std::string> depth_files;
+  std::string p0_file, backend_list;
+  size_t repeat = 10;
+  double tolerance = -1;
+  bool json = false;
+
+  for (int argI = 1; argI < argc; ++argI)
+  {
+    const std::string arg(argv[argI]);
+    const bool has_value = argI + 1 < argc;
+
+    if (arg == "-depth" && has_value)
+      depth_files.push_back(argv[++argI]);
+    else if (arg == "-p0" && has_value)
+      p0_file = argv[++argI];
+    else if (arg == "-backends" && has_value)
+      backend_list = argv[++argI];
+    else if (arg == "-repeat" && has_value)
+      repeat = std::strtoul(argv[++argI], 0, 10);
+    else if (arg == "-tolerance" && has_value)
+      tolerance = std::atof(argv[++argI]);
+    else if (arg == "-json")
+      json = true;
+    else
+      std::cerr << "Unknown argument: " << arg << std::endl;
+  }
+  if (repeat == 0)
+    repeat = 1;
+
+  std::vector<std::vector<unsigned char> > packets;
+  for (size_t i = 0; i < depth_files.size(); i++)
+  {
+    packets.push_back(std::vector<unsigned char>());
+    if (!bench::readFile(depth_files[i], packets.back()))
+    {
+      std::cerr << "failed to read " << depth_files[i] << std::endl;
+      return -1;
+    }
+  }
+  if (packets.empty())
+    packets.push_back(StreamGenerator().depthSource());
+
+  std::vector<unsigned char> p0_tables = bench::p0TablesResponse();
+  if (!p0_file.empty() && !bench::readFile(p0_file, p0_tables))
+  {
+    std::cerr << "failed to read " << p0_file << std::endl;
+    return -1;
+  }
+  const IrCameraTables tables(bench::irCameraParams());
+
+  std::vector<std::string> names = bench::depthBackendNames();
+  if (!backend_list.empty())
+  {
+    std::vector<std::string> selected(1, "cpu");
+    std::stringstream ss(backend_list);
+    std::string name;
+    while (std::getline(ss, name, ','))
+      if (name != "cpu" && std::find(names.begin(), names.end(), name) != names.end())
+        selected.push_back(name);
+    names = selected;
+  }
+
+  // Reference images of each packet.
+  std::vector<std::vector<float> > reference_ir, reference_depth;
+  std::vector<BackendResult> results;
+
+  for (size_t b = 0; b < names.size(); b++)
+  {
+    DepthPacketProcessor *processor = bench::createDepthBackend(names[b], p0_tables, tables);
+    if (!processor)
+    {
+      std::cerr << names[b] << " is not available" << std::endl;
+      if (b == 0)
+        return -1;
+      continue;
+    }
+    CapturingListener listener;
+    processor->setFrameListener(&listener);
+
+    BackendResult r;
+    r.name = names[b];
+    double seconds = 0;
+    for (size_t i = 0; i < packets.size(); i++)
+    {
+      // The first run warms up; the output of the last run is compared.
+      for (size_t k = 0; k <= repeat; k++)
+      {
+        const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        processor->process(bench::depthPacket(packets[i], uint32_t(i * (repeat + 1) + k + 1)));
+        if (k > 0)
+          seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+      }
+
+      if (b == 0)
+      {
+        reference_ir.push_back(listener.ir);
+        reference_depth.push_back(listener.depth);
+      }
+      r.depth.add(reference_depth[i], listener.depth);
+      r.ir.add(reference_ir[i], listener.ir);
+    }
+    delete processor;
+
+    r.ms_per_frame = seconds * 1000.0 / (packets.size() * repeat);
+    r.depth_p99 = r.depth.percentile(99);
+    r.ir_p99 = r.ir.percentile(99);
+    results.push_back(r);
+
+    if (!json)
+      std::printf("%-11s %8.2f ms/frame | depth mean %.3f rms %.3f p99 %.3f max %.3f mm, validity mismatch %.4f%%"
+                  " | ir mean %.3f p99 %.3f max %.3f, validity mismatch %.4f%%\n",
+                  r.name.c_str(), r.ms_per_frame,
+                  r.depth.mean(), r.depth.rms(), r.depth_p99, r.depth.max(), 100 * r.depth.mismatchRatio(),
+                  r.ir.mean(), r.ir_p99, r.ir.max(), 100 * r.ir.mismatchRatio());
+  }
+
+  if (!json && !reference_depth.empty())
+  {
+    size_t valid = 0, total = 0;
+    for (size_t i = 0; i < reference_depth.size(); i++)
+    {
+      total += reference_depth[i].size();
+      valid += std::count_if(reference_depth[i].begin(), reference_depth[i].end(), &Difference::valid);
+    }
+    std::printf("reference: %zu packets, %.1f%% valid depth pixels\n", reference_depth.size(), total ? 100.0 * valid / total : 0.0);
+  }
+
+  if (json)
+    std::cout << toJson(results);
+
+  int status = 0;
+  for (size_t i = 0; i < results.size() && tolerance >= 0; i++)
+  {
+    if (results[i].depth_p99 > tolerance)
+    {
+      std::cerr << results[i].name << ": p99 depth difference " << results[i].depth_p99
+                << " mm exceeds the tolerance of " << tolerance << " mm" << std::endl;
+      status = 1;
+    }
+  }
+  return status;
+}
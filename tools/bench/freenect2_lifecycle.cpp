@@ -0,0 +1,406 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+
+
+/** @file freenect2_lifecycle.cpp Startup, streaming and stop costs of a device, simulated by default. */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <libfreenect2/libfreenect2.hpp>
+#include <libfreenect2/frame_listener.hpp>
+#include <libfreenect2/packet_pipeline.h>
+#include <libfreenect2/logger.h>
+#include <libfreenect2/threading.h>
+
+using namespace libfreenect2;
+
+namespace
+{
+
+typedef chrono::steady_clock Clock;
+
+double msSince(Clock::time_point start)
+{
+  return chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/** Counts frames and remembers when the first of each stream arrived. */
+class CountingListener: public FrameListener
+{
+public:
+  CountingListener(): color(0), depth(0) {}
+
+  virtual bool onNewFrame(Frame::Type type, Frame *)
+  {
+    lock_guard guard(mutex_);
+    if (type == Frame::Color && color++ == 0)
+      first_color = Clock::now();
+    if (type == Frame::Depth && depth++ == 0)
+      first_depth = Clock::now();
+    return false;
+  }
+
+  void counts(size_t &c, size_t &d)
+  {
+    lock_guard guard(mutex_);
+    c = color;
+    d = depth;
+  }
+
+  size_t color, depth;
+  Clock::time_point first_color, first_depth;
+private:
+  mutex mutex_;
+};
+
+struct Cycle
+{
+  double open_ms, start_ms, first_color_ms, first_depth_ms, stop_ms, close_ms;
+  double color_fps, depth_fps;
+  double cpu_percent; ///< Process CPU time over wall time while streaming, 100 per core.
+  size_t threads;     ///< Threads of the process while streaming, 0 if unknown.
+};
+
+/** Threads of this process, 0 if the platform does not tell. */
+size_t countThreads()
+{
+#ifdef __linux__
+  FILE *f = std::fopen("/proc/self/status", "r");
+  if (!f)
+    return 0;
+  char line[256];
+  size_t threads = 0;
+  while (std::fgets(line, sizeof(line), f))
+    if (std::sscanf(line, "Threads: %zu", &threads) == 1)
+      break;
+  std::fclose(f);
+  return threads;
+#else
+  return 0;
+#endif
+}
+
+PacketPipeline *createPipeline(const std::string &name)
+{
+  if (name == "dump")
+    return new DumpPacketPipeline();
+  if (name == "cpu")
+    return new CpuPacketPipeline();
+#ifdef LIBFREENECT2_WITH_OPENCL_SUPPORT
+  if (name == "cl")
+    return new OpenCLPacketPipeline();
+#endif
+#ifdef LIBFREENECT2_WITH_OPENGL_SUPPORT
+  if (name == "gl")
+    return new OpenGLPacketPipeline();
+#endif
+#ifdef LIBFREENECT2_WITH_METAL_SUPPORT
+  if (name == "metal")
+    return new MetalPacketPipeline();
+#endif
+  return 0;
+}
+
+bool runCycle(Freenect2 &freenect2, const std::string &serial, const std::string &pipeline, double seconds, Cycle &c)
+{
+  Clock::time_point t = Clock::now();
+  Freenect2Device *device = pipeline == "default" ? freenect2.openDevice(serial) : freenect2.openDevice(serial, createPipeline(pipeline));
+  c.open_ms = msSince(t);
+  if (!device)
+    return false;
+
+  CountingListener listener;
+  device->setColorFrameListener(&listener);
+  device->setIrAndDepthFrameListener(&listener);
+
+  t = Clock::now();
+  if (!device->start())
+  {
+    delete device;
+    return false;
+  }
+  c.start_ms = msSince(t);
+
+  // Time to first frame counts from start(), wait up to 5 s for both streams.
+  size_t color = 0, depth = 0;
+  while ((color == 0 || depth == 0) && msSince(t) < 5000)
+  {
+    this_thread::sleep_for(chrono::milliseconds(1));
+    listener.counts(color, depth);
+  }
+  c.first_color_ms = color ? chrono::duration<double, std::milli>(listener.first_color - t).count() : -1;
+  c.first_depth_ms = depth ? chrono::duration<double, std::milli>(listener.first_depth - t).count() : -1;
+
+  size_t color0, depth0;
+  listener.counts(color0, depth0);
+  const std::clock_t cpu0 = std::clock();
+  const Clock::time_point steady = Clock::now();
+  this_thread::sleep_for(chrono::milliseconds(static_cast<int64_t>(seconds * 1000)));
+  const double wall = msSince(steady) / 1000;
+  const double cpu = double(std::clock() - cpu0) / CLOCKS_PER_SEC;
+  listener.counts(color, depth);
+  c.color_fps = (color - color0) / wall;
+  c.depth_fps = (depth - depth0) / wall;
+  c.cpu_percent = 100 * cpu / wall;
+  c.threads = countThreads();
+
+  t = Clock::now();
+  device->stop();
+  c.stop_ms = msSince(t);
+
+  t = Clock::now();
+  device->close();
+  delete device;
+  c.close_ms = msSince(t);
+  return true;
+}
+
+/** Like runCycle() on every device of a Freenect2DeviceManager; rates are per device. */
+bool runManagedCycle(size_t workers, const std::string &pipeline, double seconds, Cycle &c)
+{
+  Clock::time_point t = Clock::now();
+  Freenect2DeviceManager manager(workers);
+  const int num_devices = manager.enumerateDevices();
+  for (int i = 0; i < num_devices; i++)
+  {
+    const std::string serial = manager.getDeviceSerialNumber(i);
+    if (!(pipeline == "default" ? manager.openDevice(serial) : manager.openDevice(serial, createPipeline(pipeline))))
+      return false;
+  }
+  c.open_ms = msSince(t);
+
+  std::vector<Freenect2Device *> devices = manager.getDevices();
+  std::vector<CountingListener> listeners(devices.size());
+  for (size_t i = 0; i < devices.size(); i++)
+  {
+    devices[i]->setColorFrameListener(&listeners[i]);
+    devices[i]->setIrAndDepthFrameListener(&listeners[i]);
+  }
+
+  t = Clock::now();
+  if (!manager.startAll())
+    return false;
+  c.start_ms = msSince(t);
+
+  // Time to first frame of the slowest device.
+  bool all = false;
+  while (!all && msSince(t) < 5000)
+  {
+    this_thread::sleep_for(chrono::milliseconds(1));
+    all = true;
+    for (size_t i = 0; i < listeners.size(); i++)
+    {
+      size_t color, depth;
+      listeners[i].counts(color, depth);
+      all = all && color > 0 && depth > 0;
+    }
+  }
+  c.first_color_ms = c.first_depth_ms = -1;
+  for (size_t i = 0; all && i < listeners.size(); i++)
+  {
+    c.first_color_ms = std::max(c.first_color_ms, chrono::duration<double, std::milli>(listeners[i].first_color - t).count());
+    c.first_depth_ms = std::max(c.first_depth_ms, chrono::duration<double, std::milli>(listeners[i].first_depth - t).count());
+  }
+
+  manager.getThroughput();
+  const std::clock_t cpu0 = std::clock();
+  const Clock::time_point steady = Clock::now();
+  this_thread::sleep_for(chrono::milliseconds(static_cast<int64_t>(seconds * 1000)));
+  const double wall = msSince(steady) / 1000;
+  const double cpu = double(std::clock() - cpu0) / CLOCKS_PER_SEC;
+  std::vector<DeviceThroughput> throughput = manager.getThroughput();
+  c.color_fps = c.depth_fps = 0;
+  for (size_t i = 0; i < throughput.size(); i++)
+  {
+    c.color_fps += throughput[i].color_fps / throughput.size();
+    c.depth_fps += throughput[i].depth_fps / throughput.size();
+  }
+  c.cpu_percent = 100 * cpu / wall / devices.size();
+  c.threads = countThreads();
+
+  t = Clock::now();
+  manager.stopAll();
+  c.stop_ms = msSince(t);
+
+  t = Clock::now();
+  for (size_t i = 0; i < devices.size(); i++)
+    manager.closeDevice(devices[i]);
+  c.close_ms = msSince(t);
+  return true;
+}
+
+} /* namespace */
+
+int main(int argc, char *argv[])
+{
+  std::string program_path(argv[0]);
+  std::cerr << "Version: " << LIBFREENECT2_VERSION << std::endl;
+  std::cerr << "Usage: " << program_path << " [-cycles <n>] [-seconds <s>] [-pipeline dump|cpu|cl|gl|metal|default]" << std::endl;
+  std::cerr << "        [-serial <serial>] [-hardware] [-json] [-devices <n> [-workers <n>]]" << std::endl;
+  std::cerr << "        [-fast] [-command-latency <us>] [-status-delay <ms>]" << std::endl;
+  std::cerr << "  -devices: stream n devices through Freenect2DeviceManager, rates and CPU per device" << std::endl;
+  std::cerr << "  -fast: set LIBFREENECT2_FAST_START, later cycles start from cached calibration" << std::endl;
+  std::cerr << "  -command-latency, -status-delay: make simulated devices respond like real ones" << std::endl;
+
+  setGlobalLogger(createConsoleLogger(Logger::Warning));
+
+  size_t cycles = 3, devices = 0, workers = 0;
+  double seconds = 2;
+  std::string pipeline = "dump", serial;
+  bool hardware = false, json = false, fast = false;
+  std::string command_latency, status_delay;
+
+  for (int argI = 1; argI < argc; ++argI)
+  {
+    const std::string arg(argv[argI]);
+    const bool has_value = argI + 1 < argc;
+
+    if (arg == "-cycles" && has_value)
+      cycles = std::strtoul(argv[++argI], 0, 10);
+    else if (arg == "-seconds" && has_value)
+      seconds = std::atof(argv[++argI]);
+    else if (arg == "-pipeline" && has_value)
+      pipeline = argv[++argI];
+    else if (arg == "-serial" && has_value)
+      serial = argv[++argI];
+    else if (arg == "-devices" && has_value)
+      devices = std::strtoul(argv[++argI], 0, 10);
+    else if (arg == "-workers" && has_value)
+      workers = std::strtoul(argv[++argI], 0, 10);
+    else if (arg == "-fast")
+      fast = true;
+    else if (arg == "-command-latency" && has_value)
+      command_latency = argv[++argI];
+    else if (arg == "-status-delay" && has_value)
+      status_delay = argv[++argI];
+    else if (arg == "-hardware")
+      hardware = true;
+    else if (arg == "-json")
+      json = true;
+    else
+      std::cerr << "Unknown argument: " << arg << std::endl;
+  }
+
+  if (pipeline != "default")
+  {
+    PacketPipeline *probe = createPipeline(pipeline);
+    if (!probe)
+    {
+      std::cerr << "`" << pipeline << "' pipeline is not available" << std::endl;
+      return -1;
+    }
+    delete probe;
+  }
+
+  // Without -hardware, stream from simulated devices.
+  if (!hardware)
+    setenv("LIBFREENECT2_SIMULATE", std::to_string(devices > 0 ? devices : 1).c_str(), 1);
+  if (!command_latency.empty())
+    setenv("LIBFREENECT2_SIMULATE_COMMAND_LATENCY_US", command_latency.c_str(), 1);
+  if (!status_delay.empty())
+    setenv("LIBFREENECT2_SIMULATE_STATUS_DELAY_MS", status_delay.c_str(), 1);
+  if (fast)
+    setenv("LIBFREENECT2_FAST_START", "1", 1);
+
+  std::vector<Cycle> results;
+  for (size_t i = 0; devices > 0 && i < cycles; i++)
+  {
+    Cycle c;
+    if (!runManagedCycle(workers, pipeline, seconds, c))
+    {
+      std::cerr << "cycle " << i << " failed" << std::endl;
+      return -1;
+    }
+    results.push_back(c);
+  }
+
+  if (devices == 0)
+  {
+    Freenect2 freenect2;
+    const int num_devices = freenect2.enumerateDevices();
+    // Real devices are listed before simulated ones.
+    if (serial.empty() && num_devices > 0)
+      serial = freenect2.getDeviceSerialNumber(hardware ? 0 : num_devices - 1);
+    if (serial.empty())
+    {
+      std::cerr << "no device connected" << std::endl;
+      return -1;
+    }
+
+    for (size_t i = 0; i < cycles; i++)
+    {
+      Cycle c;
+      if (!runCycle(freenect2, serial, pipeline, seconds, c))
+      {
+        std::cerr << "cycle " << i << " failed" << std::endl;
+        return -1;
+      }
+      results.push_back(c);
+    }
+  }
+  else
+    serial = "all";
+
+  std::ostringstream out;
+  if (json)
+  {
+    out << "{\"version\":\"" << LIBFREENECT2_VERSION << "\",\"serial\":\"" << serial << "\",\"pipeline\":\"" << pipeline << "\",\"devices\":" << (devices > 0 ? devices : 1) << ",\"cycles\":[";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+      const Cycle &c = results[i];
+      out << (i ? "," : "") << "\n{\"open_ms\":" << c.open_ms << ",\"start_ms\":" << c.start_ms
+          << ",\"first_color_ms\":" << c.first_color_ms << ",\"first_depth_ms\":" << c.first_depth_ms
+          << ",\"color_fps\":" << c.color_fps << ",\"depth_fps\":" << c.depth_fps
+          << ",\"cpu_percent\":" << c.cpu_percent << ",\"threads\":" << c.threads
+          << ",\"stop_ms\":" << c.stop_ms << ",\"close_ms\":" << c.close_ms << "}";
+    }
+    out << "\n]}\n";
+  }
+  else
+  {
+    char line[256];
+    std::snprintf(line, sizeof(line), "%5s %9s %9s %11s %11s %9s %9s %7s %7s %9s %9s\n", "cycle", "open_ms", "start_ms",
+                  "color1st_ms", "depth1st_ms", "color_fps", "depth_fps", "cpu_%", "threads", "stop_ms", "close_ms");
+    out << line;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+      const Cycle &c = results[i];
+      std::snprintf(line, sizeof(line), "%5zu %9.2f %9.2f %11.2f %11.2f %9.2f %9.2f %7.1f %7zu %9.2f %9.2f\n", i, c.open_ms, c.start_ms,
+                    c.first_color_ms, c.first_depth_ms, c.color_fps, c.depth_fps, c.cpu_percent, c.threads, c.stop_ms, c.close_ms);
+      out << line;
+    }
+  }
+  std::cout << out.str();
+  return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file freenect2_streamgen.cpp Feed synthetic USB streams to a packet pipeline and report its throughput. */
+
+#include <iostream>
+#include <cstdlib>
+#include <string>
+
+#include <libfreenect2/libfreenect2.hpp>
+#include <libfreenect2/frame_listener.hpp>
+#include <libfreenect2/packet_pipeline.h>
+#include <libfreenect2/logger.h>
+#include <libfreenect2/stream_generator.h>
+#include <libfreenect2/rgb_packet_processor.h>
+#include <libfreenect2/depth_packet_processor.h>
+#include <libfreenect2/threading.h>
+
+/** Counts delivered frames and hands them back to the processors. */
+class CountingListener: public libfreenect2::FrameListener
+{
+public:
+  libfreenect2::atomic<size_t> color, ir, depth;
+
+  CountingListener(): color(0), ir(0), depth(0) {}
+
+  virtual bool onNewFrame(libfreenect2::Frame::Type type, libfreenect2::Frame *frame)
+  {
+    if (type == libfreenect2::Frame::Color)
+      color++;
+    else if (type == libfreenect2::Frame::Ir)
+      ir++;
+    else
+      depth++;
+    return false;
+  }
+
+  size_t total() const { return color + ir + depth; }
+};
+
+int main(int argc, char *argv[])
+{
+  std::string program_path(argv[0]);
+  std::cerr << "Version: " << LIBFREENECT2_VERSION << std::endl;
+  std::cerr << "Usage: " << program_path << " [dump | cpu | gl | cl | metal] [-frames <n>] [-rate <fps>]" << std::endl;
+  std::cerr << "        [-loss <p>] [-reorder <p>] [-jitter <us>] [-seed <n>] [-depth <file.depth>] [-rgb <file.jpg>]" << std::endl;
+  std::cerr << "        [-norgb | -nodepth] [-json | -prometheus]" << std::endl;
+  std::cerr << "Without -rgb the color payload is not a decodable JPEG, use the dump pipeline." << std::endl;
+
+  libfreenect2::setGlobalLogger(libfreenect2::createConsoleLogger(libfreenect2::Logger::Info));
+
+  libfreenect2::PacketPipeline *pipeline = 0;
+  libfreenect2::StreamGeneratorConfig config;
+  std::string depth_file, rgb_file;
+  size_t frames = 300;
+  bool enable_rgb = true;
+  bool enable_depth = true;
+  std::string telemetry_format;
+
+  for (int argI = 1; argI < argc; ++argI)
+  {
+    const std::string arg(argv[argI]);
+    const bool has_value = argI + 1 < argc;
+
+    if (arg == "-help" || arg == "--help" || arg == "-h")
+    {
+      return 0;
+    }
+    else if (arg == "dump")
+    {
+      if (!pipeline)
+        pipeline = new libfreenect2::DumpPacketPipeline();
+    }
+    else if (arg == "cpu")
+    {
+      if (!pipeline)
+        pipeline = new libfreenect2::CpuPacketPipeline();
+    }
+    else if (arg == "gl")
+    {
+#ifdef LIBFREENECT2_WITH_OPENGL_SUPPORT
+      if (!pipeline)
+        pipeline = new libfreenect2::OpenGLPacketPipeline();
+#else
+      std::cout << "OpenGL pipeline is not supported!" << std::endl;
+#endif
+    }
+    else if (arg == "cl")
+    {
+#ifdef LIBFREENECT2_WITH_OPENCL_SUPPORT
+      if (!pipeline)
+        pipeline = new libfreenect2::OpenCLPacketPipeline();
+#else
+      std::cout << "OpenCL pipeline is not supported!" << std::endl;
+#endif
+    }
+    else if (arg == "metal")
+    {
+#ifdef LIBFREENECT2_WITH_METAL_SUPPORT
+      if (!pipeline)
+        pipeline = new libfreenect2::MetalPacketPipeline();
+#else
+      std::cout << "Metal pipeline is not supported!" << std::endl;
+#endif
+    }
+    else if (arg == "-frames" && has_value)
+      frames = std::strtoul(argv[++argI], 0, 10);
+    else if (arg == "-rate" && has_value)
+      config.frame_rate = std::atof(argv[++argI]);
+    else if (arg == "-loss" && has_value)
+      config.loss = std::atof(argv[++argI]);
+    else if (arg == "-reorder" && has_value)
+      config.reorder = std::atof(argv[++argI]);
+    else if (arg == "-jitter" && has_value)
+      config.jitter_us = std::atof(argv[++argI]);
+    else if (arg == "-seed" && has_value)
+      config.seed = std::strtoul(argv[++argI], 0, 10);
+    else if (arg == "-depth" && has_value)
+      depth_file = argv[++argI];
+    else if (arg == "-rgb" && has_value)
+      rgb_file = argv[++argI];
+    else if (arg == "-norgb")
+      enable_rgb = false;
+    else if (arg == "-nodepth")
+      enable_depth = false;
+    else if (arg == "-json" || arg == "-prometheus")
+      telemetry_format = arg;
+    else
+      std::cout << "Unknown argument: " << arg << std::endl;
+  }
+
+  if (!pipeline)
+    pipeline = new libfreenect2::DumpPacketPipeline();
+
+  libfreenect2::StreamGenerator generator(config);
+  if (!depth_file.empty() && !generator.loadDepthSource(depth_file))
+    return -1;
+  if (!rgb_file.empty() && !generator.loadRgbSource(rgb_file))
+    return -1;
+
+  CountingListener listener;
+  pipeline->getRgbPacketProcessor()->setFrameListener(&listener);
+  pipeline->getDepthPacketProcessor()->setFrameListener(&listener);
+
+  double elapsed = generator.run(enable_rgb ? pipeline->getRgbPacketParser() : 0,
+                                 enable_depth ? pipeline->getIrPacketParser() : 0, frames);
+
+  // Let the processor threads drain their queues.
+  size_t delivered;
+  do
+  {
+    delivered = listener.total();
+    libfreenect2::this_thread::sleep_for(libfreenect2::chrono::milliseconds(100));
+  } while (delivered != listener.total());
+
+  libfreenect2::StreamGeneratorStatistics stats = generator.getStatistics();
+  const size_t generated = stats.rgb_frames + stats.depth_frames;
+  std::cout << "generated " << generated << " frames in " << elapsed << " s: "
+            << generated / elapsed << " frames/s, " << stats.bytes / elapsed / 1e6 << " MB/s" << std::endl;
+  std::cout << "payloads " << stats.payloads << ", lost " << stats.lost << ", reordered " << stats.reordered << std::endl;
+  std::cout << "delivered color " << listener.color << ", ir " << listener.ir << ", depth " << listener.depth << std::endl;
+
+  if (telemetry_format == "-json")
+    std::cout << pipeline->getTelemetry()->toJson() << std::endl;
+  else if (telemetry_format == "-prometheus")
+    std::cout << pipeline->getTelemetry()->toPrometheus();
+
+  delete pipeline;
+  return 0;
+}